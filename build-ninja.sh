@@ -236,6 +236,22 @@ generate_ninja_file() {
         CFLAGS+="-I/usr/include -I/usr/local/include -I/data/data/com.termux/files/usr/include "
         LIBS+="-lgd "
     fi
+
+    # libjpeg, libpng & zlib flags (streamed and png output)
+    if pkg-config --exists libjpeg libpng zlib 2>/dev/null; then
+        CFLAGS+="$(pkg-config --cflags libjpeg libpng zlib 2>/dev/null) "
+        LIBS+="$(pkg-config --libs libjpeg libpng zlib 2>/dev/null) "
+    else
+        LIBS+="-ljpeg -lpng -lz "
+    fi
+
+    # sqlite3 flags (--archive, --cache, --probe-cache)
+    if pkg-config --exists sqlite3 2>/dev/null; then
+        CFLAGS+="$(pkg-config --cflags sqlite3 2>/dev/null) "
+        LIBS+="$(pkg-config --libs sqlite3 2>/dev/null) "
+    else
+        LIBS+="-lsqlite3 "
+    fi
     
     # Set build-specific flags
     if [ "$BUILD_TYPE" = "debug" ]; then
@@ -288,21 +304,42 @@ rule cc
 rule link
   command = \$cc \$ldflags \$in \$libs -o \$out
 
+# Rule for the static library
+rule ar
+  command = rm -f \$out && ar rcs \$out \$in
+
 # Build object files
+build \$builddir/mtn_main.o: cc \$srcdir/mtn_main.c
+build \$builddir/libmtn.o: cc \$srcdir/libmtn.c
 build \$builddir/mtn.o: cc \$srcdir/mtn.c
 build \$builddir/mtn_context.o: cc \$srcdir/mtn_context.c
 build \$builddir/mtn_thumbnail.o: cc \$srcdir/mtn_thumbnail.c
 build \$builddir/mtn_error.o: cc \$srcdir/mtn_error.c
-
-# Build final binary
-build \$bindir/mtn: link \$builddir/mtn.o \$builddir/mtn_context.o \$builddir/mtn_thumbnail.o \$builddir/mtn_error.o
+build \$builddir/mtn_stream.o: cc \$srcdir/mtn_stream.c
+build \$builddir/mtn_archive.o: cc \$srcdir/mtn_archive.c
+build \$builddir/mtn_png.o: cc \$srcdir/mtn_png.c
+build \$builddir/mtn_cache.o: cc \$srcdir/mtn_cache.c
+build \$builddir/mtn_probe.o: cc \$srcdir/mtn_probe.c
+build \$builddir/mtn_scan.o: cc \$srcdir/mtn_scan.c
+build \$builddir/mtn_json.o: cc \$srcdir/mtn_json.c
+build \$builddir/mtn_serve.o: cc \$srcdir/mtn_serve.c
+build \$builddir/mtn_watch.o: cc \$srcdir/mtn_watch.c
+build \$builddir/mtn_batch.o: cc \$srcdir/mtn_batch.c
+build \$builddir/mtn_journal.o: cc \$srcdir/mtn_journal.c
+build \$builddir/mtn_dedupe.o: cc \$srcdir/mtn_dedupe.c
+build \$builddir/mtn_events.o: cc \$srcdir/mtn_events.c
+build \$builddir/mtn_log.o: cc \$srcdir/mtn_log.c
+
+# Build library and final binary
+build \$bindir/libmtn.a: ar \$builddir/libmtn.o \$builddir/mtn.o \$builddir/mtn_context.o \$builddir/mtn_thumbnail.o \$builddir/mtn_error.o \$builddir/mtn_stream.o \$builddir/mtn_archive.o \$builddir/mtn_png.o \$builddir/mtn_cache.o \$builddir/mtn_probe.o \$builddir/mtn_scan.o \$builddir/mtn_json.o \$builddir/mtn_serve.o \$builddir/mtn_watch.o \$builddir/mtn_batch.o \$builddir/mtn_journal.o \$builddir/mtn_dedupe.o \$builddir/mtn_events.o \$builddir/mtn_log.o
+build \$bindir/mtn: link \$builddir/mtn_main.o \$bindir/libmtn.a
 
 # Default target
-default \$bindir/mtn
+default \$bindir/mtn \$bindir/libmtn.a
 
 # Clean target
 build clean: phony
-  command = rm -rf \$builddir \$bindir/mtn
+  command = rm -rf \$builddir \$bindir/mtn \$bindir/libmtn.a
 NINJA_EOF
     
     log_success "Ninja build file generated: $NINJA_FILE"
@@ -12,6 +12,10 @@ BuildRequires:	gcc
 BuildRequires:	make
 BuildRequires:	gd-devel >= 2.0.35
 BuildRequires:	ffmpeg-devel >= 3.3.1
+BuildRequires:	libjpeg-turbo-devel
+BuildRequires:	libpng-devel
+BuildRequires:	zlib-devel
+BuildRequires:	sqlite-devel
 
 Requires:	gd
 Requires:   fontconfig
@@ -0,0 +1,16 @@
+{
+  "targets": [
+    {
+      "target_name": "mtn",
+      "sources": ["native/mtn_addon.c"],
+      "include_dirs": ["../src"],
+      "cflags": ["-W", "-Wall"],
+      "libraries": [
+        "<(module_root_dir)/../bin/libmtn.a",
+        "<!@(pkg-config --libs-only-L libavutil)",
+        "-lavcodec", "-lavformat", "-lswscale", "-lavutil", "-lavfilter",
+        "-lgd", "-ljpeg", "-lpng", "-lz", "-lsqlite3", "-lpthread", "-lm"
+      ]
+    }
+  ]
+}
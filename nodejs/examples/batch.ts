@@ -2,11 +2,17 @@
  * Example: Batch processing multiple videos
  * 
  * Process entire directories of videos and generate
- * thumbnails for each one.
+ * thumbnails for each one, first one at a time and then
+ * on all CPUs, and print the speedup.
+ *
+ * The native addon runs jobs on the libuv threadpool; for
+ * more than 4 at a time, start with UV_THREADPOOL_SIZE set.
  */
 
 import { MtnThumbnailer } from '../src/index';
-import { readdirSync, statSync } from 'fs';
+import { MtnOptions } from '../src/types';
+import { readdirSync } from 'fs';
+import { cpus } from 'os';
 import { join } from 'path';
 
 async function main() {
@@ -40,25 +46,37 @@ async function main() {
   }
   
   console.log(`Found ${videoFiles.length} video files`);
-  console.log('Starting batch processing...\n');
-  
-  // Process all videos
-  const results = await mtn.generateThumbnails(
-    videoFiles,
-    {
-      columns: 3,
-      rows: 2,
-      minHeight: 150,
-      outputDir: './thumbnails',
-      verbose: false,
+
+  const options: MtnOptions = {
+    columns: 3,
+    rows: 2,
+    minHeight: 150,
+    outputDir: './thumbnails',
+    verbose: false,
+  };
+
+  // One video at a time, for comparison
+  console.log('Sequential run...');
+  let start = Date.now();
+  await mtn.generateThumbnails(videoFiles, options, undefined, { concurrency: 1 });
+  const sequentialTime = Date.now() - start;
+
+  // Ctrl+C cancels the videos still running or waiting
+  const controller = new AbortController();
+  process.once('SIGINT', () => controller.abort());
+
+  console.log(`Concurrent run (${cpus().length} CPUs)...\n`);
+  start = Date.now();
+  const results = await mtn.generateThumbnails(videoFiles, options, undefined, {
+    timeout: 5 * 60 * 1000,
+    signal: controller.signal,
+    onProgress: (batch) => {
+      console.log(`[${batch.percentage.toFixed(0)}%] ${batch.completed}/${batch.total} done, ${batch.running} running`);
     },
-    (videoPath, progress) => {
-      const filename = videoPath.split('/').pop();
-      console.log(`[${progress.percentage.toFixed(0)}%] Processing: ${filename}`);
-    }
-  );
+  });
+  const concurrentTime = Date.now() - start;
   
-  // Summary
+  // Summary; results are in the order of videoFiles
   const successCount = results.filter(r => r.success).length;
   const failCount = results.length - successCount;
   
@@ -69,14 +87,16 @@ async function main() {
   
   if (failCount > 0) {
     console.log('\nFailed files:');
-    results
-      .filter(r => !r.success)
-      .forEach((r, i) => {
+    results.forEach((r, i) => {
+      if (!r.success) {
         console.log(`  - ${videoFiles[i]}: ${r.error}`);
-      });
+      }
+    });
   }
   
-  console.log(`\nTotal time: ${results.reduce((sum, r) => sum + r.executionTime, 0)}ms`);
+  console.log(`\nSequential: ${sequentialTime}ms`);
+  console.log(`Concurrent: ${concurrentTime}ms`);
+  console.log(`Speedup: ${(sequentialTime / Math.max(concurrentTime, 1)).toFixed(2)}x`);
 }
 
 main().catch(console.error);
@@ -0,0 +1,321 @@
+/*  mtn - movie thumbnailer
+    Node.js addon running libmtn jobs on the libuv threadpool
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include <node_api.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libmtn.h"
+
+#define MAX_ARGS 256
+
+#define NAPI_CALL(env, call)                                        \
+    do {                                                            \
+        if (napi_ok != (call)) {                                    \
+            napi_throw_error((env), NULL, "mtn: " #call " failed"); \
+            return NULL;                                            \
+        }                                                           \
+    } while (0)
+
+struct Work;
+
+/* data of the cancel() function of a promise; outlives or forgets its Work */
+typedef struct Handle {
+    struct Work *w;                 /* NULL once the job completed */
+} Handle;
+
+/* one generate() or probe() call */
+typedef struct Work {
+    napi_async_work work;
+    napi_deferred deferred;
+    napi_ref input;                 /* Buffer being read; NULL = path */
+    MtnJob *job;
+    char *name;                     /* path or name of the Buffer */
+    MtnReader reader;
+    MtnBuffer buffer;
+    int probe;                      /* 1 = info only */
+    MtnResult result;
+    Handle *handle;                 /* NULL if cancel() was collected */
+} Work;
+
+static void work_free(napi_env env, Work *w)
+{
+    if (w->handle)
+        w->handle->w = NULL;
+    if (w->input)
+        napi_delete_reference(env, w->input);
+    if (w->work)
+        napi_delete_async_work(env, w->work);
+    mtn_result_free(&w->result);
+    mtn_job_free(w->job);
+    free(w->name);
+    free(w);
+}
+
+static char *get_string(napi_env env, napi_value value)
+{
+    size_t len;
+    char *s;
+
+    if (napi_ok != napi_get_value_string_utf8(env, value, NULL, 0, &len))
+        return NULL;
+    s = malloc(len + 1);
+    if (s && napi_ok != napi_get_value_string_utf8(env, value, s, len + 1, &len)) {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static void set_number(napi_env env, napi_value obj, const char *key, double n)
+{
+    napi_value v;
+    if (napi_ok == napi_create_double(env, n, &v))
+        napi_set_named_property(env, obj, key, v);
+}
+
+static void set_string(napi_env env, napi_value obj, const char *key, const char *s)
+{
+    napi_value v;
+    if (napi_ok == napi_create_string_utf8(env, s, NAPI_AUTO_LENGTH, &v))
+        napi_set_named_property(env, obj, key, v);
+}
+
+static void free_data(napi_env env, void *data, void *hint)
+{
+    (void)env;
+    (void)hint;
+    free(data);
+}
+
+/* Buffer taking over out->data, or a copy if external buffers are not allowed */
+static napi_value output_buffer(napi_env env, MtnOutput *out)
+{
+    napi_value buf;
+    if (napi_ok == napi_create_external_buffer(env, out->size, out->data, free_data, NULL, &buf)) {
+        out->data = NULL;
+        return buf;
+    }
+    if (napi_ok == napi_create_buffer_copy(env, out->size, out->data, NULL, &buf))
+        return buf;
+    return NULL;
+}
+
+static napi_value info_object(napi_env env, const MtnInfo *info)
+{
+    napi_value obj;
+    if (napi_ok != napi_create_object(env, &obj))
+        return NULL;
+    set_number(env, obj, "duration", info->duration);
+    set_number(env, obj, "width", info->width);
+    set_number(env, obj, "height", info->height);
+    set_number(env, obj, "rotation", info->rotation);
+    set_number(env, obj, "frameRate", info->frame_rate);
+    set_number(env, obj, "bitrate", (double)info->bit_rate);
+    set_number(env, obj, "size", (double)info->size);
+    set_string(env, obj, "codec", info->video_codec);
+    set_string(env, obj, "audioCodec", info->audio_codec);
+    return obj;
+}
+
+/* promise.cancel(): stop the job; it resolves with code -13 */
+static napi_value cancel(napi_env env, napi_callback_info cbinfo)
+{
+    Handle *h;
+    NAPI_CALL(env, napi_get_cb_info(env, cbinfo, NULL, NULL, NULL, (void **)&h));
+    if (h->w)
+        mtn_job_cancel(h->w->job);
+    return NULL;
+}
+
+static void free_handle(napi_env env, void *data, void *hint)
+{
+    Handle *h = data;
+    (void)env;
+    (void)hint;
+    if (h->w)
+        h->w->handle = NULL;
+    free(h);
+}
+
+/* give promise a cancel() method stopping w */
+static void add_cancel(napi_env env, napi_value promise, Work *w)
+{
+    napi_value fn;
+    Handle *h = calloc(1, sizeof(Handle));
+
+    if (NULL == h)
+        return;
+    if (napi_ok != napi_create_function(env, "cancel", NAPI_AUTO_LENGTH, cancel, h, &fn)
+        || napi_ok != napi_add_finalizer(env, fn, h, free_handle, NULL, NULL)) {
+        free(h);
+        return;
+    }
+    h->w = w;
+    w->handle = h;
+    napi_set_named_property(env, promise, "cancel", fn);
+}
+
+/* threadpool */
+static void execute(napi_env env, void *data)
+{
+    Work *w = data;
+    const MtnReader *reader = w->input ? &w->reader : NULL;
+    (void)env;
+
+    if (w->probe)
+        w->result.code = mtn_job_probe(w->job, w->name, reader, &w->result.info);
+    else
+        w->result.code = mtn_job_run_reader(w->job, w->name, reader, &w->result);
+}
+
+/* JS thread: resolve with { code, error?, timedOut?, info, outputs } */
+static void complete(napi_env env, napi_status status, void *data)
+{
+    Work *w = data;
+    napi_value obj, outputs, v;
+    int i, ok = (napi_ok == status);
+
+    ok = ok && napi_ok == napi_create_object(env, &obj);
+    if (ok) {
+        set_number(env, obj, "code", w->result.code);
+        if (w->result.code < 0)
+            set_string(env, obj, "error", mtn_strerror(w->result.code));
+        if (w->result.timed_out && napi_ok == napi_get_boolean(env, true, &v))
+            napi_set_named_property(env, obj, "timedOut", v);
+        if (w->result.info.width > 0 && NULL != (v = info_object(env, &w->result.info)))
+            napi_set_named_property(env, obj, "info", v);
+        ok = napi_ok == napi_create_array_with_length(env, w->result.nb_outputs, &outputs);
+    }
+    for (i = 0; ok && i < w->result.nb_outputs; i++) {
+        napi_value out, buf = output_buffer(env, &w->result.outputs[i]);
+        ok = NULL != buf && napi_ok == napi_create_object(env, &out);
+        if (ok) {
+            set_string(env, out, "name", w->result.outputs[i].name);
+            napi_set_named_property(env, out, "data", buf);
+            napi_set_element(env, outputs, i, out);
+        }
+    }
+    if (ok) {
+        napi_set_named_property(env, obj, "outputs", outputs);
+        napi_resolve_deferred(env, w->deferred, obj);
+    } else {
+        napi_value msg, err;
+        napi_create_string_utf8(env, "mtn: building the result failed", NAPI_AUTO_LENGTH, &msg);
+        napi_create_error(env, NULL, msg, &err);
+        napi_reject_deferred(env, w->deferred, err);
+    }
+    work_free(env, w);
+}
+
+/*
+ * queue a job: (args: string[], input: string | Buffer, name?: string)
+ * args are command line options without files; getopt is not thread-safe,
+ * so they are parsed here on the JS thread
+ */
+static napi_value queue(napi_env env, napi_callback_info cbinfo, int probe)
+{
+    size_t argc = 3, i;
+    napi_value argv[3], promise, resource;
+    uint32_t nb_args = 0;
+    char *args[MAX_ARGS] = { "mtn" };
+    int nb = 1, bad_options = 0;
+    bool is_buffer = false;
+    napi_valuetype name_type = napi_undefined;
+
+    NAPI_CALL(env, napi_get_cb_info(env, cbinfo, &argc, argv, NULL, NULL));
+    if (argc < 2 || napi_ok != napi_get_array_length(env, argv[0], &nb_args) || nb_args >= MAX_ARGS) {
+        napi_throw_type_error(env, NULL, "mtn: expected (args: string[], input: string | Buffer, name?: string)");
+        return NULL;
+    }
+
+    Work *w = calloc(1, sizeof(Work));
+    if (NULL == w) {
+        napi_throw_error(env, NULL, "mtn: out of memory");
+        return NULL;
+    }
+    w->probe = probe;
+
+    for (i = 0; i < nb_args; i++) {
+        napi_value a;
+        if (napi_ok != napi_get_element(env, argv[0], i, &a) || NULL == (args[nb] = get_string(env, a)))
+            break;
+        nb++;
+    }
+    w->job = mtn_job_new();
+    if (NULL == w->job || nb != (int)nb_args + 1 || 0 != mtn_job_set_options(w->job, nb, args))
+        bad_options = 1;
+    while (--nb > 0)
+        free(args[nb]);
+
+    napi_is_buffer(env, argv[1], &is_buffer);
+    if (is_buffer) {
+        void *data;
+        size_t size;
+        napi_get_buffer_info(env, argv[1], &data, &size);
+        napi_create_reference(env, argv[1], 1, &w->input); // kept alive while the job reads it
+        mtn_buffer_reader(&w->reader, &w->buffer, data, size);
+        if (argc > 2)
+            napi_typeof(env, argv[2], &name_type);
+        w->name = napi_string == name_type ? get_string(env, argv[2]) : strdup("buffer");
+    } else {
+        w->name = get_string(env, argv[1]);
+    }
+
+    if (napi_ok != napi_create_promise(env, &w->deferred, &promise)) {
+        work_free(env, w);
+        napi_throw_error(env, NULL, "mtn: creating promise failed");
+        return NULL;
+    }
+    if (bad_options || NULL == w->name) {
+        w->result.code = bad_options ? -2 : -3; // MTN_ERROR_INVALID_ARG, MTN_ERROR_OUT_OF_MEMORY
+        complete(env, napi_ok, w);
+        return promise;
+    }
+
+    add_cancel(env, promise, w);
+    napi_create_string_utf8(env, probe ? "mtn.probe" : "mtn.generate", NAPI_AUTO_LENGTH, &resource);
+    if (napi_ok != napi_create_async_work(env, NULL, resource, execute, complete, w, &w->work)
+        || napi_ok != napi_queue_async_work(env, w->work))
+        complete(env, napi_generic_failure, w);
+    return promise;
+}
+
+static napi_value generate(napi_env env, napi_callback_info cbinfo)
+{
+    return queue(env, cbinfo, 0);
+}
+
+static napi_value probe(napi_env env, napi_callback_info cbinfo)
+{
+    return queue(env, cbinfo, 1);
+}
+
+static napi_value version(napi_env env, napi_callback_info cbinfo)
+{
+    napi_value v;
+    (void)cbinfo;
+    NAPI_CALL(env, napi_create_string_utf8(env, mtn_version(), NAPI_AUTO_LENGTH, &v));
+    return v;
+}
+
+static napi_value init(napi_env env, napi_value exports)
+{
+    napi_property_descriptor props[] = {
+        { "generate", NULL, generate, NULL, NULL, NULL, napi_default, NULL },
+        { "probe", NULL, probe, NULL, NULL, NULL, napi_default, NULL },
+        { "version", NULL, version, NULL, NULL, NULL, napi_default, NULL },
+    };
+    NAPI_CALL(env, napi_define_properties(env, exports, sizeof(props) / sizeof(props[0]), props));
+    return exports;
+}
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
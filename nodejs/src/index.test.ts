@@ -3,7 +3,7 @@
  */
 
 import { MtnThumbnailer } from './index';
-import { MtnOptions } from './types';
+import { MtnOptions, MtnBatchProgress } from './types';
 
 describe('MtnThumbnailer', () => {
   let mtn: MtnThumbnailer;
@@ -97,6 +97,47 @@ describe('MtnThumbnailer', () => {
     });
   });
 
+  describe('native addon', () => {
+    it('should report whether it is used', () => {
+      expect(typeof mtn.isNative).toBe('boolean');
+      expect(new MtnThumbnailer('/custom/path/mtn').isNative).toBe(false);
+    });
+
+    it('should fail on a Buffer that is not a video', async () => {
+      const result = await mtn.generateThumbnail(Buffer.from('not a video'), { inputName: 'x.mp4' });
+
+      expect(result.success).toBe(false);
+      expect(result.error).toBeDefined();
+    });
+  });
+
+  describe('generateThumbnails', () => {
+    it('should keep the order of the videos', async () => {
+      const videos = ['/a.mp4', '/b.mp4', '/c.mp4', '/d.mp4', '/e.mp4'];
+      const progress: MtnBatchProgress[] = [];
+      const results = await mtn.generateThumbnails(videos, {}, undefined, {
+        concurrency: 2,
+        onProgress: (p) => progress.push(p),
+      });
+
+      expect(results.map((r) => r.error)).toEqual(videos.map((v) => `Video file not found: ${v}`));
+      expect(progress[progress.length - 1]).toEqual({ completed: 5, failed: 5, running: 0, total: 5, percentage: 100 });
+      expect(Math.max(...progress.map((p) => p.running))).toBeLessThanOrEqual(2);
+    });
+
+    it('should cancel videos when aborted', async () => {
+      const controller = new AbortController();
+      controller.abort();
+      const results = await mtn.generateThumbnails([__filename, __filename], {}, undefined, { signal: controller.signal });
+
+      expect(results).toHaveLength(2);
+      results.forEach((r) => {
+        expect(r.success).toBe(false);
+        expect(r.error).toBe('Cancelled');
+      });
+    });
+  });
+
   describe('getVideoMetadata', () => {
     it('should return metadata object', async () => {
       const metadata = await mtn.getVideoMetadata('/test.mp4');
@@ -1,25 +1,43 @@
 import { spawn } from 'child_process';
 import { join, dirname, resolve } from 'path';
 import { existsSync, mkdirSync, rmSync } from 'fs';
-import { MtnOptions, MtnResult, MtnProgress, VideoMetadata } from './types';
+import { mkdir, writeFile } from 'fs/promises';
+import { cpus } from 'os';
+import {
+  MtnOptions, MtnResult, MtnProgress, VideoMetadata, MtnRunOptions, MtnBatchOptions, MtnBatchProgress, MtnEvent,
+  MtnProbe
+} from './types';
+import { NativeAddon, NativeInfo, NativeResult, loadNative } from './native';
 
 /**
  * Movie Thumbnailer (mtn) Node.js wrapper
  * 
- * Generates video thumbnails and contact sheets using mtn
+ * Generates video thumbnails and contact sheets with the native addon
+ * (libmtn on the libuv threadpool) or by spawning the mtn binary
  */
 export class MtnThumbnailer {
   private mtnPath: string;
   private tempDir?: string;
+  private native?: NativeAddon;
 
   /**
    * Create MTN thumbnailer instance
-   * @param mtnPath - Path to mtn binary (default: auto-detect)
+   * @param mtnPath - Path to mtn binary; if given, the binary is spawned
+   *   instead of using the native addon (default: native addon if built,
+   *   else auto-detect the binary)
    */
   constructor(mtnPath?: string) {
+    this.native = mtnPath ? undefined : loadNative();
     this.mtnPath = mtnPath || this.detectMtnPath();
   }
 
+  /**
+   * True if jobs run in the native addon
+   */
+  get isNative(): boolean {
+    return this.native !== undefined;
+  }
+
   /**
    * Auto-detect mtn binary location
    */
@@ -45,29 +63,61 @@ export class MtnThumbnailer {
 
   /**
    * Generate thumbnail for a video file
-   * @param videoPath - Path to video file
+   *
+   * With the native addon the files are returned as Buffers in
+   * `result.outputs` (the image also in `result.image`) and written only
+   * if `outputDir` is given.
+   * @param video - Path to video file, or the video itself (native addon)
    * @param options - MTN options
-   * @param onProgress - Progress callback
+   * @param onProgress - Progress callback; the native addon reports only completion
+   * @param run - Timeout and abort signal; a stopped job fails with
+   *   error 'Cancelled' or 'Timed out after N ms'. The native addon's
+   *   timeout starts when the job leaves the threadpool queue
    * @returns Promise with generation result
    */
   async generateThumbnail(
-    videoPath: string,
+    video: string | Buffer,
     options: MtnOptions = {},
-    onProgress?: (progress: MtnProgress) => void
+    onProgress?: (progress: MtnProgress) => void,
+    run: MtnRunOptions = {}
   ): Promise<MtnResult> {
     const startTime = Date.now();
 
+    if (run.signal?.aborted) {
+      return {
+        success: false,
+        error: 'Cancelled',
+        executionTime: 0,
+        output: '',
+        exitCode: -1
+      };
+    }
+
     // Validate video file exists
-    if (!existsSync(videoPath)) {
+    if (typeof video === 'string' && !existsSync(video)) {
       return {
         success: false,
-        error: `Video file not found: ${videoPath}`,
+        error: `Video file not found: ${video}`,
         executionTime: Date.now() - startTime,
         output: '',
         exitCode: -1
       };
     }
 
+    if (this.native) {
+      return this.generateNative(this.native, video, options, startTime, onProgress, run);
+    }
+    if (typeof video !== 'string') {
+      return {
+        success: false,
+        error: 'Buffer input needs the native addon',
+        executionTime: Date.now() - startTime,
+        output: '',
+        exitCode: -1
+      };
+    }
+    const videoPath = video;
+
     // Build command line arguments
     const args = this.buildArguments(videoPath, options);
 
@@ -78,16 +128,32 @@ export class MtnThumbnailer {
 
     return new Promise((resolve) => {
       const mtn = spawn(this.mtnPath, args);
-      let output = '';
+      const watch = this.watchJob(run, () => mtn.kill());
+      const outputs: string[] = [];
+      let metadata: VideoMetadata | undefined;
+      let pending = '';
       let errorOutput = '';
 
+      // --json-events: one event per line on stdout; the log is on stderr
       mtn.stdout.on('data', (data: Buffer) => {
-        const text = data.toString();
-        output += text;
-        
-        // Parse progress from output
-        if (onProgress) {
-          this.parseProgress(text, onProgress);
+        const lines = (pending + data.toString()).split('\n');
+        pending = lines.pop() || '';
+
+        for (const line of lines) {
+          const event = this.parseEvent(line);
+          if (event?.event === 'probe') {
+            metadata = this.eventMetadata(event);
+          } else if (event?.event === 'output' && event.path) {
+            outputs.push(event.path);
+          } else if (event?.event === 'shot' && onProgress && event.shot && event.shots) {
+            onProgress({
+              currentShot: event.shot,
+              totalShots: event.shots,
+              percentage: (event.shot * 100) / event.shots,
+              currentTime: event.time,
+              duration: metadata?.duration,
+            });
+          }
         }
       });
 
@@ -96,24 +162,30 @@ export class MtnThumbnailer {
       });
 
       mtn.on('close', (code) => {
+        watch.dispose();
         const executionTime = Date.now() - startTime;
-        const success = code === 0 || code === 1; // 0 = success, 1 = warning
+        const stopped = watch.reason();
+        const success = !stopped && (code === 0 || code === 1); // 0 = success, 1 = warning
 
-        // Parse output to find generated files
         const result: MtnResult = {
           success,
           executionTime,
-          output: output + errorOutput,
+          output: errorOutput,
           exitCode: code || 0
         };
+        if (stopped) result.error = stopped;
+        if (metadata) result.metadata = metadata;
 
-        // Extract output paths from result
-        this.parseOutputPaths(videoPath, options, result);
+        // Files reported by output events
+        for (const path of outputs) {
+          this.addOutput(options, result, this.getFilename(path), path);
+        }
 
         resolve(result);
       });
 
       mtn.on('error', (err) => {
+        watch.dispose();
         resolve({
           success: false,
           error: `Failed to execute mtn: ${err.message}`,
@@ -126,49 +198,87 @@ export class MtnThumbnailer {
   }
 
   /**
-   * Generate thumbnails for multiple videos
+   * Generate thumbnails for multiple videos, `concurrency` at a time
+   *
+   * Native jobs run on the libuv threadpool, which has 4 threads unless
+   * UV_THREADPOOL_SIZE is set before the first job.
    * @param videoPaths - Array of video paths
    * @param options - MTN options
    * @param onProgress - Progress callback (per file)
-   * @returns Promise with array of results
+   * @param batch - Concurrency, timeout per video, abort signal and batch progress
+   * @returns Promise with array of results, in the order of videoPaths
    */
   async generateThumbnails(
     videoPaths: string[],
     options: MtnOptions = {},
-    onProgress?: (path: string, progress: MtnProgress) => void
+    onProgress?: (path: string, progress: MtnProgress) => void,
+    batch: MtnBatchOptions = {}
   ): Promise<MtnResult[]> {
-    const results: MtnResult[] = [];
-
-    for (const videoPath of videoPaths) {
-      const progressCallback = onProgress 
-        ? (p: MtnProgress) => onProgress(videoPath, p)
-        : undefined;
-
-      const result = await this.generateThumbnail(videoPath, options, progressCallback);
-      results.push(result);
-    }
+    const results: MtnResult[] = new Array(videoPaths.length);
+    const progress: MtnBatchProgress = {
+      completed: 0,
+      failed: 0,
+      running: 0,
+      total: videoPaths.length,
+      percentage: 0
+    };
+    const report = () => {
+      progress.percentage = progress.total ? (progress.completed * 100) / progress.total : 100;
+      batch.onProgress?.({ ...progress });
+    };
+    let next = 0;
+
+    const worker = async () => {
+      while (next < videoPaths.length) {
+        const i = next++;
+        const videoPath = videoPaths[i];
+        const progressCallback = onProgress
+          ? (p: MtnProgress) => onProgress(videoPath, p)
+          : undefined;
+
+        progress.running++;
+        report();
+        const result = await this.generateThumbnail(videoPath, options, progressCallback, batch);
+        results[i] = result;
+        progress.running--;
+        progress.completed++;
+        if (!result.success) progress.failed++;
+        report();
+      }
+    };
 
+    const concurrency = Math.max(1, Math.min(batch.concurrency || cpus().length, videoPaths.length));
+    await Promise.all(Array.from({ length: concurrency }, worker));
     return results;
   }
 
   /**
-   * Get video metadata using mtn verbose output
-   * @param videoPath - Path to video file
+   * Get video metadata; read by the native addon or parsed from mtn verbose output
+   * @param video - Path to video file, or the video itself (native addon)
+   * @param inputName - Name of a Buffer input
    * @returns Promise with video metadata
    */
-  async getVideoMetadata(videoPath: string): Promise<VideoMetadata> {
+  async getVideoMetadata(video: string | Buffer, inputName?: string): Promise<VideoMetadata> {
+    if (this.native) {
+      const res = await this.native.probe([], video, inputName);
+      return res.info ? this.toMetadata(res.info) : {};
+    }
+    if (typeof video !== 'string') {
+      return {};
+    }
+    const videoPath = video;
     return new Promise((resolve) => {
-      const args = ['-v', '-i', videoPath];
+      // --probe only reads the container; no decoding, no thumbnails
+      const args = ['--probe', videoPath];
       const mtn = spawn(this.mtnPath, args);
       let output = '';
 
-      mtn.stderr.on('data', (data: Buffer) => {
+      mtn.stdout.on('data', (data: Buffer) => {
         output += data.toString();
       });
 
       mtn.on('close', () => {
-        const metadata: VideoMetadata = this.parseMetadata(output);
-        resolve(metadata);
+        resolve(this.probeMetadata(output));
       });
 
       mtn.on('error', () => {
@@ -181,6 +291,9 @@ export class MtnThumbnailer {
    * Check if mtn binary is available
    */
   async checkAvailability(): Promise<boolean> {
+    if (this.native) {
+      return true;
+    }
     return new Promise((resolve) => {
       const mtn = spawn(this.mtnPath, ['-v']);
       
@@ -200,6 +313,9 @@ export class MtnThumbnailer {
    * Get mtn version
    */
   async getVersion(): Promise<string> {
+    if (this.native) {
+      return this.native.version();
+    }
     return new Promise((resolve) => {
       const mtn = spawn(this.mtnPath, ['-v']);
       let version = '';
@@ -219,10 +335,174 @@ export class MtnThumbnailer {
     });
   }
 
+  /**
+   * Run a job in the native addon; no process, no log parsing
+   */
+  private async generateNative(
+    native: NativeAddon,
+    video: string | Buffer,
+    options: MtnOptions,
+    startTime: number,
+    onProgress?: (progress: MtnProgress) => void,
+    run: MtnRunOptions = {}
+  ): Promise<MtnResult> {
+    // the engine's --timeout counts from when a threadpool thread takes the
+    // job, not while it waits for one behind other jobs
+    const args = this.buildOptionArguments(options);
+    if (run.timeout) args.push(`--timeout=${Math.ceil(run.timeout / 1000)}`);
+    const job = native.generate(args, video, options.inputName);
+    const watch = this.watchJob({ signal: run.signal }, () => job.cancel?.());
+    let res: NativeResult;
+    try {
+      res = await job;
+    } finally {
+      watch.dispose();
+    }
+    const result: MtnResult = {
+      success: res.code === 0 || res.code === 1, // 0 = success, 1 = warning
+      executionTime: 0,
+      output: '',
+      exitCode: res.code >= 0 ? res.code : 2, // like the binary failing
+      outputs: res.outputs,
+    };
+    if (res.error) result.error = watch.reason() || res.error;
+    if (res.timedOut || res.code === -14) { // MTN_ERROR_TIMEOUT
+      result.success = false;
+      result.error = `Timed out after ${run.timeout} ms`;
+    }
+    if (res.info) result.metadata = this.toMetadata(res.info);
+
+    await this.storeOutputs(options, result);
+
+    if (onProgress && result.success) {
+      onProgress({ currentShot: 0, totalShots: 0, percentage: 100, duration: result.metadata?.duration });
+    }
+    result.executionTime = Date.now() - startTime;
+    return result;
+  }
+
+  /**
+   * Call stop() once run.signal aborts or run.timeout elapses
+   * @returns why the job was stopped (undefined = it wasn't), and dispose()
+   *   to call when the job ends
+   */
+  private watchJob(run: MtnRunOptions, stop: () => void): { reason: () => string | undefined; dispose: () => void } {
+    let reason: string | undefined;
+    const halt = (why: string) => {
+      if (!reason) {
+        reason = why;
+        stop();
+      }
+    };
+    const onAbort = () => halt('Cancelled');
+    const timer = run.timeout ? setTimeout(() => halt(`Timed out after ${run.timeout} ms`), run.timeout) : undefined;
+    run.signal?.addEventListener('abort', onAbort, { once: true });
+
+    return {
+      reason: () => reason,
+      dispose: () => {
+        if (timer) clearTimeout(timer);
+        run.signal?.removeEventListener('abort', onAbort);
+      }
+    };
+  }
+
+  /**
+   * Sort native outputs into the result fields; written to outputDir if given
+   */
+  private async storeOutputs(options: MtnOptions, result: MtnResult): Promise<void> {
+    const dir = options.outputDir;
+    if (dir) {
+      await mkdir(dir, { recursive: true });
+    }
+
+    for (const file of result.outputs || []) {
+      const path = dir ? join(dir, file.name) : undefined;
+      if (path) {
+        await writeFile(path, file.data);
+      }
+      this.addOutput(options, result, file.name, path, file.data);
+    }
+  }
+
+  /**
+   * Sort an output file into the result fields by its name
+   */
+  private addOutput(options: MtnOptions, result: MtnResult, name: string, path?: string, data?: Buffer): void {
+    const suffix = options.outputSuffix || '_s.jpg';
+
+    if (!result.outputPath && !result.image && name.endsWith(suffix)) {
+      result.image = data;
+      result.outputPath = path;
+    } else if (options.infoSuffix && name.endsWith(options.infoSuffix)) {
+      result.infoPath = path;
+    } else if (name.endsWith('.vtt')) {
+      result.webVttPath = path;
+    } else if (options.extractCover && name.endsWith('_cover.jpg')) {
+      result.coverPath = path;
+    } else if (path) {
+      result.individualShots = [...(result.individualShots || []), path];
+    }
+  }
+
+  /**
+   * Parse a line of --json-events
+   * @returns undefined if it isn't an event
+   */
+  private parseEvent(line: string): MtnEvent | undefined {
+    try {
+      const event = JSON.parse(line);
+      return event && typeof event.event === 'string' ? (event as MtnEvent) : undefined;
+    } catch {
+      return undefined;
+    }
+  }
+
+  /**
+   * Typed metadata from a probe event
+   */
+  private eventMetadata(event: MtnEvent): VideoMetadata {
+    return {
+      duration: event.duration,
+      width: event.width,
+      height: event.height,
+      codec: event.video_codec,
+      audioCodec: event.audio_codec || undefined,
+      frameRate: event.frame_rate || undefined,
+      bitrate: event.bit_rate ? Math.round(event.bit_rate / 1000) : undefined,
+      size: typeof event.size === 'number' ? event.size : undefined,
+      rotation: event.rotation,
+    };
+  }
+
+  /**
+   * Typed metadata from native movie info
+   */
+  private toMetadata(info: NativeInfo): VideoMetadata {
+    return {
+      duration: info.duration,
+      width: info.width,
+      height: info.height,
+      codec: info.codec,
+      audioCodec: info.audioCodec || undefined,
+      frameRate: info.frameRate || undefined,
+      bitrate: info.bitrate ? Math.round(info.bitrate / 1000) : undefined,
+      size: info.size >= 0 ? info.size : undefined,
+      rotation: info.rotation,
+    };
+  }
+
   /**
    * Build command line arguments from options
    */
   private buildArguments(videoPath: string, options: MtnOptions): string[] {
+    return [...this.buildOptionArguments(options), '--json-events', videoPath];
+  }
+
+  /**
+   * Build command line options without the video
+   */
+  private buildOptionArguments(options: MtnOptions): string[] {
     const args: string[] = [];
 
     // Output options
@@ -293,121 +573,36 @@ export class MtnThumbnailer {
     // Info file
     if (options.infoSuffix) args.push('-N', options.infoSuffix);
 
-    // Add video path
-    args.push(videoPath);
-
     return args;
   }
 
   /**
-   * Parse progress from mtn output
-   */
-  private parseProgress(output: string, onProgress: (progress: MtnProgress) => void): void {
-    // Parse shot progress
-    const shotMatch = output.match(/shot (\d+):/);
-    if (shotMatch) {
-      const currentShot = parseInt(shotMatch[1]);
-      onProgress({
-        currentShot,
-        totalShots: currentShot + 1, // Estimate
-        percentage: 0,
-      });
-    }
-
-    // Parse time progress
-    const timeMatch = output.match(/(\d+\.\d+) s.*?(\d+\.\d+) shots\/s/);
-    if (timeMatch) {
-      const currentTime = parseFloat(timeMatch[1]);
-      onProgress({
-        currentShot: 0,
-        totalShots: 0,
-        percentage: 0,
-        currentTime,
-      });
-    }
-  }
-
-  /**
-   * Parse output paths from mtn result
-   */
-  private parseOutputPaths(videoPath: string, options: MtnOptions, result: MtnResult): void {
-    // Determine output filename
-    let basePath = videoPath;
-    if (options.outputDir) {
-      basePath = join(options.outputDir, this.getFilename(videoPath));
-    }
-
-    // Remove extension if not using full filename
-    if (!options.useFullFilename) {
-      const lastDot = basePath.lastIndexOf('.');
-      if (lastDot > 0) {
-        basePath = basePath.substring(0, lastDot);
-      }
-    }
-
-    // Set output path
-    result.outputPath = basePath + (options.outputSuffix || '_s.jpg');
-
-    // Check if files exist
-    if (options.infoSuffix) {
-      const infoPath = basePath + options.infoSuffix;
-      if (existsSync(infoPath)) {
-        result.infoPath = infoPath;
-      }
-    }
-
-    if (options.extractCover) {
-      const coverPath = basePath + '_cover.jpg';
-      if (existsSync(coverPath)) {
-        result.coverPath = coverPath;
-      }
-    }
-  }
-
-  /**
-   * Parse video metadata from mtn output
+   * Typed metadata from the JSON line of mtn --probe
    */
-  private parseMetadata(output: string): VideoMetadata {
-    const metadata: VideoMetadata = {};
-
-    // Duration
-    const durationMatch = output.match(/duration: (\d+\.\d+) s/);
-    if (durationMatch) {
-      metadata.duration = parseFloat(durationMatch[1]);
-    }
-
-    // Size
-    const sizeMatch = output.match(/Size: (\d+) bytes/);
-    if (sizeMatch) {
-      metadata.size = parseInt(sizeMatch[1]);
+  private probeMetadata(output: string): VideoMetadata {
+    let probe: MtnProbe;
+    try {
+      probe = JSON.parse(output.split('\n')[0]);
+    } catch {
+      return {};
     }
-
-    // Video stream
-    const videoMatch = output.match(/Video:.*?, (\d+)x(\d+)/);
-    if (videoMatch) {
-      metadata.width = parseInt(videoMatch[1]);
-      metadata.height = parseInt(videoMatch[2]);
-    }
-
-    // Codec
-    const codecMatch = output.match(/Video: ([^,]+)/);
-    if (codecMatch) {
-      metadata.codec = codecMatch[1].trim();
-    }
-
-    // Frame rate
-    const fpsMatch = output.match(/(\d+\.\d+) fps/);
-    if (fpsMatch) {
-      metadata.frameRate = parseFloat(fpsMatch[1]);
-    }
-
-    // Bitrate
-    const bitrateMatch = output.match(/bitrate: (\d+) kb\/s/);
-    if (bitrateMatch) {
-      metadata.bitrate = parseInt(bitrateMatch[1]);
+    if (probe.error) {
+      return {};
     }
 
-    return metadata;
+    const video = probe.streams?.find((s) => s.type === 'video');
+    const audio = probe.streams?.find((s) => s.type === 'audio');
+    return {
+      duration: probe.duration ?? undefined,
+      width: video?.width,
+      height: video?.height,
+      codec: video?.codec,
+      audioCodec: audio?.codec,
+      frameRate: video?.frame_rate,
+      bitrate: probe.bit_rate ? Math.round(probe.bit_rate / 1000) : undefined,
+      size: probe.size ?? undefined,
+      rotation: video?.rotation,
+    };
   }
 
   /**
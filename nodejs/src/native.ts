@@ -0,0 +1,66 @@
+/**
+ * Native addon (binding.gyp) running libmtn jobs on the libuv threadpool
+ */
+
+/**
+ * Movie info reported by libmtn
+ */
+export interface NativeInfo {
+  duration: number;
+  width: number;
+  height: number;
+  rotation: number;
+  frameRate: number;
+  /** bits/s; 0 = unknown */
+  bitrate: number;
+  /** bytes; -1 = unknown */
+  size: number;
+  codec: string;
+  /** '' = no audio */
+  audioCodec: string;
+}
+
+/**
+ * Result of a native job
+ */
+export interface NativeResult {
+  /** 0 ok, 1 some shots are missing, <0 MtnError */
+  code: number;
+  error?: string;
+  /** stopped by --timeout; outputs have the shots so far */
+  timedOut?: boolean;
+  /** missing if the movie can't be opened */
+  info?: NativeInfo;
+  outputs: { name: string; data: Buffer }[];
+}
+
+/**
+ * Running native job; cancel() makes it resolve with code -13 (MTN_ERROR_CANCELLED)
+ */
+export type NativeJob = Promise<NativeResult> & { cancel?: () => void };
+
+export interface NativeAddon {
+  /** Make thumbnails; args are mtn options without files */
+  generate(args: string[], input: string | Buffer, name?: string): NativeJob;
+
+  /** Read movie info only */
+  probe(args: string[], input: string | Buffer, name?: string): NativeJob;
+
+  version(): string;
+}
+
+/**
+ * Load the addon built by node-gyp
+ * @returns undefined if it isn't built
+ */
+export function loadNative(): NativeAddon | undefined {
+  for (const path of ['../build/Release/mtn.node', '../build/Debug/mtn.node']) {
+    try {
+      // eslint-disable-next-line @typescript-eslint/no-var-requires
+      return require(path) as NativeAddon;
+    } catch {
+      // not built
+    }
+  }
+  return undefined;
+}
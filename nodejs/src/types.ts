@@ -120,6 +120,9 @@ export interface MtnOptions {
   
   /** File extensions to process (-e) */
   extensions?: string[];
+
+  /** Name of a Buffer input, used for output names and the info text (native addon) */
+  inputName?: string;
 }
 
 /**
@@ -142,6 +145,142 @@ export interface MtnProgress {
   duration?: number;
 }
 
+/**
+ * Limits of one generateThumbnail() call
+ */
+export interface MtnRunOptions {
+  /** Stop the job after this many milliseconds */
+  timeout?: number;
+
+  /** Stop the job when aborted */
+  signal?: AbortSignal;
+}
+
+/**
+ * Progress of generateThumbnails(), reported when a video starts or ends
+ */
+export interface MtnBatchProgress {
+  /** Videos done, failed or not */
+  completed: number;
+
+  /** Videos that failed */
+  failed: number;
+
+  /** Videos being processed */
+  running: number;
+
+  /** All videos */
+  total: number;
+
+  /** completed / total (0-100) */
+  percentage: number;
+}
+
+/**
+ * Options of generateThumbnails(); timeout and signal apply to each video
+ */
+export interface MtnBatchOptions extends MtnRunOptions {
+  /** Videos processed at the same time, default: number of CPUs */
+  concurrency?: number;
+
+  /** Progress of the whole batch */
+  onProgress?: (progress: MtnBatchProgress) => void;
+}
+
+/**
+ * Line printed by mtn --json-events
+ */
+export interface MtnEvent {
+  event: 'start' | 'probe' | 'shot' | 'output' | 'done';
+
+  /** Movie */
+  file: string;
+
+  /** probe, done: seconds since the movie was started */
+  seconds?: number;
+
+  /** probe */
+  duration?: number;
+  width?: number;
+  height?: number;
+  rotation?: number;
+  frame_rate?: number;
+  bit_rate?: number;
+  size?: number | null;
+  video_codec?: string;
+  audio_codec?: string | null;
+
+  /** shot: 1-based shot of shots, pts in stream time base, time in seconds */
+  shot?: number;
+  shots?: number;
+  pts?: number;
+  time?: number;
+
+  /** output: file written; size is also set */
+  path?: string;
+
+  /** done: 0 ok, 1 some shots are missing, <0 error */
+  code?: number;
+}
+
+/**
+ * Stream in the output of mtn --probe
+ */
+export interface MtnProbeStream {
+  index: number;
+  type: string | null;
+  codec: string;
+  profile: string | null;
+  bit_rate: number;
+  duration: number | null;
+  language: string | null;
+
+  /** video */
+  width?: number;
+  height?: number;
+  sar?: string;
+  dar?: string;
+  frame_rate?: number;
+  rotation?: number;
+  pix_fmt?: string | null;
+  color_range?: string | null;
+  color_primaries?: string | null;
+  color_trc?: string | null;
+  color_space?: string | null;
+  hdr?: boolean;
+
+  /** audio */
+  sample_rate?: number;
+  channels?: number;
+}
+
+/**
+ * Line printed by mtn --probe
+ */
+export interface MtnProbe {
+  file: string;
+  /** set if the movie can't be opened; nothing else is */
+  error?: string;
+  format?: string;
+  format_long?: string;
+  duration?: number | null;
+  start_time?: number | null;
+  bit_rate?: number;
+  size?: number | null;
+  streams?: MtnProbeStream[];
+}
+
+/**
+ * File produced by the native addon
+ */
+export interface MtnOutputFile {
+  /** File name mtn would write, without directory */
+  name: string;
+
+  /** Encoded content */
+  data: Buffer;
+}
+
 /**
  * Result from mtn execution
  */
@@ -163,6 +302,15 @@ export interface MtnResult {
   
   /** WebVTT file path (if exported) */
   webVttPath?: string;
+
+  /** Output image (native addon) */
+  image?: Buffer;
+
+  /** All files produced, in order (native addon) */
+  outputs?: MtnOutputFile[];
+
+  /** Metadata of the video (native addon) */
+  metadata?: VideoMetadata;
   
   /** Execution time in milliseconds */
   executionTime: number;
@@ -204,4 +352,7 @@ export interface VideoMetadata {
   
   /** File size in bytes */
   size?: number;
+
+  /** Rotation in degrees */
+  rotation?: number;
 }
@@ -0,0 +1,227 @@
+/*  mtn - movie thumbnailer
+    Library interface: thumbnails of movies in files or in memory
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "libmtn.h"
+#include "mtn.h"
+#include "mtn_error.h"
+#include "mtn_thumbnail.h"
+#include "libavformat/avio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct MtnJob {
+    MtnContext mc;
+    char **args;                    /* copies of the options; mc points into them */
+    int nb_args;
+    volatile int cancel;            /* set by mtn_job_cancel() */
+};
+
+MtnJob *mtn_job_new(void)
+{
+    MtnJob *job = calloc(1, sizeof(MtnJob));
+    if (NULL == job)
+        return NULL;
+    mtn_context_init(&job->mc);
+    job->mc.argv0 = "libmtn";
+    job->mc.cancel = &job->cancel;
+    gdFontCacheSetup(); // gd's font cache is shared by jobs running in different threads
+    if (0 != check_options(&job->mc)) { // derived options like on the command line
+        mtn_job_free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void mtn_job_free(MtnJob *job)
+{
+    if (NULL == job)
+        return;
+    mtn_context_cleanup(&job->mc);
+    while (--job->nb_args >= 0)
+        free(job->args[job->nb_args]);
+    free(job->args);
+    free(job);
+}
+
+int mtn_job_set_options(MtnJob *job, int argc, char **argv)
+{
+    char **args = realloc(job->args, (job->nb_args + argc + 1) * sizeof(char *));
+    int i;
+
+    if (NULL == args)
+        return -1;
+    job->args = args;
+    args += job->nb_args;
+    for (i = 0; i < argc; i++) {
+        if (NULL == (args[i] = strdup(argv[i]))) {
+            while (--i >= 0)
+                free(args[i]);
+            return -1;
+        }
+    }
+    args[argc] = NULL;
+    job->nb_args += argc;
+
+    if (0 != parse_job_options(&job->mc, argc, args) || 0 != setup_options(&job->mc))
+        return -1;
+    return 0;
+}
+
+/* MtnOutputFn collecting the outputs in a MtnResult */
+static int result_add(void *opaque, const char *name, const void *data, size_t size)
+{
+    MtnResult *result = opaque;
+    MtnOutput *outputs = realloc(result->outputs, (result->nb_outputs + 1) * sizeof(MtnOutput));
+    if (NULL == outputs)
+        return -1;
+    result->outputs = outputs;
+
+    MtnOutput *o = &outputs[result->nb_outputs];
+    o->name = strdup(name);
+    o->data = malloc(size > 0 ? size : 1);
+    o->size = size;
+    if (NULL == o->name || NULL == o->data) {
+        free(o->name);
+        free(o->data);
+        return -1;
+    }
+    memcpy(o->data, data, size);
+    result->nb_outputs++;
+    return 0;
+}
+
+static int buffer_read(void *opaque, uint8_t *buf, int size)
+{
+    MtnBuffer *b = opaque;
+    size_t left = b->size - b->pos;
+
+    if (0 == left)
+        return AVERROR_EOF;
+    if ((size_t)size > left)
+        size = (int)left;
+    memcpy(buf, b->data + b->pos, size);
+    b->pos += size;
+    return size;
+}
+
+static int64_t buffer_seek(void *opaque, int64_t offset, int whence)
+{
+    MtnBuffer *b = opaque;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE: return b->size;
+    case SEEK_SET: break;
+    case SEEK_CUR: offset += b->pos; break;
+    case SEEK_END: offset += b->size; break;
+    default: return -1;
+    }
+    if (offset < 0 || (uint64_t)offset > b->size)
+        return -1;
+    b->pos = offset;
+    return offset;
+}
+
+void mtn_buffer_reader(MtnReader *reader, MtnBuffer *buffer, const void *data, size_t size)
+{
+    buffer->data = data;
+    buffer->size = size;
+    buffer->pos = 0;
+    reader->read = buffer_read;
+    reader->seek = buffer_seek;
+    reader->opaque = buffer;
+}
+
+static int run(MtnJob *job, const char *name, const MtnReader *reader, MtnResult *result)
+{
+    MtnContext *mc = &job->mc;
+
+    memset(result, 0, sizeof(*result));
+    result->info.size = -1;
+    char *file = strdup(name);
+    if (NULL == file)
+        return result->code = MTN_ERROR_OUT_OF_MEMORY;
+
+    mc->reader = reader;
+    mc->output = result_add;
+    mc->output_opaque = result;
+    mc->info = &result->info;
+    mc->st_start = time(NULL);
+    result->code = make_thumbnail(mc, file);
+    result->timed_out = mc->timed_out;
+    mc->reader = NULL;
+    mc->output = NULL;
+    mc->output_opaque = NULL;
+    mc->info = NULL;
+
+    free(file);
+    return result->code;
+}
+
+int mtn_job_run_file(MtnJob *job, const char *path, MtnResult *result)
+{
+    return run(job, path, NULL, result);
+}
+
+int mtn_job_run_reader(MtnJob *job, const char *name, const MtnReader *reader, MtnResult *result)
+{
+    return run(job, name, reader, result);
+}
+
+void mtn_result_free(MtnResult *result)
+{
+    int i;
+    for (i = 0; i < result->nb_outputs; i++) {
+        free(result->outputs[i].name);
+        free(result->outputs[i].data);
+    }
+    free(result->outputs);
+    result->outputs = NULL;
+    result->nb_outputs = 0;
+}
+
+int mtn_job_probe(MtnJob *job, const char *name, const MtnReader *reader, MtnInfo *info)
+{
+    MtnContext *mc = &job->mc;
+    ThumbnailContext tc;
+    int ret;
+
+    memset(info, 0, sizeof(*info));
+    info->size = -1;
+    mc->reader = reader;
+    thumbnail_context_init(&tc, mc);
+    if (0 == (ret = thumbnail_open_file(&tc, name))
+        && 0 == (ret = thumbnail_find_stream(&tc, 0))
+        && 0 == (ret = thumbnail_init_decoder(&tc))
+        && 0 == (ret = thumbnail_init_filters(&tc))
+        && 0 == (ret = thumbnail_init_timing(&tc)))
+        thumbnail_get_info(&tc, info);
+    thumbnail_context_cleanup(&tc);
+    mc->reader = NULL;
+    return ret;
+}
+
+void mtn_job_cancel(MtnJob *job)
+{
+    job->cancel = 1;
+}
+
+const char *mtn_strerror(int code)
+{
+    return mtn_error_string(code);
+}
+
+const char *mtn_version(void)
+{
+    return MTN_VERSION;
+}
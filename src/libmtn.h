@@ -0,0 +1,161 @@
+/*  mtn - movie thumbnailer
+    Library interface: thumbnails of movies in files or in memory
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef LIBMTN_H
+#define LIBMTN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * MtnReader - movie read through callbacks instead of a file, e.g. from a
+ * buffer. The callbacks are those of FFmpeg's avio_alloc_context():
+ *
+ * read  - copy up to size bytes into buf
+ *         Returns the number of bytes, AVERROR_EOF at the end or <0 on error
+ * seek  - whence is SEEK_SET, SEEK_CUR, SEEK_END or AVSEEK_SIZE (0x10000:
+ *         return the size of the movie, <0 if unknown)
+ *         Returns the new position or <0 on error
+ *         NULL if the movie can't seek; then use non-seek mode (-Z)
+ */
+typedef struct MtnReader {
+    int (*read)(void *opaque, uint8_t *buf, int size);
+    int64_t (*seek)(void *opaque, int64_t offset, int whence);
+    void *opaque;
+} MtnReader;
+
+/**
+ * MtnBuffer - state of a MtnReader reading a movie in memory
+ */
+typedef struct MtnBuffer {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} MtnBuffer;
+
+/**
+ * Set reader to read size bytes of data through buffer; data must outlive
+ * the reader
+ */
+void mtn_buffer_reader(MtnReader *reader, MtnBuffer *buffer, const void *data, size_t size);
+
+/**
+ * MtnInfo - what the info text of the thumbnail says about the movie
+ */
+typedef struct MtnInfo {
+    double duration;                /* seconds */
+    int width, height;              /* of the video stream */
+    int rotation;                   /* degrees */
+    double frame_rate;              /* 0 = unknown */
+    int64_t bit_rate;               /* bits/s; 0 = unknown */
+    int64_t size;                   /* bytes; <0 = unknown */
+    char video_codec[32];
+    char audio_codec[32];           /* of the first audio stream; "" = none */
+} MtnInfo;
+
+/**
+ * MtnOutput - encoded file mtn would write: image, info text, cover,
+ * sprite or WebVTT
+ */
+typedef struct MtnOutput {
+    char *name;                     /* file name without directory */
+    uint8_t *data;
+    size_t size;
+} MtnOutput;
+
+typedef struct MtnResult {
+    int code;                       /* 0 ok, 1 some shots are missing, <0 MtnError */
+    int timed_out;                  /* stopped by --timeout; the outputs have the shots so far */
+    MtnOutput *outputs;
+    int nb_outputs;
+    MtnInfo info;                   /* set once the movie is opened */
+} MtnResult;
+
+/**
+ * MtnJob - options of the thumbnails; one job can make thumbnails of many
+ * movies, one at a time
+ */
+typedef struct MtnJob MtnJob;
+
+/**
+ * New job with the default options of the command line
+ * Returns NULL on error
+ */
+MtnJob *mtn_job_new(void);
+
+/**
+ * Free job; NULL is ignored
+ */
+void mtn_job_free(MtnJob *job);
+
+/**
+ * Set options given like on the command line; argv[0] is the program name,
+ * files are not allowed. argv is copied; options not given keep their
+ * values. Parsing uses getopt, so no two threads may set options at the
+ * same time. -q, -v and --log-format are ignored: the log is FFmpeg's and
+ * shared by the whole process, so its level is the caller's to set with
+ * av_log_set_level()
+ * Returns 0 on success, -1 if an option is invalid
+ */
+int mtn_job_set_options(MtnJob *job, int argc, char **argv);
+
+/**
+ * Make thumbnails of the movie in path; outputs are returned in result
+ * instead of being written. Free result with mtn_result_free()
+ * Returns result->code
+ */
+int mtn_job_run_file(MtnJob *job, const char *path, MtnResult *result);
+
+/**
+ * Like mtn_job_run_file(), but the movie is read through reader; name is
+ * used for the output names and the info text
+ */
+int mtn_job_run_reader(MtnJob *job, const char *name, const MtnReader *reader, MtnResult *result);
+
+/**
+ * Free the outputs of result
+ */
+void mtn_result_free(MtnResult *result);
+
+/**
+ * Read info of the movie in name without making thumbnails; the movie is
+ * read through reader unless it is NULL
+ * Returns 0 on success, <0 MtnError on error
+ */
+int mtn_job_probe(MtnJob *job, const char *name, const MtnReader *reader, MtnInfo *info);
+
+/**
+ * Stop the movie job is working on as soon as possible; the run or probe
+ * returns MTN_ERROR_CANCELLED (-13). May be called from any thread; the job
+ * stays cancelled, so new runs fail at once
+ */
+void mtn_job_cancel(MtnJob *job);
+
+/**
+ * Text of a MtnError code
+ */
+const char *mtn_strerror(int code);
+
+/**
+ * Version of mtn, e.g. "3.6.0"
+ */
+const char *mtn_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LIBMTN_H */
@@ -44,6 +44,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
 #include <math.h>
 #include <stdio.h>
@@ -61,6 +62,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/avconfig.h"
 #include "libavutil/avstring.h"
+#include "libavutil/base64.h"
 #include "libavutil/pixfmt.h"
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
@@ -72,33 +74,22 @@
 #include "gd.h"
 
 #include "mtn_thumbnail.h"
+#include "mtn_log.h"
 #include "mtn_error.h"
-
-#define UTF8_FILENAME_SIZE (FILENAME_MAX*4)
-#define LINESIZE_ALIGN 1
-#define MAX_PACKETS_WITHOUT_PICTURE 1000
-
-#define EXIT_SUCCESS 0
-#define EXIT_WARNING 1
-#define EXIT_ERROR   2
-
-
-#ifdef WIN32
-    unsigned int _CRT_fmode = _O_BINARY;  // default binary file including stdin, stdout, stderr
-    #include <tchar.h>
-    #include <windows.h>
-    #ifdef _UNICODE
-        #define UTF8_2_WC(wdst, src, size) MultiByteToWideChar(CP_UTF8, 0, (src), -1, (wdst), (size))
-        #define WC_2_UTF8(dst, wsrc, size) WideCharToMultiByte(CP_UTF8, 0, (wsrc), -1, (dst), (size), NULL, NULL)
-    #else
-        #define UTF8_2_WC(dst, src, size) ((dst) = (src)) // cant be used to check required size
-        #define WC_2_UTF8(dst, src, size) ((dst) = (src))
-    #endif
-#else
-    #include "fake_tchar.h"
-    #define UTF8_2_WC(dst, src, size) ((dst) = (src)) // cant be used to check required size
-    #define WC_2_UTF8(dst, src, size) ((dst) = (src))
-#endif
+#include "mtn_stream.h"
+#include "mtn_archive.h"
+#include "mtn_png.h"
+#include "mtn_cache.h"
+#include "mtn_probe.h"
+#include "mtn_scan.h"
+#include "mtn_serve.h"
+#include "mtn_watch.h"
+#include "mtn_batch.h"
+#include "mtn_journal.h"
+#include "mtn_dedupe.h"
+#include "mtn_events.h"
+#include "mtn_json.h"
+#include "mtn.h"
 
 
 #ifndef MIN
@@ -115,25 +106,19 @@
     #define NEWLINE "\n"
 #endif
 
-#define EDGE_PARTS 6 // # of parts used in edge detection
-#define EDGE_FOUND 0.001f // edge is considered found
+#define SCAN_THREADS 4 // threads reading subdirectories ahead
+#define DEDUPE_SAMPLES 16 // blocks hashed by --dedupe=content
+#define DEDUPE_BLOCK 65536
 
-int process_loop(int n, char **files, int current_depth);
+#ifdef WIN32
+    #define FSEEK64 _fseeki64
+#else
+    #define FSEEK64 fseeko
+#endif
 
-typedef char TIME_STR[20];
 
-typedef struct rgb_color
-{
-    int r;
-    int g;
-    int b;
-} rgb_color;
 typedef char color_str[7]; // "RRGGBB" (in hex)
 
-#define COLOR_BLACK (rgb_color){0, 0, 0}
-#define COLOR_GREY (rgb_color){128, 128, 128}
-#define COLOR_WHITE (rgb_color){255, 255, 255}
-#define COLOR_INFO (rgb_color){85, 85, 85}
 #define IMAGE_EXTENSION_JPG ".jpg"
 #define IMAGE_EXTENSION_PNG ".png"
 #define IMAGE_EXTENSION_WEBP ".webp"
@@ -174,6 +159,7 @@ typedef struct thumbnail
     int idx;                                // index of the last shot; -1 = no shot
     int tiles_nr;                           // number of shots in thumbnail
     int rotation;                           // in degrees <-180; 180> stored in movie
+    int band_y;                             // y of out_ip in the whole image; >0 only when streaming
 
     // dynamic
     int64_t *ppts; // array of pts value of each shot
@@ -207,128 +193,20 @@ typedef struct KEYCOUNTER
     int count;
 } KeyCounter;
 
+#define TARGET_SIZE_MIN_QUALITY 1   // lowest quality tried by --target-size
+#define TARGET_SIZE_MAX_TRIES 8     // max. encodes; enough to bisect 1..100
 
-/* command line options & default values */
-#define GB_A_RATIO (AVRational){0, 1}
-AVRational gb_a_ratio = GB_A_RATIO;
-#define GB_B_BLANK 0.8
-double gb_b_blank = GB_B_BLANK;
-#define GB_B_BEGIN 0.0
-double gb_B_begin = GB_B_BEGIN; // skip this seconds from the beginning
-#define GB_C_COLUMN 3
-int gb_c_column = GB_C_COLUMN;
-#define GB_C_CUT -1
-double gb_C_cut = GB_C_CUT; // cut movie; <=0 off
-#define GB_D_DEPTH -1
-int gb_d_depth = GB_D_DEPTH; //directory depth
-#define GB_D_EDGE 12
-int gb_D_edge = GB_D_EDGE; // edge detection; 0 off; >0 on
-#define GB_E_EXT "3gp,3g2,asf,avi,avs,dat,divx,dsm,evo,flv,m1v,m2ts,m2v,m4v,mj2,mjpg,mjpeg,mkv,mov,moov,mp4,mpg,mpeg,mpv,nut,ogg,ogm,qt,rm,rmvb,swf,ts,vob,webm,wmv,xvid"
-char *gb_e_ext = GB_E_EXT;
-#define GB_E_END 0.0
-double gb_E_end = GB_E_END; // skip this seconds at the end
-#ifndef GB_F_FONTNAME
-#ifdef __APPLE__
-#	define GB_F_FONTNAME "Tahoma Bold.ttf"
-#else
-#ifdef WIN32
-#	define GB_F_FONTNAME "tahomabd.ttf"
-#else
-#	define GB_F_FONTNAME "DejaVuSans.ttf"
-#endif
-#endif
-#endif
+typedef struct PROFILE_OUTPUT
+{
+    const Profile *opt;
+    thumbnail tn;
+    int quality;
+    gdImagePtr shadow_ip;
+    struct SwsContext *sws;
+    AVFrame *frame_rgb;
+    uint8_t *rgb_buffer;
+} ProfileOutput;
 
-char *gb_f_fontname = GB_F_FONTNAME;
-rgb_color gb_F_info_color = COLOR_INFO; // info color
-double gb_F_info_font_size = 9; // info font size
-char *gb_F_ts_fontname = GB_F_FONTNAME; // time stamp fontname
-rgb_color gb_F_ts_color = COLOR_WHITE; // time stamp color
-rgb_color gb_F_ts_shadow = COLOR_BLACK; // time stamp shadow color
-double gb_F_ts_font_size = 8; // time stamp font size
-#define GB_G_GAP 0
-int gb_g_gap = GB_G_GAP;
-#define GB_H_HEIGHT 150
-int gb_h_height = GB_H_HEIGHT; // mininum height of each shot; will reduce # of column to meet this height
-int gb_H_human_filesize = 0; // filesize only in human readable size (KiB, MiB, GiB)
-#define GB_I_INFO 1
-int gb_i_info = GB_I_INFO; // 1 on; 0 off
-#define GB_I_INDIVIDUAL 0
-int gb_I_individual = GB_I_INDIVIDUAL;  // 1 on; 0 off
-int gb_I_individual_thumbnail = 0;      // 1 on; 0 off
-int gb_I_individual_original = 0;       // 1 on; 0 off
-int gb_I_individual_ignore_grid = 0;    // 1 on; 0 off
-#define GB_J_QUALITY 90
-int gb_j_quality = GB_J_QUALITY;
-#define GB_K_BCOLOR COLOR_WHITE
-rgb_color gb_k_bcolor = GB_K_BCOLOR; // background color
-#define GB_L_INFO_LOCATION 4
-int gb_L_info_location = GB_L_INFO_LOCATION;
-#define GB_L_TIME_LOCATION 1
-int gb_L_time_location = GB_L_TIME_LOCATION;
-#define GB_N_NORMAL 0
-int gb_n_normal = GB_N_NORMAL; // normal priority; 1 normal; 0 lower
-#define GB_N_SUFFIX NULL
-char *gb_N_suffix = GB_N_SUFFIX; // info text file suffix
-#define GB_O_SUFFIX "_s.jpg"
-char *gb_o_suffix = GB_O_SUFFIX;
-#define GB_O_OUTDIR NULL
-char *gb_O_outdir = GB_O_OUTDIR;
-#ifdef WIN32
-    #define GB_P_PAUSE 1
-#else
-    #define GB_P_PAUSE 0
-#endif
-int gb_p_pause = GB_P_PAUSE; // pause before exiting; 1 pause; 0 dont pause
-#define GB_P_DONTPAUSE 0
-int gb_P_dontpause = GB_P_DONTPAUSE; // dont pause; overide gb_p_pause
-#define GB_Q_QUIET 0
-int gb_q_quiet = GB_Q_QUIET; // 1 on; 0 off
-#define GB_R_ROW 0
-int gb_r_row = GB_R_ROW; // 0 = as many rows as needed
-#define GB_S_STEP 120
-int gb_s_step = GB_S_STEP; // less than 0 = every frame; 0 = step evenly to get column x row
-#define GB_S_SELECT_VIDEO_STREAM 0
-int gb_S_select_video_stream = GB_S_SELECT_VIDEO_STREAM;
-#define GB_T_TIME 1
-int gb_t_timestamp = GB_T_TIME; // 1 on; 0 off
-#define GB_T_TEXT NULL
-char *gb_T_text = GB_T_TEXT;
-#define GB_V_VERBOSE 0
-int gb_v_verbose = GB_V_VERBOSE; // 1 on; 0 off
-int gb_V = GB_V_VERBOSE; // 1 on; 0 off
-#define GB_W_WIDTH 1024
-int gb_w_width = GB_W_WIDTH; // 0 = column * movie width
-#define GB_W_OVERWRITE 1
-int gb_W_overwrite = GB_W_OVERWRITE; // 1 = overwrite; 0 = dont overwrite
-#define GB_X_FILENAME_USE_FULL 0
-int gb_X_filename_use_full = GB_X_FILENAME_USE_FULL; // use full input filename (include extension)
-char* gb_x_basename_custom = NULL;
-#define GB_Z_SEEK 0
-int gb_z_seek = GB_Z_SEEK; // always use seek mode; 1 on; 0 off
-#define GB_Z_NONSEEK 0
-int gb_Z_nonseek = GB_Z_NONSEEK; // always use non-seek mode; 1 on; 0 off
-
-/* long command line options */
-int gb__shadow=-1;				// -1 off, 0 auto, >0 manual
-int gb__transparent_bg=0;		//  0 off, 1 on
-int gb__cover=0;                //  album art (cover image)
-int gb__webvtt=0;
-const char* gb__cover_suffix="_cover.jpg";
-const char* gb__webvtt_prefix="";
-AVDictionary *gb__options = NULL;
-char* gb__filters = NULL;
-char* gb__filter_color_primaries = NULL;
-int gb__tonemap = 0;
-
-/* more global variables */
-char *gb_argv0 = NULL;
-char *gb_version = "3.6.0";
-time_t gb_st_start = 0; // start time of program
-char **movie_ext = NULL;
-
-gdFTStringExtra fcStrFlagsInfotext = {0};
-gdFTStringExtra fcStrFlagsTimestamp = {0};
 
 /* misc functions */
 
@@ -508,22 +386,6 @@ char *format_color(rgb_color col, char *buf, size_t buf_size)
     return buf;
 }
 
-void format_time(double duration, TIME_STR str, char sep)
-{
-    if (duration < 0) {
-        sprintf(str, "N/A");
-    } else {
-        int hours, mins, secs;
-        secs = duration;
-        mins = secs / 60;
-        secs %= 60;
-        hours = mins / 60;
-        mins %= 60;
-
-        snprintf(str, sizeof(TIME_STR), "%02d%c%02d%c%02d", hours, sep, mins, sep, secs);
-    }
-}
-
 void format_pts(int64_t pts, double time_base, TIME_STR str)
 {
     if (pts < 0) {
@@ -672,6 +534,132 @@ int is_reg_newer(char *file, time_t st_time)
     return S_ISREG(buf.st_mode) && (difftime(buf.st_mtime, st_time) >= 0);
 }
 
+/*
+return size of file in bytes, -1 if fail
+*/
+int64_t file_size(const char *file)
+{
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t file_w[FILENAME_MAX];
+    UTF8_2_WC(file_w, file, FILENAME_MAX);
+#else
+    const char *file_w = file;
+#endif
+
+    struct _stat buf;
+    if (0 != _tstat(file_w, &buf)) {
+        return -1;
+    }
+    return buf.st_size;
+}
+
+/*
+append name to '\n' separated list
+*/
+void artefact_append(char **list, const char *name)
+{
+    size_t len = *list ? strlen(*list) : 0;
+    char *p = realloc(*list, len + strlen(name) + 2);
+    if (NULL == p)
+        return;
+    sprintf(p + len, "%s\n", name);
+    *list = p;
+}
+
+/*
+remember output name of the current movie for --cache and --dedupe and of the current --serve job
+*/
+void artefact_remember(MtnContext *mc, const char *name)
+{
+    if (NULL != mc->cache || NULL != mc->dedupe)
+        artefact_append(&mc->artefacts, name);
+    if (mc->serve_job)
+        artefact_append(&mc->job_artefacts, name);
+}
+
+/*
+remember written output name and report it to --json-events with its size
+in bytes; size < 0 = size of the file
+*/
+void artefact_add(MtnContext *mc, const char *name, int64_t size)
+{
+    artefact_remember(mc, name);
+    if (NULL != mc->events)
+        events_output(mc->events, mc->archive_source, name, size >= 0 ? size : file_size(name));
+}
+
+/*
+return 1 if outputs are encoded in memory and stored in the archive or
+passed to libmtn instead of being written to files
+*/
+int outputs_in_memory(MtnContext *mc)
+{
+    return NULL != mc->archive || NULL != mc->output;
+}
+
+/*
+return 1 if output exists either in the archive or as a regular file
+return 0 if not (always for libmtn)
+*/
+int output_exists(MtnContext *mc, char *outname)
+{
+    if (NULL != mc->output)
+        return 0;
+    if (NULL != mc->archive)
+        return archive_exists(mc->archive, mc->archive_source, path_2_file(outname)) == 1;
+
+    return is_reg(outname);
+}
+
+/*
+store data in the archive or pass it to libmtn under the file name of outname
+return 0 if saved
+*/
+int archive_save_data(MtnContext *mc, char *outname, const void *data, size_t size)
+{
+    if (NULL != mc->output) {
+        if (0 != mc->output(mc->output_opaque, path_2_file(outname), data, size)) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: keeping '%s' in memory failed\n", mc->argv0, outname);
+            return -1;
+        }
+        artefact_add(mc, outname, size);
+        return 0;
+    }
+    if (0 != archive_add(mc->archive, mc->archive_source, path_2_file(outname), data, size)) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: adding '%s' to archive '%s' failed\n", mc->argv0, outname, mc->_archive);
+        return -1;
+    }
+    artefact_add(mc, outname, size);
+    return 0;
+}
+
+/*
+store the whole content of fp in the archive
+return 0 if saved
+*/
+int archive_save_file(MtnContext *mc, FILE *fp, char *outname)
+{
+    int ret = -1;
+    long size;
+    char *data = NULL;
+
+    if (0 != fseek(fp, 0, SEEK_END) || (size = ftell(fp)) < 0 || 0 != fseek(fp, 0, SEEK_SET))
+        goto error;
+
+    data = malloc(size > 0 ? size : 1);
+    if (NULL == data || fread(data, 1, size, fp) != (size_t)size)
+        goto error;
+
+    ret = archive_save_data(mc, outname, data, size);
+    free(data);
+    return ret;
+
+  error:
+    av_log(NULL, AV_LOG_ERROR, "\n%s: reading temporary file for '%s' failed\n", mc->argv0, outname);
+    free(data);
+    return -1;
+}
+
 
 /*
 return 1 if file is a directory
@@ -694,16 +682,6 @@ int is_dir(char *file)
     return S_ISDIR(buf.st_mode);
 }
 
-int is_key_frame(AVFrame *pFrame)
-{
-    return
-#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(58, 7, 100)
-    pFrame->key_frame;
-#else
-    !!(pFrame->flags & AV_FRAME_FLAG_KEY);
-#endif
-}
-
 char *rem_trailing_slash(char *str)
 {
 #ifdef WIN32
@@ -897,11 +875,81 @@ int image_string_padding(char *font, double size, gdFTStringExtra *fcFlags)
     return image_string_height("SAMPLE", font, size, fcFlags) * 0.3 + 0.5;
 }
 
+/*
+return 1 if png should be encoded by mtn_png (--png-* options) instead of gd
+*/
+int png_encoder_used(MtnContext *mc, gdImagePtr ip)
+{
+    return gdImageTrueColor(ip)
+        && (mc->_png_level >= 0 || PNGENC_FILTER_DEFAULT != mc->_png_filter || mc->_png_threads > 1);
+}
+
+/*
+encode png with --png-* options; returned data must be freed with free()
+*/
+void *png_encode(MtnContext *mc, gdImagePtr ip, size_t *size)
+{
+    PngEncOptions opt = { mc->_png_level, mc->_png_filter, mc->_png_threads };
+    return pngenc_encode(ip, &opt, size);
+}
+
+/*
+encode image in memory and store it in the archive
+return 0 if image is saved
+*/
+int archive_save_image(MtnContext *mc, gdImagePtr ip, char *outname, int quality)
+{
+    void *data = NULL;
+    int size = 0;
+    char *image_extension = strrchr(outname, '.');
+
+    if (image_extension && strcasecmp(image_extension, IMAGE_EXTENSION_PNG) == 0) {
+        if (png_encoder_used(mc, ip)) {
+            size_t png_size;
+            void *png = png_encode(mc, ip, &png_size);
+            int ret = (NULL != png) ? archive_save_data(mc, outname, png, png_size) : -1;
+            free(png);
+            return ret;
+        }
+        data = gdImagePngPtr(ip, &size);
+    }
+    else if (image_extension && strcasecmp(image_extension, IMAGE_EXTENSION_WEBP) == 0) {
+#ifdef MTN_WITH_WEBP
+        data = gdImageWebpPtr(ip, &size);
+#else
+        av_log(NULL, AV_LOG_ERROR, "MTN not built with WebP support!\n");
+        return -1;
+#endif
+    }
+    else if (image_extension && strcasecmp(image_extension, IMAGE_EXTENSION_AVIF) == 0) {
+#ifdef MTN_WITH_AVIF
+        data = gdImageAvifPtr(ip, &size);
+#else
+        av_log(NULL, AV_LOG_ERROR, "MTN not built with avif support!\n");
+        return -1;
+#endif
+    }
+    else
+        data = gdImageJpegPtr(ip, &size, quality);
+
+    if (NULL == data) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: encoding output image '%s' failed\n", mc->argv0, outname);
+        return -1;
+    }
+
+    int ret = archive_save_data(mc, outname, data, size);
+    gdFree(data);
+    return ret;
+}
+
 /*
 return 0 if image is saved
 */
-int save_image(gdImagePtr ip, char *outname)
+int save_image_quality(MtnContext *mc, gdImagePtr ip, char *outname, int quality)
 {
+    if (outputs_in_memory(mc))
+        return archive_save_image(mc, ip, outname, quality);
+
 #if defined(WIN32) && defined(_UNICODE)
     wchar_t outname_w[FILENAME_MAX];
     UTF8_2_WC(outname_w, outname, FILENAME_MAX);
@@ -915,7 +963,23 @@ int save_image(gdImagePtr ip, char *outname)
         char* image_extension = strrchr(outname, '.');
 
 		if(image_extension && strcasecmp(image_extension, IMAGE_EXTENSION_PNG) == 0 )
-			gdImagePng(ip, fp);
+		{
+			if(png_encoder_used(mc, ip))
+			{
+				size_t png_size;
+				void *png = png_encode(mc, ip, &png_size);
+				int written = (NULL != png) && fwrite(png, 1, png_size, fp) == png_size;
+				free(png);
+				if(!written)
+				{
+					av_log(NULL, AV_LOG_ERROR, "\n%s: writing output image '%s' failed\n", mc->argv0, outname);
+					fclose(fp);
+					return -1;
+				}
+			}
+			else
+				gdImagePng(ip, fp);
+		}
 		else
 			if(image_extension && strcasecmp(image_extension, IMAGE_EXTENSION_WEBP) == 0 )
 #ifdef MTN_WITH_WEBP
@@ -936,33 +1000,134 @@ int save_image(gdImagePtr ip, char *outname)
 		}
 #endif
 				else
-					gdImageJpeg (ip, fp, gb_j_quality);
+					gdImageJpeg (ip, fp, quality);
 
-        if(fclose(fp) == 0)
+        if(fclose(fp) == 0) {
+            artefact_add(mc, outname, -1);
             return 0;
+        }
         else
-            av_log(NULL, AV_LOG_ERROR, "\n%s: closing output image '%s' failed: %s\n", gb_argv0, outname, strerror(errno));
+            av_log(NULL, AV_LOG_ERROR, "\n%s: closing output image '%s' failed: %s\n", mc->argv0, outname, strerror(errno));
     }
     else
-        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output image '%s' failed: %s\n", gb_argv0, outname, strerror(errno));
+        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output image '%s' failed: %s\n", mc->argv0, outname, strerror(errno));
 
     return -1;
 }
+
+int save_image(MtnContext *mc, gdImagePtr ip, char *outname)
+{
+    return save_image_quality(mc, ip, outname, mc->j_quality);
+}
+
 /*
-pFrame must be a AV_PIX_FMT_RGB24 frame
+write already encoded data to file or archive
+return 0 if saved
 */
-void FrameRGB_2_gdImage(AVFrame *pFrame, gdImagePtr ip, int width, int height)
+int save_data(MtnContext *mc, char *outname, const void *data, size_t size)
 {
-    uint8_t *src = pFrame->data[0];
-    int x, y;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width * 3; x += 3) {
-            gdImageSetPixel(ip, x / 3, y, gdImageColorResolve(ip, src[x], src[x + 1], src[x + 2]));
+    if (outputs_in_memory(mc))
+        return archive_save_data(mc, outname, data, size);
+
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t outname_w[FILENAME_MAX];
+    UTF8_2_WC(outname_w, outname, FILENAME_MAX);
+#else
+    char *outname_w = outname;
+#endif
+
+    FILE *fp = _tfopen(outname_w, _TEXT("wb"));
+    if (fp != NULL) {
+        int written = fwrite(data, 1, size, fp) == size;
+
+        if (fclose(fp) == 0 && written) {
+            artefact_add(mc, outname, size);
+            return 0;
         }
-        src += width * 3;
+        else
+            av_log(NULL, AV_LOG_ERROR, "\n%s: writing output image '%s' failed: %s\n", mc->argv0, outname, strerror(errno));
     }
+    else
+        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output image '%s' failed: %s\n", mc->argv0, outname, strerror(errno));
+
+    return -1;
+}
+
+/*
+encode jpeg, webp or avif with quality in memory; data must be freed with gdFree()
+return NULL if failed or the format has no quality
+*/
+void *image_ptr_quality(gdImagePtr ip, const char *image_extension, int quality, int *size)
+{
+    if (NULL == image_extension || strcasecmp(image_extension, IMAGE_EXTENSION_JPG) == 0)
+        return gdImageJpegPtr(ip, size, quality);
+#ifdef MTN_WITH_WEBP
+    if (strcasecmp(image_extension, IMAGE_EXTENSION_WEBP) == 0)
+        return gdImageWebpPtrEx(ip, size, quality);
+#endif
+#ifdef MTN_WITH_AVIF
+    if (strcasecmp(image_extension, IMAGE_EXTENSION_AVIF) == 0)
+        return gdImageAvifPtrEx(ip, size, quality, -1);
+#endif
+    return NULL;
 }
 
+/*
+save image with the highest quality <= max_quality that fits in --target-size
+qualities are bisected on in-memory encodes; only the chosen one is written.
+if nothing fits, the smallest encode is saved.
+return 0 if image is saved; *quality is the quality used
+*/
+int save_image_target_size(MtnContext *mc, gdImagePtr ip, char *outname, int max_quality, int *quality)
+{
+    const int target = mc->_target_size * 1024;
+    char *image_extension = strrchr(outname, '.');
+    void *best = NULL, *data;
+    int best_size = 0, best_q = 0, fits = 0, size, q;
+    int lo = TARGET_SIZE_MIN_QUALITY, hi = max_quality, tries = 0;
+
+    *quality = -1;
+    if (hi < lo)
+        hi = lo;
+
+    // try the requested quality first, then bisect below it
+    for (q = hi; lo <= hi && tries < TARGET_SIZE_MAX_TRIES; q = (lo + hi) / 2, tries++) {
+        data = image_ptr_quality(ip, image_extension, q, &size);
+        if (NULL == data) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: encoding output image '%s' failed\n", mc->argv0, outname);
+            gdFree(best);
+            return -1;
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "  quality %d: %d bytes\n", q, size);
+
+        if (size <= target) {
+            lo = q + 1;
+        } else {
+            hi = q - 1;
+            if (fits || (NULL != best && size >= best_size)) {
+                gdFree(data);
+                continue;
+            }
+        }
+        // keep the best fitting encode or the smallest one until something fits
+        gdFree(best);
+        best = data;
+        best_size = size;
+        best_q = q;
+        fits = size <= target;
+    }
+
+    if (!fits)
+        av_log(NULL, AV_LOG_WARNING, "  %s doesn't fit in %d KB even with quality %d (%d KB)\n",
+            outname, mc->_target_size, best_q, (best_size + 1023) / 1024);
+    av_log(NULL, AV_LOG_INFO, "  quality %d, %d KB after %d encode(s)\n", best_q, (best_size + 1023) / 1024, tries);
+
+    int ret = save_data(mc, outname, best, best_size);
+    gdFree(best);
+    if (0 == ret)
+        *quality = best_q;
+    return ret;
+}
 /* initialize
 */
 void thumb_new(thumbnail *ptn)
@@ -982,6 +1147,7 @@ void thumb_new(thumbnail *ptn)
     ptn->idx = -1;
     ptn->tiles_nr = 0;
     ptn->rotation = 0;
+    ptn->band_y = 0;
 
     // dynamic
     ptn->ppts = NULL;
@@ -1033,7 +1199,7 @@ void sprite_fit(pSprite s)
     }
 }
 
-void sprite_flush(pSprite s)
+void sprite_flush(MtnContext *mc, pSprite s)
 {
     if(s == NULL)
         return;
@@ -1042,10 +1208,10 @@ void sprite_flush(pSprite s)
     {
         sprite_fit(s);
 
-        int buflen = snprintf(NULL, 0, "%s_vtt_%d%s", s->tn.filenamebase, s->curr_file_idx, gb_o_suffix) + sizeof(char);
+        int buflen = snprintf(NULL, 0, "%s_vtt_%d%s", s->tn.filenamebase, s->curr_file_idx, mc->o_suffix) + sizeof(char);
         char *outname = (char*)malloc(buflen);
-        snprintf(outname, buflen, "%s_vtt_%d%s", s->tn.filenamebase, s->curr_file_idx, gb_o_suffix);
-        save_image(s->ip, outname);
+        snprintf(outname, buflen, "%s_vtt_%d%s", s->tn.filenamebase, s->curr_file_idx, mc->o_suffix);
+        save_image(mc, s->ip, outname);
         free(outname);
 
         gdImageDestroy(s->ip);
@@ -1058,7 +1224,7 @@ void sprite_flush(pSprite s)
     }
 }
 
-void sprite_add_shot(pSprite s, gdImagePtr ip, int64_t pts)
+void sprite_add_shot(MtnContext *mc, pSprite s, gdImagePtr ip, int64_t pts)
 {
     int very_first_shot = (s->nr_of_shots==0 && s->curr_file_idx==0)? 1 : 0;
 
@@ -1073,7 +1239,7 @@ void sprite_add_shot(pSprite s, gdImagePtr ip, int64_t pts)
     int64_t pts_to =   pts + s->tn.step_t/2.0;
 
     if(s->curr_filename == NULL)
-        sprintf_realloc(&s->curr_filename, 0, "%s%s_vtt_%d%s", gb__webvtt_prefix, s->filenamebase, s->curr_file_idx, gb_o_suffix);
+        sprintf_realloc(&s->curr_filename, 0, "%s%s_vtt_%d%s", mc->_webvtt_prefix, s->filenamebase, s->curr_file_idx, mc->o_suffix);
 
     if(very_first_shot)
         format_pts(0, s->tn.time_base, time_from);
@@ -1100,10 +1266,10 @@ void sprite_add_shot(pSprite s, gdImagePtr ip, int64_t pts)
     s->nr_of_shots++;
 
     if(s->nr_of_shots >= s->columns * s->rows)
-        sprite_flush(s);
+        sprite_flush(mc, s);
 }
 
-int sprite_export_vtt(pSprite s)
+int sprite_export_vtt(MtnContext *mc, pSprite s)
 {
     if(s == NULL)
         return 0;
@@ -1111,6 +1277,9 @@ int sprite_export_vtt(pSprite s)
     char outname[FILENAME_MAX];
     sprintf(outname, "%s.vtt", s->tn.filenamebase);
 
+    if (outputs_in_memory(mc))
+        return archive_save_data(mc, outname, s->vtt_content, strlen(s->vtt_content));
+
 #if defined(WIN32) && defined(_UNICODE)
     wchar_t outname_w[FILENAME_MAX];
     UTF8_2_WC(outname_w, outname, FILENAME_MAX);
@@ -1122,17 +1291,19 @@ int sprite_export_vtt(pSprite s)
     if (fp != NULL) {
 
         if(fwrite(s->vtt_content, sizeof(char), strlen(s->vtt_content), fp) <= 0)
-            av_log(NULL, AV_LOG_ERROR, "\n%s: error writting to file '%s': %s\n", gb_argv0, outname_w, strerror(errno));
+            av_log(NULL, AV_LOG_ERROR, "\n%s: error writting to file '%s': %s\n", mc->argv0, outname_w, strerror(errno));
 
-        if(fclose(fp) == 0)
+        if(fclose(fp) == 0) {
+            artefact_add(mc, outname, -1);
             return 0;
+        }
         else
-            av_log(NULL, AV_LOG_ERROR, "\n%s: closing output file '%s' failed: %s\n", gb_argv0, outname_w, strerror(errno));
+            av_log(NULL, AV_LOG_ERROR, "\n%s: closing output file '%s' failed: %s\n", mc->argv0, outname_w, strerror(errno));
 
         return 0;
     }
     else
-        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output file '%s' failed: %s\n", gb_argv0, outname_w, strerror(errno));
+        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output file '%s' failed: %s\n", mc->argv0, outname_w, strerror(errno));
 
     return -1;
 }
@@ -1173,7 +1344,7 @@ void thumb_cleanup_dynamic(thumbnail *ptn)
 }
 
 /* returns blured shadow on success, NULL otherwise	*/
-gdImagePtr create_shadow_image(int background, int *INOUTradius, int width, int height)
+gdImagePtr create_shadow_image(MtnContext *mc, int background, int *INOUTradius, int width, int height)
 {
     gdImagePtr shadow;
     int shW, shH, radius=*INOUTradius;
@@ -1201,7 +1372,7 @@ gdImagePtr create_shadow_image(int background, int *INOUTradius, int width, int
 				{
 					gdImageDestroy(shadow);
 					av_log(NULL, AV_LOG_INFO, "  thumbnail shadow radius: %dpx %s", radius, NEWLINE);
-					if(gb_g_gap < shadowOffset)
+					if(mc->g_gap < shadowOffset)
 						av_log(NULL, AV_LOG_INFO, "  thumbnail shadow might be invisible. Consider increase gap between individual shots (-g %d).%s", shadowOffset, NEWLINE);
 					return blurredShadow;
 				}
@@ -1229,14 +1400,15 @@ add shot
 because ptn->idx is the last index, this function assumes that shots will be added
 in increasing order.
 */
-void thumb_add_shot(thumbnail *ptn, gdImagePtr ip, gdImagePtr thumbShadowIm, int idx, int64_t pts)
+void thumb_add_shot(MtnContext *mc, thumbnail *ptn, gdImagePtr ip, gdImagePtr thumbShadowIm, int idx, int64_t pts)
 {
-    int dstX = idx%ptn->column * (ptn->shot_width_out+gb_g_gap) + gb_g_gap + ptn->center_gap;
-    int dstY = idx/ptn->column * (ptn->shot_height_out+gb_g_gap) + gb_g_gap
-        + ((3 == gb_L_info_location || 4 == gb_L_info_location) ? ptn->txt_height : 0);
+    int dstX = idx%ptn->column * (ptn->shot_width_out+mc->g_gap) + mc->g_gap + ptn->center_gap;
+    int dstY = idx/ptn->column * (ptn->shot_height_out+mc->g_gap) + mc->g_gap
+        + ((3 == mc->L_info_location || 4 == mc->L_info_location) ? ptn->txt_height : 0)
+        - ptn->band_y;
 
-    if(gb__shadow > 0 && thumbShadowIm!=NULL)
-		gdImageCopy(ptn->out_ip, thumbShadowIm, dstX+gb__shadow+1, dstY+gb__shadow+1, 0, 0, gdImageSX(thumbShadowIm), gdImageSY(thumbShadowIm));
+    if(mc->_shadow > 0 && thumbShadowIm!=NULL)
+		gdImageCopy(ptn->out_ip, thumbShadowIm, dstX+mc->_shadow+1, dstY+mc->_shadow+1, 0, 0, gdImageSX(thumbShadowIm), gdImageSY(thumbShadowIm));
 
     gdImageCopy(ptn->out_ip, ip, dstX, dstY, 0, 0, ptn->shot_width_out, ptn->shot_height_out);
     ptn->idx = idx;
@@ -1245,169 +1417,65 @@ void thumb_add_shot(thumbnail *ptn, gdImagePtr ip, gdImagePtr thumbShadowIm, int
 }
 
 /*
-perform convolution on pFrame and store result in ip
-pFrame must be a AV_PIX_FMT_RGB24 frame
-ip must be of the same size as pFrame
-begin = upper left, end = lower right
-filter should be a 2-dimensional but since we cant pass it without knowning the size, we'll use 1 dimension
-modified from:
-http://cvs.php.net/viewvc.cgi/php-src/ext/gd/libgd/gd.c?revision=1.111&view=markup
+open a page of streamed output image
 */
-void FrameRGB_convolution(AVFrame *pFrame, int width, int height,
-    float *filter, int filter_size, float filter_div, float offset,
-    gdImagePtr ip, int xbegin, int ybegin, int xend, int yend)
-{
-
-    int x, y, i, j;
-    float new_r, new_g, new_b;
-    uint8_t *src = pFrame->data[0];
-
-    for (y=ybegin; y<=yend; y++) {
-        for(x=xbegin; x<=xend; x++) {
-            new_r = new_g = new_b = 0;
-            //float grey = 0;
-
-            for (j=0; j<filter_size; j++) {
-                int yv = MIN(MAX(y - filter_size/2 + j, 0), height - 1);
-                for (i=0; i<filter_size; i++) {
-                    int xv = MIN(MAX(x - filter_size/2 + i, 0), width - 1);
-                    int pos = yv*width*3 + xv*3;
-                    new_r += src[pos]   * filter[j * filter_size + i];
-                    new_g += src[pos+1] * filter[j * filter_size + i];
-                    new_b += src[pos+2] * filter[j * filter_size + i];
-                    //grey += (src[pos] + src[pos+1] + src[pos+2])/3 * filter[j * filter_size + i];
-                }
-            }
-
-            new_r = (new_r/filter_div)+offset;
-            new_g = (new_g/filter_div)+offset;
-            new_b = (new_b/filter_div)+offset;
-            //grey = (grey/filter_div)+offset;
+FILE *stream_open_page(void *opaque, const char *filename)
+{
+    MtnContext *mc = opaque;
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t filename_w[FILENAME_MAX];
+    UTF8_2_WC(filename_w, filename, FILENAME_MAX);
+#else
+    const char *filename_w = filename;
+#endif
 
-            new_r = (new_r > 255.0f)? 255.0f : ((new_r < 0.0f)? 0.0f:new_r);
-            new_g = (new_g > 255.0f)? 255.0f : ((new_g < 0.0f)? 0.0f:new_g);
-            new_b = (new_b > 255.0f)? 255.0f : ((new_b < 0.0f)? 0.0f:new_b);
-            //grey = (grey > 255.0f)? 255.0f : ((grey < 0.0f)? 0.0f:grey);
+    FILE *fp = _tfopen(filename_w, _TEXT("wb"));
+    if (NULL == fp)
+        av_log(NULL, AV_LOG_ERROR, "  creating output image '%s' failed: %s\n", filename, strerror(errno));
+    else
+        artefact_remember(mc, filename); // --json-events reports pages when they are complete
 
-            gdImageSetPixel(ip, x, y, gdImageColorResolve(ip, (int)new_r, (int)new_g, (int)new_b));
-            //gdImageSetPixel(ip, x, y, gdTrueColor((int)new_r, (int)new_g, (int)new_b));
-            //gdImageSetPixel(ip, x, y, gdTrueColor((int)grey, (int)grey, (int)grey));
-        }
-    }
+    return fp;
 }
 
-/* begin = upper left, end = lower right
+/*
+remove pages written so far
 */
-float cmp_edge(gdImagePtr ip, int xbegin, int ybegin, int xend, int yend)
-{
-#define CMP_EDGE 208
-    int count = 0;
-    int i, j;
-    for (j = ybegin; j <= yend; j++) {
-        for (i = xbegin; i <= xend; i++) {
-            int pixel = gdImageGetPixel(ip, i, j);
-            if (gdImageRed(ip, pixel) >= CMP_EDGE
-                && gdImageGreen(ip, pixel) >= CMP_EDGE
-                && gdImageBlue(ip, pixel) >= CMP_EDGE) {
-                count++;
-            }
-        }
-    }
-    return (float)count / (yend - ybegin + 1) / (xend - xbegin + 1);
-}
-
-int is_edge(float *edge, float edge_found)
+void stream_unlink_pages(const StreamWriter *sw)
 {
-    if (gb_V) { // DEBUG
-        return 1;
-    }
-    int count = 0;
-    int i;
-    for (i = 0; i < EDGE_PARTS; i++) {
-        if (edge[i] >= edge_found) {
-            count++;
-        }
-    }
-    if (count >= 2) {
-        return count;
+    int page;
+    for (page = 0; page <= sw->page; page++) {
+        char filename[UTF8_FILENAME_SIZE];
+        stream_writer_page_name(sw, page, filename, sizeof(filename));
+#if defined(WIN32) && defined(_UNICODE)
+        wchar_t filename_w[FILENAME_MAX];
+        UTF8_2_WC(filename_w, filename, FILENAME_MAX);
+#else
+        char *filename_w = filename;
+#endif
+        _tunlink(filename_w);
     }
-    return 0;
 }
 
 /*
-pFrame must be an AV_PIX_FMT_RGB24 frame
-http://student.kuleuven.be/~m0216922/CG/
-http://www.pages.drexel.edu/~weg22/edge.html
-http://student.kuleuven.be/~m0216922/CG/filtering.html
-http://cvs.php.net/viewvc.cgi/php-src/ext/gd/libgd/gd.c?revision=1.111&view=markup
+write the current row band (shots + gap below them) and clear it for the next row
+return 0 ok, -1 error
 */
-gdImagePtr detect_edge(AVFrame *pFrame, const thumbnail* const tn, float *edge, float edge_found)
-{
-    int width =  tn->shot_width_in;
-    int height = tn->shot_height_in;
-    static float filter[] = {
-         0,-1, 0,
-        -1, 4,-1,
-         0,-1, 0
-    };
-#define FILTER_SIZE 3 // 3x3
-#define FILTER_DIV 1
-#define OFFSET 128
-    static int init_filter = 0; // FIXME
-    if (0 == init_filter) {
-        init_filter = 1;
-        filter[1] = -gb_D_edge/4.0f;
-        filter[3] = -gb_D_edge/4.0f;
-        filter[4] =  gb_D_edge;
-        filter[5] = -gb_D_edge/4.0f;
-        filter[7] = -gb_D_edge/4.0f;
-    }
-
-    gdImagePtr ip = gdImageCreateTrueColor(width, height);
-    if (NULL == ip) {
-        av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed%s", NEWLINE);
-        return NULL;
-    }
-    if (gb_v_verbose > 0) {
-        FrameRGB_2_gdImage(pFrame, ip, width, height);
-    }
+int stream_write_row(MtnContext *mc, StreamWriter *sw, thumbnail *ptn)
+{
+    const int band_height = ptn->shot_height_out + mc->g_gap;
 
-    int i;
-    for (i = 0; i < EDGE_PARTS; i++) {
-        edge[i] = 1;
-    }
-
-    // check 6 parts to speed this up & to improve correctness
-    int y_size = height/10;
-    int ya = y_size*2;
-    int yb = y_size*4;
-    int yc = y_size*6;
-    int x_crop = width/8;
-
-    // only find edge if neccessary
-    int parts[EDGE_PARTS][4] = {
-        //xbegin, ybegin, xend, yend
-        {x_crop, ya, width/2, ya+y_size},
-        {width/2+1, ya+y_size, width-x_crop, ya+2*y_size},
-        {x_crop, yb, width/2, yb+y_size},
-        {width/2+1, yb+y_size, width-x_crop, yb+2*y_size},
-        {x_crop, yc, width/2, yc+y_size},
-        {width/2+1, yc+y_size, width-x_crop, yc+2*y_size},
-    };
-    int count = 0;
-    for (i = 0; i < EDGE_PARTS && count < 2; i++) {
-        FrameRGB_convolution(pFrame, width, height, filter, FILTER_SIZE, FILTER_DIV, OFFSET,
-            ip, parts[i][0], parts[i][1], parts[i][2], parts[i][3]);
-        edge[i] = cmp_edge(ip, parts[i][0], parts[i][1], parts[i][2], parts[i][3]);
-        if (edge[i] >= edge_found) {
-            count++;
-        }
-    }
-    return ip;
+    if (0 != stream_writer_write(sw, ptn->out_ip, band_height))
+        return -1;
+
+    int background = gdImageColorResolve(ptn->out_ip, mc->k_bcolor.r, mc->k_bcolor.g, mc->k_bcolor.b);
+    gdImageFilledRectangle(ptn->out_ip, 0, 0, ptn->img_width, band_height, background);
+    ptn->band_y += band_height;
+    return 0;
 }
 
 int
-save_AVFrame(
+save_AVFrame(MtnContext *mc, 
     const AVFrame* const pFrame,
     int src_width,
     int src_height,
@@ -1454,7 +1522,7 @@ save_AVFrame(
     }
     FrameRGB_2_gdImage(pFrameRGB, ip, dst_width, dst_height);
 
-    int ret = save_image(ip, filename);
+    int ret = save_image(mc, ip, filename);
     if (0 != ret) {
         av_log(NULL, AV_LOG_ERROR, "  save_image failed: %s\n", filename);
         goto cleanup;
@@ -1477,127 +1545,24 @@ cleanup:
 
 
 
-/* av_pkt_dump_log()?? */
-void dump_packet(AVPacket *p, AVStream * ps)
-{
-    /* from av_read_frame()
-    pkt->pts, pkt->dts and pkt->duration are always set to correct values in
-    AVStream.timebase units (and guessed if the format cannot provided them).
-    pkt->pts can be AV_NOPTS_VALUE if the video format has B frames, so it is
-    better to rely on pkt->dts if you do not decompress the payload.
-    */
-    av_log(NULL, AV_LOG_VERBOSE, "***dump_packet: pos:%"PRId64"%s", p->pos, NEWLINE);
-    av_log(NULL, AV_LOG_VERBOSE, "pts tb: %"PRId64", dts tb: %"PRId64", duration tb: %"PRId64"%s",
-        p->pts, p->dts, p->duration, NEWLINE);
-    av_log(NULL, AV_LOG_VERBOSE, "pts s: %.2f, dts s: %.2f, duration s: %.2f%s",
-        p->pts * av_q2d(ps->time_base), p->dts * av_q2d(ps->time_base),
-        p->duration * av_q2d(ps->time_base), NEWLINE); // pts can be AV_NOPTS_VALUE
-}
-
-void dump_codec_context(AVCodecContext * p)
-{
-    if(p->codec == 0)
-        av_log(NULL, AV_LOG_VERBOSE, "***dump_codec_context: codec = ?0?\n");
-    else
-        av_log(NULL, AV_LOG_VERBOSE, "***dump_codec_context: name: %s, time_base: %d / %d, color_primaries = %s, colorspace = %s\n",
-            p->codec->name,
-            p->time_base.num, p->time_base.den,
-            av_color_primaries_name(p->color_primaries),
-            av_color_space_name(p->colorspace)
-            );
-    #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(60, 2, 0)
-    av_log(NULL, AV_LOG_VERBOSE, "frame_number: %d, width: %d, height: %d, sample_aspect_ratio %d/%d%s\n",
-        p->frame_number, p->width, p->height, p->sample_aspect_ratio.num, p->sample_aspect_ratio.den,
-        (0 == p->sample_aspect_ratio.num) ? "" : "**a**");
-    #else
-    av_log(NULL, AV_LOG_VERBOSE, "frame_number: %"PRId64", width: %d, height: %d, sample_aspect_ratio %d/%d%s\n",
-        p->frame_num, p->width, p->height, p->sample_aspect_ratio.num, p->sample_aspect_ratio.den,
-        (0 == p->sample_aspect_ratio.num) ? "" : "**a**");
-    #endif
-}
-
 /*
-void dump_index_entries(AVStream * p)
+set scale source width & height (scaled_w and scaled_h)
+*/
+void calc_scale_src(int width, int height, AVRational ratio, int *scaled_w, int *scaled_h)
 {
-    int i;
-    double diff = 0;
-    for (i=0; i < p->nb_index_entries; i++) {
-        AVIndexEntry *e = p->index_entries + i;
-        double prev_ts = 0, cur_ts = 0;
-        cur_ts = e->timestamp * av_q2d(p->time_base);
-        //assert(cur_ts > 0);
-        diff += cur_ts - prev_ts;
-        if (i < 20) { // show only first 20
-            av_log(NULL, AV_LOG_VERBOSE, "    i: %2d, pos: %8"PRId64", timestamp tb: %6"PRId64", timestamp s: %6.2f, flags: %d, size: %6d, min_distance: %3d\n",
-                i, e->pos, e->timestamp, e->timestamp * av_q2d(p->time_base), e->flags, e->size, e->min_distance);
-        }
-        prev_ts = cur_ts;
+    // mplayer dont downscale horizontally. however, we'll always scale
+    // horizontally, up or down, which is the same as mpc's display and
+    // vlc's snapshot. this should make square pixel for both pal & ntsc.
+    *scaled_w = width;
+    *scaled_h = height;
+    if (0 != ratio.num) { // ratio is defined
+        assert(ratio.den != 0);
+        *scaled_w = av_q2d(ratio) * width + 0.5; // round nearest
     }
-    av_log(NULL, AV_LOG_VERBOSE, "  *** nb_index_entries: %d, avg. timestamp s diff: %.2f\n", p->nb_index_entries, diff / p->nb_index_entries);
 }
-*/
 
-//based on dump.c: static void dump_sidedata(void *ctx, AVStream *st, const char *indent)
-double get_stream_rotation(AVStream *st)
-{
-    double rotation = 0.0;
-
-#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(60, 15, 100)
-    int _nb_side_data = st->nb_side_data;
-    const AVPacketSideData *const _src_sd = st->side_data;
-#else
-    int _nb_side_data = st->codecpar->nb_coded_side_data;
-    const AVPacketSideData *const _src_sd = st->codecpar->coded_side_data;
-#endif
-
-    if (_nb_side_data)
-    {
-        int i;
-        for(i=0; i < _nb_side_data ; i++ )
-        {
-            AVPacketSideData sd = _src_sd[i];
-
-            if(sd.type == AV_PKT_DATA_DISPLAYMATRIX) {
-                rotation = av_display_rotation_get((int32_t *)sd.data);
-                break;
-            }
-        }
-    }
-
-    return rotation;
-}
-
-void dump_stream(AVStream * p)
-{
-    av_log(NULL, AV_LOG_VERBOSE, "***dump_stream, time_base: %d / %d\n",
-        p->time_base.num, p->time_base.den);
-    av_log(NULL, AV_LOG_VERBOSE, "start_time tb: %"PRId64", duration tb: %"PRId64", nb_frames: %"PRId64"\n",
-        p->start_time, p->duration, p->nb_frames);
-    // get funny results here. use format_context's.
-    av_log(NULL, AV_LOG_VERBOSE, "start_time s: %.2f, duration s: %.2f\n",
-        p->start_time * av_q2d(p->time_base),
-        p->duration * av_q2d(p->time_base)); // duration can be AV_NOPTS_VALUE
-    // field pts in AVStream is for encoding
-}
-
-/*
-set scale source width & height (scaled_w and scaled_h)
-*/
-void calc_scale_src(int width, int height, AVRational ratio, int *scaled_w, int *scaled_h)
-{
-    // mplayer dont downscale horizontally. however, we'll always scale
-    // horizontally, up or down, which is the same as mpc's display and
-    // vlc's snapshot. this should make square pixel for both pal & ntsc.
-    *scaled_w = width;
-    *scaled_h = height;
-    if (0 != ratio.num) { // ratio is defined
-        assert(ratio.den != 0);
-        *scaled_w = av_q2d(ratio) * width + 0.5; // round nearest
-    }
-}
-
-long
-get_bitrate_from_metadata(const AVDictionary *dict)
+long
+get_bitrate_from_metadata(const AVDictionary *dict)
 {
     if(av_dict_count(dict) > 0)
     {
@@ -1623,30 +1588,10 @@ get_bitrate_from_metadata(const AVDictionary *dict)
     return 0;
 }
 
-AVCodecContext* get_codecContext_from_codecParams(AVCodecParameters* pCodecPar)
-{
-    AVCodecContext *pCodecContext;
-
-    pCodecContext = avcodec_alloc_context3(NULL);
-    if(!pCodecContext)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Couldn't alocate codec context %s", NEWLINE);
-        return NULL;
-    }
-
-    if(avcodec_parameters_to_context(pCodecContext, pCodecPar) <0 )
-    {
-        avcodec_free_context(&pCodecContext);
-        return NULL;
-    }
-
-    return pCodecContext;
-}
-
 /*
 modified from libavformat's dump_format
 */
-void get_stream_info_type(AVFormatContext *ic, enum AVMediaType type, char *buf, size_t buf_size, AVRational sample_aspect_ratio)
+void get_stream_info_type(MtnContext *mc, AVFormatContext *ic, enum AVMediaType type, char *buf, size_t buf_size, AVRational sample_aspect_ratio)
 {
     char sub_buf[1024] = {'\0',};
     unsigned int i;
@@ -1686,7 +1631,7 @@ void get_stream_info_type(AVFormatContext *ic, enum AVMediaType type, char *buf,
 
         strncat(buf, NEWLINE, buf_size - strlen(buf) - 1);
 
-        if (gb_v_verbose > 0) {
+        if (mc->v_verbose > 0) {
             snprintf(buf + strlen(buf), buf_size - strlen(buf), "Stream %d", i);
             if (flags & AVFMT_SHOW_IDS) {
                 snprintf(buf + strlen(buf), buf_size - strlen(buf), "[0x%x]", st->id);
@@ -1788,7 +1733,7 @@ void get_stream_info_type(AVFormatContext *ic, enum AVMediaType type, char *buf,
  * @param buf_size Size of output buffer
  * @return Pointer to buf
  */
-char *get_stream_info(AVFormatContext *ic, char *url, int strip_path, 
+char *get_stream_info(MtnContext *mc, AVFormatContext *ic, char *url, int strip_path, 
                       AVRational sample_aspect_ratio, char *buf, size_t buf_size)
 {
     int duration = -1;
@@ -1804,7 +1749,7 @@ char *get_stream_info(AVFormatContext *ic, char *url, int strip_path,
     /* file format
     sprintf(buf + strlen(buf), " (%s)", ic->iformat->name);*/
 
-    if(gb_H_human_filesize)
+    if(mc->H_human_filesize)
         /* File size only in MiB, GiB, ... */
         snprintf(buf + strlen(buf), buf_size - strlen(buf), "%sSize: %s", NEWLINE, format_size(file_size, size_buf, sizeof(size_buf)));
     else
@@ -1845,15 +1790,15 @@ char *get_stream_info(AVFormatContext *ic, char *url, int strip_path,
         strncat(buf, ", bitrate: N/A", buf_size - strlen(buf) - 1);
     }
 
-    get_stream_info_type(ic, AVMEDIA_TYPE_AUDIO,   buf, buf_size, sample_aspect_ratio);
-    get_stream_info_type(ic, AVMEDIA_TYPE_VIDEO,   buf, buf_size, sample_aspect_ratio);
-    get_stream_info_type(ic, AVMEDIA_TYPE_SUBTITLE,buf, buf_size, sample_aspect_ratio);
+    get_stream_info_type(mc, ic, AVMEDIA_TYPE_AUDIO,   buf, buf_size, sample_aspect_ratio);
+    get_stream_info_type(mc, ic, AVMEDIA_TYPE_VIDEO,   buf, buf_size, sample_aspect_ratio);
+    get_stream_info_type(mc, ic, AVMEDIA_TYPE_SUBTITLE,buf, buf_size, sample_aspect_ratio);
 
     //strfmon(buf + strlen(buf), 100, "strfmon: %!i\n", avio_size(ic->pb));
     return buf;
 }
 
-void dump_format_context(AVFormatContext *p, int __attribute__((unused)) index, char *url, int __attribute__((unused)) is_output)
+void dump_format_context(MtnContext *mc, AVFormatContext *p, int __attribute__((unused)) index, char *url, int __attribute__((unused)) is_output)
 {
     //av_log(NULL, AV_LOG_ERROR, "\n");
     av_log(NULL, AV_LOG_VERBOSE, "***dump_format_context, name: %s, long_name: %s\n",
@@ -1863,7 +1808,7 @@ void dump_format_context(AVFormatContext *p, int __attribute__((unused)) index,
     // dont show scaling info at this time because we dont have the proper sample_aspect_ratio
     {
         char info_buf[4096];
-        av_log(NULL, AV_LOG_INFO, "%s%s", get_stream_info(p, url, 0, GB_A_RATIO, info_buf, sizeof(info_buf)), NEWLINE);
+        av_log(NULL, AV_LOG_INFO, "%s%s", get_stream_info(mc, p, url, 0, GB_A_RATIO, info_buf, sizeof(info_buf)), NEWLINE);
     }
 
     av_log(NULL, AV_LOG_VERBOSE, "start_time av: %"PRId64", duration av: %"PRId64"\n",
@@ -1908,367 +1853,6 @@ void dump_frame(AVFrame *f)
     av_log(NULL, AV_LOG_INFO, "******************\n");
 }
 
-/*
-*/
-double uint8_cmp(uint8_t *pa, uint8_t *pb, uint8_t *pc, int n)
-{
-    int i, same = 0;
-    for (i=0; i<n; i++) {
-        int diffab = pa[i] - pb[i];
-        int diffac = pa[i] - pc[i];
-        int diffbc = pb[i] - pb[i];
-
-        if ((diffab > -20) && (diffab < 20) &&
-            (diffac > -20) && (diffac < 20) &&
-            (diffbc > -20) && (diffbc < 20)) {
-            same++;
-        }
-    }
-    return (double)same / n;
-}
-
-/*
-return sameness of the frame; 1 means the frame is the same in all directions, i.e. blank
-pFrame must be an AV_PIX_FMT_RGB24 frame
-*/
-double blank_frame(AVFrame *pFrame, int width, int height)
-{
-    uint8_t *src = pFrame->data[0];
-    int hor_size = height/11 * width * 3;
-    uint8_t *pa = src+hor_size*2;
-    uint8_t *pb = src+hor_size*5;
-    uint8_t *pc = src+hor_size*8;
-    double same = .4*uint8_cmp(pa, pb, pc, hor_size);
-    int ver_size = hor_size/3;
-    same += .6/3*uint8_cmp(pa, pa + ver_size, pa + ver_size*2, ver_size);
-    same += .6/3*uint8_cmp(pb, pb + ver_size, pb + ver_size*2, ver_size);
-    same += .6/3*uint8_cmp(pc, pc + ver_size, pc + ver_size*2, ver_size);
-    return same;
-}
-
-/* global */
-uint64_t gb_video_pkt_pts = AV_NOPTS_VALUE;
-
-
-/**
- * Convert an error code into a text message.
- * @param error Error code to be converted
- * @return Corresponding error text (not thread-safe)
- */
-static const char *get_error_text(const int error)
-{
-    static char error_buffer[255];
-    av_strerror(error, error_buffer, sizeof(error_buffer));
-    return error_buffer;
-}
-
-int get_frame_from_packet(AVCodecContext *pCodecCtx,
-                      AVPacket       *pkt,
-                      AVFrame        *pFrame)
-{
-    int fret;
-
-    /// send packet for decoding
-    fret = avcodec_send_packet(pCodecCtx, pkt);
-
-    // ignore invalid packets and continue
-    if(fret == AVERROR_INVALIDDATA ||
-       fret == -1 /* Operation not permitted */
-    )
-        return AVERROR(EAGAIN);
-
-    if (fret < 0) {
-        av_log(NULL, AV_LOG_ERROR,  "Error sending a packet for decoding - %s\n", get_error_text(fret));
-        exit(EXIT_ERROR);
-    }
-
-    fret = avcodec_receive_frame(pCodecCtx, pFrame);
-
-    if (fret == AVERROR(EAGAIN))
-        return fret;
-
-    if(fret == AVERROR_EOF)
-    {
-        av_log(NULL, AV_LOG_ERROR, "No more frames: recieved AVERROR_EOF\n");
-        return -1;
-    }
-    if (fret == AVERROR(EINVAL))
-    {
-        av_log(NULL, AV_LOG_ERROR, "Codec not opened: recieved AVERROR(EINVAL)\n");
-        return -1;
-    }
-    if (fret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Error during decoding packet\n");
-        exit(EXIT_ERROR);
-    }
-#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 34, 100)
-    av_log(NULL, AV_LOG_VERBOSE, "Got picture from frame pts=%"PRId64"\n", pFrame->pts);
-#else
-    av_log(NULL, AV_LOG_VERBOSE, "Got picture, Frame pkt_pts=%"PRId64"\n", pFrame->pkt_pts);
-#endif
-    return 0;
-}
-
-/**
- * @brief read packet and decode it into a frame
- * @param pFormatCtx - input
- * @param pCodecCtx - input
- * @param pFrame - decoded video frame
- * @param video_index - input
- * @param pPts - on succes it is set to packet's pts
- * @return >0 if can read packet(s) & decode a frame
- *          0 if end of file
- *         <0 if error
- */
-int
-video_decode_next_frame(AVFormatContext *pFormatCtx,
-       AVCodecContext  *pCodecCtx,
-       AVFrame         *pFrame,     /* OUTPUT */
-       int              video_index,
-       int64_t         *pPts        /* OUTPUT */
-       )
-{
-    assert(pFrame);
-    assert(pPts);
-
-    AVPacket*   pkt;
-    AVStream*   pStream = pFormatCtx->streams[video_index];
-    int         fret;       //function return code
-    int         got_picture=0;
-    uint64_t    pkt_without_pic=0;
-    int         decoded_frame = 0;
-
-    static int    run = 0;               // # of times read_and_decode has been called for a file
-    static double avg_decoded_frame = 0; // average # of decoded frame
-
-    pkt = av_packet_alloc();
-    if (!pkt)
-    {
-        av_log(NULL, AV_LOG_ERROR ,"Could not allocate packet\n");
-        return -1;
-    }
-
-    while(got_picture == 0)
-    {
-        /// read packet
-        do
-        {
-            av_packet_unref(pkt);
-            fret = av_read_frame(pFormatCtx, pkt);
-            if(fret != 0)
-            {
-                av_log(NULL, AV_LOG_VERBOSE, "av_read_frame returned %d - considering as the end of file\n", fret);
-                av_log(NULL, AV_LOG_ERROR, "Error reading from video file\n");
-                return 0;
-            }
-        } while(pkt->stream_index != video_index);
-
-        pkt_without_pic++;
-
-        dump_packet(pkt, pStream);
-
-        // Save global pts to be stored in pFrame in first call
-        av_log(NULL, AV_LOG_VERBOSE, "*saving gb_video_pkt_pts: %"PRId64"\n", pkt->pts);
-        gb_video_pkt_pts = pkt->pts;
-
-        /// try to decode packet
-        fret = get_frame_from_packet(pCodecCtx, pkt, pFrame);
-
-        // need more video packet(s)
-        if(fret == AVERROR(EAGAIN))
-        {
-            if(pkt_without_pic%50 == 0)
-                av_log(NULL, AV_LOG_INFO, "  no picture in %"PRId64" packets\n", pkt_without_pic);
-
-            if (pkt_without_pic >= MAX_PACKETS_WITHOUT_PICTURE) {
-                av_log(NULL, AV_LOG_ERROR, "  * av_read_frame couldn't decode picture in %d packets\n", MAX_PACKETS_WITHOUT_PICTURE);
-                av_packet_unref(pkt);
-                av_packet_free(&pkt);
-                return -1;
-            }
-            continue;
-        }
-
-        /// decoded frame
-        if(fret == 0)
-        {
-            got_picture=1;
-            pkt_without_pic=0;
-            decoded_frame++;
-
-            av_log(NULL, AV_LOG_VERBOSE, "*get_videoframe got frame: key_frame: %d, pict_type: %c\n",
-                           is_key_frame(pFrame), av_get_picture_type_char(pFrame->pict_type));
-
-            if (0 == decoded_frame%200) {
-                av_log(NULL, AV_LOG_INFO, "  picture not decoded in %d frames\n", decoded_frame);
-            }
-        }
-        // error decoding packet
-        else
-        {
-            av_packet_unref(pkt);
-            av_packet_free(&pkt);
-            return -1;
-        }
-    }  // end of while
-
-    av_packet_unref(pkt);
-    av_packet_free(&pkt);
-
-    run++;
-    avg_decoded_frame = (avg_decoded_frame*(run-1) + decoded_frame) / run;
-
-
-    av_log(NULL, AV_LOG_VERBOSE, "*****got picture, repeat_pict: %d%s, key_frame: %d, pict_type: %c\n",
-        pFrame->repeat_pict,(pFrame->repeat_pict > 0) ? "**r**" : "", is_key_frame(pFrame), av_get_picture_type_char(pFrame->pict_type));
-
-
-
-    dump_stream(pStream);
-    dump_codec_context(pCodecCtx);
-
-    *pPts = gb_video_pkt_pts;
-    return 1;
-}
-
-
-/* calculate timestamp to display to users
-*/
-double calc_time(int64_t timestamp, AVRational time_base, double start_time)
-{
-    // for files with start_time > 0, we need to subtract the start_time
-    // from timestamp. this should match the time display by MPC & VLC.
-    // however, for .vob files of dvds, after subtracting start_time
-    // each file will start with timestamp 0 instead of continuing from the previous file.
-
-    return av_rescale(timestamp, time_base.num, time_base.den) - start_time;
-}
-
-/*
-return the duration. guess when unknown.
-must be called after codec has been opened
-*/
-double guess_duration(AVFormatContext *pFormatCtx, int index,
-    AVCodecContext *pCodecCtx, AVFrame __attribute__((unused)) *pFrame)
-{
-    double duration = (double) pFormatCtx->duration / AV_TIME_BASE; // can be incorrect for .vob files
-    if (duration > 0) {
-        return duration;
-    }
-
-    AVStream *pStream = pFormatCtx->streams[index];
-    double guess;
-
-    // if stream bitrate is known we'll interpolate from file size.
-    // pFormatCtx->start_time would be incorrect for .vob file with multiple titles.
-    // pStream->start_time doesn't work either. so we'll need to disable timestamping.
-    assert(NULL != pStream && NULL != pCodecCtx);
-
-    int64_t file_size = avio_size(pFormatCtx->pb);
-
-//    if (pStream->codec->bit_rate > 0 && file_size > 0) {
-//        guess = 0.9 * file_size / (pStream->codec->bit_rate / 8);
-    if (pCodecCtx->bit_rate > 0 && file_size > 0) {
-        guess = 0.9 * file_size / (pCodecCtx->bit_rate / 8);
-        if (guess > 0) {
-            av_log(NULL, AV_LOG_ERROR, "  ** duration is unknown: %.2f; guessing: %.2f s from bit_rate\n", duration, guess);
-            return guess;
-        }
-    }
-
-    return -1;
-
-    // the following doesn't work.
-    /*
-    // we'll guess the duration by seeking to near the end of the file and
-    // decode a frame. the timestamp of that frame is the guess.
-    // things get more complicated for dvd's .vob files. each .vob file
-    // can contain more than 1 title. and each title will have its own pts.
-    // for example, 90% of a .vob might be for title 1 and the last 10%
-    // might be for title 2; seeking to near the end will end up getting
-    // title 2's pts. this problem cannot be solved if we just look at the
-    // .vob files. need to process other info outside .vob files too.
-    // as a result, the following will probably never work.
-    // .vob files weirdness will make our assumption to seek by byte incorrect too.
-    if (pFormatCtx->file_size <= 0) {
-        return -1;
-    }
-    int64_t byte_pos = 0.9 * pFormatCtx->file_size;
-    int ret = av_seek_frame(pFormatCtx, index, byte_pos, AVSEEK_FLAG_BYTE);
-    if (ret < 0) { // failed
-        return -1;
-    }
-    avcodec_flush_buffers(pCodecCtx);
-    int64_t pts;
-    ret = read_and_decode(pFormatCtx, index, pCodecCtx, pFrame, &pts, 0); // FIXME: key or not?
-    if (ret <= 0) { // end of file or error
-        av_log(NULL, AV_LOG_VERBOSE, "  read_and_decode during guessing duration failed\n");
-        return -1;
-    }
-    double start_time = (double) pFormatCtx->start_time / AV_TIME_BASE; // FIXME: can be unknown?
-    guess = calc_time(pts, pStream->time_base, start_time);
-    if (guess <= 0) {
-        return -1;
-    }
-    av_log(NULL, AV_LOG_ERROR, "  ** duration is unknown: %.2f; guessing: %.2f s.\n", duration, guess);
-
-    // seek back to 0 & flush buffer; FIXME: is 0 correct?
-    av_seek_frame(pFormatCtx, index, 0, AVSEEK_FLAG_BYTE); // ignore errors
-    avcodec_flush_buffers(pCodecCtx);
-
-    return guess;
-    */
-}
-
-/*
-try hard to seek
-assume flags can be either 0 or AVSEEK_FLAG_BACKWARD
-*/
-int really_seek(AVFormatContext *pFormatCtx, int index, int64_t timestamp, int flags, double duration)
-{
-    assert(flags == 0 || flags == AVSEEK_FLAG_BACKWARD);
-    int ret;
-
-    /* first try av_seek_frame */
-    ret = av_seek_frame(pFormatCtx, index, timestamp, flags);
-    if (ret >= 0) { // success
-        return ret;
-    }
-
-    /* then we try seeking to any (non key) frame AVSEEK_FLAG_ANY */
-    ret = av_seek_frame(pFormatCtx, index, timestamp, flags | AVSEEK_FLAG_ANY);
-    if (ret >= 0) { // success
-        av_log(NULL, AV_LOG_INFO, "AVSEEK_FLAG_ANY: timestamp: %"PRId64"\n", timestamp); // DEBUG
-        return ret;
-    }
-
-    /* and then we try seeking by byte (AVSEEK_FLAG_BYTE) */
-    // here we assume that the whole file has duration seconds.
-    // so we'll interpolate accordingly.
-    AVStream *pStream = pFormatCtx->streams[index];
-    double start_time = (double) pFormatCtx->start_time / AV_TIME_BASE; // in seconds
-    // if start_time is negative, we ignore it; FIXME: is this ok?
-    if (start_time < 0) {
-        start_time = 0;
-    }
-
-    // normally when seeking by timestamp we add start_time to timestamp
-    // before seeking, but seeking by byte we need to subtract the added start_time
-    timestamp -= start_time / av_q2d(pStream->time_base);
-    int64_t file_size = avio_size(pFormatCtx->pb);
-    if (file_size <= 0) {
-        return -1;
-    }
-    if (duration > 0) {
-        int64_t duration_tb = duration / av_q2d(pStream->time_base); // in time_base unit
-        int64_t byte_pos = av_rescale(timestamp, file_size, duration_tb);
-        av_log(NULL, AV_LOG_INFO, "AVSEEK_FLAG_BYTE: byte_pos: %"PRId64", timestamp: %"PRId64", file_size: %"PRId64", duration_tb: %"PRId64"\n", byte_pos, timestamp, file_size, duration_tb);
-        return av_seek_frame(pFormatCtx, index, byte_pos, AVSEEK_FLAG_BYTE);
-    }
-
-    return -1;
-}
-
 /*
 modify name so that it'll (hopefully) be unique
 by inserting a unique string before suffix.
@@ -2296,111 +1880,12 @@ int make_unique_name(char *name, char *suffix, int unum)
     return unum;
 }
 
-/*
- * find first usable video stream (not cover art)
- * based on av_find_default_stream_index()
- * returns
- *      >0: video index
- *      -1: can't find any usable video
- */
-int
-find_default_videostream_index(AVFormatContext *s, int user_selected_video_stream)
-{
-    int default_stream_idx = -1;
-    int cover_image;
-    int n_video_stream = 0;
-    unsigned int i;
-    AVStream *st;
-
-    for (i = 0; i < s->nb_streams; i++)
-    {
-        st = s->streams[i];
-        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-        {
-            cover_image = (st->disposition & AV_DISPOSITION_ATTACHED_PIC);
-
-            if(user_selected_video_stream)
-            {
-                if (++n_video_stream == user_selected_video_stream)
-                {
-                    default_stream_idx = i;
-                    av_log(NULL, AV_LOG_INFO, "Selecting video stream (-S): %d%s", user_selected_video_stream, NEWLINE);
-
-                    if(cover_image)
-                        av_log(NULL, AV_LOG_INFO, "  Warning: Selected video stream is \"cover art\"%s", NEWLINE);
-                    break;
-                }
-            }
-            else
-            {
-                if (!cover_image) {
-                    default_stream_idx = i;
-                    break;
-                }
-            }
-        }
-    }
-
-    return default_stream_idx;
-}
-
-void rotate_geometry(int *w, int *h, int angle)
-{
-    if(abs(angle) == 90)
-    {
-        int tmp = *w;
-        *w = *h;
-        *h = tmp;
-    }
-}
-
-gdImagePtr rotate_gdImage(gdImagePtr ip, int angle)
-{
-    if(angle == 0)
-        return ip;
-
-    int win = gdImageSX(ip);
-    int hin = gdImageSY(ip);
-    int wout = win;
-    int hout = hin;
-
-    if(abs(angle) == 90) {
-        wout = hin;
-        hout = win;
-    }
-
-    gdImagePtr ipr = gdImageCreateTrueColor(wout, hout);
-
-    int i,j;
-
-    for(i=0; i<win; i++)
-        for(j=0; j<hin; j++)
-            switch(angle)
-            {
-                case -180:
-                case +180:
-                    gdImageSetPixel(ipr, wout-i, hout-j, gdImageGetPixel(ip, i, j));
-                    break;
-                case   90:
-                    gdImageSetPixel(ipr, j,      hout-i, gdImageGetPixel(ip, i, j));
-                    break;
-                case  -90:
-                    gdImageSetPixel(ipr, wout-j, i,      gdImageGetPixel(ip, i, j));
-                    break;
-                default:
-                    gdImageDestroy(ipr);
-                    return ip;
-            }
-
-    gdImageDestroy(ip);
-    return ipr;
-}
-
 /*
  * Find and extract album art / cover image
+ * return 0 if saved or there is none
  */
-void
-save_cover_image(AVFormatContext *s, const char* cover_filename)
+int
+save_cover_image(MtnContext *mc, AVFormatContext *s, const char* cover_filename)
 {
     int cover_stream_idx = -1;
     unsigned int i;
@@ -2424,25 +1909,35 @@ save_cover_image(AVFormatContext *s, const char* cover_filename)
         {
             av_log(NULL, AV_LOG_VERBOSE, "Found cover art in stream index %d.%s", cover_stream_idx, NEWLINE);
 
+            if (outputs_in_memory(mc))
+                return archive_save_data(mc, (char*)cover_filename, pkt.data, pkt.size);
+
             FILE* image_file = fopen(cover_filename, "wb");
             if(image_file)
             {
-                fwrite(pkt.data, pkt.size, 1, image_file);
-                fclose(image_file);
+                size_t written = fwrite(pkt.data, pkt.size, 1, image_file);
+                if (0 == fclose(image_file) && 1 == written) {
+                    artefact_add(mc, cover_filename, pkt.size);
+                    return 0;
+                }
+                av_log(NULL, AV_LOG_ERROR, "Error writing file \"%s\"!%s", cover_filename, NEWLINE);
             }
             else
                 av_log(NULL, AV_LOG_ERROR, "Error opening file \"%s\" for writting!%s", cover_filename, NEWLINE);
+            return -1;
         }
     }
     else
         av_log(NULL, AV_LOG_VERBOSE, "No cover art found.%s", NEWLINE);
+    return 0;
 }
 
 void
-calculate_thumbnail(
+calculate_thumbnail(MtnContext *mc, 
         int req_step,
         int req_cols,
         int req_rows,
+        int req_width,
         int src_width,
         int src_height,
         int duration,
@@ -2471,24 +1966,25 @@ calculate_thumbnail(
     // make sure last row is full
     tn->step_t = duration / tn->time_base / (tn->column * tn->row + 1);
 
-    int full_width = tn->column * (src_width + gb_g_gap) + gb_g_gap;
-    if (gb_w_width > 0 && gb_w_width < full_width) {
-        tn->img_width = gb_w_width;
+    int full_width = tn->column * (src_width + mc->g_gap) + mc->g_gap;
+    if (req_width > 0 && req_width < full_width) {
+        tn->img_width = req_width;
     } else {
         tn->img_width = full_width;
     }
-    tn->shot_width_out = floor((tn->img_width - gb_g_gap*(tn->column+1)) / (double)tn->column + 0.5); // round nearest
+    tn->shot_width_out = floor((tn->img_width - mc->g_gap*(tn->column+1)) / (double)tn->column + 0.5); // round nearest
     tn->shot_width_out -= tn->shot_width_out%2; // floor to even number
     tn->shot_height_out = floor((double) src_height / src_width * tn->shot_width_out + 0.5); // round nearest
     tn->shot_height_out -= tn->shot_height_out%2; // floor to even number
-    tn->center_gap = (tn->img_width - gb_g_gap*(tn->column+1) - tn->shot_width_out * tn->column) / 2.0;
+    tn->center_gap = (tn->img_width - mc->g_gap*(tn->column+1) - tn->shot_width_out * tn->column) / 2.0;
 }
 
 void
-reduce_shots_to_fit_in(
+reduce_shots_to_fit_in(MtnContext *mc, 
     int req_step,
     int req_rows,
     int req_cols,
+    int req_width,
     int src_width,
     int src_height,
     int duration,
@@ -2505,13 +2001,13 @@ reduce_shots_to_fit_in(
     tn->shot_height_out = -99999;
 
     // reduce # of columns to meet required height
-    while (tn->shot_height_out < gb_h_height && reduced_columns > 0 && tn->shot_width_out != src_width) {
+    while (tn->shot_height_out < mc->h_height && reduced_columns > 0 && tn->shot_width_out != src_width) {
         reduced_columns--;
 
-        calculate_thumbnail(
-            req_step,
+        calculate_thumbnail(mc, req_step,
             reduced_columns,
             req_rows,
+            req_width,
             src_width,
             src_height,
             duration,
@@ -2531,10 +2027,10 @@ reduce_shots_to_fit_in(
 
         av_log(NULL, AV_LOG_INFO, "  movie is too short, reducing number of rows to %d%s", reduced_rows, NEWLINE);
 
-        calculate_thumbnail(
-            req_step,
+        calculate_thumbnail(mc, req_step,
             reduced_columns,
             reduced_rows,
+            req_width,
             src_width,
             src_height,
             duration,
@@ -2544,100 +2040,597 @@ reduce_shots_to_fit_in(
 }
 
 /*
- * return   0 ok
- *         -1 something went wrong
- *          1 some images are missing
- */
-int
-make_thumbnail(char *file)
+merge shot targets of the main output and of all profile outputs into one
+sorted list, so every frame is decoded only once.
+a profile's shot shares an existing target if it's within half of the smaller step.
+return # of targets, -1 if failed
+*/
+int shot_schedule_create(ShotTarget **psched, double start, const thumbnail *ptn, const ProfileOutput *pout, int nb_pout)
 {
-    int return_code = -1;
-    av_log(NULL, AV_LOG_VERBOSE, "make_thumbnail: %s\n", file);
-    static int nb_file = 0; /* Note: static for tracking file count across calls - used in dump_format_context */
-    nb_file++;
-    int idx = 0;
-    int thumb_nb = 0;
+    int nb = ptn->row * ptn->column;
+    int max = nb;
+    int i, k;
 
-    struct timeval tstart;
-    gettimeofday(&tstart, NULL);
+    for (i = 0; i < nb_pout; i++)
+        max += pout[i].tn.row * pout[i].tn.column;
 
-    thumbnail tn; // thumbnail data & info
-    thumb_new(&tn);
+    ShotTarget *sched = malloc(max * sizeof(*sched));
+    if (NULL == sched)
+        return -1;
 
-    pSprite sprite = NULL;
+    for (k = 0; k < nb; k++) {
+        sched[k].pts = ptn->step_t * (k+1) + start;
+        sched[k].step = ptn->step_t;
+        sched[k].outputs = 1;
+    }
 
-    gdImagePtr thumbShadowIm=NULL;
+    for (i = 0; i < nb_pout; i++) {
+        const thumbnail *t = &pout[i].tn;
+        const unsigned int bit = 1u << (i+1);
+        int pos = 0;
 
-    //int nb_shots = 0; // # of decoded shots (stat purposes)
+        for (k = 0; k < t->row * t->column; k++) {
+            int64_t pts = t->step_t * (k+1) + start;
+            int j, best = -1;
 
-    /* these are checked during cleaning up, must be NULL if not used */
-    AVFormatContext *pFormatCtx = NULL;
-    AVCodecContext *pCodecCtx = NULL;
-    AVFrame *pFrame = NULL;
-    AVFrame *pFrameRGB = NULL;
-    uint8_t *rgb_buffer = NULL;
-    struct SwsContext *pSwsCtx = NULL;
-    tn.out_ip = NULL;
-    //FILE *out_fp = NULL;
-    FILE *info_fp = NULL;
-    gdImagePtr ip = NULL;
-    const char *codec_color_primaries = NULL;
-    int filter_color_primaries_match = 1;
+            while (pos < nb && sched[pos].pts < pts)
+                pos++;
 
-    int t_timestamp = gb_t_timestamp; // local timestamp; can be turned off; 0 = off
-    int ret;
+            // nearest of the two neighbours
+            for (j = pos-1; j <= pos; j++) {
+                if (j < 0 || j >= nb || (sched[j].outputs & bit))
+                    continue;
+                int64_t diff = llabs(sched[j].pts - pts);
+                if (diff <= MIN(sched[j].step, t->step_t) / 2
+                    && (best < 0 || diff < llabs(sched[best].pts - pts)))
+                    best = j;
+            }
 
-    av_log(NULL, AV_LOG_INFO, "\n");
+            if (best >= 0) {
+                sched[best].outputs |= bit;
+                continue;
+            }
 
-    // output filenames
-    {
-        char *extpos;
-        char *filenamestartpos = NULL;
-        char filenamebase[UTF8_FILENAME_SIZE] = {'\0',};
+            memmove(&sched[pos+1], &sched[pos], (nb - pos) * sizeof(*sched));
+            sched[pos].pts = pts;
+            sched[pos].step = t->step_t;
+            sched[pos].outputs = bit;
+            nb++;
+        }
+    }
 
-        if (gb_O_outdir != NULL && strlen(gb_O_outdir) > 0) {
-            strcpy_va(filenamebase, 3, gb_O_outdir, FOLDER_SEPARATOR, path_2_file(file));
-        } else {
-            strcpy(filenamebase, file);
+    *psched = sched;
+    return nb;
+}
+
+void profile_output_cleanup(ProfileOutput *po)
+{
+    if (NULL != po->tn.out_ip)
+        gdImageDestroy(po->tn.out_ip);
+    if (NULL != po->shadow_ip)
+        gdImageDestroy(po->shadow_ip);
+    sws_freeContext(po->sws);
+    if (NULL != po->rgb_buffer)
+        av_free(po->rgb_buffer);
+    if (NULL != po->frame_rgb)
+        av_free(po->frame_rgb);
+    thumb_cleanup_dynamic(&po->tn);
+
+    po->tn.out_ip = NULL;
+    po->shadow_ip = NULL;
+    po->sws = NULL;
+    po->rgb_buffer = NULL;
+    po->frame_rgb = NULL;
+}
+
+/*
+prepare profile output; geometry is computed the same way as for the main output
+return 0 ok, -1 if the profile can't be created for this movie
+*/
+int profile_output_init(MtnContext *mc, ProfileOutput *po, const Profile *p, const thumbnail *main_tn,
+    int src_width, int src_height, double duration,
+    char *all_text, int info_text_padding)
+{
+    thumbnail *ptn = &po->tn;
+
+    thumb_new(ptn);
+    po->opt = p;
+    po->quality = (PROFILE_INHERIT != p->j_quality) ? p->j_quality : mc->j_quality;
+    ptn->time_base = main_tn->time_base;
+    ptn->rotation = main_tn->rotation;
+
+    reduce_shots_to_fit_in(mc, (PROFILE_INHERIT != p->s_step)   ? p->s_step   : mc->s_step,
+        (PROFILE_INHERIT != p->r_row)    ? p->r_row    : mc->r_row,
+        (PROFILE_INHERIT != p->c_column) ? p->c_column : mc->c_column,
+        (PROFILE_INHERIT != p->w_width)  ? p->w_width  : mc->w_width,
+        src_width,
+        src_height,
+        duration,
+        ptn
+    );
+
+    if (ptn->column <= 0 || ptn->step_t <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: thumbnail too small or movie too short; skipped\n", p->o_suffix);
+        return -1;
+    }
+
+    if(abs(ptn->rotation) == 90){
+        ptn->shot_height_in = ptn->shot_width_out;
+        ptn->shot_width_in  = ptn->shot_height_out;
+    } else {
+        ptn->shot_height_in = ptn->shot_height_out;
+        ptn->shot_width_in  = ptn->shot_width_out;
+    }
+
+    ptn->txt_height = main_tn->txt_height;
+    ptn->img_height = ptn->shot_height_out*ptn->row + mc->g_gap*(ptn->row+1) + ptn->txt_height;
+
+    // same name as the main output, only the suffix is different
+    snprintf(ptn->out_filename, sizeof(ptn->out_filename), "%s", main_tn->out_filename);
+    char *suffix = strlaststr(ptn->out_filename, mc->o_suffix);
+    if (NULL == suffix)
+        suffix = ptn->out_filename + strlen(ptn->out_filename);
+    snprintf(suffix, ptn->out_filename + sizeof(ptn->out_filename) - suffix, "%s", p->o_suffix);
+
+    if (0 == mc->W_overwrite && output_exists(mc, ptn->out_filename)) {
+        av_log(NULL, AV_LOG_INFO, "%s: output file %s already exists. omitted.\n", mc->argv0, ptn->out_filename);
+        return -1;
+    }
+
+    char *image_extension = strrchr(ptn->out_filename, '.');
+    if ((NULL == image_extension || strcasecmp(image_extension, IMAGE_EXTENSION_JPG) == 0)
+        && (ptn->img_width > 65500 || ptn->img_height > 65500)) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: jpeg only supports max size of 65500; skipped\n", p->o_suffix);
+        return -1;
+    }
+
+    av_log(NULL, AV_LOG_INFO, "  profile %s: step: %.1f s; # tiles: %dx%d, tile size: %dx%d; total size: %dx%d\n",
+        p->o_suffix, ptn->step_t*ptn->time_base, ptn->column, ptn->row,
+        ptn->shot_width_out, ptn->shot_height_out, ptn->img_width, ptn->img_height);
+
+    po->frame_rgb = av_frame_alloc();
+    int rgb_bufsize = av_image_get_buffer_size(AV_PIX_FMT_RGB24, ptn->shot_width_in, ptn->shot_height_in, LINESIZE_ALIGN);
+    po->rgb_buffer = av_malloc(rgb_bufsize);
+    if (NULL == po->frame_rgb || NULL == po->rgb_buffer
+        || av_image_fill_arrays(po->frame_rgb->data, po->frame_rgb->linesize, po->rgb_buffer,
+            AV_PIX_FMT_RGB24, ptn->shot_width_in, ptn->shot_height_in, LINESIZE_ALIGN) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: allocating frame failed\n", p->o_suffix);
+        return -1;
+    }
+
+    ptn->out_ip = gdImageCreateTrueColor(ptn->img_width, ptn->img_height);
+    if (NULL == ptn->out_ip) {
+        av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", ptn->img_width, ptn->img_height);
+        return -1;
+    }
+
+    int background = gdImageColorResolve(ptn->out_ip, mc->k_bcolor.r, mc->k_bcolor.g, mc->k_bcolor.b);
+    gdImageFilledRectangle(ptn->out_ip, 0, 0, ptn->img_width, ptn->img_height, background);
+
+	if(mc->_transparent_bg)
+		gdImageColorTransparent(ptn->out_ip, background);
+
+    if (mc->i_info && all_text && strlen(all_text) > 0) {
+        char *str_ret = image_string(ptn->out_ip,
+            mc->f_fontname, mc->F_info_color, mc->F_info_font_size,
+            mc->L_info_location, mc->g_gap, all_text, 0, COLOR_WHITE, info_text_padding, &mc->fcStrFlagsInfotext);
+        if (NULL != str_ret) {
+            av_log(NULL, AV_LOG_ERROR, "  %s; font problem? see -f option\n", str_ret);
+            return -1;
         }
+    }
+
+	if(mc->_shadow >= 0){
+		if((po->shadow_ip = create_shadow_image(mc, background, &mc->_shadow, ptn->shot_width_out, ptn->shot_height_out)) == NULL)
+			return -1;
+	}
 
-        filenamestartpos=path_2_file(filenamebase);
-        extpos = strrchr(filenamestartpos, '.');
+    if (-1 == thumb_alloc_dynamic(ptn)) {
+        av_log(NULL, AV_LOG_ERROR, "  thumb_alloc_dynamic failed\n");
+        return -1;
+    }
+
+    return 0;
+}
 
-        if (gb_X_filename_use_full != 1 && extpos != NULL)
+/*
+scale decoded frame to the profile's shot size and add it as the next shot
+return 0 ok, -1 error
+*/
+int profile_output_add_shot(MtnContext *mc, ProfileOutput *po, AVFrame *pFrame, int src_width, int src_height,
+    char *time_str, int timestamp_text_padding, int64_t pts)
+{
+    thumbnail *ptn = &po->tn;
+
+    po->sws = sws_getCachedContext(po->sws, src_width, src_height, pFrame->format,
+        ptn->shot_width_in, ptn->shot_height_in, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+    if (NULL == po->sws) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: sws_getCachedContext failed\n", po->opt->o_suffix);
+        return -1;
+    }
+
+    if (sws_scale(po->sws, (const uint8_t* const*)pFrame->data, pFrame->linesize, 0, src_height,
+            po->frame_rgb->data, po->frame_rgb->linesize) <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: sws_scale() failed\n", po->opt->o_suffix);
+        return -1;
+    }
+
+    gdImagePtr ip = gdImageCreateTrueColor(ptn->shot_width_in, ptn->shot_height_in);
+    if (NULL == ip) {
+        av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", ptn->shot_width_in, ptn->shot_height_in);
+        return -1;
+    }
+    FrameRGB_2_gdImage(po->frame_rgb, ip, ptn->shot_width_in, ptn->shot_height_in);
+    ip = rotate_gdImage(ip, ptn->rotation);
+
+    if (NULL != time_str) {
+        image_string(ip,
+            mc->F_ts_fontname, mc->F_ts_color, mc->F_ts_font_size,
+            mc->L_time_location, 0, time_str, 1, mc->F_ts_shadow, timestamp_text_padding, &mc->fcStrFlagsTimestamp);
+    }
+
+    thumb_add_shot(mc, ptn, ip, po->shadow_ip, ptn->idx + 1, pts);
+    gdImageDestroy(ip);
+    return 0;
+}
+
+/*
+crop & save profile output
+return 0 ok, 1 some shots are missing, -1 error
+*/
+int profile_output_save(MtnContext *mc, ProfileOutput *po)
+{
+    thumbnail *ptn = &po->tn;
+    const int created = ptn->idx + 1;
+    int cropp_needed = 0;
+
+    if (created <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  profile %s: no shots\n", po->opt->o_suffix);
+        return -1;
+    }
+
+    const int created_rows = ceil((double)created / ptn->column);
+    if (created_rows < ptn->row) {
+        ptn->img_height -= (ptn->row - created_rows)*ptn->shot_height_out;
+        ptn->row = created_rows;
+        cropp_needed = 1;
+    }
+    if (created_rows == 1 && created < ptn->column) {
+        ptn->img_width -= (ptn->column - created)*ptn->shot_width_out;
+        ptn->column = created;
+        cropp_needed = 1;
+    }
+    if (cropp_needed)
+        ptn->out_ip = crop_image(ptn->out_ip, ptn->img_width, ptn->img_height);
+
+    if (save_image_quality(mc, ptn->out_ip, ptn->out_filename, po->quality) != 0)
+        return -1;
+    ptn->out_saved = 1;
+
+    av_log(NULL, AV_LOG_INFO, "  profile output: %s\n", ptn->out_filename);
+
+    return (ptn->tiles_nr == ptn->row * ptn->column) ? 0 : 1;
+}
+
+/*
+fill cache key of file from stat(); no need to open the file
+return 0 if ok, -1 if failed
+*/
+int cache_key_of(MtnContext *mc, char *file, CacheKey *key)
+{
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t file_w[FILENAME_MAX];
+    UTF8_2_WC(file_w, file, FILENAME_MAX);
+#else
+    char *file_w = file;
+#endif
+
+    struct _stat buf;
+    if (0 != _tstat(file_w, &buf)) {
+        return -1;
+    }
+    key->dev = buf.st_dev;
+    key->ino = buf.st_ino;
+    if (0 == key->ino) // no inodes (windows); use the path instead
+        key->ino = (int64_t)cache_hash(CACHE_HASH_INIT, file, strlen(file));
+    key->size = buf.st_size;
+    key->mtime = buf.st_mtime;
+    key->options = mc->cache_options;
+    return 0;
+}
+
+uint64_t hash_str(uint64_t h, const char *s)
+{
+    const char null_str = 1; // differs from ""
+    return s ? cache_hash(h, s, strlen(s) + 1) : cache_hash(h, &null_str, 1);
+}
+
+#define HASH_VAL(h, v) (h = cache_hash(h, &(v), sizeof(v)))
+
+/*
+output names of file without suffix (-O, -X, -x) into filenamebase of UTF8_FILENAME_SIZE
+*/
+void output_base(MtnContext *mc, char *file, char *filenamebase)
+{
+    char *extpos;
+    char *filenamestartpos = NULL;
+
+    if (mc->O_outdir != NULL && strlen(mc->O_outdir) > 0) {
+        strcpy_va(filenamebase, 3, mc->O_outdir, FOLDER_SEPARATOR, path_2_file(file));
+    } else {
+        strcpy(filenamebase, file);
+    }
+
+    filenamestartpos=path_2_file(filenamebase);
+    extpos = strrchr(filenamestartpos, '.');
+
+    if (mc->X_filename_use_full != 1 && extpos != NULL)
+    {
+        // remove movie extenxtion (e.g. .avi)
+        *extpos = '\0';
+    }
+
+    if(mc->x_basename_custom)
+    {
+        if(extpos)
         {
-            // remove movie extenxtion (e.g. .avi)
-            *extpos = '\0';
+            char *extension = strdup(extpos);
+            strcpy_va(filenamestartpos, 2, mc->x_basename_custom, extension);
+            free(extension);
         }
+        else
+            strcpy(filenamestartpos, mc->x_basename_custom);
+    }
+}
 
-        if(gb_x_basename_custom)
-        {
-            if(extpos)
+/* outputs of make_thumbnail() filled by thumbnail_decode_and_assemble() */
+typedef struct SHOT_SINK
+{
+    MtnContext *mc;
+    ThumbnailContext *tc;
+    thumbnail *tn;
+    gdImagePtr shadow_ip;
+    pSprite sprite;
+    int stream;                     // 1 = rows are written when complete (--stream)
+    StreamWriter *sw;
+    int stream_rows;                // # of rows already written
+    ProfileOutput *pout;
+    int nb_pout;
+    int t_timestamp;                // 0 = off
+    int timestamp_text_padding;
+    const char *image_extension;
+    const char *file;               // movie, for --json-events
+} ShotSink;
+
+/*
+shots received so far are replaced when decoding starts over;
+not possible once rows are written
+*/
+int shot_sink_restart(void *opaque)
+{
+    ShotSink *s = opaque;
+    if (0 != s->stream_rows)
+        return -1;
+    for (int i = 0; i < s->nb_pout; i++) {
+        s->pout[i].tn.idx = -1;
+        s->pout[i].tn.tiles_nr = 0;
+    }
+    return 0;
+}
+
+/*
+draw the shot into the main output (timestamp, -I, --vtt, --stream) and
+into the profile outputs of its shot target
+*/
+int shot_sink_add(void *opaque, ThumbnailShot *shot)
+{
+    ShotSink *s = opaque;
+    MtnContext *mc = s->mc;
+    thumbnail *tn = s->tn;
+    AVCodecContext *pCodecCtx = s->tc->codec_ctx;
+    int idx = shot->idx;
+
+    if (idx >= 0)
+        events_shot(mc->events, s->file, idx + 1, tn->row * tn->column, shot->pts, shot->time);
+
+    if (shot->outputs & 1) {
+        /* convert to GD image */
+        gdImagePtr ip = gdImageCreateTrueColor(tn->shot_width_in, tn->shot_height_in);
+        if (NULL == ip) {
+            av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", tn->shot_width_in, tn->shot_height_in);
+            return -1;
+        }
+        FrameRGB_2_gdImage(shot->frame_rgb, ip, tn->shot_width_in, tn->shot_height_in);
+        ip = rotate_gdImage(ip, tn->rotation);
+
+        /* if debugging, save the edge instead */
+        if (mc->v_verbose > 0 && NULL != shot->edge_ip) {
+            gdImageDestroy(ip);
+            ip = shot->edge_ip;
+            shot->edge_ip = NULL;
+        }
+
+        if (mc->_webvtt)
+            sprite_add_shot(mc, s->sprite, ip, shot->pts);
+
+        /* timestamping */
+        // FIXME: this frame might not actually be at the requested position. is pts correct?
+        if (s->t_timestamp) { // on
+            TIME_STR time_str;
+            format_time(shot->time, time_str, ':');
+            char *str_ret = image_string(ip,
+                mc->F_ts_fontname, mc->F_ts_color, mc->F_ts_font_size,
+                mc->L_time_location, 0, time_str, 1, mc->F_ts_shadow, s->timestamp_text_padding, &mc->fcStrFlagsTimestamp);
+            if (NULL != str_ret) {
+                av_log(NULL, AV_LOG_ERROR, "  %s; font problem? see -f or -F option\n", str_ret);
+                gdImageDestroy(ip);
+                return -1;
+            }
+            /* stamp idx & blank & edge for debugging */
+            if (mc->v_verbose > 0) {
+                char idx_str[256];
+                snprintf(idx_str, sizeof(idx_str), "idx: %d, blank: %.2f\n%.6f  %.6f\n%.6f  %.6f\n%.6f  %.6f",
+                    idx, shot->blank, shot->edge[0], shot->edge[1], shot->edge[2], shot->edge[3], shot->edge[4], shot->edge[5]);
+                image_string(ip, mc->f_fontname, COLOR_WHITE, mc->F_ts_font_size, 2, 0, idx_str, 1, COLOR_BLACK, 0, &mc->fcStrFlagsTimestamp);
+            }
+        }
+
+        /* save individual shots */
+        if (mc->I_individual) {
+            TIME_STR time_str;
+            format_time(shot->time, time_str, '_');
+
+            char individual_filename[UTF8_FILENAME_SIZE];
+            snprintf(individual_filename, sizeof(individual_filename), "%s", tn->out_filename);
+            char *suffix = strstr(individual_filename, mc->o_suffix);
+            assert(NULL != suffix);
+
+            if(mc->I_individual_thumbnail)
             {
-                char *extension = strdup(extpos);
-                strcpy_va(filenamestartpos, 2, gb_x_basename_custom, extension);
-                free(extension);
+                snprintf(suffix, individual_filename + sizeof(individual_filename) - suffix,
+                    "_t_%s_%05d%s", time_str, idx, s->image_extension);
+                if (save_image(mc, ip, individual_filename) != 0)
+                    av_log(NULL, AV_LOG_ERROR, "  saving individual shot #%05d to %s failed\n", idx, individual_filename);
+            }
+
+            if(mc->I_individual_original)
+            {
+                snprintf(suffix, individual_filename + sizeof(individual_filename) - suffix,
+                    "_o_%s_%05d%s", time_str, idx, s->image_extension);
+
+                if(save_AVFrame(mc, shot->frame,
+                        pCodecCtx->width, pCodecCtx->height,
+                        pCodecCtx->pix_fmt,
+                        individual_filename,
+                        pCodecCtx->width, pCodecCtx->height
+                ) != 0)
+                    av_log(NULL, AV_LOG_ERROR, "  saving individual shot #%05d to %s failed\n", idx, individual_filename);
             }
-            else
-                strcpy(filenamestartpos, gb_x_basename_custom);
         }
 
+        /* add picture to output image */
+        if (!mc->I_individual_ignore_grid)
+            thumb_add_shot(mc, tn, ip, s->shadow_ip, idx, shot->pts);
+
+        /* row is complete; write it out */
+        if (s->stream && 0 == (idx+1) % tn->column) {
+            if (0 != stream_write_row(mc, s->sw, tn)) {
+                gdImageDestroy(ip);
+                return -1;
+            }
+            s->stream_rows++;
+        }
+
+        gdImageDestroy(ip);
+    }
+
+    if (s->nb_pout > 0) {
+        TIME_STR shot_time;
+        format_time(shot->time, shot_time, ':');
+        for (int i = 0; i < s->nb_pout; i++) {
+            if (0 == (shot->outputs & (1u << (i+1))))
+                continue;
+            if (0 != profile_output_add_shot(mc, &s->pout[i], shot->frame, pCodecCtx->width, pCodecCtx->height,
+                    s->t_timestamp ? shot_time : NULL, s->timestamp_text_padding, shot->pts))
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+rotation of each stream of ic into info, as stored in --probe-cache
+return 0 if ok, -1 if out of memory
+*/
+int probe_info_fill(AVFormatContext *ic, ProbeInfo *info)
+{
+    info->nb_streams = ic->nb_streams;
+    info->rotation = calloc(ic->nb_streams, sizeof(double));
+    if (NULL == info->rotation)
+        return -1;
+    for (unsigned int i = 0; i < ic->nb_streams; i++)
+        info->rotation[i] = get_stream_rotation(ic->streams[i]);
+    return 0;
+}
+
+/*
+ * return   0 ok
+ *         <0 MtnError; -1 (MTN_ERROR_GENERIC) if something else went wrong
+ *          1 some images are missing
+ */
+int
+make_thumbnail(MtnContext *mc, char *file)
+{
+    int return_code = -1;
+    av_log(NULL, AV_LOG_VERBOSE, "make_thumbnail: %s\n", file);
+    mc->timed_out = 0;
+    mc->archive_source = file;
+    mc->nb_files++;
+    int idx = 0;
+
+    struct timeval tstart;
+    gettimeofday(&tstart, NULL);
+
+    thumbnail tn; // thumbnail data & info
+    thumb_new(&tn);
+
+    pSprite sprite = NULL;
+
+    gdImagePtr thumbShadowIm=NULL;
+
+    //int nb_shots = 0; // # of decoded shots (stat purposes)
+
+    /* decoding state of this movie; everything else is checked during cleaning up, must be NULL if not used */
+    ThumbnailContext tc;
+    thumbnail_context_init(&tc, mc);
+    tn.out_ip = NULL;
+    //FILE *out_fp = NULL;
+    FILE *info_fp = NULL;
+    ProbeInfo probe_info = {0};
+    CacheKey probe_key;
+    int probe_cached = 0, probe_restored = 0;
+
+    int t_timestamp = mc->t_timestamp; // local timestamp; can be turned off; 0 = off
+
+    /* streaming mode: tn.out_ip holds only one row of shots */
+    int stream = 0;
+    int stream_rows = 0;            // # of rows already written
+    int stream_header_h = 0, stream_footer_h = 0;
+    gdImagePtr stream_header_ip = NULL, stream_footer_ip = NULL;
+    StreamWriter sw;
+    memset(&sw, 0, sizeof(sw));
+    sw.page = -1;
+
+    /* profile outputs (--profile) & merged shot targets */
+    ProfileOutput *pout = NULL;
+    int nb_pout = 0;
+    ShotTarget *sched = NULL;
+    int nb_sched = 0;
+
+    av_log(NULL, AV_LOG_INFO, "\n");
+
+    // output filenames
+    {
+        char filenamebase[UTF8_FILENAME_SIZE] = {'\0',};
+
+        output_base(mc, file, filenamebase);
+
         tn.filenamebase = (char*)malloc((strlen(filenamebase)+1) * sizeof(char));
         strcpy(tn.filenamebase, filenamebase);
 
         strcpy(tn.out_filename, filenamebase);
-        strcat(tn.out_filename, gb_o_suffix);
+        strcat(tn.out_filename, mc->o_suffix);
 
-        if (gb_N_suffix != NULL)
+        if (mc->N_suffix != NULL)
         {
             strcpy(tn.info_filename, filenamebase);
-            strcat(tn.info_filename, gb_N_suffix);
+            strcat(tn.info_filename, mc->N_suffix);
         }
 
-        if (gb__cover == 1)
+        if (mc->_cover == 1)
         {
             strcpy(tn.cover_filename, filenamebase);
-            strcat(tn.cover_filename, gb__cover_suffix);
+            strcat(tn.cover_filename, mc->_cover_suffix);
         }
     }
 
@@ -2658,23 +2651,24 @@ make_thumbnail(char *file)
 
     // if output files exist and modified time >= program start time,
     // we'll not overwrite and use a new name
+    // (not needed for the archive, it keeps every version)
     int unum = 0;
-    if (is_reg_newer(tn.out_filename, gb_st_start)) {
-        unum = make_unique_name(tn.out_filename, gb_o_suffix, unum);
-        av_log(NULL, AV_LOG_INFO, "%s: output file already exists. using: %s\n", gb_argv0, tn.out_filename);
+    if (!outputs_in_memory(mc) && is_reg_newer(tn.out_filename, mc->st_start)) {
+        unum = make_unique_name(tn.out_filename, mc->o_suffix, unum);
+        av_log(NULL, AV_LOG_INFO, "%s: output file already exists. using: %s\n", mc->argv0, tn.out_filename);
     }
-    if (NULL != gb_N_suffix && is_reg_newer(tn.info_filename, gb_st_start)) {
-        unum = make_unique_name(tn.info_filename, gb_N_suffix, unum);
-        av_log(NULL, AV_LOG_INFO, "%s: info file already exists. using: %s\n", gb_argv0, tn.info_filename);
+    if (!outputs_in_memory(mc) && NULL != mc->N_suffix && is_reg_newer(tn.info_filename, mc->st_start)) {
+        unum = make_unique_name(tn.info_filename, mc->N_suffix, unum);
+        av_log(NULL, AV_LOG_INFO, "%s: info file already exists. using: %s\n", mc->argv0, tn.info_filename);
     }
-    if (0 == gb_W_overwrite) { // dont overwrite mode
-        if (is_reg(tn.out_filename)) {
-            av_log(NULL, AV_LOG_INFO, "%s: output file %s already exists. omitted.\n", gb_argv0, tn.out_filename);
+    if (0 == mc->W_overwrite) { // dont overwrite mode
+        if (output_exists(mc, tn.out_filename)) {
+            av_log(NULL, AV_LOG_INFO, "%s: output file %s already exists. omitted.\n", mc->argv0, tn.out_filename);
             return_code = 0;
             goto cleanup;
         }
-        if (NULL != gb_N_suffix && is_reg(tn.info_filename)) {
-            av_log(NULL, AV_LOG_INFO, "%s: info file %s already exists. omitted.\n", gb_argv0, tn.info_filename);
+        if (NULL != mc->N_suffix && output_exists(mc, tn.info_filename)) {
+            av_log(NULL, AV_LOG_INFO, "%s: info file %s already exists. omitted.\n", mc->argv0, tn.info_filename);
             return_code = 0;
             goto cleanup;
         }
@@ -2690,244 +2684,90 @@ make_thumbnail(char *file)
 #endif
 //    out_fp = _tfopen(out_filename_w, _TEXT("wb"));
 //    if (NULL == out_fp) {
-//        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output image '%s' failed: %s\n", gb_argv0, tn.out_filename, strerror(errno));
+//        av_log(NULL, AV_LOG_ERROR, "\n%s: creating output image '%s' failed: %s\n", mc->argv0, tn.out_filename, strerror(errno));
 //        goto cleanup;
 //    }
-    if (NULL != gb_N_suffix) {
+    if (NULL != mc->N_suffix) {
         av_log(NULL, AV_LOG_INFO, "\nCreating info file %s\n", tn.info_filename);
-        info_fp = _tfopen(info_filename_w, _TEXT("wb"));
+        // archived when the output is saved
+        info_fp = outputs_in_memory(mc) ? tmpfile() : _tfopen(info_filename_w, _TEXT("wb"));
         if (NULL == info_fp) {
-            av_log(NULL, AV_LOG_ERROR, "\n%s: creating info file '%s' failed: %s\n", gb_argv0, tn.info_filename, strerror(errno));
+            av_log(NULL, AV_LOG_ERROR, "\n%s: creating info file '%s' failed: %s\n", mc->argv0, tn.info_filename, strerror(errno));
             goto cleanup;
         }
     }
 
     // Open video file
-    ret = avformat_open_input(&pFormatCtx, file, NULL, &gb__options);
-    if (0 != ret) {
-        av_log(NULL, AV_LOG_ERROR, "\n%s: avformat_open_input %s failed: %d\n", gb_argv0, file, ret);
+    if (0 != thumbnail_open_file(&tc, file))
         goto cleanup;
-    }
+    AVFormatContext *pFormatCtx = tc.format_ctx;
 
-
-    // generate pts?? -- from ffplay, not documented
-    // it should make av_read_frame() generate pts for unknown value
-    assert(NULL != pFormatCtx);
-    pFormatCtx->flags |= AVFMT_FLAG_GENPTS;
-
-    // Retrieve stream information
-    ret = avformat_find_stream_info(pFormatCtx, NULL);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "\n%s: avformat_find_stream_info %s failed: %d\n", gb_argv0, file, ret);
-        goto cleanup;
+    // Retrieve stream information; from the probe cache if the movie is unchanged
+    if (NULL != mc->probe_cache && 0 == cache_key_of(mc, file, &probe_key)) {
+        probe_key.options = mc->probe_options;
+        probe_cached = 1;
+        probe_restored = (1 == probe_cache_restore(mc->probe_cache, &probe_key, pFormatCtx, &probe_info));
+        if (probe_restored)
+            av_log(NULL, AV_LOG_VERBOSE, "  stream info restored from the probe cache\n");
     }
-    dump_format_context(pFormatCtx, nb_file, file, 0);
-
-    // Find videostream
-    int video_index = find_default_videostream_index(pFormatCtx, gb_S_select_video_stream);
-    if (video_index == -1)
-    {
-        if(!gb_S_select_video_stream)
-            av_log(NULL, AV_LOG_ERROR, "  couldn't find a video stream\n");
-        else
-            av_log(NULL, AV_LOG_ERROR, "  couldn't find selected video stream (-S %d)\n", gb_S_select_video_stream);
+    if (0 != thumbnail_find_stream(&tc, probe_restored))
         goto cleanup;
-    }
+    dump_format_context(mc, pFormatCtx, mc->nb_files, file, 0);
 
-    AVStream *pStream = pFormatCtx->streams[video_index];
-    pCodecCtx = get_codecContext_from_codecParams(pStream->codecpar);
-    tn.time_base = av_q2d(pStream->time_base);
+    AVStream *pStream = tc.stream;
+    tn.time_base = tc.time_base;
 
-    if(!pCodecCtx)
+    if (0 != thumbnail_init_decoder(&tc))
         goto cleanup;
+    AVCodecContext *pCodecCtx = tc.codec_ctx;
 
-    if((tn.rotation = get_stream_rotation(pStream)) != 0)
+    if (probe_restored)
+        tc.rotation = probe_info.rotation[tc.video_index];
+    tn.rotation = tc.rotation;
+    if(tn.rotation != 0)
         av_log(NULL, AV_LOG_INFO,  "  Rotation: %d degrees%s", tn.rotation, NEWLINE);
 
-    dump_stream(pStream);
-    //dump_index_entries(pStream);
-    dump_codec_context(pCodecCtx);
-    av_log(NULL, AV_LOG_VERBOSE, "\n");
-
-    codec_color_primaries = av_color_primaries_name(pCodecCtx->color_primaries);
-
-    // Find the decoder for the video stream
-    const AVCodec *pCodec = avcodec_find_decoder(pCodecCtx->codec_id);
-    if (pCodec == NULL) {
-        av_log(NULL, AV_LOG_ERROR, "  couldn't find a decoder for codec_id: %d\n", pCodecCtx->codec_id);
-        goto cleanup;
+    if (MTN_LOG_ENABLED(AV_LOG_VERBOSE)) {
+        dump_stream(pStream);
+        //dump_index_entries(pStream);
+        dump_codec_context(pCodecCtx);
+        av_log(NULL, AV_LOG_VERBOSE, "\n");
     }
-//    const AVCodec *pCodec = pCodecCtx->codec;
 
-    // discard frames; is this OK?? // FIXME
-    if (gb_s_step >= 0) {
-        // nonkey & bidir cause program crash with some files, e.g. tokyo 275 .
-        // codec bugs???
-        //pCodecCtx->skip_frame = AVDISCARD_NONKEY; // slower with nike 15-11-07
-        //pCodecCtx->skip_frame = AVDISCARD_BIDIR; // this seems to speed things up
-        pCodecCtx->skip_frame = AVDISCARD_NONREF; // internal err msg but not crash
-    }
-
-    // Open codec
-    ret = avcodec_open2(pCodecCtx, pCodec, NULL);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "  couldn't open codec %s id %d: %d\n", pCodec->name, pCodec->id, ret);
+    if( mc->_cover && 0 != save_cover_image(mc, pFormatCtx, tn.cover_filename))
         goto cleanup;
-    }
 
-    // Allocate video frame
-    pFrame = av_frame_alloc();
-    if (pFrame == NULL) {
-        av_log(NULL, AV_LOG_ERROR, "  couldn't allocate a video frame\n");
+    if (0 != thumbnail_init_filters(&tc))
         goto cleanup;
-    }
-
-    if( gb__cover )
-        save_cover_image(pFormatCtx, tn.cover_filename);
-
-    AVFilterContext *buffersink_ctx = NULL;
-    AVFilterContext *buffersrc_ctx = NULL;
-    AVFilterGraph *filter_graph = NULL;
 
-    if(gb__filters)
-    {
-        // initialize filters (FFmpeg/doc/examples/filtering_video.c)
-        AVCodecContext *dec_ctx = pCodecCtx;
-        AVRational time_base = pStream->time_base;
-        av_log(NULL, AV_LOG_VERBOSE, "Initializing filtergraph\n");
-
-        char args[512];
-        int ret = 0;
-        const AVFilter *buffersrc  = avfilter_get_by_name("buffer");
-        const AVFilter *buffersink = avfilter_get_by_name("buffersink");
-        AVFilterInOut* inputs = avfilter_inout_alloc();
-        AVFilterInOut* outputs = avfilter_inout_alloc();
-        filter_graph = avfilter_graph_alloc();
-
-        snprintf(args, sizeof(args),
-                "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
-                dec_ctx->width, dec_ctx->height, dec_ctx->pix_fmt,
-                time_base.num, time_base.den,
-                dec_ctx->sample_aspect_ratio.num, dec_ctx->sample_aspect_ratio.den);
-
-        ret = avfilter_graph_create_filter(&buffersrc_ctx, buffersrc, "in",
-                                           args, NULL, filter_graph);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create buffer source\n");
-            goto cleanup;
-        }
-
-        ret = avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out",
-                                           NULL, NULL, filter_graph);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
-            goto cleanup;
-        }
-
-        outputs->name       = av_strdup("in");
-        outputs->filter_ctx = buffersrc_ctx;
-        outputs->pad_idx    = 0;
-        outputs->next       = NULL;
-
-        inputs->name       = av_strdup("out");
-        inputs->filter_ctx = buffersink_ctx;
-        inputs->pad_idx    = 0;
-        inputs->next       = NULL;
-
-        if(avfilter_graph_parse_ptr(filter_graph, gb__filters, &inputs, &outputs, NULL)<0)
-            goto cleanup;
-
-        if (avfilter_graph_config(filter_graph, NULL) < 0)
-            goto cleanup;
-
-        avfilter_inout_free(&inputs);
-        avfilter_inout_free(&outputs);
-
-        if(gb__filter_color_primaries)
-            filter_color_primaries_match = av_match_list(codec_color_primaries, gb__filter_color_primaries, ',');
-    }
-
-    // keep a copy of sample_aspect_ratio because it might be changed after
-    // decoding a frame, e.g. Dragonball Z 001 (720x480 H264 AAC).mkv
-    AVRational sample_aspect_ratio = av_guess_sample_aspect_ratio(pFormatCtx, pStream, NULL);
-
-    double duration = (double) pFormatCtx->duration / AV_TIME_BASE; // can be unknown & can be incorrect (e.g. .vob files)
-    if (duration <= 0) {
-        duration = guess_duration(pFormatCtx, video_index, pCodecCtx, pFrame);
-    }
-    if (duration <= 0) {
-        // have to turn timestamping off because it'll be incorrect
-        if (1 == gb_t_timestamp) { // on
-            t_timestamp = 0;
-            av_log(NULL, AV_LOG_ERROR, "  turning time stamp off because of duration\n");
-        }
-        av_log(NULL, AV_LOG_ERROR, "  duration is unknown: %.2f\n", duration);
+    // duration, start time & sample_aspect_ratio (-a); decodes the first frame
+    if (0 != thumbnail_init_timing(&tc))
         goto cleanup;
-    }
-
-    double start_time = (double) pFormatCtx->start_time / AV_TIME_BASE; // in seconds
-    // VTS_01_2.VOB & beyond from DVD seem to be like this
-    //if (start_time > duration) {
-        //av_log(NULL, AV_LOG_VERBOSE, "  start_time: %.2f is more than duration: %.2f\n", start_time, duration);
-        //goto cleanup;
-    //}
-    // if start_time is negative, we ignore it; FIXME: is this ok?
-    if (start_time < 0) {
-        start_time = 0;
-    }
-    int64_t start_time_tb = start_time * pStream->time_base.den / pStream->time_base.num; // in time_base unit
-    //av_log(NULL, AV_LOG_ERROR, "  start_time_tb: %"PRId64"\n", start_time_tb);
-
-    // decode the first frame without seeking.
-    // without doing this, avcodec_decode_video wont be able to decode any picture
-    // with some files, eg. http://download.pocketmovies.net/movies/3d/twittwit_320x184.mpg
-    // bug reported by: swmaherl, jake_o from sourceforge
-    // and pCodecCtx->width and pCodecCtx->height might not be correct without this
-    // for .flv files. bug reported by: dragonbook
-    int64_t found_pts = -1;
-    int64_t first_pts = -1; // pts of first frame
-    ret = video_decode_next_frame(pFormatCtx, pCodecCtx, pFrame, video_index, &first_pts);
-    if (0 == ret) { // end of file
-        goto eof;
-    } else if (ret < 0) { // error
-        av_log(NULL, AV_LOG_ERROR, "  read_and_decode first failed!\n");
-        goto cleanup;
-    }
-    //av_log(NULL, AV_LOG_INFO, "first_pts: %"PRId64" (%.2f s)\n", first_pts, calc_time(first_pts, pStream->time_base, start_time)); // DEBUG
-
-    // set sample_aspect_ratio
-    // assuming sample_y = display_y
-    if (gb_a_ratio.num != 0) { // use cmd line arg if specified
-        sample_aspect_ratio.num = (double) pCodecCtx->height * av_q2d(gb_a_ratio) / pCodecCtx->width * 10000;
-        sample_aspect_ratio.den = 10000;
-        av_log(NULL, AV_LOG_INFO, "  *** using sample_aspect_ratio: %d/%d because of -a %.4f option\n", sample_aspect_ratio.num, sample_aspect_ratio.den, av_q2d(gb_a_ratio));
-    } else {
-        if (sample_aspect_ratio.num != 0 && pCodecCtx->sample_aspect_ratio.num != 0
-            && av_q2d(sample_aspect_ratio) != av_q2d(pCodecCtx->sample_aspect_ratio)) {
-            av_log(NULL, AV_LOG_INFO, "  *** conflicting sample_aspect_ratio: %.2f vs %.2f: using %.2f\n",
-                av_q2d(sample_aspect_ratio), av_q2d(pCodecCtx->sample_aspect_ratio), av_q2d(sample_aspect_ratio));
-            av_log(NULL, AV_LOG_INFO, "      to use sample_aspect_ratio %.2f use: -a %.4f option\n",
-                av_q2d(pCodecCtx->sample_aspect_ratio), av_q2d(pCodecCtx->sample_aspect_ratio) * pCodecCtx->width / pCodecCtx->height);
-            // we'll continue with existing value. is this ok? FIXME
-            // this is the same as mpc's and vlc's.
-        }
-        if (sample_aspect_ratio.num == 0) { // not defined
-            sample_aspect_ratio = pCodecCtx->sample_aspect_ratio;
-        }
-    }
+    if (NULL != mc->info)
+        thumbnail_get_info(&tc, mc->info);
+    if (NULL != mc->events) {
+        MtnInfo info;
+        struct timeval tprobe;
+        thumbnail_get_info(&tc, &info);
+        gettimeofday(&tprobe, NULL);
+        events_probe(mc->events, file, (tprobe.tv_sec - tstart.tv_sec) + (tprobe.tv_usec - tstart.tv_usec) / 1000000.0, &info);
+    }
+    AVRational sample_aspect_ratio = tc.sample_aspect_ratio;
+    double duration = tc.duration;
+    double start_time = tc.start_time;
 
     /* calc options */
     // FIXME: make sure values are ok when movies are very short or very small
     double net_duration;
-    if (gb_C_cut > 0) {
-        net_duration = gb_C_cut;
-        if (net_duration + gb_B_begin > duration) {
-            net_duration = duration - gb_B_begin;
-            av_log(NULL, AV_LOG_ERROR, "  -C %.2f s is too long, using %.2f s.\n", gb_C_cut, net_duration);
+    if (mc->C_cut > 0) {
+        net_duration = mc->C_cut;
+        if (net_duration + mc->B_begin > duration) {
+            net_duration = duration - mc->B_begin;
+            av_log(NULL, AV_LOG_ERROR, "  -C %.2f s is too long, using %.2f s.\n", mc->C_cut, net_duration);
         }
     } else {
-        //double net_duration = duration - start_time - gb_B_begin - gb_E_end;
-        net_duration = duration - gb_B_begin - gb_E_end; // DVD
+        //double net_duration = duration - start_time - mc->B_begin - mc->E_end;
+        net_duration = duration - mc->B_begin - mc->E_end; // DVD
         if (net_duration <= 0) {
             av_log(NULL, AV_LOG_ERROR, "  duration: %.2f s, net duration after -B & -E is negative: %.2f s.\n", duration, net_duration);
             goto cleanup;
@@ -2946,16 +2786,15 @@ make_thumbnail(char *file)
             sample_aspect_ratio.num, sample_aspect_ratio.den);
     }
 
-    int seek_mode = 1; // 1 = seek; 0 = non-seek
     int scaled_src_width_out  = scaled_src_width,
         scaled_src_height_out = scaled_src_height;
 
     rotate_geometry(&scaled_src_width_out, &scaled_src_height_out, tn.rotation);
 
-    reduce_shots_to_fit_in(
-        gb_s_step,
-        gb_r_row,
-        gb_c_column,
+    reduce_shots_to_fit_in(mc, mc->s_step,
+        mc->r_row,
+        mc->c_column,
+        mc->w_width,
         scaled_src_width_out,
         scaled_src_height_out,
         net_duration,
@@ -2966,9 +2805,9 @@ make_thumbnail(char *file)
     {
         int suggested_width, suggested_height;
         // guess new width and height to create thumbnails
-        suggested_width = ceil(gb_h_height * scaled_src_width_out/scaled_src_height_out + 2*(double)gb_g_gap);
+        suggested_width = ceil(mc->h_height * scaled_src_width_out/scaled_src_height_out + 2*(double)mc->g_gap);
         suggested_width+= suggested_width%2;
-        suggested_height = floor((gb_w_width - 2*gb_g_gap) * scaled_src_height_out/scaled_src_width_out);
+        suggested_height = floor((mc->w_width - 2*mc->g_gap) * scaled_src_height_out/scaled_src_width_out);
         suggested_height-= suggested_height%2;
 
         av_log(NULL, AV_LOG_ERROR, "  thumbnail to small; increase image width to %d (-w) or decrease min. image height to %d (-h)%s" ,
@@ -2989,20 +2828,33 @@ make_thumbnail(char *file)
         tn.shot_width_in  = tn.shot_width_out;
     }
 
-    if (tn.column != gb_c_column) {
-        av_log(NULL, AV_LOG_INFO, "  changing # of column to %d to meet minimum height of %d; see -h option\n", tn.column, gb_h_height);
+    if (tn.column != mc->c_column) {
+        av_log(NULL, AV_LOG_INFO, "  changing # of column to %d to meet minimum height of %d; see -h option\n", tn.column, mc->h_height);
     }
-    if (gb_w_width > 0 && gb_w_width != tn.img_width) {
+    if (mc->w_width > 0 && mc->w_width != tn.img_width) {
         av_log(NULL, AV_LOG_INFO, "  changing width to %d to match movie's size (%dx%d)\n", tn.img_width, scaled_src_width, tn.column);
     }
 
     char all_text_buf[4096];
-    char *all_text = get_stream_info(pFormatCtx, file, 1, sample_aspect_ratio, all_text_buf, sizeof(all_text_buf));
+    char *all_text = all_text_buf;
+    uint64_t info_key = hash_str(CACHE_HASH_INIT, path_2_file(file));
+    HASH_VAL(info_key, sample_aspect_ratio);
+    HASH_VAL(info_key, mc->H_human_filesize);
+    if (probe_restored && NULL != probe_info.info_text && probe_info.info_key == info_key) {
+        snprintf(all_text_buf, sizeof(all_text_buf), "%s", probe_info.info_text);
+    } else {
+        all_text_buf[0] = '\0';
+        all_text = get_stream_info(mc, pFormatCtx, file, 1, sample_aspect_ratio, all_text_buf, sizeof(all_text_buf));
+        if (probe_cached && !probe_restored) {
+            probe_info.info_text = strdup(all_text);
+            probe_info.info_key = info_key;
+        }
+    }
 
     if (NULL != info_fp) {
         fprintf(info_fp, "%s%s", all_text, NEWLINE);
     }
-    if (0 == gb_i_info) { // off
+    if (0 == mc->i_info) { // off
         *all_text = '\0';
     }
 
@@ -3010,38 +2862,38 @@ make_thumbnail(char *file)
 	int timestamp_text_padding = 0;
 	int turning_off_info_text = 0;
 
-	if( gb_i_info)
+	if( mc->i_info)
 	{
-		if((info_text_padding = image_string_padding(gb_f_fontname, gb_F_info_font_size, &fcStrFlagsInfotext)) == 0)
+		if((info_text_padding = image_string_padding(mc->f_fontname, mc->F_info_font_size, &mc->fcStrFlagsInfotext)) == 0)
 		{
 			av_log(NULL, AV_LOG_WARNING, "Turning off info text rendering\n");
-			gb_i_info = 0;
+			mc->i_info = 0;
 			turning_off_info_text = 1;
 		}
 	}
 
-	if(gb_t_timestamp)
+	if(mc->t_timestamp)
 	{
-		if( (turning_off_info_text && !strcmp(gb_f_fontname, gb_F_ts_fontname) && fcStrFlagsInfotext.flags == fcStrFlagsTimestamp.flags)
+		if( (turning_off_info_text && !strcmp(mc->f_fontname, mc->F_ts_fontname) && mc->fcStrFlagsInfotext.flags == mc->fcStrFlagsTimestamp.flags)
 			||
-			(timestamp_text_padding = image_string_padding(gb_F_ts_fontname, gb_F_ts_font_size, &fcStrFlagsTimestamp)) == 0)
+			(timestamp_text_padding = image_string_padding(mc->F_ts_fontname, mc->F_ts_font_size, &mc->fcStrFlagsTimestamp)) == 0)
 		{
 			av_log(NULL, AV_LOG_WARNING, "Turning off timestamp rendering\n");
-			gb_t_timestamp = t_timestamp = 0;
+			mc->t_timestamp = t_timestamp = 0;
 		}
 	}
 
-    if (gb_T_text)
-        sprintf(all_text+strlen(all_text), "%s%s", NEWLINE, gb_T_text);
+    if (mc->T_text)
+        sprintf(all_text+strlen(all_text), "%s%s", NEWLINE, mc->T_text);
 
-    if(gb_i_info)
+    if(mc->i_info)
 	{
-        tn.txt_height = image_string_height(all_text, gb_f_fontname, gb_F_info_font_size, &fcStrFlagsInfotext)
-						+ gb_g_gap
+        tn.txt_height = image_string_height(all_text, mc->f_fontname, mc->F_info_font_size, &mc->fcStrFlagsInfotext)
+						+ mc->g_gap
 						+ info_text_padding;
 	}
 
-    tn.img_height = tn.shot_height_out*tn.row + gb_g_gap*(tn.row+1) + tn.txt_height;
+    tn.img_height = tn.shot_height_out*tn.row + mc->g_gap*(tn.row+1) + tn.txt_height;
 
     char* extra_info_text = NULL;
     sprintf_realloc(&extra_info_text, 0, "Tiles: step: %.1f s; # tiles: %dx%d, tile size: %dx%d; total size: %dx%d",
@@ -3051,62 +2903,87 @@ make_thumbnail(char *file)
 
     if (NULL != info_fp) {
         fprintf(info_fp, "%s%s", extra_info_text, NEWLINE);
-        if(gb_T_text)
-			fprintf(info_fp, "%s%s", gb_T_text, NEWLINE);
+        if(mc->T_text)
+			fprintf(info_fp, "%s%s", mc->T_text, NEWLINE);
     }
 
 	free(extra_info_text);
 	extra_info_text = NULL;
 
-    // jpeg seems to have max size of 65500 pixels
-    if (strcasecmp(image_extension, IMAGE_EXTENSION_JPG)==0 && (tn.img_width > 65500 || tn.img_height > 65500)) {
-        av_log(NULL, AV_LOG_ERROR, "  jpeg only supports max size of 65500\n");
-        goto cleanup;
+    int is_jpeg = strcasecmp(image_extension, IMAGE_EXTENSION_JPG)==0;
+    int is_png  = strcasecmp(image_extension, IMAGE_EXTENSION_PNG)==0;
+    if (mc->_stream && !is_jpeg && !is_png) {
+        av_log(NULL, AV_LOG_WARNING, "  --stream works with jpeg & png only; creating the image in memory\n");
     }
-
-    int64_t evade_step = MIN(10/tn.time_base, tn.step_t / 14); // max 10 s to evade blank screen
-    if (evade_step*tn.time_base <= 1) {
-        evade_step = 0;
-        av_log(NULL, AV_LOG_INFO, "  step is less than 14 s; blank & blur evasion is turned off.\n");
+    if (!mc->I_individual_ignore_grid && (is_jpeg || is_png) && !outputs_in_memory(mc)) {
+        stream = mc->_stream || (is_jpeg && tn.img_height > STREAM_JPEG_MAX_SIZE);
     }
 
-    /* prepare for resize & conversion to AV_PIX_FMT_RGB24 */
-    pFrameRGB = av_frame_alloc();
-    if (pFrameRGB == NULL) {
-        av_log(NULL, AV_LOG_ERROR, "  couldn't allocate a video frame\n");
+    // jpeg seems to have max size of 65500 pixels
+    if (is_jpeg && (tn.img_width > STREAM_JPEG_MAX_SIZE || (!stream && tn.img_height > STREAM_JPEG_MAX_SIZE))) {
+        av_log(NULL, AV_LOG_ERROR, "  jpeg only supports max size of 65500\n");
         goto cleanup;
     }
-    int rgb_bufsize = av_image_get_buffer_size(AV_PIX_FMT_RGB24, tn.shot_width_in, tn.shot_height_in, LINESIZE_ALIGN);
-    rgb_buffer = av_malloc(rgb_bufsize);
-
-    if (NULL == rgb_buffer) {
-        av_log(NULL, AV_LOG_ERROR, "  av_malloc %d bytes failed\n", rgb_bufsize);
-        goto cleanup;
+    if (stream && mc->_target_size > 0) {
+        av_log(NULL, AV_LOG_WARNING, "  --target-size is not used for streamed output\n");
     }
-    // Returns: the size in bytes required for src, a negative error code in case of failure
-    ret = av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, rgb_buffer, AV_PIX_FMT_RGB24, tn.shot_width_in, tn.shot_height_in, LINESIZE_ALIGN);
-    if(ret <0 )
-    {
-        av_log(NULL, AV_LOG_ERROR, "  av_image_fill_arrays failed (%d)\n", ret);
-        goto cleanup;
+    if (stream && !mc->_stream) {
+        av_log(NULL, AV_LOG_INFO, "  height %d is over jpeg's limit; streaming into pages, see --stream\n", tn.img_height);
     }
 
-    pSwsCtx = sws_getContext(pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt,
-        tn.shot_width_in, tn.shot_height_in, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
-    if (NULL == pSwsCtx) {
-        av_log(NULL, AV_LOG_ERROR, "  sws_getContext failed\n");
+    if (0 != thumbnail_alloc_frames(&tc, tn.shot_width_in, tn.shot_height_in))
         goto cleanup;
-    }
+    tc.shot_width_out = tn.shot_width_out;
+    tc.shot_height_out = tn.shot_height_out;
+    tc.column = tn.column;
+    tc.row = tn.row;
+    tc.step_t = tn.step_t;
+    tc.scaled_src_width = scaled_src_width;
 
     /* create the output image */
-    tn.out_ip = gdImageCreateTrueColor(tn.img_width, tn.img_height);
-    if (NULL == tn.out_ip) {
-        av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", tn.img_width, tn.img_height);
-        goto cleanup;
+    if (stream) {
+        // output is written in bands: header (gap & top info text), one band per row, footer (bottom info text)
+        stream_header_h = mc->g_gap + ((3 == mc->L_info_location || 4 == mc->L_info_location) ? tn.txt_height : 0);
+        stream_footer_h = (3 == mc->L_info_location || 4 == mc->L_info_location) ? 0 : tn.txt_height;
+
+        int *band_height = malloc((tn.row + 2) * sizeof(int));
+        if (NULL == band_height) {
+            av_log(NULL, AV_LOG_ERROR, "  malloc failed\n");
+            goto cleanup;
+        }
+        band_height[0] = stream_header_h;
+        for (int i = 1; i <= tn.row; i++)
+            band_height[i] = tn.shot_height_out + mc->g_gap;
+        band_height[tn.row + 1] = stream_footer_h;
+
+        int nb_pages = stream_writer_init(&sw, is_jpeg ? STREAM_FORMAT_JPEG : STREAM_FORMAT_PNG, mc->j_quality,
+            tn.img_width, band_height, tn.row + 2, mc->_stream_page_height, tn.out_filename, mc->o_suffix, stream_open_page, mc);
+        free(band_height);
+        if (nb_pages < 0)
+            goto cleanup;
+        sw.png_level = mc->_png_level;
+        sw.png_filter = mc->_png_filter;
+        av_log(NULL, AV_LOG_VERBOSE, "  streaming %d rows into %d page(s)\n", tn.row, nb_pages);
+
+        tn.out_ip = gdImageCreateTrueColor(tn.img_width, tn.shot_height_out + mc->g_gap);
+        if (stream_header_h > 0)
+            stream_header_ip = gdImageCreateTrueColor(tn.img_width, stream_header_h);
+        if (stream_footer_h > 0)
+            stream_footer_ip = gdImageCreateTrueColor(tn.img_width, stream_footer_h);
+        if (NULL == tn.out_ip || (stream_header_h > 0 && NULL == stream_header_ip) || (stream_footer_h > 0 && NULL == stream_footer_ip)) {
+            av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d\n", tn.img_width);
+            goto cleanup;
+        }
+    } else {
+        tn.out_ip = gdImageCreateTrueColor(tn.img_width, tn.img_height);
+        if (NULL == tn.out_ip) {
+            av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", tn.img_width, tn.img_height);
+            goto cleanup;
+        }
     }
 
-    if(gb__webvtt)
-        sprite = sprite_create(gb_w_width, tn.shot_width_in, tn.shot_height_out, tn);
+    if(mc->_webvtt)
+        sprite = sprite_create(mc->w_width, tn.shot_width_in, tn.shot_height_out, tn);
 
 
     /* setting alpha blending is not needed, using default mode:
@@ -3119,381 +2996,98 @@ make_thumbnail(char *file)
 		//gdEffectMultiply	//overlay pixels with multiply effect, see gdLayerMultiply
     );
     */
-    int background = gdImageColorResolve(tn.out_ip, gb_k_bcolor.r, gb_k_bcolor.g, gb_k_bcolor.b);
+    int background = gdImageColorResolve(tn.out_ip, mc->k_bcolor.r, mc->k_bcolor.g, mc->k_bcolor.b);
     gdImageFilledRectangle(tn.out_ip, 0, 0, tn.img_width, tn.img_height, background);
 
-	if(gb__transparent_bg)
+	if(mc->_transparent_bg)
 		gdImageColorTransparent(tn.out_ip, background);
 
+    gdImagePtr info_ip = tn.out_ip;
+    if (stream) {
+        if (NULL != stream_header_ip)
+            gdImageFilledRectangle(stream_header_ip, 0, 0, tn.img_width, stream_header_h, background);
+        if (NULL != stream_footer_ip)
+            gdImageFilledRectangle(stream_footer_ip, 0, 0, tn.img_width, stream_footer_h, background);
+        if (mc->_transparent_bg && is_png)
+            sw.transparent = background;
+        info_ip = (3 == mc->L_info_location || 4 == mc->L_info_location) ? stream_header_ip : stream_footer_ip;
+    }
+
     /* add info & text */ // do this early so when font is not found we'll quit early
-    if (gb_i_info &&  all_text && strlen(all_text) > 0) {
-        char *str_ret = image_string(tn.out_ip,
-            gb_f_fontname, gb_F_info_color, gb_F_info_font_size,
-            gb_L_info_location, gb_g_gap, all_text, 0, COLOR_WHITE, info_text_padding, &fcStrFlagsInfotext);
+    if (mc->i_info &&  all_text && strlen(all_text) > 0 && NULL != info_ip) {
+        char *str_ret = image_string(info_ip,
+            mc->f_fontname, mc->F_info_color, mc->F_info_font_size,
+            mc->L_info_location, mc->g_gap, all_text, 0, COLOR_WHITE, info_text_padding, &mc->fcStrFlagsInfotext);
         if (NULL != str_ret) {
             av_log(NULL, AV_LOG_ERROR, "  %s; font problem? see -f option\n", str_ret);
             goto cleanup;
         }
     }
 
+    if (NULL != stream_header_ip) {
+        if (0 != stream_writer_write(&sw, stream_header_ip, stream_header_h))
+            goto cleanup;
+        gdImageDestroy(stream_header_ip);
+        stream_header_ip = NULL;
+    }
+
 	/* if needed create shadow image used for every shot	*/
-	if(gb__shadow >= 0){
-		if((thumbShadowIm = create_shadow_image(background, &gb__shadow, tn.shot_width_out, tn.shot_height_out)) == NULL)
+	if(mc->_shadow >= 0){
+		if((thumbShadowIm = create_shadow_image(mc, background, &mc->_shadow, tn.shot_width_out, tn.shot_height_out)) == NULL)
 			goto cleanup;
 	}
 
     /* alloc dynamic thumb data */
     if (-1 == thumb_alloc_dynamic(&tn)) {
         av_log(NULL, AV_LOG_ERROR, "  thumb_alloc_dynamic failed\n");
-        goto cleanup;
-    }
-
-    if (1 == gb_z_seek) {
-        seek_mode = 1;
-    }
-    if (1 == gb_Z_nonseek) {
-        seek_mode = 0;
-        av_log(NULL, AV_LOG_INFO, "  *** using non-seek mode -- slower but more accurate timing.\n");
-    }
-
-    int64_t seek_target, seek_evade; // in time_base unit
-
-    /* decode & fill in the shots */
-  restart:
-    seek_target = 0, seek_evade = 0; // in time_base unit
-    if (0 == seek_mode && gb_B_begin > 10) {
-        av_log(NULL, AV_LOG_INFO, "  -B %.2f with non-seek mode will take some time.\n", gb_B_begin);
-    }
-
-    int evade_try = 0; // blank screen evasion index
-    double avg_evade_try = 0; // average
-    int direction = 0; // seek direction (seek flags)
-    seek_target = tn.step_t + (start_time + gb_B_begin) / tn.time_base;
-    idx = 0; // idx = thumb_idx
-    thumb_nb = tn.row * tn.column; // thumb_nb = # of shots we need
-    int64_t prevshot_pts = -1; // pts of previous good shot
-    int64_t prevfound_pts = -1; // pts of previous decoding
-    gdImagePtr edge_ip = NULL; // edge image
-
-    for (idx = 0; idx < thumb_nb; idx++) {
-
-        int64_t eff_target = seek_target + seek_evade; // effective target
-        eff_target = MAX(eff_target, start_time_tb); // make sure eff_target > start_time
-        TIME_STR time_tmp;
-        format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
-
-        /* for some formats, previous seek might over shoot pass this seek_target; is this a bug in libavcodec? */
-        if (prevshot_pts > eff_target && 0 == evade_try) {
-            // restart in seek mode of skipping shots (FIXME)
-            if ( seek_mode == 1 && 0 == gb_z_seek ) {
-              av_log(NULL, AV_LOG_INFO, "  *** previous seek overshot target %s; switching to non-seek mode\n", time_tmp);
-              av_seek_frame(pFormatCtx, video_index, 0, 0);
-              avcodec_flush_buffers(pCodecCtx);
-              seek_mode = 0;
-              goto restart;
-            }
-            av_log(NULL, AV_LOG_INFO, "  skipping shot at %s because of previous seek or evasions\n", time_tmp);
-            idx--;
-            thumb_nb--;
-            goto skip_shot;
-        }
-
-        // make sure eff_target > previous found
-        eff_target = MAX(eff_target, prevfound_pts+1);
-
-        format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
-        av_log(NULL, AV_LOG_VERBOSE, "\n***eff_target tb: %"PRId64", eff_target s:%.2f (%s), prevshot_pts: %"PRId64"\n",
-            eff_target, calc_time(eff_target, pStream->time_base, start_time), time_tmp, prevshot_pts);
-
-        /* jump to next shot */
-        //struct timeval dstart; // DEBUG
-        //gettimeofday(&dstart, NULL); // calendar time; effected by load & io & etc. DEBUG
-        if (1 == seek_mode) { // seek mode
-            ret = really_seek(pFormatCtx, video_index, eff_target, direction, duration);
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "  seeking to %.2f s failed\n", calc_time(eff_target, pStream->time_base, start_time));
-                goto eof;
-            }
-            avcodec_flush_buffers(pCodecCtx);
-
-            ret = video_decode_next_frame(pFormatCtx, pCodecCtx, pFrame, video_index, &found_pts);
-            if (0 == ret) { // end of file
-                /*goto cleanup;         stops and writes no image */
-                goto eof;               // write into image everything we have so far
-            } else if (ret < 0) { // error
-                av_log(NULL, AV_LOG_ERROR, "  read&decode failed!\n");
-                goto eof;
-            }
-        } else { // non-seek mode -- we keep decoding until we get to the next shot
-            found_pts = 0;
-            while (found_pts < eff_target) {
-                // we should check if it's taking too long for this loop. FIXME
-                ret =  video_decode_next_frame(pFormatCtx, pCodecCtx, pFrame, video_index, &found_pts);
-                if (0 == ret) { // end of file
-                    goto eof;
-                } else if (ret < 0) { // error
-                    av_log(NULL, AV_LOG_ERROR, "  read&decode failed!\n");
-                    goto eof;
-                }
-            }
-        }
-        //struct timeval dfinish; // DEBUG
-        //gettimeofday(&dfinish, NULL); // calendar time; effected by load & io & etc. DEBUG
-        //double decode_time = (dfinish.tv_sec + dfinish.tv_usec/1000000.0) - (dstart.tv_sec + dstart.tv_usec/1000000.0);
-        double decode_time = 0;
-
-        int64_t found_diff = found_pts - eff_target;
-        //av_log(NULL, AV_LOG_INFO, "  found_diff: %.2f\n", found_diff); // DEBUG
-        // if found frame is too far off from target, we'll disable seeking and start over
-        if (idx < 5 && 1 == seek_mode && 0 == gb_z_seek
-            // usually movies have key frames every 10 s
-            && (tn.step_t < (15/tn.time_base) || found_diff > 15/tn.time_base)
-            && (found_diff <= -tn.step_t || found_diff >= tn.step_t)) {
-
-            // compute the approx. time it take for the non-seek mode, if too long print a msg instead
-            double shot_dtime;
-            if (scaled_src_width > 576*4/3.0) { // HD
-                shot_dtime = tn.step_t*tn.time_base * 30 / 30.0;
-            } else if (scaled_src_width > 288*4/3.0) { // ~DVD
-                shot_dtime = tn.step_t*tn.time_base * 30 / 80.0;
-            } else { // small
-                shot_dtime = tn.step_t*tn.time_base * 30 / 500.0;
-            }
-            if (shot_dtime > 2 || shot_dtime * tn.column * tn.row > 120) {
-                av_log(NULL, AV_LOG_INFO, "  *** seeking off target %.2f s, increase time step or use non-seek mode.\n", found_diff*tn.time_base);
-                goto non_seek_too_long;
-            }
-
-            // disable seeking and start over
-            av_seek_frame(pFormatCtx, video_index, 0, 0);
-            avcodec_flush_buffers(pCodecCtx);
-            seek_mode = 0;
-            av_log(NULL, AV_LOG_INFO, "  *** switching to non-seek mode because seeking was off target by %.2f s.\n", found_diff*tn.time_base);
-            av_log(NULL, AV_LOG_INFO, "  non-seek mode is slower. increase time step or use -z if you don't want this.\n");
-            goto restart;
-        }
-      non_seek_too_long:
-
-        //nb_shots++;
-        av_log(NULL, AV_LOG_VERBOSE, "shot %d: found_: %"PRId64" (%.2fs), eff_: %"PRId64" (%.2fs), dtime: %.3f\n",
-            idx, found_pts, calc_time(found_pts, pStream->time_base, start_time),
-            eff_target, calc_time(eff_target, pStream->time_base, start_time), decode_time);
-        av_log(NULL, AV_LOG_VERBOSE, "approx. decoded frames/s: %.2f\n", tn.step_t * tn.time_base * 30 / decode_time); //TODO W: decode_time allways==0
-        /*
-        char debug_filename[2048]; // DEBUG
-        sprintf(debug_filename, "%s_decoded%05d.jpg", tn.out_filename, nb_shots - 1);
-        save_AVFrame(pFrame, pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt,
-            debug_filename, pCodecCtx->width, pCodecCtx->height);
-        */
-
-        // got same picture as previous shot, we'll skip it
-        if (prevshot_pts == found_pts && 0 == evade_try) {
-            av_log(NULL, AV_LOG_INFO, "  skipping shot at %s because got previous shot\n", time_tmp);
-            idx--;
-            thumb_nb--;
-            goto skip_shot;
-        }
-
-        if(gb__filters && filter_color_primaries_match)
-        {
-            av_log(NULL, AV_LOG_VERBOSE, "Aplying filtergraph to the frame\n");
-
-            AVFrame *filt_frame = av_frame_alloc();
-
-            /* push the decoded frame into the filtergraph */
-            if (av_buffersrc_add_frame_flags(buffersrc_ctx, pFrame, AV_BUFFERSRC_FLAG_KEEP_REF) >= 0)
-            {
-                 /* pull filtered frames from the filtergraph */
-                 while (1) {
-                     int ret = av_buffersink_get_frame(buffersink_ctx, filt_frame);
-                     if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
-                         break;
-                     if (ret >= 0)
-                     {
-                        av_frame_unref(pFrame);
-                        pFrame = filt_frame;
-                     }
-                     else
-                        av_log(NULL, AV_LOG_ERROR, "Error while reading the filtergraph\n");
-                 }
-
-                struct SwsContext *pFilteredSwsCtx = sws_getContext(pCodecCtx->width, pCodecCtx->height, filt_frame->format,
-                    tn.shot_width_in, tn.shot_height_in, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
-
-                if (!pFilteredSwsCtx) {
-                    av_log(NULL, AV_LOG_ERROR, "  Filtered sws_getContext failed\n");
-                    goto cleanup;
-                }
-
-                sws_freeContext(pSwsCtx);
-                pSwsCtx = pFilteredSwsCtx;
-            }
-            else
-                av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
-        }
-
-        /* convert to AV_PIX_FMT_RGB24 & resize */
-        int height_of_the_output_slice = sws_scale(pSwsCtx, (const uint8_t* const*)pFrame->data, pFrame->linesize, 0, pCodecCtx->height,
-            pFrameRGB->data, pFrameRGB->linesize);
-        if(height_of_the_output_slice <= 0)
-        {
-            av_log(NULL, AV_LOG_ERROR, "  sws_scale() failed\n");
-            goto cleanup;
-        }
-        /*
-        sprintf(debug_filename, "%s_resized%05d.jpg", tn.out_filename, nb_shots - 1); // DEBUG
-        save_AVFrame(pFrameRGB, tn.shot_width, tn.shot_height, AV_PIX_FMT_RGB24,
-            debug_filename, tn.shot_width, tn.shot_height);
-        */
-
-        /* if blank screen, try again */
-        /* Note: evade logic works best with reasonable step values (>1s) */
-        double blank = blank_frame(pFrameRGB, tn.shot_width_out, tn.shot_height_out);
-        /* Edge detection array - initialized to 1 (edge found) for all parts */
-        float edge[EDGE_PARTS];
-        for (int i = 0; i < EDGE_PARTS; i++) edge[i] = 1.0f;
-        
-        if (evade_step > 0 && blank <= gb_b_blank && gb_D_edge > 0) {
-            edge_ip = rotate_gdImage(
-                detect_edge(pFrameRGB, &tn, edge, EDGE_FOUND),
-                tn.rotation);
-
-        }
-        //av_log(NULL, AV_LOG_VERBOSE, "  idx: %d, evade_try: %d, blank: %.2f%s edge: %.3f %.3f %.3f %.3f %.3f %.3f%s\n",
-        //    idx, evade_try, blank, (blank > gb_b_blank) ? "**b**" : "",
-        //    edge[0], edge[1], edge[2], edge[3], edge[4], edge[5], is_edge(edge, EDGE_FOUND) ? "" : "**e**"); // DEBUG
-        if (evade_step > 0 && (blank > gb_b_blank || !is_edge(edge, EDGE_FOUND))) {
-            idx--;
-            evade_try++;
-            // we'll always search forward to support non-seek mode, which cant go backward
-            // keep trying until getting close to next step
-            seek_evade = evade_step * evade_try;
-            if (seek_evade < (tn.step_t - evade_step)) {
-                av_log(NULL, AV_LOG_VERBOSE, "  * blank or no edge * try #%d: seeking forward seek_evade: %"PRId64" (%.2f s)\n",
-                    evade_try, seek_evade, seek_evade * av_q2d(pStream->time_base));
-                goto continue_cleanup;
-            }
-
-            // not found -- skip shot
-            TIME_STR time_tmp;
-            format_time(calc_time(seek_target, pStream->time_base, start_time), time_tmp, ':');
-            av_log(NULL, AV_LOG_INFO, "  * blank %.2f or no edge * skipping shot at %s after %d tries\n", blank, time_tmp, evade_try);
-            thumb_nb--; // reduce # shots
-            goto skip_shot;
-        }
-
-        //
-        avg_evade_try = (avg_evade_try * idx + evade_try ) / (idx+1); // DEBUG
-        //av_log(NULL, AV_LOG_VERBOSE, "  *** avg_evade_try: %.2f\n", avg_evade_try); // DEBUG
-
-        /* convert to GD image */
-        ip = gdImageCreateTrueColor(tn.shot_width_in, tn.shot_height_in);
-        if (NULL == ip) {
-            av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed: width %d, height %d\n", tn.shot_width_in, tn.shot_height_in);
-            goto cleanup;
-        }
-        FrameRGB_2_gdImage(pFrameRGB, ip, tn.shot_width_in, tn.shot_height_in);
-        ip = rotate_gdImage(ip, tn.rotation);
-
-        /* if debugging, save the edge instead */
-        if (gb_v_verbose > 0 && NULL != edge_ip) {
-            gdImageDestroy(ip);
-            ip = edge_ip;
-            edge_ip = NULL;
-        }
-
-        if (gb__webvtt)
-            sprite_add_shot(sprite, ip, found_pts);
-
-        /* timestamping */
-        // FIXME: this frame might not actually be at the requested position. is pts correct?
-        if (t_timestamp) { // on
-            TIME_STR time_str;
-            format_time(calc_time(found_pts, pStream->time_base, start_time), time_str, ':');
-            char *str_ret = image_string(ip,
-                gb_F_ts_fontname, gb_F_ts_color, gb_F_ts_font_size,
-                gb_L_time_location, 0, time_str, 1, gb_F_ts_shadow, timestamp_text_padding, &fcStrFlagsTimestamp);
-            if (NULL != str_ret) {
-                av_log(NULL, AV_LOG_ERROR, "  %s; font problem? see -f or -F option\n", str_ret);
-                goto cleanup; // LEAK: ip, edge_ip
-            }
-            /* stamp idx & blank & edge for debugging */
-            if (gb_v_verbose > 0) {
-                char idx_str[256];
-                snprintf(idx_str, sizeof(idx_str), "idx: %d, blank: %.2f\n%.6f  %.6f\n%.6f  %.6f\n%.6f  %.6f",
-                    idx, blank, edge[0], edge[1], edge[2], edge[3], edge[4], edge[5]);
-                image_string(ip, gb_f_fontname, COLOR_WHITE, gb_F_ts_font_size, 2, 0, idx_str, 1, COLOR_BLACK, 0, &fcStrFlagsTimestamp);
-            }
-        }
-
-        /* save individual shots */
-        if (gb_I_individual) {
-            TIME_STR time_str;
-            format_time(calc_time(found_pts, pStream->time_base, start_time), time_str, '_');
-
-            char individual_filename[UTF8_FILENAME_SIZE];
-            snprintf(individual_filename, sizeof(individual_filename), "%s", tn.out_filename);
-            char *suffix = strstr(individual_filename, gb_o_suffix);
-            assert(NULL != suffix);
-
-            if(gb_I_individual_thumbnail)
-            {
-                snprintf(suffix, individual_filename + sizeof(individual_filename) - suffix,
-                    "_t_%s_%05d%s", time_str, idx, image_extension);
-                if (save_image(ip, individual_filename) != 0)
-                    av_log(NULL, AV_LOG_ERROR, "  saving individual shot #%05d to %s failed\n", idx, individual_filename);
-            }
-
-            if(gb_I_individual_original)
-            {
-                snprintf(suffix, individual_filename + sizeof(individual_filename) - suffix,
-                    "_o_%s_%05d%s", time_str, idx, image_extension);
-
-                if(save_AVFrame(pFrame,
-                        pCodecCtx->width, pCodecCtx->height,
-                        pCodecCtx->pix_fmt,
-                        individual_filename,
-                        pCodecCtx->width, pCodecCtx->height
-                ) != 0)
-                    av_log(NULL, AV_LOG_ERROR, "  saving individual shot #%05d to %s failed\n", idx, individual_filename);
-            }
-        }
-
-        /* add picture to output image */
-        if (!gb_I_individual_ignore_grid)
-            thumb_add_shot(&tn, ip, thumbShadowIm, idx, found_pts);
+        goto cleanup;
+    }
 
-        gdImageDestroy(ip);
-        ip = NULL;
-
-      skip_shot:
-        /* step */
-        seek_target += tn.step_t;
-
-        seek_evade = 0;
-        direction = 0;
-        evade_try = 0;
-        prevshot_pts = found_pts;
-        av_log(NULL, AV_LOG_VERBOSE, "found_pts bottom: %"PRId64"\n", found_pts);
-
-      continue_cleanup: // cleaning up before continuing the loop
-        prevfound_pts = found_pts;
-        if (NULL != edge_ip) {
-            gdImageDestroy(edge_ip);
-            edge_ip = NULL;
+    /* profile outputs are filled from the same decoded frames */
+    if (mc->_nb_profiles > 0 && !mc->I_individual_ignore_grid) {
+        pout = calloc(mc->_nb_profiles, sizeof(*pout));
+        if (NULL == pout) {
+            av_log(NULL, AV_LOG_ERROR, "  calloc failed\n");
+            goto cleanup;
+        }
+        for (int i = 0; i < mc->_nb_profiles; i++) {
+            if (0 == profile_output_init(mc, &pout[nb_pout], &mc->_profiles[i], &tn,
+                    scaled_src_width_out, scaled_src_height_out, net_duration, all_text, info_text_padding))
+                nb_pout++;
+            else
+                profile_output_cleanup(&pout[nb_pout]);
         }
     }
-    av_log(NULL, AV_LOG_VERBOSE, "  *** avg_evade_try: %.2f\n", avg_evade_try); // DEBUG
 
-    sprite_flush(sprite);
-    sprite_export_vtt(sprite);
+    nb_sched = shot_schedule_create(&sched, (start_time + mc->B_begin) / tn.time_base, &tn, pout, nb_pout);
+    if (nb_sched <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  shot_schedule_create failed\n");
+        goto cleanup;
+    }
+    if (nb_pout > 0)
+        av_log(NULL, AV_LOG_VERBOSE, "  %d shots to decode for %d outputs\n", nb_sched, nb_pout + 1);
 
-    if (gb_I_individual_ignore_grid) {
-        return_code = 0;
+    /* decode & fill in the shots */
+    ShotSink sink = {
+        mc, &tc, &tn, thumbShadowIm, sprite, stream, &sw, 0, pout, nb_pout,
+        t_timestamp, timestamp_text_padding, image_extension, file
+    };
+    ThumbnailSink thumbnail_sink = { shot_sink_restart, shot_sink_add, &sink };
+    idx = thumbnail_decode_and_assemble(&tc, sched, nb_sched, &thumbnail_sink);
+    if (idx < 0)
         goto cleanup;
+    stream_rows = sink.stream_rows;
+
+    if (!tc.eof) {
+        sprite_flush(mc, sprite);
+        sprite_export_vtt(mc, sprite);
+
+        if (mc->I_individual_ignore_grid) {
+            return_code = 0;
+            goto cleanup;
+        }
     }
 
-  eof: ;
     /* crop if we dont get enough shots */
     int cropp_needed = 0;
     const int created_rows = ceil((double)idx / tn.column);
@@ -3502,6 +3096,19 @@ make_thumbnail(char *file)
         av_log(NULL, AV_LOG_ERROR, "  all rows're skipped?\n");
         goto cleanup;
     }
+    if (stream) {
+        // page heights are already written; fill skipped rows with background instead of cropping
+        if (0 != skipped_rows)
+            av_log(NULL, AV_LOG_INFO, "  %d row(s) left empty because of skipped shots\n", skipped_rows);
+
+        for (; stream_rows < tn.row; stream_rows++) {
+            if (0 != stream_write_row(mc, &sw, &tn))
+                goto cleanup;
+        }
+        if (NULL != stream_footer_ip && 0 != stream_writer_write(&sw, stream_footer_ip, stream_footer_h))
+            goto cleanup;
+        skipped_rows = 0;
+    }
     if (0 != skipped_rows) {
         int cropped_height = tn.img_height - skipped_rows*tn.shot_height_out;
 
@@ -3510,7 +3117,7 @@ make_thumbnail(char *file)
 		cropp_needed = 1;
     }
 
-	if(created_rows == 1)
+	if(created_rows == 1 && !stream)
 	{
 		const int created_cols = idx;
 
@@ -3537,7 +3144,23 @@ make_thumbnail(char *file)
 	}
 
     /* save output image */
-    if(save_image(tn.out_ip, tn.out_filename) == 0)
+    if (stream) {
+        if (0 != stream_writer_close(&sw))
+            goto cleanup;
+        tn.out_saved = 1;
+        for (int page = 0; NULL != mc->events && page <= sw.page; page++) {
+            char page_name[UTF8_FILENAME_SIZE];
+            stream_writer_page_name(&sw, page, page_name, sizeof(page_name));
+            events_output(mc->events, file, page_name, file_size(page_name));
+        }
+    } else if (mc->_target_size > 0 && !is_png) {
+        int quality;
+        if (save_image_target_size(mc, tn.out_ip, tn.out_filename, mc->j_quality, &quality) != 0)
+            goto cleanup;
+        tn.out_saved = 1;
+        if (NULL != info_fp)
+            fprintf(info_fp, "Quality: %d (target size %d KB)%s", quality, mc->_target_size, NEWLINE);
+    } else if(save_image(mc, tn.out_ip, tn.out_filename) == 0)
         tn.out_saved  = 1;
     else
         goto cleanup;
@@ -3547,50 +3170,83 @@ make_thumbnail(char *file)
     double diff_time = (tfinish.tv_sec + tfinish.tv_usec/1000000.0) - (tstart.tv_sec + tstart.tv_usec/1000000.0);
     // previous version reported # of decoded shots/s; now we report the # of final shots/s
     //av_log(NULL, AV_LOG_INFO, "  avg. %.2f shots/s; output file: %s\n", nb_shots / diff_time, tn.out_filename);
-    av_log(NULL, AV_LOG_INFO, "  %.2f s, %.2f shots/s; output: %s\n",
-        diff_time, (tn.idx + 1) / diff_time, tn.out_filename);
+    if (stream && sw.nb_pages > 1) {
+        char first_page[UTF8_FILENAME_SIZE];
+        stream_writer_page_name(&sw, 0, first_page, sizeof(first_page));
+        av_log(NULL, AV_LOG_INFO, "  %.2f s, %.2f shots/s; output: %d pages, %s .. %s\n",
+            diff_time, (tn.idx + 1) / diff_time, sw.nb_pages, first_page, sw.page_filename);
+    } else {
+        av_log(NULL, AV_LOG_INFO, "  %.2f s, %.2f shots/s; output: %s\n",
+            diff_time, (tn.idx + 1) / diff_time, tn.out_filename);
+    }
 
     if(tn.tiles_nr == (tn.row * tn.column))
         return_code = 0;        // everything is fine
     else
         return_code = 1;        // warning - some images are missing
+    if (tc.timed_out)
+        return_code = 1;        // --timeout: the shots so far
+
+    for (int i = 0; i < nb_pout; i++) {
+        int ret_profile = profile_output_save(mc, &pout[i]);
+        if (ret_profile < 0)
+            return_code = -1;
+        else if (ret_profile > 0 && 0 == return_code)
+            return_code = 1;
+    }
 
   cleanup:
-    if (NULL != ip)
-        gdImageDestroy(ip);
     if (NULL != thumbShadowIm)
         gdImageDestroy(thumbShadowIm);
     if (NULL != tn.out_ip)
         gdImageDestroy(tn.out_ip);
+    if (NULL != stream_header_ip)
+        gdImageDestroy(stream_header_ip);
+    if (NULL != stream_footer_ip)
+        gdImageDestroy(stream_footer_ip);
+    if (stream) {
+        if (1 != tn.out_saved) {
+            stream_writer_close(&sw); // aborts unfinished page
+            stream_unlink_pages(&sw);
+        }
+        stream_writer_free(&sw);
+    }
+    for (int i = 0; i < nb_pout; i++)
+        profile_output_cleanup(&pout[i]);
+    free(pout);
+    free(sched);
 
     if (NULL != info_fp) {
-        fclose(info_fp);
-        if (gb_I_individual_ignore_grid == 0 && 1 != tn.out_saved) {
-            _tunlink(info_filename_w);
+        if (outputs_in_memory(mc)) {
+            if (mc->I_individual_ignore_grid != 0 || 1 == tn.out_saved)
+                archive_save_file(mc, info_fp, tn.info_filename);
+            fclose(info_fp);
+        } else {
+            fclose(info_fp);
+            if (mc->I_individual_ignore_grid == 0 && 1 != tn.out_saved) {
+                _tunlink(info_filename_w);
+            } else
+                artefact_add(mc, tn.info_filename, -1);
         }
     }
 
-    sws_freeContext(pSwsCtx);
+    // remember stream info and the keyframes found while seeking
+    if (probe_cached && !probe_restored && return_code >= 0 && NULL != tc.format_ctx
+        && 0 == probe_info_fill(tc.format_ctx, &probe_info))
+        probe_cache_store(mc->probe_cache, &probe_key, tc.format_ctx, &probe_info);
+    probe_info_free(&probe_info);
 
-    // Free the video frame
-    if (NULL != rgb_buffer)
-        av_free(rgb_buffer);
-    if (NULL != pFrameRGB)
-        av_free(pFrameRGB);
-    if (NULL != pFrame)
-        av_free(pFrame);
-
-    // Close the codec
-    if (NULL != pCodecCtx) {
-#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(60, 40, 100)
-        avcodec_close(pCodecCtx);
-#endif
-        avcodec_free_context(&pCodecCtx);
+    // errors of the engine; decoding errors don't stop the file until there are too many
+    if (tc.nb_errors > 0) {
+        av_log(NULL, AV_LOG_ERROR, "  %d error(s) in %s; first: %s\n", tc.nb_errors, file, mtn_error_string(tc.error));
+        if (MTN_ERROR_GENERIC == return_code)
+            return_code = tc.error;
     }
 
-    // Close the video file
-    if (NULL != pFormatCtx)
-        avformat_close_input(&pFormatCtx);
+    mc->timed_out = tc.timed_out;
+
+    // Close the codec & the video file
+    thumbnail_context_cleanup(&tc);
 
     thumb_cleanup_dynamic(&tn);
 
@@ -3600,50 +3256,36 @@ make_thumbnail(char *file)
 
 /* modified from glibc
 */
-int myalphasort(const void *a, const void *b)
+int myalphacasesort(const void *a, const void *b)
 {
-    return strcoll(*(const char **) a, *(const char **) b);
+    return strcasecmp(*(const char **) a, *(const char **) b);
 }
 
-/* modified from glibc
+/*
+sort movie_ext for check_extension(); before the scanner threads start
 */
-int myalphacasesort(const void *a, const void *b)
+void sort_movie_ext(MtnContext *mc)
 {
-    return strcasecmp(*(const char **) a, *(const char **) b);
+    assert(mc->movie_ext);
+
+    mc->nb_movie_ext = 0;
+    while (NULL != mc->movie_ext[mc->nb_movie_ext])
+        mc->nb_movie_ext++;
+    qsort(mc->movie_ext, mc->nb_movie_ext, sizeof(*mc->movie_ext), myalphacasesort);
 }
 
 /*
 return 1 if filename has one of the predefined extensions
 */
-int check_extension(char *filename)
+int check_extension(void *opaque, char *filename)
 {
-    assert(movie_ext);
-
-    static int sorted = 0; // 1 = sorted
-
-    static int nb_ext = 0;
-    if(nb_ext == 0)
-    {
-        while(1)
-        {
-            if(movie_ext[nb_ext] == NULL)
-                break;
-
-            nb_ext++;
-        }
-    }
-
-    if (0 == sorted) {
-        qsort(movie_ext, nb_ext, sizeof(*movie_ext), myalphacasesort);
-        sorted = 1;
-    }
-
+    MtnContext *mc = opaque;
     char *ext = strrchr(filename, '.');
     if (NULL == ext) {
         return 0;
     }
     ext += 1;
-    if (NULL == bsearch(&ext, movie_ext, nb_ext, sizeof(*movie_ext), myalphacasesort)) {
+    if (NULL == bsearch(&ext, mc->movie_ext, mc->nb_movie_ext, sizeof(*mc->movie_ext), myalphacasesort)) {
         return 0;
     }
     if (NULL != strstr(filename, "uTorrentPartFile")) {
@@ -3653,17 +3295,15 @@ int check_extension(char *filename)
 }
 
 /**
- * @brief modified from glibc's scandir -- mingw doesn't have scandir
+ * @brief read subdirectories and movies of sd->path into sd -- called by the scanner threads
+ * entries are stat()ed only if readdir doesn't tell their type (d_type)
  * @return 0- success, otherwise - failed
  */
-int process_dir(char *dir, int current_depth)
+int read_dir(void *opaque, ScanDir *sd)
 {
+    MtnContext *mc = opaque;
     int return_code = -1;
-
-    if(gb_d_depth >= 0 && current_depth>gb_d_depth)
-        return 0;
-
-    current_depth++;
+    char *dir = sd->path;
 
 #if defined(WIN32) && defined(_UNICODE)
     wchar_t dir_w[FILENAME_MAX];
@@ -3678,10 +3318,7 @@ int process_dir(char *dir, int current_depth)
         return -1;
     }
 
-    /* read directory & sort */
     struct _tdirent *d;
-    char **v = NULL;
-    size_t cnt = 0, vsize = 0;
     while (1) {
         errno = 0;
         d = _treaddir(dp);
@@ -3707,46 +3344,553 @@ int process_dir(char *dir, int current_depth)
         char child_utf8[UTF8_FILENAME_SIZE];
         strcpy_va(child_utf8, 3, dir, FOLDER_SEPARATOR, d_name_utf8);
 
-        if (1 != is_dir(child_utf8) && 1 != check_extension(child_utf8)) {
+        int child_is_dir = -1; // unknown
+#ifdef DT_DIR
+        if (DT_DIR == d->d_type)
+            child_is_dir = 1;
+        else if (DT_REG == d->d_type)
+            child_is_dir = 0;
+#endif
+        if (0 == child_is_dir && 1 != check_extension(mc, child_utf8)) {
             continue;
         }
+        if (-1 == child_is_dir) { // symlinks, filesystems without d_type
+            child_is_dir = is_dir(child_utf8);
+            if (1 != child_is_dir && 1 != check_extension(mc, child_utf8))
+                continue;
+        }
 
-        if (cnt == vsize) {
-            char **new;
-            if (vsize == 0)
-                vsize = 50;
-            else
-                vsize *= 2;
-            new = realloc(v, vsize * sizeof(*v));
-            if (new == NULL) {
-                // mingw doesn't seem to set errno for memory functions
-                av_log(NULL, AV_LOG_ERROR, "\n%s: realloc failed: %s\n", dir, strerror(errno));
-                goto cleanup;
+        if (0 != scan_dir_add(sd, child_utf8, child_is_dir))
+            goto cleanup;
+    }
+    return_code = 0;
+
+  cleanup:
+    _tclosedir(dp);
+
+    return return_code;
+}
+
+/**
+ * @brief process listing sd of dir; read now if sd is NULL
+ * @return 0- success, otherwise - failed
+ */
+int process_dir(MtnContext *mc, char *dir, ScanDir *sd, int current_depth)
+{
+    int return_code = -1;
+
+    if(mc->d_depth >= 0 && current_depth>mc->d_depth)
+        return 0;
+
+    if (NULL == sd) {
+        sd = scanner_open(mc->scanner, dir, current_depth);
+        if (NULL == sd) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: malloc failed: %s\n", dir, strerror(errno));
+            return -1;
+        }
+    }
+
+    /* process dirs & files in sorted order */
+    if (0 == scanner_wait(mc->scanner, sd))
+        return_code = process_loop(mc, sd->cnt, NULL, sd, current_depth + 1);
+
+    scanner_close(mc->scanner, sd);
+
+    return return_code;
+}
+
+/*
+process paths read from list (file or "-" for stdin) as they are read;
+paths are separated by newlines or NUL characters (find -print0)
+only the current path is kept in memory
+return like process_loop
+*/
+int process_files_from(MtnContext *mc, const char *list)
+{
+    FILE *fp = stdin;
+    if (0 != strcmp(list, "-")) {
+#if defined(WIN32) && defined(_UNICODE)
+        wchar_t list_w[FILENAME_MAX];
+        UTF8_2_WC(list_w, list, FILENAME_MAX);
+#else
+        const char *list_w = list;
+#endif
+        fp = _tfopen(list_w, _TEXT("rb"));
+        if (NULL == fp) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: opening file list '%s' failed: %s\n", mc->argv0, list, strerror(errno));
+            return EXIT_ERROR;
+        }
+    }
+
+    char *path = NULL;
+    size_t size = 0, len;
+    unsigned long n = 0, files_done = 0, files_uncomplete = 0;
+    int c, failed = 0;
+
+    do {
+        len = 0;
+        while (EOF != (c = getc(fp)) && '\n' != c && '\0' != c) {
+            if (len + 1 >= size) {
+                size_t new_size = size ? size * 2 : FILENAME_MAX;
+                char *new = realloc(path, new_size);
+                if (NULL == new) {
+                    av_log(NULL, AV_LOG_ERROR, "\n%s: realloc failed: %s\n", list, strerror(errno));
+                    failed = 1;
+                    goto cleanup;
+                }
+                path = new;
+                size = new_size;
             }
-            v = new;
+            path[len++] = c;
         }
+        if (len > 0 && '\r' == path[len - 1]) // CRLF lists
+            len--;
+        if (0 == len)
+            continue;
+        path[len] = '\0';
 
-        char *vnew = malloc(strlen(child_utf8) + 1); // for '\0'
-        if (vnew == NULL) {
-            av_log(NULL, AV_LOG_ERROR, "\n%s: malloc failed: %s\n", dir, strerror(errno));
+        n++;
+        if (NULL != mc->batch) // run by workers; batch_done() prints the exit code
+            mc->batch->tag = n;
+        int ret = process_loop(mc, 1, &path, NULL, 0);
+        if (NULL == mc->batch)
+            av_log(NULL, AV_LOG_INFO, "%s: %lu: %s: exit code %d\n", mc->argv0, n, path, ret);
+        if (EXIT_SUCCESS == ret || EXIT_WARNING == ret)
+            files_done++;
+        if (EXIT_WARNING == ret)
+            files_uncomplete++;
+    } while (EOF != c);
+
+    if (ferror(fp)) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: reading file list '%s' failed: %s\n", mc->argv0, list, strerror(errno));
+        failed = 1;
+    }
+
+  cleanup:
+    if (NULL != mc->batch)
+        mc->batch->tag = 0;
+    free(path);
+    if (stdin != fp)
+        fclose(fp);
+
+    if (failed || files_done < n)
+        return EXIT_ERROR;
+    if (files_uncomplete > 0)
+        return EXIT_WARNING;
+    return EXIT_SUCCESS;
+}
+
+/*
+hash of all options affecting the output into mc->cache_options
+options which only select files or change messages are not included
+*/
+void cache_options_hash(MtnContext *mc)
+{
+    uint64_t h = hash_str(CACHE_HASH_INIT, mc->version);
+    AVDictionaryEntry *e = NULL;
+    int i;
+
+    HASH_VAL(h, mc->a_ratio);
+    HASH_VAL(h, mc->b_blank);
+    HASH_VAL(h, mc->B_begin);
+    HASH_VAL(h, mc->c_column);
+    HASH_VAL(h, mc->C_cut);
+    HASH_VAL(h, mc->D_edge);
+    HASH_VAL(h, mc->E_end);
+    h = hash_str(h, mc->f_fontname);
+    HASH_VAL(h, mc->F_info_color);
+    HASH_VAL(h, mc->F_info_font_size);
+    h = hash_str(h, mc->F_ts_fontname);
+    HASH_VAL(h, mc->F_ts_color);
+    HASH_VAL(h, mc->F_ts_shadow);
+    HASH_VAL(h, mc->F_ts_font_size);
+    HASH_VAL(h, mc->g_gap);
+    HASH_VAL(h, mc->h_height);
+    HASH_VAL(h, mc->H_human_filesize);
+    HASH_VAL(h, mc->i_info);
+    HASH_VAL(h, mc->I_individual);
+    HASH_VAL(h, mc->I_individual_thumbnail);
+    HASH_VAL(h, mc->I_individual_original);
+    HASH_VAL(h, mc->I_individual_ignore_grid);
+    HASH_VAL(h, mc->j_quality);
+    HASH_VAL(h, mc->k_bcolor);
+    HASH_VAL(h, mc->L_info_location);
+    HASH_VAL(h, mc->L_time_location);
+    h = hash_str(h, mc->N_suffix);
+    h = hash_str(h, mc->o_suffix);
+    h = hash_str(h, mc->O_outdir);
+    HASH_VAL(h, mc->r_row);
+    HASH_VAL(h, mc->s_step);
+    HASH_VAL(h, mc->S_select_video_stream);
+    HASH_VAL(h, mc->t_timestamp);
+    h = hash_str(h, mc->T_text);
+    HASH_VAL(h, mc->w_width);
+    HASH_VAL(h, mc->X_filename_use_full);
+    h = hash_str(h, mc->x_basename_custom);
+    HASH_VAL(h, mc->z_seek);
+    HASH_VAL(h, mc->Z_nonseek);
+
+    HASH_VAL(h, mc->_shadow);
+    HASH_VAL(h, mc->_transparent_bg);
+    HASH_VAL(h, mc->_cover);
+    HASH_VAL(h, mc->_webvtt);
+    h = hash_str(h, mc->_cover_suffix);
+    h = hash_str(h, mc->_webvtt_prefix);
+    while ((e = av_dict_get(mc->_options, "", e, AV_DICT_IGNORE_SUFFIX))) {
+        h = hash_str(h, e->key);
+        h = hash_str(h, e->value);
+    }
+    h = hash_str(h, mc->_filters);
+    h = hash_str(h, mc->_filter_color_primaries);
+    HASH_VAL(h, mc->_tonemap);
+    HASH_VAL(h, mc->_stream);
+    HASH_VAL(h, mc->_stream_page_height);
+    for (i = 0; i < mc->_nb_profiles; i++) {
+        h = hash_str(h, mc->_profiles[i].o_suffix);
+        HASH_VAL(h, mc->_profiles[i].w_width);
+        HASH_VAL(h, mc->_profiles[i].c_column);
+        HASH_VAL(h, mc->_profiles[i].r_row);
+        HASH_VAL(h, mc->_profiles[i].s_step);
+        HASH_VAL(h, mc->_profiles[i].j_quality);
+    }
+    h = hash_str(h, mc->_archive);
+    HASH_VAL(h, mc->_png_level);
+    HASH_VAL(h, mc->_png_filter);
+    HASH_VAL(h, mc->_target_size);
+
+    snprintf(mc->cache_options, sizeof(mc->cache_options), "%016llx", (unsigned long long)h);
+}
+
+/*
+hash of all options affecting stream info into mc->probe_options
+*/
+void probe_options_hash(MtnContext *mc)
+{
+    uint64_t h = hash_str(CACHE_HASH_INIT, mc->version);
+    AVDictionaryEntry *e = NULL;
+
+    h = hash_str(h, LIBAVFORMAT_IDENT);
+    while ((e = av_dict_get(mc->_options, "", e, AV_DICT_IGNORE_SUFFIX))) {
+        h = hash_str(h, e->key);
+        h = hash_str(h, e->value);
+    }
+    snprintf(mc->probe_options, sizeof(mc->probe_options), "%016llx", (unsigned long long)h);
+}
+
+/*
+estimated cost of processing a movie for --order: its size, weighted by the
+largest video resolution if --probe-cache knows it, as a byte of a 4K movie
+takes longer to decode than a byte of a SD one
+*/
+int64_t movie_cost(MtnContext *mc, char *file)
+{
+    CacheKey key;
+    int64_t duration, pixels;
+
+    if (0 != cache_key_of(mc, file, &key))
+        return 0;
+    key.options = mc->probe_options;
+    if (NULL != mc->probe_cache && 1 == probe_cache_peek(mc->probe_cache, &key, &duration, &pixels) && pixels > 0) {
+        av_log(NULL, AV_LOG_VERBOSE, "%s: %"PRId64" bytes, %"PRId64" pixels, %.0f s\n", file, key.size, pixels, (double)duration / AV_TIME_BASE);
+        return (int64_t)((double)key.size * pixels / (1920 * 1080));
+    }
+    return key.size;
+}
+
+/*
+count movie in its --shard and return 1 if it's in ours; the shard is a
+hash of the path relative to the crawl root, so every node crawling the
+same tree from any mount point gets the same shards; files given directly
+are hashed as given
+*/
+int shard_accept(MtnContext *mc, const char *file)
+{
+    const char *rel = file + mc->shard_root;
+    uint64_t h = CACHE_HASH_INIT;
+
+    for (; *rel; rel++) {
+        char c = ('\\' == *rel) ? '/' : *rel; // same on Windows
+        h = cache_hash(h, &c, 1);
+    }
+    int shard = h % mc->_shard_n;
+    mc->shard_counts[shard]++;
+    return shard == mc->_shard_i - 1;
+}
+
+/*
+hash of size and DEDUPE_SAMPLES blocks spread over the movie for --dedupe=content
+return 0 ok, -1 error
+*/
+int dedupe_hash(const char *path, int64_t size, uint64_t *hash)
+{
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t path_w[FILENAME_MAX];
+    UTF8_2_WC(path_w, path, FILENAME_MAX);
+#else
+    const char *path_w = path;
+#endif
+    FILE *fp = _tfopen(path_w, _TEXT("rb"));
+    uint8_t *buf = malloc(DEDUPE_BLOCK);
+    uint64_t h = cache_hash(CACHE_HASH_INIT, &size, sizeof(size));
+    int i, ret = -1;
+
+    if (NULL == fp || NULL == buf)
+        goto cleanup;
+    for (i = 0; i < DEDUPE_SAMPLES; i++) {
+        int64_t pos = (size <= DEDUPE_BLOCK) ? 0 : (size - DEDUPE_BLOCK) / (DEDUPE_SAMPLES - 1) * i;
+        if (0 != FSEEK64(fp, pos, SEEK_SET))
             goto cleanup;
-        }
-        strcpy(vnew, child_utf8);
-        v[cnt++] = vnew;
-        //av_log(NULL, AV_LOG_INFO, "process_dir added: %s\n", v[cnt-1]); // DEBUG
+        size_t n = fread(buf, 1, DEDUPE_BLOCK, fp);
+        if (ferror(fp))
+            goto cleanup;
+        h = cache_hash(h, buf, n);
+        if (size <= DEDUPE_BLOCK)
+            break;
     }
-    qsort(v, cnt, sizeof(*v), myalphasort);
+    *hash = h;
+    ret = 0;
+
+  cleanup:
+    free(buf);
+    if (NULL != fp)
+        fclose(fp);
+    return ret;
+}
+
+/*
+make output dst of a --dedupe duplicate from src: a hard link, or a copy where that's impossible
+return 0 ok, -1 error
+*/
+int link_output(const char *src, const char *dst)
+{
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t src_w[FILENAME_MAX], dst_w[FILENAME_MAX];
+    UTF8_2_WC(src_w, src, FILENAME_MAX);
+    UTF8_2_WC(dst_w, dst, FILENAME_MAX);
+#else
+    const char *src_w = src, *dst_w = dst;
+#endif
+    _tunlink(dst_w); // link() doesn't replace
+#ifndef WIN32
+    if (0 == link(src_w, dst_w))
+        return 0;
+#endif
+
+    FILE *in = _tfopen(src_w, _TEXT("rb")), *out = NULL;
+    char *buf = malloc(DEDUPE_BLOCK);
+    int ret = -1;
+    size_t n;
 
-    /* process dirs & files */
-    return_code = process_loop(cnt, v, current_depth);
+    if (NULL == in || NULL == buf || NULL == (out = _tfopen(dst_w, _TEXT("wb"))))
+        goto cleanup;
+    while ((n = fread(buf, 1, DEDUPE_BLOCK, in)) > 0) {
+        if (n != fwrite(buf, 1, n, out))
+            goto cleanup;
+    }
+    ret = ferror(in) ? -1 : 0;
 
   cleanup:
-    while (cnt > 0)
-        free(v[--cnt]);
-    free(v);
-    _tclosedir(dp);
+    if (NULL != out && 0 != fclose(out))
+        ret = -1;
+    if (NULL != in)
+        fclose(in);
+    free(buf);
+    return ret;
+}
 
-    return return_code;
+/*
+make outputs of file, a duplicate of first, from the outputs of first
+return result of first or -1 if an output couldn't be made
+*/
+int dedupe_outputs(MtnContext *mc, const DedupeMovie *first, char *file)
+{
+    char base[UTF8_FILENAME_SIZE];
+    size_t len = strlen(first->base);
+    char *name = first->artefacts, *nl;
+    int ret = first->result;
+
+    av_log(NULL, AV_LOG_INFO, "%s: %s is the same as %s. using its outputs.\n", mc->argv0, file, first->path);
+    output_base(mc, file, base);
+    mc->archive_source = file;
+
+    for (; NULL != (nl = strchr(name, '\n')); name = nl + 1) {
+        char *src = malloc(nl - name + 1);
+        char *dst = NULL;
+        if (NULL != src) {
+            memcpy(src, name, nl - name);
+            src[nl - name] = '\0';
+        }
+        if (NULL == src || 0 != strncmp(src, first->base, len)
+            || NULL == (dst = malloc(strlen(base) + strlen(src + len) + 1))) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: no output name for %s of '%s'\n", mc->argv0, file, src ? src : "");
+            free(src);
+            ret = -1;
+            continue;
+        }
+        sprintf(dst, "%s%s", base, src + len);
+
+        if (0 == strcmp(src, dst)) { // same output names, e.g. the same path twice
+            artefact_add(mc, dst, -1);
+        } else if (0 == mc->W_overwrite && output_exists(mc, dst)) {
+            av_log(NULL, AV_LOG_INFO, "%s: output file %s already exists. omitted.\n", mc->argv0, dst);
+        } else if (NULL != mc->archive) {
+            void *data;
+            size_t size;
+            if (0 != archive_get(mc->archive, first->path, path_2_file(src), &data, &size)) {
+                ret = -1;
+            } else {
+                if (0 != archive_save_data(mc, dst, data, size))
+                    ret = -1;
+                free(data);
+            }
+        } else if (0 == link_output(src, dst)) {
+            av_log(NULL, AV_LOG_VERBOSE, "%s -> %s\n", src, dst);
+            artefact_add(mc, dst, -1);
+        } else {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: making '%s' from '%s' failed: %s\n", mc->argv0, dst, src, strerror(errno));
+            ret = -1;
+        }
+        free(src);
+        free(dst);
+    }
+    return ret;
+}
+
+/*
+print movies found in each --shard for balancing checks
+*/
+void shard_summary(MtnContext *mc)
+{
+    unsigned long total = 0;
+    int i;
+
+    for (i = 0; i < mc->_shard_n; i++)
+        total += mc->shard_counts[i];
+    av_log(NULL, AV_LOG_INFO, "%s: shard %d/%d: %lu of %lu movies; per shard:", mc->argv0,
+        mc->_shard_i, mc->_shard_n, mc->shard_counts[mc->_shard_i - 1], total);
+    for (i = 0; i < mc->_shard_n; i++)
+        av_log(NULL, AV_LOG_INFO, " %lu", mc->shard_counts[i]);
+    av_log(NULL, AV_LOG_INFO, "\n");
+}
+
+/*
+--probe: print stream info of file as a JSON line without opening decoders;
+from --probe-cache if the movie is unchanged
+return 0 ok, <0 MtnError
+*/
+int probe_movie(MtnContext *mc, char *file)
+{
+    ThumbnailContext tc;
+    ProbeInfo probe_info = {0};
+    CacheKey key;
+    int ret, cached = 0, restored = 0;
+
+    thumbnail_context_init(&tc, mc);
+    ret = thumbnail_open_file(&tc, file);
+    if (0 == ret && NULL != mc->probe_cache && 0 == cache_key_of(mc, file, &key)) {
+        key.options = mc->probe_options;
+        cached = 1;
+        restored = (1 == probe_cache_restore(mc->probe_cache, &key, tc.format_ctx, &probe_info));
+    }
+    if (0 == ret && !restored && avformat_find_stream_info(tc.format_ctx, NULL) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: avformat_find_stream_info %s failed\n", mc->argv0, file);
+        ret = MTN_ERROR_STREAM_NOT_FOUND;
+    }
+    if (0 == ret && !restored && 0 != probe_info_fill(tc.format_ctx, &probe_info))
+        ret = MTN_ERROR_OUT_OF_MEMORY;
+
+    if (0 == ret) {
+        probe_write_json(stdout, file, tc.format_ctx, probe_info.rotation);
+        if (cached && !restored)
+            probe_cache_store(mc->probe_cache, &key, tc.format_ctx, &probe_info);
+    } else {
+        fputs("{\"file\":", stdout);
+        json_write_str(stdout, file);
+        fputs(",\"error\":", stdout);
+        json_write_str(stdout, mtn_error_string(ret));
+        fputs("}\n", stdout);
+        fflush(stdout);
+    }
+
+    probe_info_free(&probe_info);
+    thumbnail_context_cleanup(&tc);
+    return ret;
+}
+
+/*
+process one movie unless --cache has it
+return value of make_thumbnail()
+*/
+static int process_movie_logged(MtnContext *mc, char *file)
+{
+    CacheKey key;
+    const DedupeMovie *first = NULL;
+    int ret, have_key = ((NULL != mc->cache || NULL != mc->dedupe) && 0 == cache_key_of(mc, file, &key));
+    int cached = (NULL != mc->cache && have_key);
+    struct timeval tstart, tfinish;
+
+    if (mc->_probe)
+        return probe_movie(mc, file);
+
+    if (NULL != mc->journal) {
+        int code, failures;
+        switch (journal_check(mc->journal, file, mc->_max_retries, &code, &failures)) {
+        case JOURNAL_FINISHED:
+            av_log(NULL, AV_LOG_INFO, "%s: %s is finished according to the journal. omitted.\n", mc->argv0, file);
+            return code;
+        case JOURNAL_GAVE_UP:
+            av_log(NULL, AV_LOG_ERROR, "%s: %s failed %d times. omitted.\n", mc->argv0, file, failures);
+            return -1;
+        default:
+            if (failures > 0)
+                av_log(NULL, AV_LOG_INFO, "%s: %s failed %d times. retrying.\n", mc->argv0, file, failures);
+        }
+        journal_start(mc->journal, file);
+    }
+    gettimeofday(&tstart, NULL);
+    events_start(mc->events, file);
+    mc->timed_out = 0;
+
+    if (cached && 1 == cache_lookup(mc->cache, &key, &ret)) {
+        av_log(NULL, AV_LOG_INFO, "%s: %s is unchanged since the last run. omitted.\n", mc->argv0, file);
+    } else {
+        free(mc->artefacts);
+        mc->artefacts = NULL;
+        if (NULL != mc->dedupe && have_key)
+            first = dedupe_find(mc->dedupe, file, key.dev, key.ino, key.size);
+        if (NULL != first) {
+            ret = dedupe_outputs(mc, first, file);
+        } else {
+            ret = make_thumbnail(mc, file);
+            if (NULL != mc->dedupe && have_key && NULL != mc->artefacts && !mc->timed_out) {
+                char base[UTF8_FILENAME_SIZE];
+                output_base(mc, file, base);
+                dedupe_add(mc->dedupe, file, key.dev, key.ino, key.size, base, mc->artefacts, ret);
+            }
+        }
+        // a movie cut short by --timeout is to be made again, e.g. with more time
+        if (cached && ret >= 0 && !mc->timed_out)
+            cache_store(mc->cache, &key, file, ret, mc->artefacts);
+    }
+
+    gettimeofday(&tfinish, NULL);
+    events_done(mc->events, file, ret, (tfinish.tv_sec - tstart.tv_sec) + (tfinish.tv_usec - tstart.tv_usec) / 1000000.0);
+    if (NULL != mc->journal) // timed out: failed, so --resume retries it
+        journal_end(mc->journal, file, mc->timed_out ? EXIT_ERROR : 0 == ret ? EXIT_SUCCESS : 1 == ret ? EXIT_WARNING : EXIT_ERROR);
+    return ret;
+}
+
+/*
+process_movie_logged() with file as the "file" of --log-format=json
+*/
+int process_movie(MtnContext *mc, char *file)
+{
+    int ret;
+
+    mtn_log_set_file(file);
+    ret = process_movie_logged(mc, file);
+    mtn_log_set_file(NULL);
+    return ret;
 }
 
 /**
@@ -3755,23 +3899,44 @@ int process_dir(char *dir, int current_depth)
  *  1- uncomplete image(s)
  *  2- error
  */
-int process_loop(int n, char **files, int current_depth)
+int process_loop(MtnContext *mc, int n, char **files, ScanDir *sd, int current_depth)
 {
     int i;
     int files_done=0;
     int files_uncomplete=0;
 
     for (i = 0; i < n; i++) {
-        av_log(NULL, AV_LOG_VERBOSE, "process_loop: %s\n", files[i]);
-        rem_trailing_slash(files[i]); //
-
-        if (is_dir(files[i])) { // directory
-            //av_log(NULL, AV_LOG_INFO, "process_loop: %s is a DIR\n", files[i]); // DEBUG
-            if(process_dir(files[i], current_depth) == 0)
+        char *file;
+        int file_is_dir;
+        if (NULL != sd) { // directory listing; type is known
+            file = sd->entries[i].path;
+            file_is_dir = sd->entries[i].is_dir;
+        } else {
+            file = files[i];
+            rem_trailing_slash(file); //
+            file_is_dir = is_dir(file);
+            // crawl root of --shard: the directory; files (also of --files-from) are
+            // hashed as given, as a basename like video.mp4 would put them all in one shard
+            mc->shard_root = file_is_dir ? strlen(file) + 1 : 0;
+        }
+        av_log(NULL, AV_LOG_VERBOSE, "process_loop: %s\n", file);
+
+        if (file_is_dir) { // directory
+            //av_log(NULL, AV_LOG_INFO, "process_loop: %s is a DIR\n", file); // DEBUG
+            ScanDir *sub = NULL;
+            if (NULL != sd) { // closed by process_dir
+                sub = sd->entries[i].sub;
+                sd->entries[i].sub = NULL;
+            }
+            if(process_dir(mc, file, sub, current_depth) == 0)
+                files_done++;
+        } else if (mc->_shard_n > 0 && !shard_accept(mc, file)) { // another node's
+            files_done++;
+        } else if (NULL != mc->batch) { // run by the workers of process_batch_stream() or later by process_batch()
+            if (0 == batch_add(mc->batch, file, BATCH_ORDER_NAME == mc->_order ? 0 : movie_cost(mc, file)))
                 files_done++;
         } else { // not a directory
-
-            switch (make_thumbnail(files[i])) {
+            switch (process_movie(mc, file)) {
             case 0:
                 files_done++;
                 break;
@@ -3788,71 +3953,20 @@ int process_loop(int n, char **files, int current_depth)
     if(files_done == n && files_uncomplete > 0)
         return EXIT_WARNING;
 
-    if(files_done == n)
-        return EXIT_SUCCESS;
-
-    return EXIT_ERROR;
-}
-
-// copied & modified from mingw-runtime-3.13's init.c
-typedef struct STARTUPINFO{
-  int newmode;
-} _startupinfo;
-extern void __wgetmainargs (int *, wchar_t ***, wchar_t ***, int, _startupinfo *);
-
-char *gb_argv[10240]; // FIXME: global & hopefully noone will use more than this
-/*
-get command line arguments and expand wildcards in utf-8 in windows
-caller needs to free argv[i]
-return 0 if ok
-*/
-int get_windows_argv(int __attribute__((unused)) *pargc, char __attribute__((unused)) ***pargv)
-{
-#if defined(WIN32) && defined(_UNICODE)
-    // copied & modified from mingw-runtime-3.13's init.c
-    int _argc = 0;
-    wchar_t **_argv = 0;
-    wchar_t **dummy_environ = 0;
-    _startupinfo start_info;
-    start_info.newmode = 0;
-    __wgetmainargs(&_argc, &_argv, &dummy_environ, -1, &start_info);
-
-    //printf("\nafter __wgetmainargs; _argc: %d\n", _argc); // DEBUG
-    int i;
-    for (i = 0; i < _argc; i++) {
-        //wprintf(L"_argv[%d] wc: %s\n", i, _argv[i]); // DEBUG
-        char utf8_buf[UTF8_FILENAME_SIZE] = "";
-        WC_2_UTF8(utf8_buf, _argv[i], UTF8_FILENAME_SIZE);
-        //printf("_argv[%d] utf8: %s\n", i, utf8_buf); // DEBUG
-
-        char *dup = strdup(utf8_buf);
-        if (NULL == dup) {
-            goto error;
-        }
-        gb_argv[i] = dup;
-    }
-    *pargc = _argc;
-    *pargv = gb_argv;
-    return 0;
-
-  error:
-    while (--_argc >= 0) {
-        free(gb_argv[_argc]);
-    }
-    return -1;
-#endif
-
-    return 0;
+    if(files_done == n)
+        return EXIT_SUCCESS;
+
+    return EXIT_ERROR;
 }
 
 /*
 */
-int get_location_opt(char c, char *optarg)
+int get_location_opt(MtnContext *mc, char c, char *optarg)
 {
     int ret = 1;
     char *bak = strdup(optarg); // backup for displaying error
     if (NULL == bak) {
-        av_log(NULL, AV_LOG_ERROR, "%s: strdup failed\n", gb_argv0);
+        av_log(NULL, AV_LOG_ERROR, "%s: strdup failed\n", mc->argv0);
         return ret;
     }
 
@@ -3864,7 +3978,7 @@ int get_location_opt(char c, char *optarg)
     if (NULL == token) {
         goto cleanup;
     }
-    gb_L_info_location = strtod(token, &tailptr);
+    mc->L_info_location = strtod(token, &tailptr);
     if ('\0' != *tailptr) { // error
         goto cleanup;
     }
@@ -3875,7 +3989,7 @@ int get_location_opt(char c, char *optarg)
         ret = 0; // time stamp format is optional
         goto cleanup;
     }
-    gb_L_time_location = strtod(token, &tailptr);
+    mc->L_time_location = strtod(token, &tailptr);
     if ('\0' != *tailptr) { // error
         goto cleanup;
     }
@@ -3884,7 +3998,7 @@ int get_location_opt(char c, char *optarg)
 
   cleanup:
     if (0 != ret) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", gb_argv0, c, bak);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", mc->argv0, c, bak);
     }
     free(bak);
     return ret;
@@ -3927,10 +4041,10 @@ int parse_color(rgb_color *rgb, color_str str)
 
 /*
 */
-int get_color_opt(char c, rgb_color *color, char *optarg)
+int get_color_opt(MtnContext *mc, char c, rgb_color *color, char *optarg)
 {
     if (-1 == parse_color(color, optarg))   {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s' -- must be RRGGBB in hex\n", gb_argv0, c, optarg);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s' -- must be RRGGBB in hex\n", mc->argv0, c, optarg);
         return 1;
     }
     return 0;
@@ -3938,12 +4052,12 @@ int get_color_opt(char c, rgb_color *color, char *optarg)
 
 /*
 */
-int get_format_opt(char c, char *optarg)
+int get_format_opt(MtnContext *mc, char c, char *optarg)
 {
     int ret = 1;
     char *bak = strdup(optarg); // backup for displaying error
     if (NULL == bak) {
-        av_log(NULL, AV_LOG_ERROR, "%s: strdup failed\n", gb_argv0);
+        av_log(NULL, AV_LOG_ERROR, "%s: strdup failed\n", mc->argv0);
         return ret;
     }
 
@@ -3951,7 +4065,7 @@ int get_format_opt(char c, char *optarg)
 
     // info text font color
     char *token = strtok(optarg, delim);
-    if (NULL == token || -1 == parse_color(&gb_F_info_color, token)) {
+    if (NULL == token || -1 == parse_color(&mc->F_info_color, token)) {
         goto cleanup;
     }
     // info text font size
@@ -3960,7 +4074,7 @@ int get_format_opt(char c, char *optarg)
         goto cleanup;
     }
     char *tailptr;
-    gb_F_info_font_size = strtod(token, &tailptr);
+    mc->F_info_font_size = strtod(token, &tailptr);
     if ('\0' != *tailptr) { // error
         goto cleanup;
     }
@@ -3968,19 +4082,19 @@ int get_format_opt(char c, char *optarg)
     token = strtok (NULL, delim);
     if (NULL == token) {
         ret = 0; // time stamp format is optional
-        gb_F_ts_fontname = gb_f_fontname;
-        gb_F_ts_font_size = gb_F_info_font_size - 1;
+        mc->F_ts_fontname = mc->f_fontname;
+        mc->F_ts_font_size = mc->F_info_font_size - 1;
         goto cleanup;
     }
-    gb_F_ts_fontname = token;
+    mc->F_ts_fontname = token;
     // time stamp font color
     token = strtok (NULL, delim);
-    if (NULL == token || -1 == parse_color(&gb_F_ts_color , token)) {
+    if (NULL == token || -1 == parse_color(&mc->F_ts_color , token)) {
         goto cleanup;
     }
     // time stamp shadow color
     token = strtok (NULL, delim);
-    if (NULL == token || -1 == parse_color(&gb_F_ts_shadow  , token)) {
+    if (NULL == token || -1 == parse_color(&mc->F_ts_shadow  , token)) {
         goto cleanup;
     }
     // time stamp font size
@@ -3988,7 +4102,7 @@ int get_format_opt(char c, char *optarg)
     if (NULL == token) {
         goto cleanup;
     }
-    gb_F_ts_font_size = strtod(token, &tailptr);
+    mc->F_ts_font_size = strtod(token, &tailptr);
     if ('\0' != *tailptr) { // error
         goto cleanup;
     }
@@ -3997,7 +4111,7 @@ int get_format_opt(char c, char *optarg)
 
   cleanup:
     if (0 != ret) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", gb_argv0, c, bak);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", mc->argv0, c, bak);
         av_log(NULL, AV_LOG_ERROR, "examples:\n");
         av_log(NULL, AV_LOG_ERROR, "info text blue color size 10:\n  -%c 0000FF:10\n", c);
         av_log(NULL, AV_LOG_ERROR, "info text green color size 12; time stamp font comicbd.ttf yellow color black shadow size 8 :\n  -%c 00FF00:12:comicbd.ttf:ffff00:000000:8\n", c);
@@ -4007,7 +4121,7 @@ int get_format_opt(char c, char *optarg)
 }
 
 int
-get_opt_for_I_arg(char *optarg)
+get_opt_for_I_arg(MtnContext *mc, char *optarg)
 {
     if(strchr(optarg, '-'))
     {
@@ -4016,17 +4130,17 @@ get_opt_for_I_arg(char *optarg)
     }
 
     if(strchr(optarg, 't') || strchr(optarg, 'T'))
-        gb_I_individual_thumbnail = 1;
+        mc->I_individual_thumbnail = 1;
 
     if(strchr(optarg, 'o') || strchr(optarg, 'O'))
-        gb_I_individual_original  = 1;
+        mc->I_individual_original  = 1;
 
     if(strchr(optarg, 'i') || strchr(optarg, 'I'))
-        gb_I_individual_ignore_grid = 1;
+        mc->I_individual_ignore_grid = 1;
 
-    if( gb_I_individual_thumbnail +
-        gb_I_individual_original +
-        gb_I_individual_ignore_grid == 0 )
+    if( mc->I_individual_thumbnail +
+        mc->I_individual_original +
+        mc->I_individual_ignore_grid == 0 )
     {
         av_log(NULL, AV_LOG_ERROR, "Unknown argument \"%s\" for -I option!", optarg);
         return 1;
@@ -4035,45 +4149,98 @@ get_opt_for_I_arg(char *optarg)
     return 0;
 }
 
-int get_int_opt(char *c, int *opt, char *optarg, int sign)
+int get_int_opt(MtnContext *mc, char *c, int *opt, char *optarg, int sign)
 {
     char *tailptr;
     int ret = strtol(optarg, &tailptr, 10);
     if ('\0' != *tailptr) { // error
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s is invalid at '%s'\n", gb_argv0, c, tailptr);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s is invalid at '%s'\n", mc->argv0, c, tailptr);
         return 1;
     }
     if (sign > 0 && ret <= 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s must be > 0\n", gb_argv0, c);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s must be > 0\n", mc->argv0, c);
         return 1;
     } else if (sign == 0 && ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s must be >= 0\n", gb_argv0, c);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%s must be >= 0\n", mc->argv0, c);
         return 1;
     }
     *opt = ret;
     return 0;
 }
 
-int get_double_opt(char c, double *opt, char *optarg, double sign)
+/*
+parse --profile "o:SUFFIX|w:WIDTH|c:COLUMNS|r:ROWS|s:STEP|j:QUALITY"
+return 0 ok, -1 error
+*/
+int profile_parse(MtnContext *mc, Profile *p, char *spec)
+{
+    AVDictionary *dict = NULL;
+    AVDictionaryEntry *e = NULL;
+    int parse_error = 0;
+
+    p->o_suffix = NULL;
+    p->w_width = p->c_column = p->r_row = p->s_step = p->j_quality = PROFILE_INHERIT;
+
+    if (av_dict_parse_string(&dict, spec, ":", "|", 0) != 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: error parsing input parameter --profile=%s\n", mc->argv0, spec);
+        av_dict_free(&dict);
+        return -1;
+    }
+
+    while (NULL != (e = av_dict_get(dict, "", e, AV_DICT_IGNORE_SUFFIX))) {
+        if (strcmp(e->key, "o") == 0) {
+            free(p->o_suffix);
+            p->o_suffix = strdup(e->value);
+        } else if (strcmp(e->key, "w") == 0)
+            parse_error += get_int_opt(mc, "-profile w", &p->w_width, e->value, 0);
+        else if (strcmp(e->key, "c") == 0)
+            parse_error += get_int_opt(mc, "-profile c", &p->c_column, e->value, 1);
+        else if (strcmp(e->key, "r") == 0)
+            parse_error += get_int_opt(mc, "-profile r", &p->r_row, e->value, 0);
+        else if (strcmp(e->key, "s") == 0)
+            parse_error += get_int_opt(mc, "-profile s", &p->s_step, e->value, 0);
+        else if (strcmp(e->key, "j") == 0)
+            parse_error += get_int_opt(mc, "-profile j", &p->j_quality, e->value, 1);
+        else {
+            av_log(NULL, AV_LOG_ERROR, "%s: unknown key '%s' in --profile=%s\n", mc->argv0, e->key, spec);
+            parse_error++;
+        }
+    }
+    av_dict_free(&dict);
+
+    if (NULL == p->o_suffix || '\0' == *p->o_suffix) {
+        av_log(NULL, AV_LOG_ERROR, "%s: --profile=%s needs an output suffix (o:SUFFIX)\n", mc->argv0, spec);
+        parse_error++;
+    }
+
+    if (parse_error) {
+        free(p->o_suffix);
+        p->o_suffix = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int get_double_opt(MtnContext *mc, char c, double *opt, char *optarg, double sign)
 {
     char *tailptr;
     double ret = strtod(optarg, &tailptr);
     if ('\0' != *tailptr) { // error
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", gb_argv0, c, tailptr);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c is invalid at '%s'\n", mc->argv0, c, tailptr);
         return 1;
     }
     if (sign > 0 && ret <= 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c must be > 0\n", gb_argv0, c);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c must be > 0\n", mc->argv0, c);
         return 1;
     } else if (sign == 0.0 && ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c must be >= 0\n", gb_argv0, c);
+        av_log(NULL, AV_LOG_ERROR, "%s: argument for option -%c must be >= 0\n", mc->argv0, c);
         return 1;
     }
     *opt = ret;
     return 0;
 }
 
-char* mtn_identification()
+char* mtn_identification(MtnContext *mc)
 {
     const char txt[] = "Movie Thumbnailer (mtn) %s\nCompiled%s with FFmpeg %s (%s %s %s %s), GD %s, WebP %s, Avif %s";
     const char* FFMPEG_IDENT = av_version_info();
@@ -4106,20 +4273,20 @@ char* mtn_identification()
 	"n/a";
 #endif
 
-    size_t s = snprintf(NULL, 0, txt, gb_version, STATIC_MSG, FFMPEG_IDENT, LIBAVCODEC_IDENT, LIBAVFORMAT_IDENT, LIBAVUTIL_IDENT, LIBSWSCALE_IDENT, GD_VER, WEBP_IDENT, AVIF_IDENT) +1;
+    size_t s = snprintf(NULL, 0, txt, mc->version, STATIC_MSG, FFMPEG_IDENT, LIBAVCODEC_IDENT, LIBAVFORMAT_IDENT, LIBAVUTIL_IDENT, LIBSWSCALE_IDENT, GD_VER, WEBP_IDENT, AVIF_IDENT) +1;
 	char* msg = malloc(s);
-               snprintf( msg, s, txt, gb_version, STATIC_MSG, FFMPEG_IDENT, LIBAVCODEC_IDENT, LIBAVFORMAT_IDENT, LIBAVUTIL_IDENT, LIBSWSCALE_IDENT, GD_VER, WEBP_IDENT, AVIF_IDENT);
+               snprintf( msg, s, txt, mc->version, STATIC_MSG, FFMPEG_IDENT, LIBAVCODEC_IDENT, LIBAVFORMAT_IDENT, LIBAVUTIL_IDENT, LIBSWSCALE_IDENT, GD_VER, WEBP_IDENT, AVIF_IDENT);
 	return msg;
 }
 
 void
-usage()
+usage(MtnContext *mc)
 {
-    av_log(NULL, AV_LOG_INFO, "\n%s\n\n", mtn_identification());
+    av_log(NULL, AV_LOG_INFO, "\n%s\n\n", mtn_identification(mc));
 #ifndef DEBUG
     av_log(NULL, AV_LOG_INFO, "Mtn saves thumbnails of specified movie files or directories to image files.\n");
     av_log(NULL, AV_LOG_INFO, "For directories, it will recursively search inside for movie files.\n\n");
-    av_log(NULL, AV_LOG_INFO, "Usage:\n  %s [options] file_or_dir1 [file_or_dir2] ... [file_or_dirn]\n", gb_argv0);
+    av_log(NULL, AV_LOG_INFO, "Usage:\n  %s [options] file_or_dir1 [file_or_dir2] ... [file_or_dirn]\n", mc->argv0);
     av_log(NULL, AV_LOG_INFO, "Options: (and default values)\n");
     av_log(NULL, AV_LOG_INFO, "  -a aspect_ratio : override input file's display aspect ratio\n");
     av_log(NULL, AV_LOG_INFO, "  -b %.2f : skip if %% blank is higher; 0:skip all 1:skip really blank >1:off\n", GB_B_BLANK);
@@ -4127,7 +4294,7 @@ usage()
     av_log(NULL, AV_LOG_INFO, "  -c %d : # of column\n", GB_C_COLUMN);
     av_log(NULL, AV_LOG_INFO, "  -C %d : cut movie and thumbnails not more than the specified seconds; <=0:off\n", GB_C_CUT);
     av_log(NULL, AV_LOG_INFO, "  -d #: recursion depth; 0:immediate children files only\n");
-    av_log(NULL, AV_LOG_INFO, "  -D %d : edge detection; 0:off >0:on; higher detects more; try -D4 -D6 or -D8\n", gb_D_edge);
+    av_log(NULL, AV_LOG_INFO, "  -D %d : edge detection; 0:off >0:on; higher detects more; try -D4 -D6 or -D8\n", mc->D_edge);
     av_log(NULL, AV_LOG_INFO, "  -e : comma separated list of file extensions\n");
     av_log(NULL, AV_LOG_INFO, "  -E %.1f : omit this seconds at the end\n", GB_E_END);
     av_log(NULL, AV_LOG_INFO, "  -f %s : font file; use absolute path if not in usual places\n", GB_F_FONTNAME);
@@ -4167,25 +4334,53 @@ usage()
     av_log(NULL, AV_LOG_INFO, "  --filters=FILTER_GRAPH\n       simple FILTER_GRAPH passed to the FFmpeg's libavfilter library (same as -vf or -filter:v in ffmpeg)\n");
     av_log(NULL, AV_LOG_INFO, "  --filter-color-primaries=<COLOR_PRIMARIES>\n       comma-separated list of color primaries\n");
     av_log(NULL, AV_LOG_INFO, "  --tonemap[=<MODE>]\n       tonemap HDR movies; 0: off, 1-3: predefined filtergraphs\n");
+    av_log(NULL, AV_LOG_INFO, "  --profile=o:SUFFIX[|w:WIDTH|c:COLUMNS|r:ROWS|s:STEP|j:QUALITY]\n       create additional output with SUFFIX from the same decoded frames; unspecified values are taken from -w -c -r -s -j; can be repeated\n");
+    av_log(NULL, AV_LOG_INFO, "  --target-size=KB\n       lower the quality of jpeg/webp/avif output until it fits in KB kilobytes; the quality from -j is tried first. The quality used is written to the info file (-N)\n");
+    av_log(NULL, AV_LOG_INFO, "  --cache=FILE\n       remember processed movies in the SQLite database FILE and skip them while their size, modification time and the options are the same\n");
+    av_log(NULL, AV_LOG_INFO, "  --probe-cache=FILE\n       remember stream info and keyframe index of movies in the SQLite database FILE and reuse them while the size and modification time are the same; may be the same file as --cache\n");
+    av_log(NULL, AV_LOG_INFO, "  --files-from=FILE\n       process paths read from FILE (- for stdin) separated by newlines or NUL characters, one by one as they are read; the result of each path is printed\n");
+    av_log(NULL, AV_LOG_INFO, "  --serve=SOCKET\n       stay resident and run jobs received as JSON lines on the Unix socket SOCKET; options given with --serve are defaults of all jobs (not on Windows)\n");
+    av_log(NULL, AV_LOG_INFO, "  --serve-workers=N\n       run at most N jobs at once; default is the number of CPUs\n");
+    av_log(NULL, AV_LOG_INFO, "  --watch=DIR\n       stay resident and process movies as they are written or moved into DIR and its subdirectories (up to -d); movies already in DIR are not processed (Linux only)\n");
+    av_log(NULL, AV_LOG_INFO, "  --watch-delay=MS\n       process a movie after it wasn't written for MS milliseconds; default is 2000\n");
+    av_log(NULL, AV_LOG_INFO, "  --watch-workers=N\n       process at most N movies at once; default is the number of CPUs\n");
+    av_log(NULL, AV_LOG_INFO, "  --order=name|largest|smallest\n       collect all movies first (largest, smallest) and process them by estimated cost (size, and resolution from --probe-cache); largest finishes a batch soonest with --jobs, smallest gets most movies done soonest. Default is name: as listed\n");
+    av_log(NULL, AV_LOG_INFO, "  --jobs=N\n       process N movies at once in worker processes; a worker gets the next movie when it's done, as it is found unless --order collects them (not on Windows)\n");
+    av_log(NULL, AV_LOG_INFO, "  --shard=i/N\n       process only movies of shard i of N, chosen by a hash of their path relative to the directory given on the command line, or of the path of a file as given; nodes crawling the same tree with i = 1..N process each movie once. Movies found in each shard are counted at the end\n");
+    av_log(NULL, AV_LOG_INFO, "  --journal=FILE\n       append the result of each movie to the text file FILE; several mtn processes can write to the same journal\n");
+    av_log(NULL, AV_LOG_INFO, "  --resume=FILE\n       like --journal, but skip movies finished according to FILE; failed movies and movies which crashed mtn are retried up to --max-retries times\n");
+    av_log(NULL, AV_LOG_INFO, "  --max-retries=N\n       retry failed movies at most N times with --resume; default is 2\n");
+    av_log(NULL, AV_LOG_INFO, "  --dedupe[=inode|content]\n       process hard links of a movie processed before (inode, default) or also identical copies (content: same size and sampled blocks) only once; their outputs are hard links or copies of the first one's. With --jobs only duplicates processed by the same worker are found\n");
+    av_log(NULL, AV_LOG_INFO, "  --json-events\n       print progress as JSON lines on stdout: start, probe, shot, output and done of each movie; the log stays on stderr\n");
+    av_log(NULL, AV_LOG_INFO, "  --probe\n       print container, streams, codecs, rotation, SAR and colour properties of each movie as a JSON line on stdout without decoding; uses --probe-cache\n");
+    av_log(NULL, AV_LOG_INFO, "  --probesize=BYTES\n       read at most BYTES to find the streams; lower is faster, but may miss streams or codec details\n");
+    av_log(NULL, AV_LOG_INFO, "  --analyzeduration=MICROSECONDS\n       analyze at most MICROSECONDS of the movie to find the streams\n");
+    av_log(NULL, AV_LOG_INFO, "  --timeout=SEC\n       give each movie at most SEC seconds, opening included; a movie running out of time keeps the shots so far and exits with 1 like other missing shots. 0 = no limit (default)\n");
+    av_log(NULL, AV_LOG_INFO, "  --log-format=text|json\n       json: write the log to stderr as JSON lines with time, level, src, file and msg keys; -v and -q still choose the level\n");
+    av_log(NULL, AV_LOG_INFO, "  --archive=FILE\n       store all outputs in the SQLite database FILE instead of separate files; several mtn processes can add to the same archive at once. --stream is not used with this option\n");
+    av_log(NULL, AV_LOG_INFO, "  --png-level=0-9\n       zlib compression level of png output; lower is faster\n");
+    av_log(NULL, AV_LOG_INFO, "  --png-filter=none|sub|up|avg|paeth|adaptive\n       png row filter; adaptive (default) chooses the filter for each row\n");
+    av_log(NULL, AV_LOG_INFO, "  --png-threads=N\n       deflate png output in N threads; the file is the same for any N\n");
+    av_log(NULL, AV_LOG_INFO, "  --stream[=MAX_PAGE_HEIGHT]\n       write jpeg/png output row by row to keep memory low; split into pages (_p001, ...) higher than MAX_PAGE_HEIGHT. Turned on automatically for jpeg higher than 65500\n");
     av_log(NULL, AV_LOG_INFO, "  file_or_dirX\n       name of the movie file or directory containing movie files\n\n");
 
 // no man page for windows; let them know about examples
 #ifdef WIN32
     av_log(NULL, AV_LOG_INFO, "Examples:\n");
-    av_log(NULL, AV_LOG_INFO, "  to save thumbnails to file infile%s with default options:\n    %s infile.avi\n", GB_O_SUFFIX, gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to change time step to 65 seconds & change total width to 900:\n    %s -s 65 -w 900 infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to step evenly to get 3 columns x 10 rows:\n    %s -c 3 -r 10 infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to save output files to writeable directory:\n    %s -O writeable /read/only/dir/infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to get 2 columns in original movie size:\n    %s -c 2 -w 0 infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to skip uninteresting shots, try:\n    %s -D 6 infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to save only individual shots and keep original size:\n    %s -I io infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to draw shadows of the individual shots, try:\n    %s --shadow=3 -g 7 infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to export thumbnails in WebVTT format every 10 seconds and max size of 1920x1920px:\n    %s -s 10 -w 1920 --vtt=/var/www/html/ -O /mnt/fileshare -Ii -o .jpg infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to skip warning messages to be printed to console (useful for flv files producing lot of warnings), try:\n    %s -q infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "  to enable additional protocols:\n    %s --options=protocol_whitelist:file,crypto,data,http,https,tcp,tls infile.avi\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "\nIn windows, you can run %s from command prompt or drag files/dirs from\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "windows explorer and drop them on %s. you can change the default options\n", gb_argv0);
-    av_log(NULL, AV_LOG_INFO, "by creating a shortcut to %s and add options there (right click the\n", gb_argv0);
+    av_log(NULL, AV_LOG_INFO, "  to save thumbnails to file infile%s with default options:\n    %s infile.avi\n", GB_O_SUFFIX, mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to change time step to 65 seconds & change total width to 900:\n    %s -s 65 -w 900 infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to step evenly to get 3 columns x 10 rows:\n    %s -c 3 -r 10 infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to save output files to writeable directory:\n    %s -O writeable /read/only/dir/infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to get 2 columns in original movie size:\n    %s -c 2 -w 0 infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to skip uninteresting shots, try:\n    %s -D 6 infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to save only individual shots and keep original size:\n    %s -I io infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to draw shadows of the individual shots, try:\n    %s --shadow=3 -g 7 infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to export thumbnails in WebVTT format every 10 seconds and max size of 1920x1920px:\n    %s -s 10 -w 1920 --vtt=/var/www/html/ -O /mnt/fileshare -Ii -o .jpg infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to skip warning messages to be printed to console (useful for flv files producing lot of warnings), try:\n    %s -q infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "  to enable additional protocols:\n    %s --options=protocol_whitelist:file,crypto,data,http,https,tcp,tls infile.avi\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "\nIn windows, you can run %s from command prompt or drag files/dirs from\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "windows explorer and drop them on %s. you can change the default options\n", mc->argv0);
+    av_log(NULL, AV_LOG_INFO, "by creating a shortcut to %s and add options there (right click the\n", mc->argv0);
     av_log(NULL, AV_LOG_INFO, "shortcut -> Properties -> Target); then drop files/dirs on the shortcut\n");
     av_log(NULL, AV_LOG_INFO, "instead.\n");
 #endif
@@ -4204,27 +4399,12 @@ usage()
 /**
  * @return 0- success, otherwise - failed
  */
-int main(int argc, char *argv[])
+/*
+parse options into mc
+return number of errors
+*/
+int parse_options(MtnContext *mc, int argc, char *argv[])
 {
-    int return_code = -1;
-
-    gb_argv0 = path_2_file(argv[0]);
-    setvbuf(stderr, NULL, _IONBF, 0); // turn off buffering in mingw
-
-    gb_st_start = time(NULL); // program start time
-    srand(gb_st_start);
-
-    // get utf-8 argv in windows
-    if (0 != get_windows_argv(&argc, &argv)) {
-        av_log(NULL, AV_LOG_ERROR, "%s: cannot get command line arguments\n", gb_argv0);
-        return -1;
-    }
-
-    av_log(NULL, AV_LOG_VERBOSE, "locale: %s\n", setlocale(LC_ALL, ""));
-
-    /* get & check options */
-
-
 	struct option long_options[] = {		// no_argument, required_argument, optional_argument
 		{"shadow",                optional_argument,  0,  0 },
 		{"transparent",           no_argument,        0,  0 },
@@ -4234,6 +4414,34 @@ int main(int argc, char *argv[])
 		{"filters",               required_argument,  0,  0 },
 		{"filter-color-primaries",required_argument,  0,  0 },
 		{"tonemap",               optional_argument,  0,  0 },
+		{"stream",                optional_argument,  0,  0 },
+		{"profile",               required_argument,  0,  0 },
+		{"archive",               required_argument,  0,  0 },
+		{"png-level",             required_argument,  0,  0 },
+		{"png-filter",            required_argument,  0,  0 },
+		{"png-threads",           required_argument,  0,  0 },
+		{"target-size",           required_argument,  0,  0 },
+		{"cache",                 required_argument,  0,  0 },
+		{"probe-cache",           required_argument,  0,  0 },
+		{"files-from",            required_argument,  0,  0 },
+		{"serve",                 required_argument,  0,  0 },
+		{"serve-workers",         required_argument,  0,  0 },
+		{"watch",                 required_argument,  0,  0 },
+		{"watch-delay",           required_argument,  0,  0 },
+		{"watch-workers",         required_argument,  0,  0 },
+		{"order",                 required_argument,  0,  0 },
+		{"jobs",                  required_argument,  0,  0 },
+		{"shard",                 required_argument,  0,  0 },
+		{"journal",               required_argument,  0,  0 },
+		{"resume",                required_argument,  0,  0 },
+		{"max-retries",           required_argument,  0,  0 },
+		{"dedupe",                optional_argument,  0,  0 },
+		{"json-events",           no_argument,        0,  0 },
+		{"probe",                 no_argument,        0,  0 },
+		{"probesize",             required_argument,  0,  0 },
+		{"analyzeduration",       required_argument,  0,  0 },
+		{"timeout",               required_argument,  0,  0 },
+		{"log-format",            required_argument,  0,  0 },
 		{0,                       0,                  0,  0 }
 	};
     int parse_error = 0, option_index = 0;
@@ -4245,50 +4453,50 @@ int main(int argc, char *argv[])
             if(strcmp("shadow", long_options[option_index].name) == 0)
             {
                 if(optarg)
-                    parse_error += get_int_opt("-shadow", &gb__shadow, optarg, 0);
+                    parse_error += get_int_opt(mc, "-shadow", &mc->_shadow, optarg, 0);
                 else
-                    gb__shadow = 0;
+                    mc->_shadow = 0;
             }
             else
             {
                 if(strcmp("transparent", long_options[option_index].name) == 0)
-                    gb__transparent_bg = 1;
+                    mc->_transparent_bg = 1;
                 else
                 {
                     if(strcmp("cover", long_options[option_index].name) == 0)
                     {
-                        gb__cover = 1;
+                        mc->_cover = 1;
 
                         if(optarg)
-                            gb__cover_suffix = optarg;
+                            mc->_cover_suffix = optarg;
                     }
                     else
                     {
                         if(strcmp("vtt", long_options[option_index].name) == 0)
                         {
-                            gb__webvtt = 1;
+                            mc->_webvtt = 1;
 
                             if(optarg)
-                                gb__webvtt_prefix = optarg;
+                                mc->_webvtt_prefix = optarg;
                         }
                         else
                         {
                             if(strcmp("options", long_options[option_index].name) == 0)
                             {
-                                if(options_add_2_AVDictionary(&gb__options, optarg) != 0)
+                                if(options_add_2_AVDictionary(&mc->_options, optarg) != 0)
                                     parse_error++;
                             }
                             else
                             {
                                 if(strcmp("filters", long_options[option_index].name) == 0)
                                 {
-                                    gb__filters = strdup(optarg);
+                                    mc->_filters = strdup(optarg);
                                 }
                                 else
                                 {
                                     if(strcmp("filter-color-primaries", long_options[option_index].name) == 0)
                                     {
-                                        gb__filter_color_primaries = strdup(optarg);
+                                        mc->_filter_color_primaries = strdup(optarg);
                                     }
                                     else
                                     {
@@ -4298,30 +4506,198 @@ int main(int argc, char *argv[])
                                             {
                                                 char *endptr = NULL;
                                                 errno = 0;
-                                                gb__tonemap = strtol(optarg, &endptr, 10);
+                                                mc->_tonemap = strtol(optarg, &endptr, 10);
 
                                                 if(errno != 0)
                                                 {
                                                     parse_error++;
-                                                    av_log(NULL, AV_LOG_ERROR, "%s: invalid argument for the --tonemap option\n", gb_argv0);
+                                                    av_log(NULL, AV_LOG_ERROR, "%s: invalid argument for the --tonemap option\n", mc->argv0);
                                                 }
 
                                                 if(optarg == endptr)
                                                 {
                                                     parse_error++;
-                                                    av_log(NULL, AV_LOG_ERROR, "%s: No digits were found in argument for the --tonemap option\n", gb_argv0);
+                                                    av_log(NULL, AV_LOG_ERROR, "%s: No digits were found in argument for the --tonemap option\n", mc->argv0);
                                                 }
 
-                                                if(gb__tonemap < 0 || gb__tonemap > 4347
+                                                if(mc->_tonemap < 0 || mc->_tonemap > 4347
                                                 )
                                                 {
                                                     parse_error++;
-                                                    av_log(NULL, AV_LOG_ERROR, "%s: argument for the --tonemap option must be between 0 and 3\n", gb_argv0);
+                                                    av_log(NULL, AV_LOG_ERROR, "%s: argument for the --tonemap option must be between 0 and 3\n", mc->argv0);
                                                 }
                                             }
                                             else
                                             {
-                                                gb__tonemap = DEFAULT_FLTERGRAPH;
+                                                mc->_tonemap = DEFAULT_FLTERGRAPH;
+                                            }
+                                        }
+                                        else if(strcmp("stream", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_stream = 1;
+
+                                            if(optarg)
+                                                parse_error += get_int_opt(mc, "-stream", &mc->_stream_page_height, optarg, 1);
+                                        }
+                                        else if(strcmp("profile", long_options[option_index].name) == 0)
+                                        {
+                                            if(mc->_nb_profiles >= MAX_PROFILES)
+                                            {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: at most %d --profile options are supported\n", mc->argv0, MAX_PROFILES);
+                                            }
+                                            else if(profile_parse(mc, &mc->_profiles[mc->_nb_profiles], optarg) == 0)
+                                                mc->_nb_profiles++;
+                                            else
+                                                parse_error++;
+                                        }
+                                        else if(strcmp("archive", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_archive = optarg;
+                                        }
+                                        else if(strcmp("png-level", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-png-level", &mc->_png_level, optarg, 0);
+                                            if(mc->_png_level > 9)
+                                            {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --png-level option must be between 0 and 9\n", mc->argv0);
+                                            }
+                                        }
+                                        else if(strcmp("png-filter", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_png_filter = pngenc_filter_from_name(optarg);
+                                            if(mc->_png_filter < 0)
+                                            {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --png-filter option must be none, sub, up, avg, paeth or adaptive\n", mc->argv0);
+                                            }
+                                        }
+                                        else if(strcmp("png-threads", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-png-threads", &mc->_png_threads, optarg, 1);
+                                        }
+                                        else if(strcmp("target-size", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-target-size", &mc->_target_size, optarg, 1);
+                                        }
+                                        else if(strcmp("cache", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_cache = optarg;
+                                        }
+                                        else if(strcmp("probe-cache", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_probe_cache = optarg;
+                                        }
+                                        else if(strcmp("files-from", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_files_from = optarg;
+                                        }
+                                        else if(strcmp("serve", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_serve = optarg;
+                                        }
+                                        else if(strcmp("serve-workers", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-serve-workers", &mc->_serve_workers, optarg, 1);
+                                        }
+                                        else if(strcmp("watch", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_watch = optarg;
+                                        }
+                                        else if(strcmp("watch-delay", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-watch-delay", &mc->_watch_delay, optarg, 0);
+                                        }
+                                        else if(strcmp("watch-workers", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-watch-workers", &mc->_watch_workers, optarg, 1);
+                                        }
+                                        else if(strcmp("order", long_options[option_index].name) == 0)
+                                        {
+                                            if(strcmp("name", optarg) == 0)
+                                                mc->_order = BATCH_ORDER_NAME;
+                                            else if(strcmp("largest", optarg) == 0)
+                                                mc->_order = BATCH_ORDER_LARGEST;
+                                            else if(strcmp("smallest", optarg) == 0)
+                                                mc->_order = BATCH_ORDER_SMALLEST;
+                                            else
+                                            {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --order option must be name, largest or smallest\n", mc->argv0);
+                                            }
+                                        }
+                                        else if(strcmp("jobs", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-jobs", &mc->_jobs, optarg, 1);
+                                        }
+                                        else if(strcmp("shard", long_options[option_index].name) == 0)
+                                        {
+                                            char c;
+                                            if(sscanf(optarg, "%d/%d%c", &mc->_shard_i, &mc->_shard_n, &c) != 2
+                                                || mc->_shard_n < 1 || mc->_shard_i < 1 || mc->_shard_i > mc->_shard_n)
+                                            {
+                                                parse_error++;
+                                                mc->_shard_n = 0;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --shard option must be i/N with 1 <= i <= N\n", mc->argv0);
+                                            }
+                                        }
+                                        else if(strcmp("journal", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_journal = optarg;
+                                        }
+                                        else if(strcmp("resume", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_resume = optarg;
+                                        }
+                                        else if(strcmp("max-retries", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-max-retries", &mc->_max_retries, optarg, 0);
+                                        }
+                                        else if(strcmp("dedupe", long_options[option_index].name) == 0)
+                                        {
+                                            if(NULL == optarg || strcmp("inode", optarg) == 0)
+                                                mc->_dedupe = 1;
+                                            else if(strcmp("content", optarg) == 0)
+                                                mc->_dedupe = 2;
+                                            else
+                                            {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --dedupe option must be inode or content\n", mc->argv0);
+                                            }
+                                        }
+                                        else if(strcmp("json-events", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_json_events = 1;
+                                        }
+                                        else if(strcmp("probe", long_options[option_index].name) == 0)
+                                        {
+                                            mc->_probe = 1;
+                                        }
+                                        else if(strcmp("probesize", long_options[option_index].name) == 0
+                                            || strcmp("analyzeduration", long_options[option_index].name) == 0)
+                                        {
+                                            // demuxer options like --options; also used when making thumbnails
+                                            const char *name = long_options[option_index].name;
+                                            int limit;
+                                            if (0 == get_int_opt(mc, 'p' == name[0] ? "-probesize" : "-analyzeduration", &limit, optarg, 1))
+                                                av_dict_set(&mc->_options, name, optarg, 0);
+                                            else
+                                                parse_error++;
+                                        }
+                                        else if(strcmp("timeout", long_options[option_index].name) == 0)
+                                        {
+                                            parse_error += get_int_opt(mc, "-timeout", &mc->_timeout, optarg, 0);
+                                        }
+                                        else if(strcmp("log-format", long_options[option_index].name) == 0)
+                                        {
+                                            if (0 == strcmp("text", optarg))
+                                                mc->_log_json = 0;
+                                            else if (0 == strcmp("json", optarg))
+                                                mc->_log_json = 1;
+                                            else {
+                                                parse_error++;
+                                                av_log(NULL, AV_LOG_ERROR, "%s: argument for the --log-format option must be text or json\n", mc->argv0);
                                             }
                                         }
                                     }
@@ -4333,303 +4709,605 @@ int main(int argc, char *argv[])
             }
             break;
         case 'a':
-            if (0 == get_double_opt('a', &tmp_a_ratio, optarg, 1)) { // success
-                gb_a_ratio.num = tmp_a_ratio * 10000;
-                gb_a_ratio.den = 10000;
+            if (0 == get_double_opt(mc, 'a', &tmp_a_ratio, optarg, 1)) { // success
+                mc->a_ratio.num = tmp_a_ratio * 10000;
+                mc->a_ratio.den = 10000;
             } else {
                 parse_error++;
             }
             break;
 //		case 'A':
         case 'b':
-            parse_error += get_double_opt('b', &gb_b_blank, optarg, 0);
-            if (gb_b_blank < .2) {
-                av_log(NULL, AV_LOG_INFO, "%s: -b %.2f might be too extreme; try -b .5\n", gb_argv0, gb_b_blank);
+            parse_error += get_double_opt(mc, 'b', &mc->b_blank, optarg, 0);
+            if (mc->b_blank < .2) {
+                av_log(NULL, AV_LOG_INFO, "%s: -b %.2f might be too extreme; try -b .5\n", mc->argv0, mc->b_blank);
             }
-            if (gb_b_blank > 1) {
+            if (mc->b_blank > 1) {
                 // turn edge detection off cuz it requires blank detection
-                gb_D_edge = 0;
+                mc->D_edge = 0;
             }
             break;
         case 'B':
-            parse_error += get_double_opt('B', &gb_B_begin, optarg, 0);
+            parse_error += get_double_opt(mc, 'B', &mc->B_begin, optarg, 0);
             break;
         case 'c':
-            parse_error += get_int_opt("c", &gb_c_column, optarg, 1);
+            parse_error += get_int_opt(mc, "c", &mc->c_column, optarg, 1);
             break;
         case 'C':
-            parse_error += get_double_opt('C', &gb_C_cut, optarg, 1);
+            parse_error += get_double_opt(mc, 'C', &mc->C_cut, optarg, 1);
             break;
         case 'd':
-            parse_error += get_int_opt("d", &gb_d_depth, optarg, 0);
+            parse_error += get_int_opt(mc, "d", &mc->d_depth, optarg, 0);
             break;
         case 'D':
-            parse_error += get_int_opt("D", &gb_D_edge, optarg, 0);
-            if (gb_D_edge > 0
-                && (gb_D_edge < 4 || gb_D_edge > 12)) {
-                av_log(NULL, AV_LOG_INFO, "%s: -D%d might be too extreme; try -D4, -D6, or -D8\n", gb_argv0, gb_D_edge);
+            parse_error += get_int_opt(mc, "D", &mc->D_edge, optarg, 0);
+            if (mc->D_edge > 0
+                && (mc->D_edge < 4 || mc->D_edge > 12)) {
+                av_log(NULL, AV_LOG_INFO, "%s: -D%d might be too extreme; try -D4, -D6, or -D8\n", mc->argv0, mc->D_edge);
             }
             break;
 		case 'e':
-            gb_e_ext = optarg;
+            mc->e_ext = optarg;
             break;
         case 'E':
-            parse_error += get_double_opt('E', &gb_E_end, optarg, 0);
+            parse_error += get_double_opt(mc, 'E', &mc->E_end, optarg, 0);
             break;
         case 'f':
-            gb_f_fontname = optarg;
+            mc->f_fontname = optarg;
             break;
         case 'F':
-            parse_error += get_format_opt('F', optarg);
+            parse_error += get_format_opt(mc, 'F', optarg);
             break;
         case 'g':
-            parse_error += get_int_opt("g", &gb_g_gap, optarg, 0);
+            parse_error += get_int_opt(mc, "g", &mc->g_gap, optarg, 0);
             break;
 //		case 'G':
         case 'h':
-            parse_error += get_int_opt("h", &gb_h_height, optarg, 0);
+            parse_error += get_int_opt(mc, "h", &mc->h_height, optarg, 0);
             break;
         case 'H':
-            gb_H_human_filesize = 1;
+            mc->H_human_filesize = 1;
             break;
         case 'i':
-            gb_i_info = 0;
+            mc->i_info = 0;
             break;
         case 'I':
-            gb_I_individual = 1;
-            parse_error += get_opt_for_I_arg(optarg);
+            mc->I_individual = 1;
+            parse_error += get_opt_for_I_arg(mc, optarg);
             break;
         case 'j':
-            parse_error += get_int_opt("j", &gb_j_quality, optarg, 1);
+            parse_error += get_int_opt(mc, "j", &mc->j_quality, optarg, 1);
             break;
 //		case 'J':
         case 'k': // background color
-            parse_error += get_color_opt('k', &gb_k_bcolor, optarg);
+            parse_error += get_color_opt(mc, 'k', &mc->k_bcolor, optarg);
             break;
 //		case 'K':
 //      case 'l':
         case 'L':
-            parse_error += get_location_opt('L', optarg);
+            parse_error += get_location_opt(mc, 'L', optarg);
             break;
 //		case 'm':
 //		case 'M':
         case 'n':
-            gb_n_normal = 1; // normal priority
+            mc->n_normal = 1; // normal priority
             break;
         case 'N':
-            gb_N_suffix = optarg;
+            mc->N_suffix = optarg;
             break;
         case 'o':
-            gb_o_suffix = optarg;
+            mc->o_suffix = optarg;
             break;
         case 'O':
-            gb_O_outdir = optarg;
-            rem_trailing_slash(gb_O_outdir);
+            mc->O_outdir = optarg;
+            rem_trailing_slash(mc->O_outdir);
             break;
         case 'p':
-            gb_p_pause = 1; // pause before exiting
+            mc->p_pause = 1; // pause before exiting
             break;
         case 'P':
-            gb_P_dontpause = 1; // dont pause
+            mc->P_dontpause = 1; // dont pause
             break;
         case 'q':
-            gb_q_quiet = 1; //quiet
+            mc->q_quiet = 1; //quiet
             break;
 //		case 'Q':
         case 'r':
-            parse_error += get_int_opt("r", &gb_r_row, optarg, 0);
+            parse_error += get_int_opt(mc, "r", &mc->r_row, optarg, 0);
             break;
 //		case 'R':
         case 's':
-            parse_error += get_int_opt("s", &gb_s_step, optarg, 0);
+            parse_error += get_int_opt(mc, "s", &mc->s_step, optarg, 0);
             break;
         case 'S':
-            parse_error += get_int_opt("S", &gb_S_select_video_stream, optarg, 0);
+            parse_error += get_int_opt(mc, "S", &mc->S_select_video_stream, optarg, 0);
             break;
         case 't':
-            gb_t_timestamp = 0; // off
-			fcStrFlagsTimestamp.flags |= gdFTEX_FONTCONFIG;
-			fcStrFlagsTimestamp.flags &= ~gdFTEX_FONTPATHNAME;
+            mc->t_timestamp = 0; // off
+			mc->fcStrFlagsTimestamp.flags |= gdFTEX_FONTCONFIG;
+			mc->fcStrFlagsTimestamp.flags &= ~gdFTEX_FONTPATHNAME;
             break;
         case 'T':
-            gb_T_text = optarg;
+            mc->T_text = optarg;
             break;
 //		case 'u':
 //		case 'U':
         case 'v':
-            gb_v_verbose = 1; // verbose
+            mc->v_verbose = 1; // verbose
             break;
         case 'V':
-            gb_V = 1; // DEBUG
-            av_log(NULL, AV_LOG_INFO, "%s: -V is only used for debugging\n", gb_argv0);
+            mc->V = 1; // DEBUG
+            av_log(NULL, AV_LOG_INFO, "%s: -V is only used for debugging\n", mc->argv0);
             break;
         case 'w':
-            parse_error += get_int_opt("w", &gb_w_width, optarg, 0);
+            parse_error += get_int_opt(mc, "w", &mc->w_width, optarg, 0);
             break;
         case 'W':
-            gb_W_overwrite = 0;
+            mc->W_overwrite = 0;
             break;
 		case 'x':
-            gb_x_basename_custom = optarg;
+            mc->x_basename_custom = optarg;
             break;
         case 'X':
-            gb_X_filename_use_full = 1;
+            mc->X_filename_use_full = 1;
             break;
 //		case 'y':
 //		case 'Y':
         case 'z':
-            gb_z_seek = 1; // always seek mode
+            mc->z_seek = 1; // always seek mode
             break;
         case 'Z':
-            gb_Z_nonseek = 1; // always non-seek mode
+            mc->Z_nonseek = 1; // always non-seek mode
             break;
         default:
             parse_error += 1;
             break;
         }
     }
+    return parse_error;
+}
 
-    if (optind == argc) {
-        //av_log(NULL, AV_LOG_ERROR, "%s: no input files or directories specified", gb_argv0);
-        parse_error += 1;
-    }
+/*
+check options and set up what depends on them
+return number of errors
+*/
+int check_options(MtnContext *mc)
+{
+    int parse_error = 0;
 
     /* check arguments */
-    if (gb_r_row == 0 && gb_s_step == 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: option -r and -s cant be 0 at the same time", gb_argv0);
+    if (mc->r_row == 0 && mc->s_step == 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: option -r and -s cant be 0 at the same time", mc->argv0);
         parse_error += 1;
     }
-    if (gb_b_blank > 1 && gb_D_edge > 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: -D requires -b arg to be less than 1", gb_argv0);
+    if (mc->b_blank > 1 && mc->D_edge > 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: -D requires -b arg to be less than 1", mc->argv0);
         parse_error += 1;
     }
-    if (gb_z_seek == 1 && gb_Z_nonseek == 1) {
-        av_log(NULL, AV_LOG_ERROR, "%s: option -z and -Z cant be used together", gb_argv0);
+    if (mc->z_seek == 1 && mc->Z_nonseek == 1) {
+        av_log(NULL, AV_LOG_ERROR, "%s: option -z and -Z cant be used together", mc->argv0);
         parse_error += 1;
     }
-    if (gb_E_end > 0 && gb_C_cut > 0) {
-        av_log(NULL, AV_LOG_ERROR, "%s: option -C and -E cant be used together", gb_argv0);
+    if (mc->E_end > 0 && mc->C_cut > 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: option -C and -E cant be used together", mc->argv0);
         parse_error += 1;
     }
-    if (gb__tonemap && gb__filters)    {
+    if (mc->_tonemap && mc->_filters)    {
         parse_error += 1;
-        av_log(NULL, AV_LOG_ERROR, "%s: option --tonemap and --filters cant be used together", gb_argv0);
+        av_log(NULL, AV_LOG_ERROR, "%s: option --tonemap and --filters cant be used together", mc->argv0);
+    }
+    for (int i = 0; i < mc->_nb_profiles; i++) {
+        int clash = (strcmp(mc->_profiles[i].o_suffix, mc->o_suffix) == 0);
+        for (int j = 0; j < i; j++)
+            clash |= (strcmp(mc->_profiles[i].o_suffix, mc->_profiles[j].o_suffix) == 0);
+        if (clash) {
+            parse_error += 1;
+            av_log(NULL, AV_LOG_ERROR, "%s: --profile suffix %s is already used by another output\n", mc->argv0, mc->_profiles[i].o_suffix);
+        }
     }
 
 
     /* gdFTUseFontConfig(1);  => no needed, using gdImageStringFTEx */
-	fcStrFlagsInfotext.flags  =
-	fcStrFlagsTimestamp.flags = gdFTEX_FONTPATHNAME | gdFTEX_RETURNFONTPATHNAME;
+	mc->fcStrFlagsInfotext.flags  =
+	mc->fcStrFlagsTimestamp.flags = gdFTEX_FONTPATHNAME | gdFTEX_RETURNFONTPATHNAME;
 
-	if (!strcmp(gb_f_fontname, GB_F_FONTNAME)) {
-		fcStrFlagsInfotext.flags |= gdFTEX_FONTCONFIG;
-		fcStrFlagsInfotext.flags &= ~gdFTEX_FONTPATHNAME;
+	if (!strcmp(mc->f_fontname, GB_F_FONTNAME)) {
+		mc->fcStrFlagsInfotext.flags |= gdFTEX_FONTCONFIG;
+		mc->fcStrFlagsInfotext.flags &= ~gdFTEX_FONTPATHNAME;
 	}
-	if (!strcmp(gb_F_ts_fontname, GB_F_FONTNAME)) {
-		gb_F_ts_fontname = gb_f_fontname;
+	if (!strcmp(mc->F_ts_fontname, GB_F_FONTNAME)) {
+		mc->F_ts_fontname = mc->f_fontname;
 
-		fcStrFlagsTimestamp = fcStrFlagsInfotext;
+		mc->fcStrFlagsTimestamp = mc->fcStrFlagsInfotext;
 	}
 
 
-    if((movie_ext = strsplit(gb_e_ext, ",")) == NULL)
+    for (char **ext = mc->movie_ext; NULL != ext && NULL != *ext; ext++) // of earlier jobs
+        free(*ext);
+    free(mc->movie_ext);
+    if((mc->movie_ext = strsplit(mc->e_ext, ",")) == NULL)
     {
         parse_error += 1;
-        av_log(NULL, AV_LOG_ERROR, "%s: error parsing option -e", gb_argv0);
+        av_log(NULL, AV_LOG_ERROR, "%s: error parsing option -e", mc->argv0);
     }
+    else
+        sort_movie_ext(mc);
 
+    if (mc->_shard_n > 0) {
+        free(mc->shard_counts);
+        mc->shard_counts = calloc(mc->_shard_n, sizeof(*mc->shard_counts));
+        if (NULL == mc->shard_counts)
+            parse_error += 1;
+    }
 
-
-    if (0 != parse_error) {
-        usage();
-        goto exit;
+#ifdef WIN32
+    if (mc->_jobs > 1) {
+        av_log(NULL, AV_LOG_WARNING, "%s: --jobs is not supported on Windows; movies are processed one by one\n", mc->argv0);
+        mc->_jobs = 1;
     }
+#endif
+    // each worker has its own table; the first movie's outputs are in another process
+    if (mc->_dedupe && mc->_jobs > 1)
+        av_log(NULL, AV_LOG_WARNING, "%s: --dedupe with --jobs only finds duplicates processed by the same worker; use --jobs=1 to process each movie once\n", mc->argv0);
 
-    if(gb__tonemap > 0)
-    {
-        gb__filters = strdup(FILTER_GRAPHS[gb__tonemap-1]);
+    return parse_error;
+}
 
-        if(gb__filter_color_primaries)
-            free(gb__filter_color_primaries);
+/*
+apply options: filters, output directory and log level
+return 0 if ok, -1 if failed
+*/
+int setup_options(MtnContext *mc)
+{
+    if(mc->_tonemap > 0)
+    {
+        mc->_filters = strdup(FILTER_GRAPHS[mc->_tonemap-1]);
 
-        gb__filter_color_primaries = strdup("bt2020");
-    }
+        if(mc->_filter_color_primaries)
+            free(mc->_filter_color_primaries);
 
-    /* lower priority */
-    if (1 != gb_n_normal) { // lower priority
-#ifdef WIN32
-        SetPriorityClass(GetCurrentProcess(), IDLE_PRIORITY_CLASS);
-#else
-		errno = 0;
-        int nice_ret = nice(10); // mingw doesn't have nice??
-        //setpriority (PRIO_PROCESS, 0, PRIO_MAX/2);
-		if(nice_ret == -1 && errno != 0)
-			av_log(NULL, AV_LOG_ERROR, "error setting process priority (nice=10)\n");
-#endif
+        mc->_filter_color_primaries = strdup("bt2020");
     }
 
     /* create output directory */
-    if (NULL != gb_O_outdir && !is_dir(gb_O_outdir)) {
+    if (NULL != mc->O_outdir && !is_dir(mc->O_outdir)) {
 #ifdef WIN32
-        int ret = mkdir(gb_O_outdir);
+        int ret = mkdir(mc->O_outdir);
 #else
-        int ret = mkdir(gb_O_outdir, S_IRWXU | S_IRWXG | S_IRWXO);
+        int ret = mkdir(mc->O_outdir, S_IRWXU | S_IRWXG | S_IRWXO);
 #endif
         if (0 != ret) {
-            av_log(NULL, AV_LOG_ERROR, "\n%s: creating output directory '%s' failed: %s\n", gb_argv0, gb_O_outdir, strerror(errno));
-            goto exit;
+            av_log(NULL, AV_LOG_ERROR, "\n%s: creating output directory '%s' failed: %s\n", mc->argv0, mc->O_outdir, strerror(errno));
+            return -1;
         }
     }
 
-    /* init */
-#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
-    av_register_all();          // Register all formats and codecs
-#endif
-#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 0, 0)
-    avformat_network_init();    // optional since FFmpeg 4.0
-#endif
+    return 0;
+}
 
-	if(gb_q_quiet>0)
+/*
+set the log level (-q, -v) and format (--log-format) of the process; not
+for libmtn jobs, whose callers own the log
+*/
+void setup_log(MtnContext *mc)
+{
+	if(mc->q_quiet>0)
 		av_log_set_level(AV_LOG_ERROR);
 	else
 	{
-		if (gb_v_verbose > 0)
+		if (mc->v_verbose > 0)
 			av_log_set_level(AV_LOG_VERBOSE);
 		else
 			av_log_set_level(AV_LOG_INFO);
 
         av_log_set_flags(AV_LOG_SKIP_REPEATED);
 	}
+    if (mc->_log_json)
+        mtn_log_json(stderr);
+}
+
+/*
+open archive, caches and directory scanner used while processing movies
+return 0 if ok, -1 if failed
+*/
+int processing_open(void *opaque)
+{
+    MtnContext *mc = opaque;
+    if (NULL != mc->_archive) {
+        mc->archive = archive_open(mc->_archive, 0);
+        if (NULL == mc->archive) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: opening archive '%s' failed\n", mc->argv0, mc->_archive);
+            return -1;
+        }
+        if (mc->_stream)
+            av_log(NULL, AV_LOG_WARNING, "%s: --stream is not used with --archive\n", mc->argv0);
+    }
+
+    if (NULL != mc->_cache) {
+        mc->cache = cache_open(mc->_cache);
+        if (NULL == mc->cache) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: opening cache '%s' failed\n", mc->argv0, mc->_cache);
+            return -1;
+        }
+        cache_options_hash(mc);
+        av_log(NULL, AV_LOG_VERBOSE, "cache: %s, options hash: %s\n", mc->_cache, mc->cache_options);
+    }
 
-	// display mtn+libraries versions for bug reporting
-	av_log(NULL, AV_LOG_VERBOSE, "%s\n\n", mtn_identification());
+    if (NULL != mc->_probe_cache) {
+        mc->probe_cache = probe_cache_open(mc->_probe_cache);
+        if (NULL == mc->probe_cache) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: opening probe cache '%s' failed\n", mc->argv0, mc->_probe_cache);
+            return -1;
+        }
+        probe_options_hash(mc);
+    }
 
-    /* process movie files */
-    return_code = process_loop(argc - optind, argv + optind, 0);
+    mc->scanner = scanner_new(read_dir, mc, mc->d_depth, SCAN_THREADS);
+    if (NULL == mc->scanner) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: starting directory scanner failed\n", mc->argv0);
+        return -1;
+    }
 
-  exit:
-    // clean up
-#if defined(WIN32) && defined(_UNICODE)
-    while (--argc >= 0) {
-        free(argv[argc]);
+    if (mc->_dedupe) {
+        mc->dedupe = dedupe_new(2 == mc->_dedupe ? dedupe_hash : NULL);
+        if (NULL == mc->dedupe)
+            return -1;
+    }
+
+    mc->events = mc->_json_events ? stdout : NULL;
+    return 0;
+}
+
+/*
+close what processing_open() opened; can be called if it failed
+*/
+void processing_close(void *opaque)
+{
+    MtnContext *mc = opaque;
+    archive_close(mc->archive);
+    mc->archive = NULL;
+    cache_close(mc->cache);
+    mc->cache = NULL;
+    probe_cache_close(mc->probe_cache);
+    mc->probe_cache = NULL;
+    scanner_free(mc->scanner);
+    mc->scanner = NULL;
+    dedupe_free(mc->dedupe);
+    mc->dedupe = NULL;
+    mc->events = NULL;
+    free(mc->artefacts);
+    mc->artefacts = NULL;
+}
+
+/*
+process a movie of mc->batch; return exit code like process_loop()
+*/
+int process_file(void *opaque, char *path)
+{
+    MtnContext *mc = opaque;
+    switch (process_movie(mc, path)) {
+    case 0:
+        return EXIT_SUCCESS;
+    case 1:
+        return EXIT_WARNING;
+    default:
+        return EXIT_ERROR;
+    }
+}
+
+/*
+print the exit code of a --files-from path run by mc->batch
+*/
+static void batch_done(void *opaque, const char *path, unsigned long tag, int code)
+{
+    MtnContext *mc = opaque;
+    if (tag > 0)
+        av_log(NULL, AV_LOG_INFO, "%s: %lu: %s: exit code %d\n", mc->argv0, tag, path, code);
+}
+
+/*
+with --jobs in --order=name, give the movies process_loop() finds to the
+workers at once instead of collecting them; this process keeps only the
+directory scanner. return 0 if ok, -1 if failed
+*/
+int process_batch_stream(MtnContext *mc)
+{
+    BatchWorker worker = { processing_open, process_file, processing_close, batch_done, mc };
+
+    processing_close(mc);
+    mc->scanner = scanner_new(read_dir, mc, mc->d_depth, SCAN_THREADS);
+    if (NULL == mc->scanner) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: starting directory scanner failed\n", mc->argv0);
+        return -1;
+    }
+    if (0 != batch_stream(mc->batch, mc->_jobs, &worker)) // collected; process_batch() runs them
+        av_log(NULL, AV_LOG_VERBOSE, "%s: movies are collected before the workers start\n", mc->argv0);
+    return 0;
+}
+
+/*
+process movies collected in mc->batch by process_loop() in --order, with
+--jobs workers which open their own archive and caches, or wait for the
+ones of process_batch_stream()
+*/
+int process_batch(MtnContext *mc)
+{
+    BatchWorker worker = { processing_open, process_file, processing_close, batch_done, mc };
+    Batch *b = mc->batch;
+
+    mc->batch = NULL; // process_loop() processes movies again
+    if (mc->_jobs > 1)
+        processing_close(mc);
+    int ret = batch_run(b, mc->_order, mc->_jobs, &worker);
+    batch_free(b);
+    return ret;
+}
+
+/*
+reset getopt to parse another argv
+*/
+void reset_getopt()
+{
+#ifdef __GLIBC__
+    optind = 0; // also resets glibc's internal state
+#else
+    optind = 1;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    optreset = 1;
+#endif
+#endif
+}
+
+/*
+parse the options of a --serve or libmtn job over the ones already in mc
+return number of errors
+*/
+int parse_job_options(MtnContext *mc, int argc, char **argv)
+{
+    if (mc->_tonemap > 0) {    // set by setup_options(); not given by the user
+        free(mc->_filters);
+        mc->_filters = NULL;
+    }
+    if (mc->F_ts_fontname == mc->f_fontname) // set by check_options()
+        mc->F_ts_fontname = GB_F_FONTNAME;
+
+    reset_getopt();
+    int parse_error = parse_options(mc, argc, argv);
+    if (optind != argc) {
+        av_log(NULL, AV_LOG_ERROR, "%s: job options can't contain files\n", mc->argv0);
+        parse_error += 1;
+    }
+    return parse_error + check_options(mc);
+}
+
+/*
+set up gd's font cache and load the fonts of the info text and timestamps
+once, so workers forked later (--serve, --watch) find fontconfig and the
+fonts ready instead of each setting them up again
+*/
+void font_cache_warm_up(MtnContext *mc)
+{
+    gdFontCacheSetup();
+    image_string_height("SAMPLE", mc->f_fontname, mc->F_info_font_size, &mc->fcStrFlagsInfotext);
+    image_string_height("SAMPLE", mc->F_ts_fontname, mc->F_ts_font_size, &mc->fcStrFlagsTimestamp);
+}
+
+#ifndef WIN32
+/*
+write file as base64 JSON string; null if it can't be read (e.g. in --archive)
+*/
+void json_write_file(FILE *out, const char *name)
+{
+    FILE *fp = fopen(name, "rb");
+    uint8_t *data = NULL;
+    char *b64 = NULL;
+    long size;
+
+    if (NULL != fp && 0 == fseek(fp, 0, SEEK_END) && (size = ftell(fp)) >= 0 && size < INT_MAX / 2
+        && 0 == fseek(fp, 0, SEEK_SET) && NULL != (data = malloc(size + 1)) && fread(data, 1, size, fp) == (size_t)size
+        && NULL != (b64 = malloc(AV_BASE64_SIZE(size))) && NULL != av_base64_encode(b64, AV_BASE64_SIZE(size), data, size))
+        fprintf(out, "\"%s\"", b64);
+    else
+        fputs("null", out);
+
+    free(b64);
+    free(data);
+    if (NULL != fp)
+        fclose(fp);
+}
+
+/*
+run a --serve job in its worker process: the job's options are parsed over
+the daemon's ones, then the input is processed like a command line argument
+*/
+void serve_job(void *opaque, const ServeJob *job, FILE *out)
+{
+    MtnContext *mc = opaque;
+    int ret = EXIT_ERROR;
+
+    mc->serve_job = 1;
+    mc->st_start = time(NULL); // outputs of earlier jobs are not overwritten by -W logic
+    int parse_error = parse_job_options(mc, job->argc, job->argv);
+
+    char *input = strdup(job->input);
+    if (0 != parse_error) {
+        fputs("\"error\":\"invalid options\",", out);
+    } else if (NULL != input && 0 == setup_options(mc)) {
+        setup_log(mc); // the worker process is the job's
+        if (0 == processing_open(mc))
+            ret = process_loop(mc, 1, &input, NULL, 0);
+    }
+    processing_close(mc);
+    free(input);
+
+    fprintf(out, "\"exit_code\":%d,\"outputs\":[", ret);
+    char *name = mc->job_artefacts, *nl;
+    for (int i = 0; name && NULL != (nl = strchr(name, '\n')); i++, name = nl + 1) {
+        *nl = '\0';
+        if (i > 0)
+            fputc(',', out);
+        json_write_str(out, name);
+        *nl = '\n';
+    }
+    fputc(']', out);
+    if (job->data) {
+        fputs(",\"data\":[", out);
+        name = mc->job_artefacts;
+        for (int i = 0; name && NULL != (nl = strchr(name, '\n')); i++, name = nl + 1) {
+            *nl = '\0';
+            if (i > 0)
+                fputc(',', out);
+            if (NULL != mc->_archive)
+                fputs("null", out);
+            else
+                json_write_file(out, name);
+            *nl = '\n';
+        }
+        fputc(']', out);
     }
+}
 #endif
 
-    if(gb__options)
-        av_dict_free(&gb__options);
+#ifdef __linux__
+/*
+process a movie found by --watch in its worker process
+*/
+int watch_job(void *opaque, char *path)
+{
+    MtnContext *mc = opaque;
+    int ret = EXIT_ERROR;
 
-    if(gb__filters)
-        free(gb__filters);
-    if(gb__filter_color_primaries)
-        free(gb__filter_color_primaries);
+    mc->st_start = time(NULL); // outputs of earlier movies are not overwritten by -W logic
+    if (0 == processing_open(mc))
+        ret = process_loop(mc, 1, &path, NULL, 0);
+    processing_close(mc);
+    return ret;
+}
+#endif
 
-    //av_log(NULL, AV_LOG_VERBOSE, "\n%s: total run time: %.2f s.\n", gb_argv0, difftime(time(NULL), gb_st_start));
+/*
+open --resume or --journal; kept open in worker processes too
+return 0 ok, -1 error
+*/
+int open_journal(MtnContext *mc)
+{
+    const char *path = NULL != mc->_resume ? mc->_resume : mc->_journal;
+#if defined(WIN32) && defined(_UNICODE)
+    wchar_t path_w[FILENAME_MAX];
+    UTF8_2_WC(path_w, path, FILENAME_MAX);
+#else
+    const char *path_w = path;
+#endif
 
-    if (1 == gb_p_pause && 0 == gb_P_dontpause) {
-        av_log(NULL, AV_LOG_ERROR, "\npausing... press Enter key to exit (see -P option)\n");
-        fflush(stdout);
-        fflush(stderr);
-        getchar();
+    FILE *fp = _tfopen(path_w, _TEXT("a+b"));
+    if (NULL == fp) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: opening journal '%s' failed: %s\n", mc->argv0, path, strerror(errno));
+        return -1;
     }
-    return return_code;
+    mc->journal = journal_open(fp, NULL != mc->_resume);
+    if (NULL == mc->journal) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: opening journal '%s' failed\n", mc->argv0, path);
+        return -1;
+    }
+    return 0;
 }
@@ -0,0 +1,72 @@
+/*  mtn - movie thumbnailer
+    Core of mtn shared by the command line (mtn_main.c) and libmtn
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_H
+#define MTN_H
+
+#include <stdio.h>
+#include "mtn_context.h"
+#include "mtn_scan.h"
+#include "mtn_serve.h"
+
+#define UTF8_FILENAME_SIZE (FILENAME_MAX*4)
+
+#define EXIT_SUCCESS 0
+#define EXIT_WARNING 1
+#define EXIT_ERROR   2
+
+#ifdef WIN32
+    #include <tchar.h>
+    #include <windows.h>
+    #ifdef _UNICODE
+        #define UTF8_2_WC(wdst, src, size) MultiByteToWideChar(CP_UTF8, 0, (src), -1, (wdst), (size))
+        #define WC_2_UTF8(dst, wsrc, size) WideCharToMultiByte(CP_UTF8, 0, (wsrc), -1, (dst), (size), NULL, NULL)
+    #else
+        #define UTF8_2_WC(dst, src, size) ((dst) = (src)) // cant be used to check required size
+        #define WC_2_UTF8(dst, src, size) ((dst) = (src))
+    #endif
+#else
+    #include "fake_tchar.h"
+    #define UTF8_2_WC(dst, src, size) ((dst) = (src)) // cant be used to check required size
+    #define WC_2_UTF8(dst, src, size) ((dst) = (src))
+#endif
+
+/* options */
+int parse_options(MtnContext *mc, int argc, char *argv[]);
+int check_options(MtnContext *mc);
+int setup_options(MtnContext *mc);
+void setup_log(MtnContext *mc);
+void reset_getopt();
+int parse_job_options(MtnContext *mc, int argc, char **argv);
+void usage(MtnContext *mc);
+char *mtn_identification(MtnContext *mc);
+
+/* processing; make_thumbnail() returns 0 ok, 1 some shots are missing, <0 MtnError */
+int processing_open(void *opaque);
+void processing_close(void *opaque);
+int make_thumbnail(MtnContext *mc, char *file);
+int process_loop(MtnContext *mc, int n, char **files, ScanDir *sd, int current_depth);
+int process_files_from(MtnContext *mc, const char *list);
+int process_batch_stream(MtnContext *mc);
+int process_batch(MtnContext *mc);
+void shard_summary(MtnContext *mc);
+int open_journal(MtnContext *mc);
+
+/* --serve and --watch workers */
+void font_cache_warm_up(MtnContext *mc);
+void serve_job(void *opaque, const ServeJob *job, FILE *out);
+int watch_job(void *opaque, char *path);
+int check_extension(void *opaque, char *filename);
+
+char *path_2_file(char *path);
+
+#endif /* MTN_H */
@@ -5,10 +5,10 @@ TARGET = mtn
 INCLUDEPATH += .
 INCLUDEPATH += /usr/include/ffmpeg
 INCLUDEPATH += /usr/include
-LIBS += -L/usr/lib64 -lavcodec -lavutil -lavfilter -lavcodec -lswscale -lavutil -lgd
+LIBS += -L/usr/lib64 -lavcodec -lavutil -lavfilter -lavcodec -lswscale -lavutil -lgd -ljpeg -lpng -lz -lsqlite3 -lpthread
 
-HEADERS += fake_tchar.h
-SOURCES += mtn.c
+HEADERS += fake_tchar.h mtn.h mtn_context.h mtn_thumbnail.h mtn_error.h libmtn.h mtn_stream.h mtn_archive.h mtn_png.h mtn_cache.h mtn_probe.h mtn_scan.h mtn_json.h mtn_serve.h mtn_watch.h mtn_batch.h mtn_journal.h mtn_dedupe.h mtn_events.h mtn_log.h
+SOURCES += mtn_main.c libmtn.c mtn.c mtn_context.c mtn_thumbnail.c mtn_error.c mtn_stream.c mtn_archive.c mtn_png.c mtn_cache.c mtn_probe.c mtn_scan.c mtn_json.c mtn_serve.c mtn_watch.c mtn_batch.c mtn_journal.c mtn_dedupe.c mtn_events.c mtn_log.c
 
 DISTFILES += \
     Make.MinGW.bat
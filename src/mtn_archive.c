@@ -0,0 +1,204 @@
+/*  mtn - movie thumbnailer
+    Archive output: all artefacts of a run in one SQLite database
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_archive.h"
+#include "libavutil/log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/* wait for other writers up to this time (ms) */
+#define ARCHIVE_BUSY_TIMEOUT 60000
+
+struct MtnArchive {
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    sqlite3_stmt *exists;
+    sqlite3_stmt *get;
+};
+
+static const char *archive_schema =
+    "CREATE TABLE IF NOT EXISTS artefact ("
+    "  id      INTEGER PRIMARY KEY,"
+    "  source  TEXT NOT NULL,"
+    "  name    TEXT NOT NULL,"
+    "  created INTEGER NOT NULL,"
+    "  data    BLOB NOT NULL"
+    ");"
+    "CREATE INDEX IF NOT EXISTS artefact_key ON artefact(source, name, id);";
+
+static int archive_prepare(MtnArchive *a, const char *sql, sqlite3_stmt **stmt)
+{
+    if (SQLITE_OK != sqlite3_prepare_v2(a->db, sql, -1, stmt, NULL)) {
+        av_log(NULL, AV_LOG_ERROR, "  archive: %s\n", sqlite3_errmsg(a->db));
+        return -1;
+    }
+    return 0;
+}
+
+MtnArchive *archive_open(const char *path, int readonly)
+{
+    MtnArchive *a = calloc(1, sizeof(MtnArchive));
+    if (NULL == a)
+        return NULL;
+
+    int flags = readonly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    if (SQLITE_OK != sqlite3_open_v2(path, &a->db, flags, NULL)) {
+        av_log(NULL, AV_LOG_ERROR, "  archive: opening '%s' failed: %s\n", path, a->db ? sqlite3_errmsg(a->db) : "out of memory");
+        archive_close(a);
+        return NULL;
+    }
+    sqlite3_busy_timeout(a->db, ARCHIVE_BUSY_TIMEOUT);
+
+    if (!readonly) {
+        char *err = NULL;
+        if (SQLITE_OK != sqlite3_exec(a->db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, &err)
+            || SQLITE_OK != sqlite3_exec(a->db, archive_schema, NULL, NULL, &err)) {
+            av_log(NULL, AV_LOG_ERROR, "  archive: initializing '%s' failed: %s\n", path, err ? err : "");
+            sqlite3_free(err);
+            archive_close(a);
+            return NULL;
+        }
+        if (0 != archive_prepare(a, "INSERT INTO artefact(source, name, created, data) VALUES(?, ?, ?, ?)", &a->insert)) {
+            archive_close(a);
+            return NULL;
+        }
+    }
+
+    if (0 != archive_prepare(a, "SELECT 1 FROM artefact WHERE source=? AND name=? LIMIT 1", &a->exists)
+        || 0 != archive_prepare(a, "SELECT data FROM artefact WHERE source=? AND name=? ORDER BY id DESC LIMIT 1", &a->get)) {
+        archive_close(a);
+        return NULL;
+    }
+
+    return a;
+}
+
+void archive_close(MtnArchive *a)
+{
+    if (NULL == a)
+        return;
+
+    sqlite3_finalize(a->insert);
+    sqlite3_finalize(a->exists);
+    sqlite3_finalize(a->get);
+    sqlite3_close(a->db);
+    free(a);
+}
+
+int archive_add(MtnArchive *a, const char *source, const char *name, const void *data, size_t size)
+{
+    int ret = -1;
+
+    if (NULL == a || NULL == a->insert)
+        return -1;
+
+    sqlite3_bind_text(a->insert, 1, source, -1, SQLITE_STATIC);
+    sqlite3_bind_text(a->insert, 2, name, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(a->insert, 3, (sqlite3_int64)time(NULL));
+    sqlite3_bind_blob64(a->insert, 4, data, size, SQLITE_STATIC);
+
+    if (SQLITE_DONE == sqlite3_step(a->insert))
+        ret = 0;
+    else
+        av_log(NULL, AV_LOG_ERROR, "  archive: adding '%s' failed: %s\n", name, sqlite3_errmsg(a->db));
+
+    sqlite3_reset(a->insert);
+    sqlite3_clear_bindings(a->insert);
+    return ret;
+}
+
+int archive_exists(MtnArchive *a, const char *source, const char *name)
+{
+    int ret;
+
+    sqlite3_bind_text(a->exists, 1, source, -1, SQLITE_STATIC);
+    sqlite3_bind_text(a->exists, 2, name, -1, SQLITE_STATIC);
+
+    switch (sqlite3_step(a->exists)) {
+    case SQLITE_ROW:
+        ret = 1;
+        break;
+    case SQLITE_DONE:
+        ret = 0;
+        break;
+    default:
+        av_log(NULL, AV_LOG_ERROR, "  archive: %s\n", sqlite3_errmsg(a->db));
+        ret = -1;
+    }
+
+    sqlite3_reset(a->exists);
+    return ret;
+}
+
+int archive_get(MtnArchive *a, const char *source, const char *name, void **data, size_t *size)
+{
+    int ret;
+
+    *data = NULL;
+    *size = 0;
+    sqlite3_bind_text(a->get, 1, source, -1, SQLITE_STATIC);
+    sqlite3_bind_text(a->get, 2, name, -1, SQLITE_STATIC);
+
+    switch (sqlite3_step(a->get)) {
+    case SQLITE_ROW:
+        *size = sqlite3_column_bytes(a->get, 0);
+        *data = malloc(*size > 0 ? *size : 1);
+        if (NULL == *data) {
+            ret = -1;
+            break;
+        }
+        if (*size > 0)
+            memcpy(*data, sqlite3_column_blob(a->get, 0), *size);
+        ret = 0;
+        break;
+    case SQLITE_DONE:
+        ret = 1;
+        break;
+    default:
+        av_log(NULL, AV_LOG_ERROR, "  archive: %s\n", sqlite3_errmsg(a->db));
+        ret = -1;
+    }
+
+    sqlite3_reset(a->get);
+    return ret;
+}
+
+int archive_list(MtnArchive *a, const char *source, archive_list_fn fn, void *opaque)
+{
+    sqlite3_stmt *stmt = NULL;
+    int ret = 0, rc;
+
+    // newest row of each key
+    if (0 != archive_prepare(a,
+            "SELECT source, name, length(data), created FROM artefact"
+            " WHERE id IN (SELECT max(id) FROM artefact WHERE ?1 IS NULL OR source=?1 GROUP BY source, name)"
+            " ORDER BY source, name", &stmt))
+        return -1;
+
+    if (NULL != source)
+        sqlite3_bind_text(stmt, 1, source, -1, SQLITE_STATIC);
+
+    while (SQLITE_ROW == (rc = sqlite3_step(stmt))) {
+        if (0 != fn((const char*)sqlite3_column_text(stmt, 0), (const char*)sqlite3_column_text(stmt, 1),
+                sqlite3_column_int64(stmt, 2), sqlite3_column_int64(stmt, 3), opaque))
+            break;
+    }
+    if (SQLITE_ROW != rc && SQLITE_DONE != rc) {
+        av_log(NULL, AV_LOG_ERROR, "  archive: %s\n", sqlite3_errmsg(a->db));
+        ret = -1;
+    }
+
+    sqlite3_finalize(stmt);
+    return ret;
+}
@@ -0,0 +1,73 @@
+/*  mtn - movie thumbnailer
+    Archive output: all artefacts of a run in one SQLite database
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_ARCHIVE_H
+#define MTN_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Archive - append-only pack of output files
+ *
+ * Every artefact (thumbnail, individual shot, sprite, .vtt, info text, cover)
+ * is stored as a blob keyed by the source movie path and the artefact name
+ * (output file name without directory). Rows are never updated; when the
+ * same key is written again, readers get the newest one.
+ *
+ * The database uses WAL journal and a busy timeout, so several mtn
+ * processes can append to the same archive at the same time.
+ */
+typedef struct MtnArchive MtnArchive;
+
+/**
+ * Called for every artefact by archive_list()
+ * Return non-zero to stop listing
+ */
+typedef int (*archive_list_fn)(const char *source, const char *name, int64_t size, int64_t created, void *opaque);
+
+/**
+ * Open or create archive
+ * Returns NULL on error
+ */
+MtnArchive *archive_open(const char *path, int readonly);
+
+/**
+ * Close archive; NULL is ignored
+ */
+void archive_close(MtnArchive *a);
+
+/**
+ * Append artefact
+ * Returns 0 on success, -1 on error
+ */
+int archive_add(MtnArchive *a, const char *source, const char *name, const void *data, size_t size);
+
+/**
+ * Returns 1 if artefact exists, 0 if not, -1 on error
+ */
+int archive_exists(MtnArchive *a, const char *source, const char *name);
+
+/**
+ * Read the newest version of an artefact; *data must be freed with free()
+ * Returns 0 on success, 1 if not found, -1 on error
+ */
+int archive_get(MtnArchive *a, const char *source, const char *name, void **data, size_t *size);
+
+/**
+ * List newest versions of artefacts of one source (or all if source is NULL)
+ * ordered by source and name
+ * Returns 0 on success, -1 on error
+ */
+int archive_list(MtnArchive *a, const char *source, archive_list_fn fn, void *opaque);
+
+#endif /* MTN_ARCHIVE_H */
@@ -0,0 +1,431 @@
+/*  mtn - movie thumbnailer
+    Batch scheduling: movies ordered by estimated cost, run by workers
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_batch.h"
+#include "libavutil/log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+/* exit code of a movie whose worker crashed */
+#define BATCH_CRASHED 2
+
+Batch *batch_new()
+{
+    return calloc(1, sizeof(Batch));
+}
+
+static int pool_finish(struct BatchPool *p);
+
+void batch_free(Batch *b)
+{
+    int i;
+    if (NULL == b)
+        return;
+    if (NULL != b->pool)
+        pool_finish(b->pool);
+    for (i = 0; i < b->nb_items; i++)
+        free(b->items[i].path);
+    free(b->items);
+    free(b);
+}
+
+static int pool_feed(struct BatchPool *p, const char *path, unsigned long tag);
+
+int batch_add(Batch *b, const char *path, int64_t cost)
+{
+    if (NULL != b->pool)
+        return pool_feed(b->pool, path, b->tag);
+
+    if (b->nb_items == b->size) {
+        int size = b->size ? b->size * 2 : 64;
+        BatchItem *new = realloc(b->items, size * sizeof(BatchItem));
+        if (NULL == new)
+            return -1;
+        b->items = new;
+        b->size = size;
+    }
+    char *p = strdup(path);
+    if (NULL == p)
+        return -1;
+    b->items[b->nb_items] = (BatchItem){ p, cost, b->nb_items, b->tag };
+    b->nb_items++;
+    return 0;
+}
+
+static int cmp_largest(const void *a, const void *b)
+{
+    const BatchItem *x = a, *y = b;
+    if (x->cost != y->cost)
+        return x->cost < y->cost ? 1 : -1;
+    return x->seq - y->seq;
+}
+
+static int cmp_smallest(const void *a, const void *b)
+{
+    const BatchItem *x = a, *y = b;
+    if (x->cost != y->cost)
+        return x->cost > y->cost ? 1 : -1;
+    return x->seq - y->seq;
+}
+
+static void batch_sort(Batch *b, BatchOrder order)
+{
+    if (BATCH_ORDER_LARGEST == order)
+        qsort(b->items, b->nb_items, sizeof(BatchItem), cmp_largest);
+    else if (BATCH_ORDER_SMALLEST == order)
+        qsort(b->items, b->nb_items, sizeof(BatchItem), cmp_smallest);
+}
+
+static int run_here(Batch *b, const BatchWorker *w)
+{
+    int i, ret = 0;
+    for (i = 0; i < b->nb_items; i++) {
+        int r = w->run(w->opaque, b->items[i].path);
+        if (NULL != w->done)
+            w->done(w->opaque, b->items[i].path, b->items[i].tag, r);
+        if (r > ret)
+            ret = r;
+    }
+    return ret;
+}
+
+#ifndef WIN32
+
+typedef struct Worker {
+    pid_t pid;
+    int to, from;                   /* pipes: path to the worker, exit code back */
+    char *path;                     /* running movie or NULL */
+    unsigned long tag;
+} Worker;
+
+typedef struct BatchPool {
+    BatchWorker w;
+    Worker *ws;
+    struct pollfd *pfd;
+    int workers;
+    int opened;                     /* no worker could be started and open was called here: 1 ok, -1 failed */
+    int ret;                        /* highest exit code */
+    void (*old_pipe)(int);
+} BatchPool;
+
+static int write_all(int fd, const void *data, size_t n)
+{
+    const char *c = data;
+    while (n > 0) {
+        ssize_t w = write(fd, c, n);
+        if (w < 0 && EINTR == errno)
+            continue;
+        if (w <= 0)
+            return -1;
+        c += w;
+        n -= w;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t n)
+{
+    char *c = data;
+    while (n > 0) {
+        ssize_t r = read(fd, c, n);
+        if (r < 0 && EINTR == errno)
+            continue;
+        if (r <= 0)
+            return -1;
+        c += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int write_int(int fd, int v)
+{
+    return write_all(fd, &v, sizeof(v));
+}
+
+static int read_int(int fd, int *v)
+{
+    return read_all(fd, v, sizeof(*v));
+}
+
+/* length and bytes of path */
+static int write_path(int fd, const char *path)
+{
+    int len = strlen(path);
+    return (0 == write_int(fd, len) && 0 == write_all(fd, path, len)) ? 0 : -1;
+}
+
+/* NULL at EOF */
+static char *read_path(int fd)
+{
+    int len;
+    char *path;
+
+    if (0 != read_int(fd, &len) || len < 0)
+        return NULL;
+    path = malloc(len + 1);
+    if (NULL == path || 0 != read_all(fd, path, len)) {
+        free(path);
+        return NULL;
+    }
+    path[len] = '\0';
+    return path;
+}
+
+static void worker_loop(const BatchWorker *w, int in, int out)
+{
+    int opened = (NULL == w->open || 0 == w->open(w->opaque));
+    char *path;
+
+    while (NULL != (path = read_path(in))) {
+        int r = opened ? w->run(w->opaque, path) : BATCH_CRASHED;
+        free(path);
+        if (0 != write_int(out, r))
+            break;
+    }
+    if (opened && NULL != w->close)
+        w->close(w->opaque);
+}
+
+static int start_worker(BatchPool *p, int k)
+{
+    int to[2], from[2], i;
+
+    if (0 != pipe(to))
+        return -1;
+    if (0 != pipe(from)) {
+        close(to[0]);
+        close(to[1]);
+        return -1;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (0 == pid) {
+        for (i = 0; i < p->workers; i++) { // the others see EOF only if no worker holds their pipes
+            if (p->ws[i].pid > 0) {
+                close(p->ws[i].to);
+                close(p->ws[i].from);
+            }
+        }
+        close(to[1]);
+        close(from[0]);
+        signal(SIGPIPE, SIG_DFL);
+        worker_loop(&p->w, to[0], from[1]);
+        fflush(NULL);
+        _exit(0);
+    }
+    close(to[0]);
+    close(from[1]);
+    if (pid < 0) {
+        close(to[1]);
+        close(from[0]);
+        return -1;
+    }
+    p->ws[k] = (Worker){ pid, to[1], from[0], NULL, 0 };
+    return 0;
+}
+
+static void stop_worker(Worker *wk)
+{
+    close(wk->to);
+    close(wk->from);
+    waitpid(wk->pid, NULL, 0);
+    wk->pid = 0;
+}
+
+static void pool_done(BatchPool *p, const char *path, unsigned long tag, int r)
+{
+    av_log(NULL, AV_LOG_VERBOSE, "batch: %s: exit code %d\n", path, r);
+    if (NULL != p->w.done)
+        p->w.done(p->w.opaque, path, tag, r);
+    if (r > p->ret)
+        p->ret = r;
+}
+
+static BatchPool *pool_new(int workers, const BatchWorker *w)
+{
+    BatchPool *p = calloc(1, sizeof(BatchPool));
+    if (NULL == p)
+        return NULL;
+    p->ws = calloc(workers, sizeof(Worker));
+    p->pfd = calloc(workers, sizeof(struct pollfd));
+    if (NULL == p->ws || NULL == p->pfd) {
+        free(p->ws);
+        free(p->pfd);
+        free(p);
+        return NULL;
+    }
+    p->w = *w;
+    p->workers = workers;
+    p->old_pipe = signal(SIGPIPE, SIG_IGN);
+    return p;
+}
+
+/* wait until a running movie is finished */
+static void pool_wait(BatchPool *p)
+{
+    int k, nb = 0;
+
+    for (k = 0; k < p->workers; k++) {
+        p->pfd[k] = (struct pollfd){ NULL != p->ws[k].path ? p->ws[k].from : -1, POLLIN, 0 };
+        nb += (NULL != p->ws[k].path);
+    }
+    if (0 == nb)
+        return;
+    if (poll(p->pfd, p->workers, -1) < 0) {
+        if (EINTR == errno)
+            return;
+        av_log(NULL, AV_LOG_ERROR, "batch: poll failed: %s\n", strerror(errno));
+        for (k = 0; k < p->workers; k++) // results can't be read; the movies count as crashed
+            p->pfd[k].revents = (NULL != p->ws[k].path) ? POLLERR : 0;
+    }
+
+    for (k = 0; k < p->workers; k++) {
+        Worker *wk = &p->ws[k];
+        int r;
+        if (0 == p->pfd[k].revents)
+            continue;
+        if (0 != (p->pfd[k].revents & POLLERR) || 0 != read_int(wk->from, &r)) {
+            av_log(NULL, AV_LOG_ERROR, "batch: worker processing %s crashed\n", wk->path);
+            r = BATCH_CRASHED;
+            stop_worker(wk);
+        }
+        pool_done(p, wk->path, wk->tag, r);
+        free(wk->path);
+        wk->path = NULL;
+    }
+}
+
+/* give path to an idle worker; runs it here if no worker can be started */
+static int pool_feed(BatchPool *p, const char *path, unsigned long tag)
+{
+    char *copy = strdup(path);
+    int k;
+
+    if (NULL == copy)
+        return -1;
+    for (;;) {
+        int running = 0;
+        for (k = 0; k < p->workers; k++) {
+            Worker *wk = &p->ws[k];
+            if (0 == wk->pid && 0 != start_worker(p, k)) {
+                av_log(NULL, AV_LOG_ERROR, "batch: starting worker failed: %s\n", strerror(errno));
+                continue;
+            }
+            if (NULL != wk->path) {
+                running++;
+                continue;
+            }
+            if (0 != write_path(wk->to, copy)) {
+                stop_worker(wk);
+                continue;
+            }
+            wk->path = copy;
+            wk->tag = tag;
+            return 0;
+        }
+        if (0 == running)
+            break;
+        pool_wait(p);
+    }
+
+    if (0 == p->opened)
+        p->opened = (NULL == p->w.open || 0 == p->w.open(p->w.opaque)) ? 1 : -1;
+    pool_done(p, copy, tag, p->opened > 0 ? p->w.run(p->w.opaque, copy) : BATCH_CRASHED);
+    free(copy);
+    return 0;
+}
+
+/* wait for the running movies and stop the workers; returns the highest exit code */
+static int pool_finish(BatchPool *p)
+{
+    int k, ret;
+
+    for (;;) {
+        for (k = 0; k < p->workers && NULL == p->ws[k].path; k++)
+            ;
+        if (k == p->workers)
+            break;
+        pool_wait(p);
+    }
+    for (k = 0; k < p->workers; k++) {
+        if (p->ws[k].pid > 0)
+            stop_worker(&p->ws[k]);
+    }
+    if (p->opened > 0 && NULL != p->w.close)
+        p->w.close(p->w.opaque);
+    signal(SIGPIPE, p->old_pipe);
+    ret = p->ret;
+    free(p->ws);
+    free(p->pfd);
+    free(p);
+    return ret;
+}
+
+#endif /* WIN32 */
+
+int batch_stream(Batch *b, int workers, const BatchWorker *w)
+{
+#ifndef WIN32
+    if (workers > 1 && NULL == b->pool && 0 == b->nb_items) {
+        b->pool = pool_new(workers, w);
+        if (NULL != b->pool)
+            return 0;
+    }
+#endif
+    return -1;
+}
+
+int batch_run(Batch *b, BatchOrder order, int workers, const BatchWorker *w)
+{
+#ifndef WIN32
+    BatchPool *p = b->pool;
+    int i;
+
+    if (NULL != p) {
+        b->pool = NULL;
+        return pool_finish(p);
+    }
+#endif
+    batch_sort(b, order);
+
+#ifndef WIN32
+    if (workers > 1 && b->nb_items > 0) {
+        p = pool_new(workers < b->nb_items ? workers : b->nb_items, w);
+        if (NULL != p) {
+            for (i = 0; i < b->nb_items; i++) {
+                if (0 != pool_feed(p, b->items[i].path, b->items[i].tag))
+                    pool_done(p, b->items[i].path, b->items[i].tag, BATCH_CRASHED);
+            }
+            return pool_finish(p);
+        }
+        // no memory for workers; the caller has closed what open opens
+        if (NULL != w->open && 0 != w->open(w->opaque))
+            return BATCH_CRASHED;
+        int r = run_here(b, w);
+        if (NULL != w->close)
+            w->close(w->opaque);
+        return r;
+    }
+#endif
+    return run_here(b, w);
+}
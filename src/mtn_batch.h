@@ -0,0 +1,90 @@
+/*  mtn - movie thumbnailer
+    Batch scheduling: movies ordered by estimated cost, run by workers
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_BATCH_H
+#define MTN_BATCH_H
+
+#include <stdint.h>
+
+typedef enum BatchOrder {
+    BATCH_ORDER_NAME,               /* order of the command line and directory listings */
+    BATCH_ORDER_LARGEST,            /* largest cost first: shortest total time with workers */
+    BATCH_ORDER_SMALLEST,           /* smallest cost first: most movies done soonest */
+} BatchOrder;
+
+typedef struct BatchItem {
+    char *path;
+    int64_t cost;                   /* estimated; any unit, only compared */
+    int seq;                        /* order of batch_add(); breaks ties */
+    unsigned long tag;              /* Batch.tag when added */
+} BatchItem;
+
+typedef struct Batch {
+    BatchItem *items;
+    int nb_items;
+    int size;
+    unsigned long tag;              /* given to the items added next, e.g. a line of --files-from; 0 = none */
+    struct BatchPool *pool;         /* batch_stream(): movies run as they are added */
+} Batch;
+
+/* processing in a worker; open, close and done may be NULL */
+typedef struct BatchWorker {
+    int (*open)(void *opaque);      /* before the first movie; 0 = success */
+    int (*run)(void *opaque, char *path); /* returns exit code */
+    void (*close)(void *opaque);    /* after the last movie */
+    void (*done)(void *opaque, const char *path, unsigned long tag, int code); /* in the caller when a movie is finished */
+    void *opaque;                   /* passed to the functions */
+} BatchWorker;
+
+Batch *batch_new();
+
+/**
+ * Free batch, waiting for the movies of batch_stream() still running;
+ * NULL is ignored
+ */
+void batch_free(Batch *b);
+
+/**
+ * Append a movie with its estimated cost; after batch_stream() the movie is
+ * given to an idle worker at once, waiting for one if all are busy
+ * Returns 0 on success, -1 on error
+ */
+int batch_add(Batch *b, const char *path, int64_t cost);
+
+/**
+ * Run the movies of the empty batch b in the order they are added, by
+ * workers (> 1) started like in batch_run(); only the running ones are kept
+ * in memory. Call batch_run() after the last one to wait for the rest.
+ * Returns 0 on success, -1 if not possible (e.g. on Windows): b collects
+ * the movies as before
+ */
+int batch_stream(Batch *b, int workers, const BatchWorker *w);
+
+/**
+ * Run all movies of b in order; equal costs keep the order they were added
+ *
+ * With workers > 1 the movies run in that many processes forked from the
+ * caller, which is expected to have nothing open that can't be shared
+ * (e.g. SQLite databases). Each worker calls open once, then gets the next
+ * movie of the queue whenever it is done, so a long movie doesn't hold
+ * back the others. A crashed worker is replaced. Not on Windows, where the
+ * movies run one by one in this process like with workers <= 1 (open and
+ * close aren't called then).
+ *
+ * done gets the exit code of each movie as it is finished. After
+ * batch_stream() order, workers and w are ignored and the movies still
+ * running are waited for.
+ * Returns the highest exit code of the movies
+ */
+int batch_run(Batch *b, BatchOrder order, int workers, const BatchWorker *w);
+
+#endif /* MTN_BATCH_H */
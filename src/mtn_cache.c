@@ -0,0 +1,148 @@
+/*  mtn - movie thumbnailer
+    Result cache for incremental runs
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_cache.h"
+#include "libavutil/log.h"
+#include <stdlib.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/* wait for other writers up to this time (ms) */
+#define CACHE_BUSY_TIMEOUT 60000
+
+struct MtnCache {
+    sqlite3 *db;
+    sqlite3_stmt *lookup;
+    sqlite3_stmt *store;
+};
+
+static const char *cache_schema =
+    "CREATE TABLE IF NOT EXISTS result ("
+    "  dev       INTEGER NOT NULL,"
+    "  ino       INTEGER NOT NULL,"
+    "  options   TEXT NOT NULL,"
+    "  size      INTEGER NOT NULL,"
+    "  mtime     INTEGER NOT NULL,"
+    "  path      TEXT NOT NULL,"
+    "  result    INTEGER NOT NULL,"
+    "  artefacts TEXT NOT NULL,"
+    "  created   INTEGER NOT NULL,"
+    "  PRIMARY KEY(dev, ino, options)"
+    ");";
+
+MtnCache *cache_open(const char *path)
+{
+    char *err = NULL;
+    MtnCache *c = calloc(1, sizeof(MtnCache));
+    if (NULL == c)
+        return NULL;
+
+    if (SQLITE_OK != sqlite3_open(path, &c->db)) {
+        av_log(NULL, AV_LOG_ERROR, "  cache: opening '%s' failed: %s\n", path, c->db ? sqlite3_errmsg(c->db) : "out of memory");
+        cache_close(c);
+        return NULL;
+    }
+    sqlite3_busy_timeout(c->db, CACHE_BUSY_TIMEOUT);
+
+    if (SQLITE_OK != sqlite3_exec(c->db, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;", NULL, NULL, &err)
+        || SQLITE_OK != sqlite3_exec(c->db, cache_schema, NULL, NULL, &err)) {
+        av_log(NULL, AV_LOG_ERROR, "  cache: initializing '%s' failed: %s\n", path, err ? err : "");
+        sqlite3_free(err);
+        cache_close(c);
+        return NULL;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(c->db,
+            "SELECT size, mtime, result FROM result WHERE dev=? AND ino=? AND options=?", -1, &c->lookup, NULL)
+        || SQLITE_OK != sqlite3_prepare_v2(c->db,
+            "INSERT OR REPLACE INTO result(dev, ino, options, size, mtime, path, result, artefacts, created)"
+            " VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?)", -1, &c->store, NULL)) {
+        av_log(NULL, AV_LOG_ERROR, "  cache: %s\n", sqlite3_errmsg(c->db));
+        cache_close(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+void cache_close(MtnCache *c)
+{
+    if (NULL == c)
+        return;
+
+    sqlite3_finalize(c->lookup);
+    sqlite3_finalize(c->store);
+    sqlite3_close(c->db);
+    free(c);
+}
+
+int cache_lookup(MtnCache *c, const CacheKey *key, int *result)
+{
+    int ret;
+
+    sqlite3_bind_int64(c->lookup, 1, key->dev);
+    sqlite3_bind_int64(c->lookup, 2, key->ino);
+    sqlite3_bind_text(c->lookup, 3, key->options, -1, SQLITE_STATIC);
+
+    switch (sqlite3_step(c->lookup)) {
+    case SQLITE_ROW:
+        ret = sqlite3_column_int64(c->lookup, 0) == key->size
+            && sqlite3_column_int64(c->lookup, 1) == key->mtime;
+        if (ret)
+            *result = sqlite3_column_int(c->lookup, 2);
+        break;
+    case SQLITE_DONE:
+        ret = 0;
+        break;
+    default:
+        av_log(NULL, AV_LOG_ERROR, "  cache: %s\n", sqlite3_errmsg(c->db));
+        ret = -1;
+    }
+
+    sqlite3_reset(c->lookup);
+    return ret;
+}
+
+int cache_store(MtnCache *c, const CacheKey *key, const char *path, int result, const char *artefacts)
+{
+    int ret = 0;
+
+    sqlite3_bind_int64(c->store, 1, key->dev);
+    sqlite3_bind_int64(c->store, 2, key->ino);
+    sqlite3_bind_text(c->store, 3, key->options, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(c->store, 4, key->size);
+    sqlite3_bind_int64(c->store, 5, key->mtime);
+    sqlite3_bind_text(c->store, 6, path, -1, SQLITE_STATIC);
+    sqlite3_bind_int(c->store, 7, result);
+    sqlite3_bind_text(c->store, 8, artefacts ? artefacts : "", -1, SQLITE_STATIC);
+    sqlite3_bind_int64(c->store, 9, (sqlite3_int64)time(NULL));
+
+    if (SQLITE_DONE != sqlite3_step(c->store)) {
+        av_log(NULL, AV_LOG_ERROR, "  cache: storing '%s' failed: %s\n", path, sqlite3_errmsg(c->db));
+        ret = -1;
+    }
+
+    sqlite3_reset(c->store);
+    sqlite3_clear_bindings(c->store);
+    return ret;
+}
+
+uint64_t cache_hash(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    while (size--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
@@ -0,0 +1,68 @@
+/*  mtn - movie thumbnailer
+    Result cache for incremental runs
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_CACHE_H
+#define MTN_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* initial value of cache_hash() */
+#define CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+/**
+ * Cache - results of processed movies (SQLite database)
+ *
+ * A movie is identified by device and inode, so renamed or hard linked
+ * files are found too. The entry is valid only if size and modification
+ * time are unchanged and the options hash is the same, so a changed file is
+ * detected by stat() alone and a different option set gets its own entry.
+ */
+typedef struct MtnCache MtnCache;
+
+typedef struct CacheKey {
+    int64_t dev;
+    int64_t ino;
+    int64_t size;
+    int64_t mtime;
+    const char *options;            /* hash of options affecting the output */
+} CacheKey;
+
+/**
+ * Open or create cache
+ * Returns NULL on error
+ */
+MtnCache *cache_open(const char *path);
+
+/**
+ * Close cache; NULL is ignored
+ */
+void cache_close(MtnCache *c);
+
+/**
+ * Returns 1 if the movie is unchanged since it was stored (*result is the
+ * stored result code), 0 if not found or changed, -1 on error
+ */
+int cache_lookup(MtnCache *c, const CacheKey *key, int *result);
+
+/**
+ * Store result of a movie and its artefacts (output names separated by '\n')
+ * Returns 0 on success, -1 on error
+ */
+int cache_store(MtnCache *c, const CacheKey *key, const char *path, int result, const char *artefacts);
+
+/**
+ * FNV-1a hash of data continuing from h
+ */
+uint64_t cache_hash(uint64_t h, const void *data, size_t size);
+
+#endif /* MTN_CACHE_H */
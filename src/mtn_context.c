@@ -15,25 +15,7 @@
 #include <string.h>
 #include <time.h>
 #include <stdio.h>
-
-/* Import defaults from mtn.c - these should match */
-#define GB_E_END             0.0
-#define GB_H_human_filesize  0
-#define GB_N_SUFFIX          NULL
-#define GB_O_OUTDIR          NULL
-#define GB_T_TEXT            NULL
-
-#ifndef GB_F_FONTNAME
-#ifdef __APPLE__
-#   define GB_F_FONTNAME "Tahoma Bold.ttf"
-#else
-#ifdef _WIN32
-#   define GB_F_FONTNAME "tahomabd.ttf"
-#else
-#   define GB_F_FONTNAME "DejaVuSans.ttf"
-#endif
-#endif
-#endif
+#include "libavutil/dict.h"
 
 void mtn_context_init(MtnContext *ctx)
 {
@@ -60,7 +42,7 @@ void mtn_context_init(MtnContext *ctx)
     ctx->F_ts_font_size = 8.0;
     ctx->g_gap = GB_G_GAP;
     ctx->h_height = GB_H_HEIGHT;
-    ctx->H_human_filesize = GB_H_human_filesize;
+    ctx->H_human_filesize = 0;
     ctx->i_info = GB_I_INFO;
     ctx->I_individual = GB_I_INDIVIDUAL;
     ctx->I_individual_thumbnail = 0;
@@ -74,11 +56,7 @@ void mtn_context_init(MtnContext *ctx)
     ctx->N_suffix = GB_N_SUFFIX;
     ctx->o_suffix = GB_O_SUFFIX;
     ctx->O_outdir = GB_O_OUTDIR;
-#ifdef _WIN32
-    ctx->p_pause = 1;  /* Windows default */
-#else
-    ctx->p_pause = 0;  /* Unix default */
-#endif
+    ctx->p_pause = GB_P_PAUSE;
     ctx->P_dontpause = GB_P_DONTPAUSE;
     ctx->q_quiet = GB_Q_QUIET;
     ctx->r_row = GB_R_ROW;
@@ -106,39 +84,53 @@ void mtn_context_init(MtnContext *ctx)
     ctx->_filters = NULL;
     ctx->_filter_color_primaries = NULL;
     ctx->_tonemap = 0;
+    ctx->_stream = 0;
+    ctx->_stream_page_height = 0;
+    ctx->_nb_profiles = 0;
+    ctx->_archive = NULL;
+    ctx->_png_level = -1;
+    ctx->_png_filter = PNGENC_FILTER_DEFAULT;
+    ctx->_png_threads = 0;
+    ctx->_target_size = 0;
+    ctx->_cache = NULL;
+    ctx->_probe_cache = NULL;
+    ctx->_files_from = NULL;
+    ctx->_serve = NULL;
+    ctx->_serve_workers = 0;
+    ctx->_watch = NULL;
+    ctx->_watch_delay = 2000;
+    ctx->_watch_workers = 0;
+    ctx->_order = BATCH_ORDER_NAME;
+    ctx->_jobs = 1;
+    ctx->_shard_i = 0;
+    ctx->_shard_n = 0;
+    ctx->_journal = NULL;
+    ctx->_resume = NULL;
+    ctx->_max_retries = 2;
+    ctx->_dedupe = 0;
+    ctx->_json_events = 0;
+    ctx->_probe = 0;
+    ctx->_timeout = 0;
+    ctx->_log_json = 0;
 
     /* Runtime state */
     ctx->argv0 = NULL;
-    ctx->version = "3.5.0";
+    ctx->version = MTN_VERSION;
     ctx->st_start = 0;
     ctx->movie_ext = NULL;
-    ctx->fcStrFlagsInfotext = NULL;
-    ctx->fcStrFlagsTimestamp = NULL;
+    ctx->nb_movie_ext = 0;
+    /* opened archive, caches etc. and font flags are zeroed by memset */
 }
 
 void mtn_context_cleanup(MtnContext *ctx)
 {
     if (!ctx) return;
 
-    /* Note: String literals (GB_*) should not be freed */
-    /* Only free dynamically allocated strings */
-    
-    if (ctx->argv0) {
-        free(ctx->argv0);
-        ctx->argv0 = NULL;
-    }
-    if (ctx->x_basename_custom) {
-        free(ctx->x_basename_custom);
-        ctx->x_basename_custom = NULL;
-    }
-    if (ctx->_filters) {
-        free(ctx->_filters);
-        ctx->_filters = NULL;
-    }
-    if (ctx->_filter_color_primaries) {
-        free(ctx->_filter_color_primaries);
-        ctx->_filter_color_primaries = NULL;
-    }
+    av_dict_free(&ctx->_options);
+    free(ctx->_filters);
+    ctx->_filters = NULL;
+    free(ctx->_filter_color_primaries);
+    ctx->_filter_color_primaries = NULL;
 
     /* Free movie extensions array */
     if (ctx->movie_ext) {
@@ -150,6 +142,12 @@ void mtn_context_cleanup(MtnContext *ctx)
         free(ctx->movie_ext);
         ctx->movie_ext = NULL;
     }
+    ctx->nb_movie_ext = 0;
 
-    /* Note: _options (AVDictionary*) should be freed by caller using av_dict_free */
+    free(ctx->shard_counts);
+    ctx->shard_counts = NULL;
+    free(ctx->artefacts);
+    ctx->artefacts = NULL;
+    free(ctx->job_artefacts);
+    ctx->job_artefacts = NULL;
 }
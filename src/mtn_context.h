@@ -13,9 +13,21 @@
 #ifndef MTN_CONTEXT_H
 #define MTN_CONTEXT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 #include "libavutil/rational.h"
+#include "libavutil/dict.h"
+#include "gd.h"
+#include "mtn_archive.h"
+#include "mtn_cache.h"
+#include "mtn_probe.h"
+#include "mtn_scan.h"
+#include "mtn_batch.h"
+#include "mtn_journal.h"
+#include "mtn_dedupe.h"
+#include "mtn_png.h"
+#include "libmtn.h"
 
 /**
  * RGB color structure
@@ -29,6 +41,8 @@ typedef struct rgb_color {
 #define COLOR_WHITE  (rgb_color){255, 255, 255}
 #define COLOR_INFO   (rgb_color){85, 85, 85}
 
+#define MTN_VERSION "3.6.0"
+
 /**
  * Default values for command line options
  */
@@ -39,7 +53,19 @@ typedef struct rgb_color {
 #define GB_C_CUT             -1
 #define GB_D_DEPTH           -1
 #define GB_D_EDGE            12
+#define GB_E_END             0.0
 #define GB_E_EXT             "3gp,3g2,asf,avi,avs,dat,divx,dsm,evo,flv,m1v,m2ts,m2v,m4v,mj2,mjpg,mjpeg,mkv,mov,moov,mp4,mpg,mpeg,mpv,nut,ogg,ogm,qt,rm,rmvb,swf,ts,vob,webm,wmv,xvid"
+#ifndef GB_F_FONTNAME
+#ifdef __APPLE__
+#   define GB_F_FONTNAME "Tahoma Bold.ttf"
+#else
+#ifdef WIN32
+#   define GB_F_FONTNAME "tahomabd.ttf"
+#else
+#   define GB_F_FONTNAME "DejaVuSans.ttf"
+#endif
+#endif
+#endif
 #define GB_G_GAP             0
 #define GB_H_HEIGHT          150
 #define GB_I_INFO            1
@@ -49,14 +75,21 @@ typedef struct rgb_color {
 #define GB_L_INFO_LOCATION   4
 #define GB_L_TIME_LOCATION   1
 #define GB_N_NORMAL          0
+#define GB_N_SUFFIX          NULL
 #define GB_O_SUFFIX          "_s.jpg"
+#define GB_O_OUTDIR          NULL
+#ifdef WIN32
+#define GB_P_PAUSE           1
+#else
 #define GB_P_PAUSE           0
+#endif
 #define GB_P_DONTPAUSE       0
 #define GB_Q_QUIET           0
 #define GB_R_ROW             0
 #define GB_S_STEP            120
 #define GB_S_SELECT_VIDEO_STREAM 0
 #define GB_T_TIME            1
+#define GB_T_TEXT            NULL
 #define GB_V_VERBOSE         0
 #define GB_W_WIDTH           1024
 #define GB_W_OVERWRITE       1
@@ -64,9 +97,29 @@ typedef struct rgb_color {
 #define GB_Z_SEEK            0
 #define GB_Z_NONSEEK         0
 
+#define MAX_PROFILES 16
+#define PROFILE_INHERIT -1
+
+typedef struct PROFILE
+{
+    char *o_suffix;     // output suffix; selects image format too
+    int w_width;        // PROFILE_INHERIT = same as main output (-w)
+    int c_column;       // -c
+    int r_row;          // -r
+    int s_step;         // -s
+    int j_quality;      // -j
+} Profile; // additional output created from the same decoded frames (--profile)
+
+/**
+ * Output of libmtn: data of the file name would be written
+ * Returns 0 on success, -1 on error
+ */
+typedef int (*MtnOutputFn)(void *opaque, const char *name, const void *data, size_t size);
+
 /**
- * MTN Context - contains all configuration and state
- * This replaces the global variables for better testability and maintainability
+ * MTN Context - contains all configuration and state of a run
+ * Every function of mtn.c takes it as its first argument, so jobs with
+ * different options can run in one process, each with its own context
  */
 typedef struct MtnContext {
     /* Command line options */
@@ -126,20 +179,73 @@ typedef struct MtnContext {
     int _webvtt;                     /* --vtt */
     const char *_cover_suffix;       /* --cover suffix */
     const char *_webvtt_prefix;      /* --vtt prefix */
-    void *_options;                  /* --options: AVDictionary* */
+    AVDictionary *_options;          /* --options */
     char *_filters;                  /* --filters */
     char *_filter_color_primaries;   /* --filter-color-primaries */
     int _tonemap;                    /* --tonemap */
+    int _stream;                     /* --stream: write the image row by row */
+    int _stream_page_height;         /* --stream: max. height of each page; 0 = no limit */
+    Profile _profiles[MAX_PROFILES]; /* --profile */
+    int _nb_profiles;
+    char *_archive;                  /* --archive: store all outputs in this archive */
+    int _png_level;                  /* --png-level: zlib level 0-9; -1 gd's default */
+    int _png_filter;                 /* --png-filter */
+    int _png_threads;                /* --png-threads: >1 deflate png in parallel */
+    int _target_size;                /* --target-size: max. KB of jpeg/webp/avif; 0 off */
+    char *_cache;                    /* --cache */
+    char *_probe_cache;              /* --probe-cache */
+    char *_files_from;               /* --files-from: "-" = stdin */
+    char *_serve;                    /* --serve: Unix socket */
+    int _serve_workers;              /* --serve-workers: 0 = # of CPUs */
+    char *_watch;                    /* --watch: directory */
+    int _watch_delay;                /* --watch-delay: ms */
+    int _watch_workers;              /* --watch-workers: 0 = # of CPUs */
+    int _order;                      /* --order: BatchOrder */
+    int _jobs;                       /* --jobs: movies processed at once */
+    int _shard_i;                    /* --shard i/N: 1..N */
+    int _shard_n;                    /* --shard: 0 = off */
+    char *_journal;                  /* --journal */
+    char *_resume;                   /* --resume */
+    int _max_retries;                /* --max-retries */
+    int _dedupe;                     /* --dedupe: 1 same inode, 2 also same content */
+    int _json_events;                /* --json-events */
+    int _probe;                      /* --probe: print stream info as JSON instead of making thumbnails */
+    int _timeout;                    /* --timeout: seconds per movie; 0 = none */
+    int _log_json;                   /* --log-format=json */
 
     /* Runtime state */
     char *argv0;                     /* Program name */
     char *version;                   /* Version string */
     time_t st_start;                 /* Start time */
     char **movie_ext;                /* Movie extensions array */
+    int nb_movie_ext;
+    MtnArchive *archive;             /* opened --archive */
+    const char *archive_source;      /* movie whose outputs are being archived or reported */
+    MtnCache *cache;                 /* opened --cache */
+    char cache_options[17];          /* hex hash of options affecting the output */
+    char *artefacts;                 /* outputs of the current movie for --cache; '\n' separated */
+    ProbeCache *probe_cache;         /* opened --probe-cache */
+    char probe_options[17];          /* hex hash of options affecting probing */
+    int serve_job;                   /* 1 = running a --serve job */
+    char *job_artefacts;             /* outputs of the current --serve job; '\n' separated */
+    Scanner *scanner;
+    Batch *batch;                    /* movies collected for --order or --jobs */
+    size_t shard_root;               /* length of the crawl root in paths of --shard; 0 = whole path */
+    unsigned long *shard_counts;     /* movies found in each --shard */
+    Journal *journal;                /* opened --journal or --resume */
+    Dedupe *dedupe;                  /* movies processed in this run for --dedupe */
+    FILE *events;                    /* --json-events: stdout; NULL = off */
+    const MtnReader *reader;         /* libmtn: movie read through callbacks, NULL = file */
+    MtnOutputFn output;              /* libmtn: outputs go here instead of files, NULL = files */
+    void *output_opaque;
+    MtnInfo *info;                   /* libmtn: filled by make_thumbnail(), NULL = not wanted */
+    const volatile int *cancel;      /* libmtn: stop the movie when set, NULL = never */
+    int timed_out;                   /* the last make_thumbnail() stopped at --timeout */
+    int nb_files;                    /* make_thumbnail() calls; index of dump_format_context() */
 
     /* Font config */
-    void *fcStrFlagsInfotext;        /* gdFTStringExtra for info text */
-    void *fcStrFlagsTimestamp;       /* gdFTStringExtra for timestamp */
+    gdFTStringExtra fcStrFlagsInfotext;
+    gdFTStringExtra fcStrFlagsTimestamp;
 } MtnContext;
 
 /**
@@ -148,7 +254,9 @@ typedef struct MtnContext {
 void mtn_context_init(MtnContext *ctx);
 
 /**
- * Free dynamically allocated members of MtnContext
+ * Free dynamically allocated members of MtnContext; option strings point
+ * into argv and are not freed, opened archive, caches etc. are closed by
+ * their owner
  */
 void mtn_context_cleanup(MtnContext *ctx);
 
@@ -0,0 +1,155 @@
+/*  mtn - movie thumbnailer
+    Finding hard links and copies of movies processed before
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_dedupe.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct Dedupe {
+    DedupeHash hash;                /* NULL = hard links only */
+    DedupeMovie *movies;
+    int nb_movies;
+    int size;                       /* of movies and the hash tables */
+    int *by_ino;                    /* first movie of each bucket or -1 */
+    int *by_size;
+};
+
+static unsigned bucket(int64_t a, int64_t b, int size)
+{
+    uint64_t h = (uint64_t)a * 0x9e3779b97f4a7c15ULL ^ (uint64_t)b * 0xc2b2ae3d27d4eb4fULL;
+    return (unsigned)((h ^ (h >> 32)) % (unsigned)size);
+}
+
+/* double the capacity and rebuild the hash tables */
+static int grow(Dedupe *d)
+{
+    int size = d->size ? d->size * 2 : 256, i;
+    DedupeMovie *movies = realloc(d->movies, size * sizeof(DedupeMovie));
+    int *by_ino = malloc(size * sizeof(int));
+    int *by_size = malloc(size * sizeof(int));
+
+    if (movies)
+        d->movies = movies;
+    if (NULL == movies || NULL == by_ino || NULL == by_size) {
+        free(by_ino);
+        free(by_size);
+        return -1;
+    }
+    for (i = 0; i < size; i++)
+        by_ino[i] = by_size[i] = -1;
+    for (i = 0; i < d->nb_movies; i++) {
+        DedupeMovie *m = &d->movies[i];
+        unsigned bi = bucket(m->dev, m->ino, size), bs = bucket(m->size, 0, size);
+        m->next_ino = by_ino[bi];
+        by_ino[bi] = i;
+        m->next_size = by_size[bs];
+        by_size[bs] = i;
+    }
+    free(d->by_ino);
+    free(d->by_size);
+    d->by_ino = by_ino;
+    d->by_size = by_size;
+    d->size = size;
+    return 0;
+}
+
+Dedupe *dedupe_new(DedupeHash hash)
+{
+    Dedupe *d = calloc(1, sizeof(Dedupe));
+    if (NULL == d)
+        return NULL;
+    d->hash = hash;
+    if (0 != grow(d)) {
+        dedupe_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+void dedupe_free(Dedupe *d)
+{
+    int i;
+    if (NULL == d)
+        return;
+    for (i = 0; i < d->nb_movies; i++) {
+        free(d->movies[i].path);
+        free(d->movies[i].base);
+        free(d->movies[i].artefacts);
+    }
+    free(d->movies);
+    free(d->by_ino);
+    free(d->by_size);
+    free(d);
+}
+
+static int hash_of(Dedupe *d, DedupeMovie *m)
+{
+    if (0 == m->hashed)
+        m->hashed = (0 == d->hash(m->path, m->size, &m->hash)) ? 1 : -1;
+    return m->hashed;
+}
+
+const DedupeMovie *dedupe_find(Dedupe *d, const char *path, int64_t dev, int64_t ino, int64_t size)
+{
+    DedupeMovie probe = { (char *)path, dev, ino, size, 0, 0, NULL, NULL, 0, -1, -1 };
+    int i;
+
+    for (i = d->by_ino[bucket(dev, ino, d->size)]; i >= 0; i = d->movies[i].next_ino) {
+        if (d->movies[i].dev == dev && d->movies[i].ino == ino)
+            return &d->movies[i];
+    }
+    if (NULL == d->hash)
+        return NULL;
+
+    // copies: sampled blocks are read only if the size matches
+    for (i = d->by_size[bucket(size, 0, d->size)]; i >= 0; i = d->movies[i].next_size) {
+        DedupeMovie *m = &d->movies[i];
+        if (m->size != size)
+            continue;
+        if (1 != hash_of(d, &probe))
+            return NULL;
+        if (1 == hash_of(d, m) && m->hash == probe.hash)
+            return m;
+    }
+    return NULL;
+}
+
+int dedupe_add(Dedupe *d, const char *path, int64_t dev, int64_t ino, int64_t size,
+               const char *base, const char *artefacts, int result)
+{
+    if (d->nb_movies == d->size && 0 != grow(d))
+        return -1;
+
+    DedupeMovie *m = &d->movies[d->nb_movies];
+    memset(m, 0, sizeof(*m));
+    m->path = strdup(path);
+    m->base = strdup(base);
+    m->artefacts = artefacts ? strdup(artefacts) : NULL;
+    if (NULL == m->path || NULL == m->base || (artefacts && NULL == m->artefacts)) {
+        free(m->path);
+        free(m->base);
+        free(m->artefacts);
+        return -1;
+    }
+    m->dev = dev;
+    m->ino = ino;
+    m->size = size;
+    m->result = result;
+
+    unsigned bi = bucket(dev, ino, d->size), bs = bucket(size, 0, d->size);
+    m->next_ino = d->by_ino[bi];
+    d->by_ino[bi] = d->nb_movies;
+    m->next_size = d->by_size[bs];
+    d->by_size[bs] = d->nb_movies;
+    d->nb_movies++;
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*  mtn - movie thumbnailer
+    Finding hard links and copies of movies processed before
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_DEDUPE_H
+#define MTN_DEDUPE_H
+
+#include <stdint.h>
+
+/**
+ * Hash of sampled blocks of a movie of size bytes
+ * Returns 0 on success, -1 if it can't be read
+ */
+typedef int (*DedupeHash)(const char *path, int64_t size, uint64_t *hash);
+
+typedef struct DedupeMovie {
+    char *path;
+    int64_t dev, ino, size;
+    uint64_t hash;
+    int hashed;                     /* 1 = hash is known, -1 = can't be read */
+    char *base;                     /* output names without suffix */
+    char *artefacts;                /* '\n' separated */
+    int result;                     /* of make_thumbnail() */
+    int next_ino, next_size;        /* chains of the hash tables */
+} DedupeMovie;
+
+/**
+ * Dedupe - movies processed in this run, found again by device and inode
+ * (hard links, the same path twice) and optionally by content (copies)
+ */
+typedef struct Dedupe Dedupe;
+
+/**
+ * hash - compare content of movies of the same size too; NULL = only
+ * paths of the same file (device and inode)
+ */
+Dedupe *dedupe_new(DedupeHash hash);
+
+/**
+ * Free dedupe; NULL is ignored
+ */
+void dedupe_free(Dedupe *d);
+
+/**
+ * Earlier movie with the same device and inode, or with the same size and
+ * hash of sampled blocks; hashes are computed only for movies whose size
+ * another movie has
+ * Returns NULL if there is none
+ */
+const DedupeMovie *dedupe_find(Dedupe *d, const char *path, int64_t dev, int64_t ino, int64_t size);
+
+/**
+ * Remember a processed movie with its output names
+ * Returns 0 on success, -1 on error
+ */
+int dedupe_add(Dedupe *d, const char *path, int64_t dev, int64_t ino, int64_t size,
+               const char *base, const char *artefacts, int result);
+
+#endif /* MTN_DEDUPE_H */
@@ -44,6 +44,10 @@ const char* mtn_error_string(MtnError err)
             return "Image save failed";
         case MTN_ERROR_BUFFER_TOO_SMALL:
             return "Buffer too small";
+        case MTN_ERROR_CANCELLED:
+            return "Cancelled";
+        case MTN_ERROR_TIMEOUT:
+            return "Timed out";
         default:
             return "Unknown error";
     }
@@ -32,6 +32,8 @@ typedef enum MtnError {
     MTN_ERROR_FILTER_INIT_FAILED = -10,
     MTN_ERROR_IMAGE_SAVE_FAILED = -11,
     MTN_ERROR_BUFFER_TOO_SMALL = -12,
+    MTN_ERROR_CANCELLED = -13,
+    MTN_ERROR_TIMEOUT = -14,
 } MtnError;
 
 /**
@@ -0,0 +1,96 @@
+/*  mtn - movie thumbnailer
+    Machine-readable progress events (--json-events)
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_events.h"
+#include "mtn_json.h"
+#include <inttypes.h>
+
+static void begin(FILE *fp, const char *event, const char *file)
+{
+    fprintf(fp, "{\"event\":\"%s\",\"file\":", event);
+    json_write_str(fp, file);
+}
+
+static void end(FILE *fp)
+{
+    fputs("}\n", fp);
+    fflush(fp);
+}
+
+static void number(FILE *fp, const char *key, double num)
+{
+    fprintf(fp, ",\"%s\":", key);
+    json_write_num(fp, num);
+}
+
+void events_start(FILE *fp, const char *file)
+{
+    if (NULL == fp)
+        return;
+    begin(fp, "start", file);
+    end(fp);
+}
+
+void events_probe(FILE *fp, const char *file, double seconds, const MtnInfo *info)
+{
+    if (NULL == fp)
+        return;
+    begin(fp, "probe", file);
+    number(fp, "seconds", seconds);
+    number(fp, "duration", info->duration);
+    fprintf(fp, ",\"width\":%d,\"height\":%d,\"rotation\":%d", info->width, info->height, info->rotation);
+    number(fp, "frame_rate", info->frame_rate);
+    fprintf(fp, ",\"bit_rate\":%" PRId64 ",\"size\":", info->bit_rate);
+    if (info->size >= 0)
+        fprintf(fp, "%" PRId64, info->size);
+    else
+        fputs("null", fp);
+    fputs(",\"video_codec\":", fp);
+    json_write_str(fp, info->video_codec);
+    fputs(",\"audio_codec\":", fp);
+    json_write_str(fp, info->audio_codec[0] ? info->audio_codec : NULL);
+    end(fp);
+}
+
+void events_shot(FILE *fp, const char *file, int n, int shots, int64_t pts, double time)
+{
+    if (NULL == fp)
+        return;
+    begin(fp, "shot", file);
+    fprintf(fp, ",\"shot\":%d,\"shots\":%d,\"pts\":%" PRId64, n, shots, pts);
+    number(fp, "time", time);
+    end(fp);
+}
+
+void events_output(FILE *fp, const char *file, const char *path, int64_t size)
+{
+    if (NULL == fp)
+        return;
+    begin(fp, "output", file);
+    fputs(",\"path\":", fp);
+    json_write_str(fp, path);
+    if (size >= 0)
+        fprintf(fp, ",\"size\":%" PRId64, size);
+    else
+        fputs(",\"size\":null", fp);
+    end(fp);
+}
+
+void events_done(FILE *fp, const char *file, int code, double seconds)
+{
+    if (NULL == fp)
+        return;
+    begin(fp, "done", file);
+    fprintf(fp, ",\"code\":%d", code);
+    number(fp, "seconds", seconds);
+    end(fp);
+}
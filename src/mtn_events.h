@@ -0,0 +1,54 @@
+/*  mtn - movie thumbnailer
+    Machine-readable progress events (--json-events)
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_EVENTS_H
+#define MTN_EVENTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "libmtn.h"
+
+/**
+ * Events - one JSON object per line, flushed at once so processes sharing
+ * fp (--jobs) don't mix their lines:
+ *
+ *   {"event":"start","file":"a.mkv"}
+ *   {"event":"probe","file":"a.mkv","seconds":0.08,"duration":5400.5,"width":1920,"height":1080,...}
+ *   {"event":"shot","file":"a.mkv","shot":3,"shots":24,"pts":9723000,"time":675.06}
+ *   {"event":"output","file":"a.mkv","path":"a_s.jpg","size":812345}
+ *   {"event":"done","file":"a.mkv","code":0,"seconds":3.52}
+ *
+ * seconds are counted from the start of the file. shot is 1-based. size is
+ * null if unknown. code is that of make_thumbnail(): 0 ok, 1 some shots are
+ * missing, <0 MtnError. All functions do nothing if fp is NULL
+ */
+
+void events_start(FILE *fp, const char *file);
+
+/**
+ * Movie is opened; info as returned by libmtn
+ */
+void events_probe(FILE *fp, const char *file, double seconds, const MtnInfo *info);
+
+/**
+ * Shot n of shots of the main output is decoded; pts in stream time_base
+ */
+void events_shot(FILE *fp, const char *file, int n, int shots, int64_t pts, double time);
+
+/**
+ * Output path is written; size < 0 = unknown
+ */
+void events_output(FILE *fp, const char *file, const char *path, int64_t size);
+
+void events_done(FILE *fp, const char *file, int code, double seconds);
+
+#endif /* MTN_EVENTS_H */
@@ -0,0 +1,308 @@
+/*  mtn - movie thumbnailer
+    Journal of processed movies for resuming a crawl
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_journal.h"
+#include "libavutil/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <io.h>
+#define fsync(fd) _commit(fd)
+#else
+#include <unistd.h>
+#endif
+
+/* records are written with one write() from this buffer */
+#define JOURNAL_BUFFER_SIZE 65536
+
+typedef struct JournalEntry {
+    char *path;
+    int code;                       /* last exit code; -1 = none */
+    int failures;
+    int finished;
+} JournalEntry;
+
+struct Journal {
+    FILE *fp;
+    JournalEntry *entries;          /* sorted by path */
+    int nb_entries;
+    char *line;                     /* for reading and writing records */
+    size_t line_size;
+};
+
+/* one line of the journal while reading */
+typedef struct Record {
+    char *path;
+    int seq;
+    int start;
+    int code;
+} Record;
+
+static int line_reserve(Journal *j, size_t size)
+{
+    if (size <= j->line_size)
+        return 0;
+    size_t new_size = j->line_size ? j->line_size : 256;
+    while (new_size < size)
+        new_size *= 2;
+    char *new = realloc(j->line, new_size);
+    if (NULL == new)
+        return -1;
+    j->line = new;
+    j->line_size = new_size;
+    return 0;
+}
+
+/* read line without '\n' into j->line; returns 1 if complete, 0 at EOF, -1 on error */
+static int read_line(Journal *j)
+{
+    size_t len = 0;
+    int c;
+
+    while (EOF != (c = getc(j->fp)) && '\n' != c) {
+        if (0 != line_reserve(j, len + 2))
+            return -1;
+        j->line[len++] = c;
+    }
+    if (EOF == c) // incomplete last line is ignored
+        return ferror(j->fp) ? -1 : 0;
+    if (0 != line_reserve(j, len + 1))
+        return -1;
+    j->line[len] = '\0';
+    return 1;
+}
+
+static char *unescape(const char *s)
+{
+    char *out = malloc(strlen(s) + 1), *o = out;
+    if (NULL == out)
+        return NULL;
+    for (; *s; s++) {
+        if ('\\' != *s) {
+            *o++ = *s;
+            continue;
+        }
+        switch (*++s) {
+        case 't': *o++ = '\t'; break;
+        case 'r': *o++ = '\r'; break;
+        case 'n': *o++ = '\n'; break;
+        case '\\': *o++ = '\\'; break;
+        default:
+            free(out);
+            return NULL;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+/* returns 1 if parsed, 0 if malformed, -1 on error */
+static int parse_record(char *line, Record *r)
+{
+    char *code = strchr(line, '\t');
+    char *path = code ? strchr(code + 1, '\t') : NULL;
+    if (NULL == path)
+        return 0;
+    *code++ = '\0';
+    *path++ = '\0';
+
+    r->start = (0 == strcmp(line, "start"));
+    if (!r->start && 0 != strcmp(line, "done") && 0 != strcmp(line, "warning") && 0 != strcmp(line, "failed"))
+        return 0;
+    r->code = atoi(code);
+    r->path = unescape(path);
+    return r->path ? 1 : 0;
+}
+
+static int cmp_record(const void *a, const void *b)
+{
+    const Record *x = a, *y = b;
+    int c = strcmp(x->path, y->path);
+    return c ? c : x->seq - y->seq;
+}
+
+/* fold the records of each path into one entry */
+static int build_entries(Journal *j, Record *r, int nb)
+{
+    int i;
+
+    qsort(r, nb, sizeof(Record), cmp_record);
+    j->entries = calloc(nb > 0 ? nb : 1, sizeof(JournalEntry));
+    if (NULL == j->entries)
+        return -1;
+
+    JournalEntry *e = NULL;
+    int pending = 0;
+    for (i = 0; i < nb; i++) {
+        if (NULL == e || 0 != strcmp(e->path, r[i].path)) {
+            if (e && pending) // crashed
+                e->failures++;
+            e = &j->entries[j->nb_entries++];
+            e->path = r[i].path;
+            e->code = -1;
+            pending = 0;
+        } else {
+            free(r[i].path);
+        }
+        r[i].path = NULL;
+
+        if (r[i].start) {
+            if (pending)
+                e->failures++;
+            pending = 1;
+            e->finished = 0;
+        } else {
+            pending = 0;
+            e->code = r[i].code;
+            e->finished = (0 == r[i].code || 1 == r[i].code);
+            if (!e->finished)
+                e->failures++;
+        }
+    }
+    if (e && pending)
+        e->failures++;
+    return 0;
+}
+
+static int read_records(Journal *j)
+{
+    Record *r = NULL;
+    int nb = 0, size = 0, ret, i;
+
+    rewind(j->fp);
+    while (1 == (ret = read_line(j))) {
+        if (nb == size) {
+            size = size ? size * 2 : 256;
+            Record *new = realloc(r, size * sizeof(Record));
+            if (NULL == new) {
+                ret = -1;
+                break;
+            }
+            r = new;
+        }
+        r[nb].seq = nb;
+        int p = parse_record(j->line, &r[nb]);
+        if (p < 0) {
+            ret = -1;
+            break;
+        }
+        nb += p;
+    }
+    if (0 == ret)
+        ret = build_entries(j, r, nb);
+
+    for (i = 0; i < nb; i++)
+        free(r[i].path);
+    free(r);
+    return ret;
+}
+
+Journal *journal_open(FILE *fp, int resume)
+{
+    Journal *j = calloc(1, sizeof(Journal));
+    if (NULL == j) {
+        fclose(fp);
+        return NULL;
+    }
+    j->fp = fp;
+    setvbuf(fp, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
+
+    if (resume && 0 != read_records(j)) {
+        av_log(NULL, AV_LOG_ERROR, "  journal: reading failed\n");
+        journal_close(j);
+        return NULL;
+    }
+
+    // a line cut by a crash is ended, so the next record starts on its own line
+    if (0 == fseek(fp, -1, SEEK_END) && '\n' != getc(fp)) {
+        fseek(fp, 0, SEEK_END);
+        fputc('\n', fp);
+        fflush(fp);
+    }
+    fseek(fp, 0, SEEK_END);
+    return j;
+}
+
+void journal_close(Journal *j)
+{
+    int i;
+    if (NULL == j)
+        return;
+    for (i = 0; i < j->nb_entries; i++)
+        free(j->entries[i].path);
+    free(j->entries);
+    free(j->line);
+    fclose(j->fp);
+    free(j);
+}
+
+static int cmp_entry(const void *key, const void *e)
+{
+    return strcmp(key, ((const JournalEntry *)e)->path);
+}
+
+JournalState journal_check(const Journal *j, const char *path, int max_retries, int *code, int *failures)
+{
+    const JournalEntry *e = bsearch(path, j->entries, j->nb_entries, sizeof(JournalEntry), cmp_entry);
+
+    *code = e ? e->code : -1;
+    *failures = e ? e->failures : 0;
+    if (NULL == e)
+        return JOURNAL_TODO;
+    if (e->finished)
+        return JOURNAL_FINISHED;
+    if (e->failures > max_retries)
+        return JOURNAL_GAVE_UP;
+    return JOURNAL_TODO;
+}
+
+static int write_record(Journal *j, const char *status, const char *code, const char *path)
+{
+    size_t len = strlen(status) + strlen(code) + 2 * strlen(path) + 4;
+    char *o;
+
+    if (0 != line_reserve(j, len))
+        return -1;
+    o = j->line + sprintf(j->line, "%s\t%s\t", status, code);
+    for (; *path; path++) {
+        switch (*path) {
+        case '\t': *o++ = '\\'; *o++ = 't'; break;
+        case '\r': *o++ = '\\'; *o++ = 'r'; break;
+        case '\n': *o++ = '\\'; *o++ = 'n'; break;
+        case '\\': *o++ = '\\'; *o++ = '\\'; break;
+        default: *o++ = *path;
+        }
+    }
+    *o++ = '\n';
+
+    // the whole line in one write(); appended atomically to the shared file
+    if (o - j->line != (long)fwrite(j->line, 1, o - j->line, j->fp) || 0 != fflush(j->fp)) {
+        av_log(NULL, AV_LOG_ERROR, "  journal: writing failed\n");
+        clearerr(j->fp);
+        return -1;
+    }
+    fsync(fileno(j->fp));
+    return 0;
+}
+
+int journal_start(Journal *j, const char *path)
+{
+    return write_record(j, "start", "-", path);
+}
+
+int journal_end(Journal *j, const char *path, int code)
+{
+    char c[16];
+    snprintf(c, sizeof(c), "%d", code);
+    return write_record(j, 0 == code ? "done" : 1 == code ? "warning" : "failed", c, path);
+}
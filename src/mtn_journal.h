@@ -0,0 +1,71 @@
+/*  mtn - movie thumbnailer
+    Journal of processed movies for resuming a crawl
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_JOURNAL_H
+#define MTN_JOURNAL_H
+
+#include <stdio.h>
+
+/**
+ * Journal - append-only text file, one record per line:
+ *
+ *   start   -  /movies/a.mkv
+ *   done    0  /movies/a.mkv
+ *   warning 1  /movies/b.mkv
+ *   failed  2  /movies/c.mkv
+ *
+ * Fields are separated by tabs; '\', tab, CR and LF in paths are escaped
+ * with '\'. Each record is written at once and synced, so processes sharing
+ * the file (opened for appending) don't mix their lines and a crash loses
+ * at most the record being written. A start without an end means the
+ * movie crashed mtn; it counts as failed. Incomplete lines are ignored.
+ */
+typedef struct Journal Journal;
+
+typedef enum JournalState {
+    JOURNAL_TODO,                   /* not in the journal or to be retried */
+    JOURNAL_FINISHED,               /* done or warning */
+    JOURNAL_GAVE_UP,                /* failed too often */
+} JournalState;
+
+/**
+ * Use fp opened for appending and reading ("a+b"); with resume the records
+ * in it are read first. fp is closed by journal_close(), also on error
+ * Returns NULL on error
+ */
+Journal *journal_open(FILE *fp, int resume);
+
+/**
+ * Close journal; NULL is ignored
+ */
+void journal_close(Journal *j);
+
+/**
+ * State of path in the records read by journal_open(); failures are retried
+ * until they failed more than max_retries times
+ * *code is the last exit code, *failures the number of failures
+ */
+JournalState journal_check(const Journal *j, const char *path, int max_retries, int *code, int *failures);
+
+/**
+ * Append start record of path
+ * Returns 0 on success, -1 on error
+ */
+int journal_start(Journal *j, const char *path);
+
+/**
+ * Append end record of path with exit code (0 done, 1 warning, else failed)
+ * Returns 0 on success, -1 on error
+ */
+int journal_end(Journal *j, const char *path, int code);
+
+#endif /* MTN_JOURNAL_H */
@@ -0,0 +1,313 @@
+/*  mtn - movie thumbnailer
+    Minimal JSON reading and writing
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_json.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void skip_ws(const char **p)
+{
+    while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r')
+        (*p)++;
+}
+
+static int hex4(const char *p, unsigned *v)
+{
+    int i;
+    *v = 0;
+    for (i = 0; i < 4; i++) {
+        char c = p[i];
+        *v <<= 4;
+        if (c >= '0' && c <= '9')
+            *v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            *v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            *v |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return 0;
+}
+
+static char *put_utf8(char *o, unsigned cp)
+{
+    if (cp < 0x80) {
+        *o++ = cp;
+    } else if (cp < 0x800) {
+        *o++ = 0xc0 | (cp >> 6);
+        *o++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *o++ = 0xe0 | (cp >> 12);
+        *o++ = 0x80 | ((cp >> 6) & 0x3f);
+        *o++ = 0x80 | (cp & 0x3f);
+    } else {
+        *o++ = 0xf0 | (cp >> 18);
+        *o++ = 0x80 | ((cp >> 12) & 0x3f);
+        *o++ = 0x80 | ((cp >> 6) & 0x3f);
+        *o++ = 0x80 | (cp & 0x3f);
+    }
+    return o;
+}
+
+/* *p points to '"'; returns malloc'ed string or NULL */
+static char *parse_string(const char **p)
+{
+    const char *s = *p + 1;
+    char *out = malloc(strlen(s) + 1); // escapes never expand
+    char *o = out;
+    unsigned cp, lo;
+
+    if (NULL == out)
+        return NULL;
+    while (*s && *s != '"') {
+        if ((unsigned char)*s < 0x20)
+            goto error;
+        if (*s != '\\') {
+            *o++ = *s++;
+            continue;
+        }
+        s++;
+        switch (*s++) {
+        case '"':  *o++ = '"';  break;
+        case '\\': *o++ = '\\'; break;
+        case '/':  *o++ = '/';  break;
+        case 'b':  *o++ = '\b'; break;
+        case 'f':  *o++ = '\f'; break;
+        case 'n':  *o++ = '\n'; break;
+        case 'r':  *o++ = '\r'; break;
+        case 't':  *o++ = '\t'; break;
+        case 'u':
+            if (0 != hex4(s, &cp))
+                goto error;
+            s += 4;
+            if (cp >= 0xd800 && cp < 0xdc00) { // surrogate pair
+                if (s[0] != '\\' || s[1] != 'u' || 0 != hex4(s + 2, &lo) || lo < 0xdc00 || lo > 0xdfff)
+                    goto error;
+                s += 6;
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            if (0 == cp)
+                goto error;
+            o = put_utf8(o, cp);
+            break;
+        default:
+            goto error;
+        }
+    }
+    if (*s != '"')
+        goto error;
+    *o = '\0';
+    *p = s + 1;
+    return out;
+
+  error:
+    free(out);
+    return NULL;
+}
+
+/* number, true, false, null as text */
+static char *parse_literal(const char **p)
+{
+    const char *s = *p;
+    while (*s && strchr("+-.0123456789eEtruefalsn", *s))
+        s++;
+    if (s == *p)
+        return NULL;
+    char *out = malloc(s - *p + 1);
+    if (NULL == out)
+        return NULL;
+    memcpy(out, *p, s - *p);
+    out[s - *p] = '\0';
+    *p = s;
+    return out;
+}
+
+static int parse_scalar(const char **p, JsonMember *m)
+{
+    char *end;
+
+    if (**p == '"') {
+        m->type = JSON_STRING;
+        m->str = parse_string(p);
+        return m->str ? 0 : -1;
+    }
+    m->str = parse_literal(p);
+    if (NULL == m->str)
+        return -1;
+    if (0 == strcmp(m->str, "null")) {
+        m->type = JSON_NULL;
+    } else if (0 == strcmp(m->str, "true") || 0 == strcmp(m->str, "false")) {
+        m->type = JSON_BOOL;
+        m->num = ('t' == m->str[0]);
+    } else {
+        m->type = JSON_NUMBER;
+        m->num = strtod(m->str, &end);
+        if (*end != '\0')
+            return -1;
+    }
+    return 0;
+}
+
+static int parse_array(const char **p, JsonMember *m)
+{
+    m->type = JSON_ARRAY;
+    (*p)++;
+    skip_ws(p);
+    if (**p == ']') {
+        (*p)++;
+        return 0;
+    }
+    while (1) {
+        JsonMember item = {0};
+        char **new;
+
+        skip_ws(p);
+        if (0 != parse_scalar(p, &item)) {
+            free(item.str);
+            return -1;
+        }
+        new = realloc(m->items, (m->nb_items + 2) * sizeof(char *));
+        if (NULL == new) {
+            free(item.str);
+            return -1;
+        }
+        m->items = new;
+        m->items[m->nb_items++] = item.str;
+        m->items[m->nb_items] = NULL;
+
+        skip_ws(p);
+        if (**p == ',') {
+            (*p)++;
+            continue;
+        }
+        if (**p != ']')
+            return -1;
+        (*p)++;
+        return 0;
+    }
+}
+
+int json_parse_object(const char *text, JsonObject *obj)
+{
+    const char *p = text;
+
+    memset(obj, 0, sizeof(*obj));
+    skip_ws(&p);
+    if (*p++ != '{')
+        return -1;
+    skip_ws(&p);
+    if (*p == '}') {
+        p++;
+        goto end;
+    }
+    while (1) {
+        JsonMember *new = realloc(obj->members, (obj->nb_members + 1) * sizeof(JsonMember));
+        if (NULL == new)
+            goto error;
+        obj->members = new;
+        JsonMember *m = &obj->members[obj->nb_members++];
+        memset(m, 0, sizeof(*m));
+
+        skip_ws(&p);
+        if (*p != '"' || NULL == (m->key = parse_string(&p)))
+            goto error;
+        skip_ws(&p);
+        if (*p++ != ':')
+            goto error;
+        skip_ws(&p);
+        if (*p == '[' ? 0 != parse_array(&p, m) : 0 != parse_scalar(&p, m))
+            goto error;
+        skip_ws(&p);
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        if (*p++ != '}')
+            goto error;
+        break;
+    }
+
+  end:
+    skip_ws(&p);
+    if (*p == '\0')
+        return 0;
+
+  error:
+    json_object_free(obj);
+    return -1;
+}
+
+const JsonMember *json_get(const JsonObject *obj, const char *key)
+{
+    int i;
+    for (i = 0; i < obj->nb_members; i++) {
+        if (0 == strcmp(obj->members[i].key, key))
+            return &obj->members[i];
+    }
+    return NULL;
+}
+
+void json_object_free(JsonObject *obj)
+{
+    int i, j;
+    for (i = 0; i < obj->nb_members; i++) {
+        JsonMember *m = &obj->members[i];
+        free(m->key);
+        free(m->str);
+        for (j = 0; j < m->nb_items; j++)
+            free(m->items[j]);
+        free(m->items);
+    }
+    free(obj->members);
+    memset(obj, 0, sizeof(*obj));
+}
+
+void json_write_str(FILE *fp, const char *s)
+{
+    if (NULL == s) {
+        fputs("null", fp);
+        return;
+    }
+    fputc('"', fp);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        switch (c) {
+        case '"':  fputs("\\\"", fp); break;
+        case '\\': fputs("\\\\", fp); break;
+        case '\n': fputs("\\n", fp);  break;
+        case '\r': fputs("\\r", fp);  break;
+        case '\t': fputs("\\t", fp);  break;
+        default:
+            if (c < 0x20)
+                fprintf(fp, "\\u%04x", c);
+            else
+                fputc(c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+void json_write_num(FILE *fp, double num)
+{
+    char buf[64], *comma;
+
+    if (!isfinite(num)) {
+        fputs("null", fp);
+        return;
+    }
+    snprintf(buf, sizeof(buf), "%.10g", num);
+    if (NULL != (comma = strchr(buf, ','))) // LC_NUMERIC of setlocale(LC_ALL, "")
+        *comma = '.';
+    fputs(buf, fp);
+}
@@ -0,0 +1,68 @@
+/*  mtn - movie thumbnailer
+    Minimal JSON reading and writing
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_JSON_H
+#define MTN_JSON_H
+
+#include <stdio.h>
+
+typedef enum JsonType {
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY
+} JsonType;
+
+typedef struct JsonMember {
+    char *key;
+    JsonType type;
+    char *str;                      /* JSON_STRING; text of JSON_NUMBER */
+    double num;                     /* JSON_NUMBER; JSON_BOOL is 0 or 1 */
+    char **items;                   /* JSON_ARRAY of strings/numbers as text */
+    int nb_items;
+} JsonMember;
+
+/**
+ * JsonObject - one flat JSON object: members are scalars or arrays of
+ * scalars; nested objects are not supported
+ */
+typedef struct JsonObject {
+    JsonMember *members;
+    int nb_members;
+} JsonObject;
+
+/**
+ * Parse text containing one object
+ * Returns 0 on success, -1 on error (obj is empty)
+ */
+int json_parse_object(const char *text, JsonObject *obj);
+
+/**
+ * Returns member key or NULL
+ */
+const JsonMember *json_get(const JsonObject *obj, const char *key);
+
+void json_object_free(JsonObject *obj);
+
+/**
+ * Write s as quoted JSON string; NULL is written as null
+ */
+void json_write_str(FILE *fp, const char *s);
+
+/**
+ * Write num with '.' as decimal point whatever the locale; NaN and
+ * infinity are written as null
+ */
+void json_write_num(FILE *fp, double num);
+
+#endif /* MTN_JSON_H */
@@ -0,0 +1,120 @@
+/*  mtn - movie thumbnailer
+    Level-gated logging and the JSON log sink (--log-format=json)
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_log.h"
+#include "mtn_json.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define LOG_LINE_SIZE 1024
+
+/* line being joined from av_log() calls; shared by threads like FFmpeg's own callback */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *log_fp;
+static const char *log_file;
+static char line[LOG_LINE_SIZE];
+static int line_len;
+static int line_level;
+static const char *line_src;
+
+static const char *level_name(int level)
+{
+    if (level <= AV_LOG_PANIC)   return "panic";
+    if (level <= AV_LOG_FATAL)   return "fatal";
+    if (level <= AV_LOG_ERROR)   return "error";
+    if (level <= AV_LOG_WARNING) return "warning";
+    if (level <= AV_LOG_INFO)    return "info";
+    if (level <= AV_LOG_VERBOSE) return "verbose";
+    if (level <= AV_LOG_DEBUG)   return "debug";
+    return "trace";
+}
+
+/* name of the FFmpeg component logging through avcl */
+static const char *source_name(void *avcl)
+{
+    const AVClass *cls = avcl ? *(const AVClass **)avcl : NULL;
+    if (NULL == cls)
+        return "mtn";
+    if (NULL != cls->item_name)
+        return cls->item_name(avcl);
+    return cls->class_name;
+}
+
+/* write the joined line unless it is blank; log_mutex is held */
+static void line_flush(void)
+{
+    struct timeval now;
+    char *msg = line;
+
+    while (line_len > 0 && strchr(" \t\r", line[line_len - 1]))
+        line_len--;
+    line[line_len] = '\0';
+    line_len = 0;
+    while (' ' == *msg || '\t' == *msg)
+        msg++;
+    if ('\0' == *msg)
+        return;
+
+    gettimeofday(&now, NULL);
+    fputs("{\"time\":", log_fp);
+    json_write_num(log_fp, now.tv_sec + now.tv_usec / 1000000.0);
+    fprintf(log_fp, ",\"level\":\"%s\",\"src\":", level_name(line_level));
+    json_write_str(log_fp, line_src);
+    fputs(",\"file\":", log_fp);
+    json_write_str(log_fp, log_file);
+    fputs(",\"msg\":", log_fp);
+    json_write_str(log_fp, msg);
+    fputs("}\n", log_fp);
+    fflush(log_fp);
+}
+
+static void json_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    char buf[LOG_LINE_SIZE];
+    const char *c;
+
+    if (level > av_log_get_level())
+        return;
+    vsnprintf(buf, sizeof(buf), fmt, vl);
+
+    pthread_mutex_lock(&log_mutex);
+    for (c = buf; '\0' != *c; c++) {
+        if (0 == line_len) {
+            line_level = level;
+            line_src = source_name(avcl);
+        }
+        if ('\n' == *c)
+            line_flush();
+        else if (line_len < LOG_LINE_SIZE - 1)
+            line[line_len++] = *c;
+    }
+    pthread_mutex_unlock(&log_mutex);
+}
+
+void mtn_log_json(FILE *fp)
+{
+    pthread_mutex_lock(&log_mutex);
+    log_fp = fp;
+    pthread_mutex_unlock(&log_mutex);
+    av_log_set_callback(json_callback);
+}
+
+void mtn_log_set_file(const char *file)
+{
+    pthread_mutex_lock(&log_mutex);
+    if (line_len > 0) // the rest of a message about the previous movie
+        line_flush();
+    log_file = file;
+    pthread_mutex_unlock(&log_mutex);
+}
@@ -0,0 +1,51 @@
+/*  mtn - movie thumbnailer
+    Level-gated logging and the JSON log sink (--log-format=json)
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_LOG_H
+#define MTN_LOG_H
+
+#include <stdio.h>
+#include "libavutil/log.h"
+
+/**
+ * 1 if messages of level are printed; check it before building a message
+ * costs something, e.g. dumps and formatted times
+ */
+#define MTN_LOG_ENABLED(level) ((level) <= av_log_get_level())
+
+/**
+ * av_log() whose arguments are not evaluated unless level is printed; for
+ * messages in loops over shots, packets and frames
+ */
+#define MTN_LOG(level, ...) do {                \
+    if (MTN_LOG_ENABLED(level))                 \
+        av_log(NULL, (level), __VA_ARGS__);     \
+} while (0)
+
+/**
+ * Write the log to fp as one JSON object per line instead of text:
+ *
+ *   {"time":1718000000.123,"level":"error","src":"mtn","file":"a.mkv","msg":"seeking to 12.00 s failed"}
+ *
+ * src is "mtn" or the FFmpeg component (e.g. "h264"); file is the movie
+ * being processed or null. Messages split over several av_log() calls are
+ * joined; empty lines are dropped. The level of av_log_set_level() applies
+ */
+void mtn_log_json(FILE *fp);
+
+/**
+ * Movie the following messages are about; NULL = none. file must stay
+ * valid until it is replaced
+ */
+void mtn_log_set_file(const char *file);
+
+#endif /* MTN_LOG_H */
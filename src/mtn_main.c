@@ -0,0 +1,241 @@
+/*  mtn - movie thumbnailer
+    Command line client of the mtn core
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>, et al.	 		http://moviethumbnail.sourceforge.net/
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>					https://gitlab.com/movie_thumbnailer/mtn/wikis
+    Copyright (C) 2026 AhmadNaruto										https://github.com/AhmadNaruto/mtn
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+// enable unicode functions in mingw
+#ifdef WIN32
+    #define UNICODE
+    #define _UNICODE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "libavutil/log.h"
+#include "libavformat/avformat.h"
+
+#include "mtn.h"
+#include "mtn_batch.h"
+#include "mtn_journal.h"
+#include "mtn_serve.h"
+#include "mtn_watch.h"
+
+#ifdef WIN32
+    unsigned int _CRT_fmode = _O_BINARY;  // default binary file including stdin, stdout, stderr
+#endif
+
+// copied & modified from mingw-runtime-3.13's init.c
+typedef struct STARTUPINFO{
+  int newmode;
+} _startupinfo;
+extern void __wgetmainargs (int *, wchar_t ***, wchar_t ***, int, _startupinfo *);
+
+char *gb_argv[10240]; // FIXME: global & hopefully noone will use more than this
+/*
+get command line arguments and expand wildcards in utf-8 in windows
+caller needs to free argv[i]
+return 0 if ok
+*/
+int get_windows_argv(int __attribute__((unused)) *pargc, char __attribute__((unused)) ***pargv)
+{
+#if defined(WIN32) && defined(_UNICODE)
+    // copied & modified from mingw-runtime-3.13's init.c
+    int _argc = 0;
+    wchar_t **_argv = 0;
+    wchar_t **dummy_environ = 0;
+    _startupinfo start_info;
+    start_info.newmode = 0;
+    __wgetmainargs(&_argc, &_argv, &dummy_environ, -1, &start_info);
+
+    //printf("\nafter __wgetmainargs; _argc: %d\n", _argc); // DEBUG
+    int i;
+    for (i = 0; i < _argc; i++) {
+        //wprintf(L"_argv[%d] wc: %s\n", i, _argv[i]); // DEBUG
+        char utf8_buf[UTF8_FILENAME_SIZE] = "";
+        WC_2_UTF8(utf8_buf, _argv[i], UTF8_FILENAME_SIZE);
+        //printf("_argv[%d] utf8: %s\n", i, utf8_buf); // DEBUG
+
+        char *dup = strdup(utf8_buf);
+        if (NULL == dup) {
+            goto error;
+        }
+        gb_argv[i] = dup;
+    }
+    *pargc = _argc;
+    *pargv = gb_argv;
+    return 0;
+
+  error:
+    while (--_argc >= 0) {
+        free(gb_argv[_argc]);
+    }
+    return -1;
+#endif
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int return_code = -1;
+    MtnContext context, *mc = &context;
+
+    mtn_context_init(mc);
+
+    mc->argv0 = path_2_file(argv[0]);
+    setvbuf(stderr, NULL, _IONBF, 0); // turn off buffering in mingw
+
+    mc->st_start = time(NULL); // program start time
+    srand(mc->st_start);
+
+    // get utf-8 argv in windows
+    if (0 != get_windows_argv(&argc, &argv)) {
+        av_log(NULL, AV_LOG_ERROR, "%s: cannot get command line arguments\n", mc->argv0);
+        return -1;
+    }
+
+    av_log(NULL, AV_LOG_VERBOSE, "locale: %s\n", setlocale(LC_ALL, ""));
+
+    /* get & check options */
+    int parse_error = parse_options(mc, argc, argv);
+
+    if (optind == argc && NULL == mc->_files_from && NULL == mc->_serve && NULL == mc->_watch) {
+        //av_log(NULL, AV_LOG_ERROR, "%s: no input files or directories specified", mc->argv0);
+        parse_error += 1;
+    }
+
+    parse_error += check_options(mc);
+
+    if (0 != parse_error) {
+        usage(mc);
+        goto exit;
+    }
+
+    /* lower priority */
+    if (1 != mc->n_normal) { // lower priority
+#ifdef WIN32
+        SetPriorityClass(GetCurrentProcess(), IDLE_PRIORITY_CLASS);
+#else
+		errno = 0;
+        int nice_ret = nice(10); // mingw doesn't have nice??
+        //setpriority (PRIO_PROCESS, 0, PRIO_MAX/2);
+		if(nice_ret == -1 && errno != 0)
+			av_log(NULL, AV_LOG_ERROR, "error setting process priority (nice=10)\n");
+#endif
+    }
+
+    /* init */
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 9, 100)
+    av_register_all();          // Register all formats and codecs
+#endif
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 0, 0)
+    avformat_network_init();    // optional since FFmpeg 4.0
+#endif
+
+    if (0 != setup_options(mc))
+        goto exit;
+    setup_log(mc);
+
+    // display mtn+libraries versions for bug reporting
+    av_log(NULL, AV_LOG_VERBOSE, "%s\n\n", mtn_identification(mc));
+
+    if ((NULL != mc->_journal || NULL != mc->_resume) && 0 != open_journal(mc))
+        goto exit;
+
+    if (NULL != mc->_serve) {
+#ifdef WIN32
+        av_log(NULL, AV_LOG_ERROR, "%s: --serve is not supported on Windows\n", mc->argv0);
+#else
+        int workers = mc->_serve_workers > 0 ? mc->_serve_workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        font_cache_warm_up(mc);
+        if (0 == serve_run(mc->_serve, workers, serve_job, mc))
+            return_code = EXIT_SUCCESS;
+#endif
+        goto exit;
+    }
+
+    if (NULL != mc->_watch) {
+#ifdef __linux__
+        WatchOptions wo = {
+            .dir = mc->_watch,
+            .max_depth = mc->d_depth,
+            .delay = mc->_watch_delay,
+            .workers = mc->_watch_workers > 0 ? mc->_watch_workers : (int)sysconf(_SC_NPROCESSORS_ONLN),
+            .accept = check_extension,
+            .run = watch_job,
+            .opaque = mc,
+        };
+        font_cache_warm_up(mc);
+        if (0 == watch_run(&wo))
+            return_code = EXIT_SUCCESS;
+#else
+        av_log(NULL, AV_LOG_ERROR, "%s: --watch is only supported on Linux\n", mc->argv0);
+#endif
+        goto exit;
+    }
+
+    if (0 != processing_open(mc))
+        goto exit;
+
+    if (mc->_jobs > 1 || BATCH_ORDER_NAME != mc->_order) {
+        mc->batch = batch_new();
+        if (NULL == mc->batch)
+            goto exit;
+        if (mc->_jobs > 1 && BATCH_ORDER_NAME == mc->_order && 0 != process_batch_stream(mc))
+            goto exit;
+    }
+
+    /* process movie files */
+    return_code = process_loop(mc, argc - optind, argv + optind, NULL, 0);
+    if (NULL != mc->_files_from) {
+        int ret = process_files_from(mc, mc->_files_from);
+        if (ret > return_code)
+            return_code = ret;
+    }
+    if (NULL != mc->batch) {
+        int ret = process_batch(mc);
+        if (ret > return_code)
+            return_code = ret;
+    }
+    if (mc->_shard_n > 0)
+        shard_summary(mc);
+
+  exit:
+    // clean up
+#if defined(WIN32) && defined(_UNICODE)
+    while (--argc >= 0) {
+        free(argv[argc]);
+    }
+#endif
+
+    processing_close(mc);
+    journal_close(mc->journal);
+    mc->journal = NULL;
+
+    //av_log(NULL, AV_LOG_VERBOSE, "\n%s: total run time: %.2f s.\n", mc->argv0, difftime(time(NULL), mc->st_start));
+
+    if (1 == mc->p_pause && 0 == mc->P_dontpause) {
+        av_log(NULL, AV_LOG_ERROR, "\npausing... press Enter key to exit (see -P option)\n");
+        fflush(stdout);
+        fflush(stderr);
+        getchar();
+    }
+    mtn_context_cleanup(mc);
+    return return_code;
+}
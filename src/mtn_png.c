@@ -0,0 +1,427 @@
+/*  mtn - movie thumbnailer
+    PNG encoder with configurable deflate level, filter and parallel deflate
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_png.h"
+#include "libavutil/log.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/* uncompressed bytes per deflate block; must not depend on the number of threads */
+#define PNGENC_BLOCK_SIZE (256*1024)
+/* deflate window; end of the previous block is used as dictionary */
+#define PNGENC_DICT_SIZE 32768
+/* max. size of IDAT chunk */
+#define PNGENC_CHUNK_MAX (1 << 30)
+
+static const char *filter_names[] = { "none", "sub", "up", "avg", "paeth", "adaptive" };
+
+typedef struct PngEncBlock {
+    int y0, y1;                     /* rows [y0, y1) */
+    uint8_t *data;                  /* raw deflate data */
+    size_t size;
+    uLong adler;                    /* adler32 of uncompressed rows */
+    size_t raw_size;
+    int error;
+} PngEncBlock;
+
+typedef struct PngEncJob {
+    gdImagePtr ip;
+    int level;
+    int strategy;
+    int filter;
+    int channels;                   /* 3 = RGB, 4 = RGBA */
+    size_t row_bytes;               /* filter type byte + pixels */
+    PngEncBlock *blocks;
+    int nb_blocks;
+    int next;                       /* next block to compress */
+    pthread_mutex_t lock;
+} PngEncJob;
+
+typedef struct OutBuf {
+    uint8_t *data;
+    size_t size;
+    size_t alloc;
+    int error;
+} OutBuf;
+
+int pngenc_filter_from_name(const char *name)
+{
+    size_t i;
+    for (i = 0; i < sizeof(filter_names) / sizeof(*filter_names); i++)
+        if (strcasecmp(name, filter_names[i]) == 0)
+            return (int)i;
+    return -1;
+}
+
+static void get_row(const PngEncJob *job, int y, uint8_t *dst)
+{
+    const int *src = job->ip->tpixels[y];
+    int x;
+
+    for (x = 0; x < job->ip->sx; x++) {
+        *dst++ = gdTrueColorGetRed(src[x]);
+        *dst++ = gdTrueColorGetGreen(src[x]);
+        *dst++ = gdTrueColorGetBlue(src[x]);
+        if (4 == job->channels) {
+            // gd: 0 = opaque .. 127 = transparent
+            int a = gdTrueColorGetAlpha(src[x]);
+            *dst++ = 255 - ((a << 1) + (a >> 6));
+        }
+    }
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+/*
+filter row cur (prev = row above) with filter type into dst (type byte + len bytes)
+return sum of absolute values of filtered bytes (as signed)
+*/
+static unsigned long filter_row(int type, const uint8_t *cur, const uint8_t *prev, int bpp, size_t len, uint8_t *dst)
+{
+    unsigned long sum = 0;
+    size_t i;
+
+    *dst++ = type;
+    for (i = 0; i < len; i++) {
+        int left = i >= (size_t)bpp ? cur[i - bpp] : 0;
+        int upleft = i >= (size_t)bpp ? prev[i - bpp] : 0;
+        uint8_t v;
+
+        switch (type) {
+        case PNGENC_FILTER_SUB:   v = cur[i] - left; break;
+        case PNGENC_FILTER_UP:    v = cur[i] - prev[i]; break;
+        case PNGENC_FILTER_AVG:   v = cur[i] - ((left + prev[i]) >> 1); break;
+        case PNGENC_FILTER_PAETH: v = cur[i] - paeth(left, prev[i], upleft); break;
+        default:                  v = cur[i];
+        }
+        dst[i] = v;
+        sum += v < 128 ? v : 256 - v;
+    }
+    return sum;
+}
+
+/*
+same heuristic as libpng: try all filters, use the one with the smallest sum
+*/
+static void filter_row_adaptive(const uint8_t *cur, const uint8_t *prev, int bpp, size_t len, uint8_t *dst, uint8_t *tmp)
+{
+    unsigned long best = filter_row(PNGENC_FILTER_NONE, cur, prev, bpp, len, dst);
+    int type;
+
+    for (type = PNGENC_FILTER_SUB; type <= PNGENC_FILTER_PAETH; type++) {
+        unsigned long sum = filter_row(type, cur, prev, bpp, len, tmp);
+        if (sum < best) {
+            best = sum;
+            memcpy(dst, tmp, len + 1);
+        }
+    }
+}
+
+/*
+filter and deflate one block of rows
+the block is terminated by a sync flush (last block: end of stream), so blocks
+can be simply concatenated
+*/
+static int compress_block(PngEncJob *job, int b)
+{
+    PngEncBlock *blk = &job->blocks[b];
+    const size_t row_bytes = job->row_bytes, len = row_bytes - 1;
+    const int bpp = job->channels;
+    uint8_t *raw = NULL, *cur = NULL, *prev = NULL, *tmp = NULL;
+    z_stream zs;
+    int ret = -1, zret, y;
+
+    memset(&zs, 0, sizeof(zs));
+
+    // rows of the previous block needed for the dictionary are filtered again
+    int d0 = blk->y0;
+    if (b > 0) {
+        int dict_rows = (PNGENC_DICT_SIZE + row_bytes - 1) / row_bytes;
+        d0 = blk->y0 - dict_rows;
+        if (d0 < job->blocks[b-1].y0)
+            d0 = job->blocks[b-1].y0;
+    }
+
+    raw = malloc((blk->y1 - d0) * row_bytes);
+    cur = malloc(len);
+    prev = calloc(1, len);
+    tmp = malloc(row_bytes);
+    if (NULL == raw || NULL == cur || NULL == prev || NULL == tmp)
+        goto cleanup;
+
+    if (d0 > 0)
+        get_row(job, d0 - 1, prev);
+
+    for (y = d0; y < blk->y1; y++) {
+        uint8_t *dst = raw + (y - d0) * row_bytes;
+
+        get_row(job, y, cur);
+        if (PNGENC_FILTER_ADAPTIVE == job->filter)
+            filter_row_adaptive(cur, prev, bpp, len, dst, tmp);
+        else
+            filter_row(job->filter, cur, prev, bpp, len, dst);
+
+        uint8_t *swap = prev;
+        prev = cur;
+        cur = swap;
+    }
+
+    size_t dict_size = (blk->y0 - d0) * row_bytes;
+    const uint8_t *data = raw + dict_size;
+    blk->raw_size = (blk->y1 - blk->y0) * row_bytes;
+    blk->adler = adler32(adler32(0L, Z_NULL, 0), data, blk->raw_size);
+
+    if (Z_OK != deflateInit2(&zs, job->level, Z_DEFLATED, -MAX_WBITS, 8, job->strategy))
+        goto cleanup;
+
+    if (dict_size > 0) {
+        size_t n = dict_size < PNGENC_DICT_SIZE ? dict_size : PNGENC_DICT_SIZE;
+        if (Z_OK != deflateSetDictionary(&zs, data - n, n))
+            goto cleanup;
+    }
+
+    size_t alloc = deflateBound(&zs, blk->raw_size) + 64;
+    blk->data = malloc(alloc);
+    if (NULL == blk->data)
+        goto cleanup;
+
+    const int flush = (b == job->nb_blocks - 1) ? Z_FINISH : Z_SYNC_FLUSH;
+    zs.next_in = (Bytef*)data;
+    zs.avail_in = blk->raw_size;
+    zs.next_out = blk->data;
+    zs.avail_out = alloc;
+    for (;;) {
+        if (0 == zs.avail_out) {
+            uint8_t *p = realloc(blk->data, alloc * 2);
+            if (NULL == p)
+                goto cleanup;
+            blk->data = p;
+            zs.next_out = blk->data + zs.total_out;
+            zs.avail_out = alloc;
+            alloc *= 2;
+        }
+        zret = deflate(&zs, flush);
+        if (Z_STREAM_END == zret || (Z_OK == zret && Z_SYNC_FLUSH == flush && zs.avail_out > 0))
+            break;
+        if ((Z_OK != zret && Z_BUF_ERROR != zret) || (Z_BUF_ERROR == zret && zs.avail_out > 0))
+            goto cleanup;
+    }
+    blk->size = zs.total_out;
+    ret = 0;
+
+  cleanup:
+    deflateEnd(&zs);
+    free(raw);
+    free(cur);
+    free(prev);
+    free(tmp);
+    if (0 != ret)
+        blk->error = 1;
+    return ret;
+}
+
+static void *compress_worker(void *arg)
+{
+    PngEncJob *job = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        int b = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (b >= job->nb_blocks)
+            break;
+        compress_block(job, b);
+    }
+    return NULL;
+}
+
+static void out_write(OutBuf *o, const void *data, size_t size)
+{
+    if (o->error || 0 == size)
+        return;
+
+    if (o->size + size > o->alloc) {
+        size_t alloc = o->alloc ? o->alloc : 4096;
+        while (alloc < o->size + size)
+            alloc *= 2;
+        uint8_t *p = realloc(o->data, alloc);
+        if (NULL == p) {
+            o->error = 1;
+            return;
+        }
+        o->data = p;
+        o->alloc = alloc;
+    }
+    memcpy(o->data + o->size, data, size);
+    o->size += size;
+}
+
+static void out_u32(OutBuf *o, uint32_t v)
+{
+    uint8_t b[4] = { v >> 24, v >> 16, v >> 8, v };
+    out_write(o, b, 4);
+}
+
+/*
+write chunk whose data is the concatenation of up to 3 pieces
+*/
+static void out_chunk(OutBuf *o, const char *type,
+                      const void *d1, size_t s1, const void *d2, size_t s2, const void *d3, size_t s3)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    // crc32() with NULL buffer would return the initial value
+    crc = crc32(crc, (const Bytef*)type, 4);
+    if (s1 > 0)
+        crc = crc32(crc, d1, s1);
+    if (s2 > 0)
+        crc = crc32(crc, d2, s2);
+    if (s3 > 0)
+        crc = crc32(crc, d3, s3);
+
+    out_u32(o, s1 + s2 + s3);
+    out_write(o, type, 4);
+    out_write(o, d1, s1);
+    out_write(o, d2, s2);
+    out_write(o, d3, s3);
+    out_u32(o, crc);
+}
+
+void *pngenc_encode(gdImagePtr ip, const PngEncOptions *opt, size_t *size)
+{
+    static const uint8_t signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+    PngEncJob job;
+    OutBuf out;
+    pthread_t *tids = NULL;
+    int nb_threads = 0, i;
+
+    memset(&out, 0, sizeof(out));
+    memset(&job, 0, sizeof(job));
+    *size = 0;
+
+    if (NULL == ip || !gdImageTrueColor(ip) || ip->sx <= 0 || ip->sy <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  png encoder: only truecolor images are supported\n");
+        return NULL;
+    }
+
+    job.ip = ip;
+    job.level = (opt->level >= 0 && opt->level <= 9) ? opt->level : Z_DEFAULT_COMPRESSION;
+    job.filter = (opt->filter >= PNGENC_FILTER_NONE && opt->filter <= PNGENC_FILTER_ADAPTIVE) ? opt->filter : PNGENC_FILTER_ADAPTIVE;
+    job.strategy = (PNGENC_FILTER_NONE == job.filter) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+    job.channels = ip->saveAlphaFlag ? 4 : 3;
+    job.row_bytes = 1 + (size_t)ip->sx * job.channels;
+
+    // fixed blocks of whole rows
+    int block_rows = PNGENC_BLOCK_SIZE / job.row_bytes;
+    if (block_rows < 1)
+        block_rows = 1;
+    job.nb_blocks = (ip->sy + block_rows - 1) / block_rows;
+    job.blocks = calloc(job.nb_blocks, sizeof(PngEncBlock));
+    if (NULL == job.blocks)
+        goto error;
+    for (i = 0; i < job.nb_blocks; i++) {
+        job.blocks[i].y0 = i * block_rows;
+        job.blocks[i].y1 = (i + 1) * block_rows < ip->sy ? (i + 1) * block_rows : ip->sy;
+    }
+
+    // caller's thread compresses too
+    pthread_mutex_init(&job.lock, NULL);
+    if (opt->threads > 1 && job.nb_blocks > 1) {
+        int n = (opt->threads < job.nb_blocks ? opt->threads : job.nb_blocks) - 1;
+        tids = malloc(n * sizeof(pthread_t));
+        for (i = 0; tids && i < n; i++) {
+            if (0 != pthread_create(&tids[nb_threads], NULL, compress_worker, &job))
+                break;
+            nb_threads++;
+        }
+    }
+    compress_worker(&job);
+    for (i = 0; i < nb_threads; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+    pthread_mutex_destroy(&job.lock);
+
+    uLong adler = job.blocks[0].adler;
+    for (i = 0; i < job.nb_blocks; i++) {
+        if (job.blocks[i].error)
+            goto error;
+        if (i > 0)
+            adler = adler32_combine(adler, job.blocks[i].adler, job.blocks[i].raw_size);
+    }
+
+    out_write(&out, signature, sizeof(signature));
+
+    uint8_t ihdr[13];
+    ihdr[0] = ip->sx >> 24; ihdr[1] = ip->sx >> 16; ihdr[2] = ip->sx >> 8; ihdr[3] = ip->sx;
+    ihdr[4] = ip->sy >> 24; ihdr[5] = ip->sy >> 16; ihdr[6] = ip->sy >> 8; ihdr[7] = ip->sy;
+    ihdr[8] = 8;                            // bit depth
+    ihdr[9] = 4 == job.channels ? 6 : 2;    // RGBA or RGB
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;     // deflate, adaptive filtering, no interlace
+    out_chunk(&out, "IHDR", ihdr, sizeof(ihdr), NULL, 0, NULL, 0);
+
+    if (3 == job.channels && ip->transparent >= 0) {
+        uint8_t trns[6] = { 0, gdTrueColorGetRed(ip->transparent), 0, gdTrueColorGetGreen(ip->transparent),
+                            0, gdTrueColorGetBlue(ip->transparent) };
+        out_chunk(&out, "tRNS", trns, sizeof(trns), NULL, 0, NULL, 0);
+    }
+
+    // zlib header, blocks, adler32 of all rows
+    int flevel = job.level == Z_DEFAULT_COMPRESSION ? 2 : job.level < 2 ? 0 : job.level < 6 ? 1 : job.level == 6 ? 2 : 3;
+    uint8_t zhdr[2] = { 0x78, flevel << 6 };
+    zhdr[1] += 31 - ((zhdr[0] << 8) + zhdr[1]) % 31;
+    uint8_t ztrailer[4] = { adler >> 24, adler >> 16, adler >> 8, adler };
+
+    for (i = 0; i < job.nb_blocks; i++) {
+        const uint8_t *d = job.blocks[i].data;
+        size_t left = job.blocks[i].size;
+        int first = (0 == i), last = (i == job.nb_blocks - 1);
+
+        do {
+            size_t n = left < PNGENC_CHUNK_MAX ? left : PNGENC_CHUNK_MAX;
+            left -= n;
+            out_chunk(&out, "IDAT", zhdr, first ? sizeof(zhdr) : 0, d, n, ztrailer, (last && 0 == left) ? sizeof(ztrailer) : 0);
+            d += n;
+            first = 0;
+        } while (left > 0);
+    }
+
+    out_chunk(&out, "IEND", NULL, 0, NULL, 0, NULL, 0);
+    if (out.error)
+        goto error;
+
+    for (i = 0; i < job.nb_blocks; i++)
+        free(job.blocks[i].data);
+    free(job.blocks);
+    *size = out.size;
+    return out.data;
+
+  error:
+    av_log(NULL, AV_LOG_ERROR, "  png encoder: encoding failed\n");
+    for (i = 0; job.blocks && i < job.nb_blocks; i++)
+        free(job.blocks[i].data);
+    free(job.blocks);
+    free(out.data);
+    return NULL;
+}
@@ -0,0 +1,53 @@
+/*  mtn - movie thumbnailer
+    PNG encoder with configurable deflate level, filter and parallel deflate
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_PNG_H
+#define MTN_PNG_H
+
+#include <stddef.h>
+#include "gd.h"
+
+/* row filter; values 0-4 are png filter types used for every row */
+typedef enum PngEncFilter {
+    PNGENC_FILTER_DEFAULT = -1,     /* adaptive */
+    PNGENC_FILTER_NONE = 0,
+    PNGENC_FILTER_SUB,
+    PNGENC_FILTER_UP,
+    PNGENC_FILTER_AVG,
+    PNGENC_FILTER_PAETH,
+    PNGENC_FILTER_ADAPTIVE          /* per row the filter with smallest sum of abs. differences */
+} PngEncFilter;
+
+typedef struct PngEncOptions {
+    int level;                      /* zlib level 0-9; -1 = zlib default */
+    int filter;                     /* PngEncFilter */
+    int threads;                    /* deflate threads; <= 1 = no threads */
+} PngEncOptions;
+
+/**
+ * Encode a truecolor image to png in memory
+ *
+ * The image is deflated in fixed blocks of rows which are concatenated into
+ * one zlib stream, so the output is the same for any number of threads.
+ * Transparent color (gdImageColorTransparent) is saved as tRNS chunk,
+ * alpha channel only if gdImageSaveAlpha is on.
+ *
+ * Returns malloc'ed data or NULL on error
+ */
+void *pngenc_encode(gdImagePtr ip, const PngEncOptions *opt, size_t *size);
+
+/**
+ * Returns PngEncFilter of the name (none, sub, up, avg, paeth, adaptive) or -1
+ */
+int pngenc_filter_from_name(const char *name);
+
+#endif /* MTN_PNG_H */
@@ -0,0 +1,677 @@
+/*  mtn - movie thumbnailer
+    Probe cache: stream info and keyframe index of movies
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_probe.h"
+#include "mtn_json.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+/* wait for other writers up to this time (ms) */
+#define PROBE_BUSY_TIMEOUT 60000
+/* pos, timestamp, size, min_distance, flags */
+#define KEYFRAME_SIZE 28
+
+/* integer columns of probe_stream */
+enum {
+    SC_CODEC_TYPE, SC_CODEC_ID, SC_CODEC_TAG, SC_FORMAT, SC_BIT_RATE,
+    SC_BITS_CODED, SC_BITS_RAW, SC_PROFILE, SC_LEVEL,
+    SC_WIDTH, SC_HEIGHT, SC_SAR_NUM, SC_SAR_DEN, SC_FIELD_ORDER,
+    SC_COLOR_RANGE, SC_COLOR_PRIMARIES, SC_COLOR_TRC, SC_COLOR_SPACE, SC_CHROMA_LOCATION, SC_VIDEO_DELAY,
+    SC_SAMPLE_RATE, SC_CHANNELS, SC_FRAME_SIZE, SC_BLOCK_ALIGN,
+    SC_TB_NUM, SC_TB_DEN, SC_START_TIME, SC_DURATION, SC_NB_FRAMES,
+    SC_R_RATE_NUM, SC_R_RATE_DEN, SC_AVG_RATE_NUM, SC_AVG_RATE_DEN, SC_ST_SAR_NUM, SC_ST_SAR_DEN,
+    SC_NB
+};
+
+static const char *stream_cols[SC_NB] = {
+    "codec_type", "codec_id", "codec_tag", "format", "bit_rate",
+    "bits_per_coded_sample", "bits_per_raw_sample", "profile", "level",
+    "width", "height", "sar_num", "sar_den", "field_order",
+    "color_range", "color_primaries", "color_trc", "color_space", "chroma_location", "video_delay",
+    "sample_rate", "channels", "frame_size", "block_align",
+    "tb_num", "tb_den", "start_time", "duration", "nb_frames",
+    "r_rate_num", "r_rate_den", "avg_rate_num", "avg_rate_den", "st_sar_num", "st_sar_den"
+};
+
+struct ProbeCache {
+    sqlite3 *db;
+    sqlite3_stmt *probe_select;
+    sqlite3_stmt *probe_insert;
+    sqlite3_stmt *stream_select;
+    sqlite3_stmt *stream_delete;
+    sqlite3_stmt *stream_insert;
+    sqlite3_stmt *peek_select;
+};
+
+/* one row of probe_stream */
+typedef struct ProbeStream {
+    int64_t v[SC_NB];
+    double rotation;
+    uint8_t *extradata;
+    int extradata_size;
+    uint8_t *keyframes;
+    int nb_keyframes;
+} ProbeStream;
+
+static void put_le(uint8_t *p, uint64_t v, int bytes)
+{
+    int i;
+    for (i = 0; i < bytes; i++)
+        p[i] = v >> (8 * i);
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+    uint64_t v = 0;
+    int i;
+    for (i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static int index_count(AVStream *st)
+{
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 78, 100)
+    return st->nb_index_entries;
+#else
+    return avformat_index_get_entries_count(st);
+#endif
+}
+
+static const AVIndexEntry *index_entry(AVStream *st, int i)
+{
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 78, 100)
+    return &st->index_entries[i];
+#else
+    return avformat_index_get_entry(st, i);
+#endif
+}
+
+static void stream_save(AVStream *st, int64_t *v)
+{
+    AVCodecParameters *par = st->codecpar;
+
+    v[SC_CODEC_TYPE] = par->codec_type;
+    v[SC_CODEC_ID] = par->codec_id;
+    v[SC_CODEC_TAG] = par->codec_tag;
+    v[SC_FORMAT] = par->format;
+    v[SC_BIT_RATE] = par->bit_rate;
+    v[SC_BITS_CODED] = par->bits_per_coded_sample;
+    v[SC_BITS_RAW] = par->bits_per_raw_sample;
+    v[SC_PROFILE] = par->profile;
+    v[SC_LEVEL] = par->level;
+    v[SC_WIDTH] = par->width;
+    v[SC_HEIGHT] = par->height;
+    v[SC_SAR_NUM] = par->sample_aspect_ratio.num;
+    v[SC_SAR_DEN] = par->sample_aspect_ratio.den;
+    v[SC_FIELD_ORDER] = par->field_order;
+    v[SC_COLOR_RANGE] = par->color_range;
+    v[SC_COLOR_PRIMARIES] = par->color_primaries;
+    v[SC_COLOR_TRC] = par->color_trc;
+    v[SC_COLOR_SPACE] = par->color_space;
+    v[SC_CHROMA_LOCATION] = par->chroma_location;
+    v[SC_VIDEO_DELAY] = par->video_delay;
+    v[SC_SAMPLE_RATE] = par->sample_rate;
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 24, 100)
+    v[SC_CHANNELS] = par->channels;
+#else
+    v[SC_CHANNELS] = par->ch_layout.nb_channels;
+#endif
+    v[SC_FRAME_SIZE] = par->frame_size;
+    v[SC_BLOCK_ALIGN] = par->block_align;
+    v[SC_TB_NUM] = st->time_base.num;
+    v[SC_TB_DEN] = st->time_base.den;
+    v[SC_START_TIME] = st->start_time;
+    v[SC_DURATION] = st->duration;
+    v[SC_NB_FRAMES] = st->nb_frames;
+    v[SC_R_RATE_NUM] = st->r_frame_rate.num;
+    v[SC_R_RATE_DEN] = st->r_frame_rate.den;
+    v[SC_AVG_RATE_NUM] = st->avg_frame_rate.num;
+    v[SC_AVG_RATE_DEN] = st->avg_frame_rate.den;
+    v[SC_ST_SAR_NUM] = st->sample_aspect_ratio.num;
+    v[SC_ST_SAR_DEN] = st->sample_aspect_ratio.den;
+}
+
+static int stream_restore(AVStream *st, const ProbeStream *ps)
+{
+    AVCodecParameters *par = st->codecpar;
+    const int64_t *v = ps->v;
+    int i;
+
+    par->codec_type = v[SC_CODEC_TYPE];
+    par->codec_id = v[SC_CODEC_ID];
+    par->codec_tag = v[SC_CODEC_TAG];
+    par->format = v[SC_FORMAT];
+    par->bit_rate = v[SC_BIT_RATE];
+    par->bits_per_coded_sample = v[SC_BITS_CODED];
+    par->bits_per_raw_sample = v[SC_BITS_RAW];
+    par->profile = v[SC_PROFILE];
+    par->level = v[SC_LEVEL];
+    par->width = v[SC_WIDTH];
+    par->height = v[SC_HEIGHT];
+    par->sample_aspect_ratio = (AVRational){ v[SC_SAR_NUM], v[SC_SAR_DEN] };
+    par->field_order = v[SC_FIELD_ORDER];
+    par->color_range = v[SC_COLOR_RANGE];
+    par->color_primaries = v[SC_COLOR_PRIMARIES];
+    par->color_trc = v[SC_COLOR_TRC];
+    par->color_space = v[SC_COLOR_SPACE];
+    par->chroma_location = v[SC_CHROMA_LOCATION];
+    par->video_delay = v[SC_VIDEO_DELAY];
+    par->sample_rate = v[SC_SAMPLE_RATE];
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 24, 100)
+    par->channels = v[SC_CHANNELS];
+#else
+    if (0 == par->ch_layout.nb_channels && v[SC_CHANNELS] > 0)
+        av_channel_layout_default(&par->ch_layout, v[SC_CHANNELS]);
+#endif
+    par->frame_size = v[SC_FRAME_SIZE];
+    par->block_align = v[SC_BLOCK_ALIGN];
+    st->start_time = v[SC_START_TIME];
+    st->duration = v[SC_DURATION];
+    st->nb_frames = v[SC_NB_FRAMES];
+    st->r_frame_rate = (AVRational){ v[SC_R_RATE_NUM], v[SC_R_RATE_DEN] };
+    st->avg_frame_rate = (AVRational){ v[SC_AVG_RATE_NUM], v[SC_AVG_RATE_DEN] };
+    st->sample_aspect_ratio = (AVRational){ v[SC_ST_SAR_NUM], v[SC_ST_SAR_DEN] };
+
+    // extradata found while probing, e.g. parsed from the first packets
+    if (0 == par->extradata_size && ps->extradata_size > 0) {
+        par->extradata = av_mallocz(ps->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (NULL == par->extradata)
+            return -1;
+        memcpy(par->extradata, ps->extradata, ps->extradata_size);
+        par->extradata_size = ps->extradata_size;
+    }
+
+    // keyframes found while reading; demuxers with own index already have it
+    if (0 == index_count(st)) {
+        for (i = 0; i < ps->nb_keyframes; i++) {
+            const uint8_t *p = ps->keyframes + i * KEYFRAME_SIZE;
+            av_add_index_entry(st, (int64_t)get_le(p, 8), (int64_t)get_le(p + 8, 8),
+                (int32_t)get_le(p + 16, 4), (int32_t)get_le(p + 20, 4), (int32_t)get_le(p + 24, 4));
+        }
+    }
+    return 0;
+}
+
+static int probe_prepare(ProbeCache *pc, const char *sql, sqlite3_stmt **stmt)
+{
+    if (SQLITE_OK != sqlite3_prepare_v2(pc->db, sql, -1, stmt, NULL)) {
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: %s\n", sqlite3_errmsg(pc->db));
+        return -1;
+    }
+    return 0;
+}
+
+ProbeCache *probe_cache_open(const char *path)
+{
+    char cols[2048] = "", params[256] = "", sql[4096];
+    char *err = NULL;
+    int i;
+
+    ProbeCache *pc = calloc(1, sizeof(ProbeCache));
+    if (NULL == pc)
+        return NULL;
+
+    if (SQLITE_OK != sqlite3_open(path, &pc->db)) {
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: opening '%s' failed: %s\n", path, pc->db ? sqlite3_errmsg(pc->db) : "out of memory");
+        probe_cache_close(pc);
+        return NULL;
+    }
+    sqlite3_busy_timeout(pc->db, PROBE_BUSY_TIMEOUT);
+
+    for (i = 0; i < SC_NB; i++) {
+        snprintf(cols + strlen(cols), sizeof(cols) - strlen(cols), "%s, ", stream_cols[i]);
+        snprintf(params + strlen(params), sizeof(params) - strlen(params), "?, ");
+    }
+
+    snprintf(sql, sizeof(sql),
+        "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;"
+        "CREATE TABLE IF NOT EXISTS probe ("
+        "  dev INTEGER NOT NULL, ino INTEGER NOT NULL, options TEXT NOT NULL,"
+        "  size INTEGER NOT NULL, mtime INTEGER NOT NULL, nb_streams INTEGER NOT NULL,"
+        "  duration INTEGER, start_time INTEGER, bit_rate INTEGER,"
+        "  info_key INTEGER, info_text TEXT, created INTEGER NOT NULL,"
+        "  PRIMARY KEY(dev, ino, options)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS probe_stream ("
+        "  dev INTEGER NOT NULL, ino INTEGER NOT NULL, options TEXT NOT NULL, idx INTEGER NOT NULL,"
+        "  %s rotation REAL, extradata BLOB, keyframes BLOB,"
+        "  PRIMARY KEY(dev, ino, options, idx)"
+        ");", cols);
+    if (SQLITE_OK != sqlite3_exec(pc->db, sql, NULL, NULL, &err)) {
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: initializing '%s' failed: %s\n", path, err ? err : "");
+        sqlite3_free(err);
+        probe_cache_close(pc);
+        return NULL;
+    }
+
+    if (0 != probe_prepare(pc, "SELECT size, mtime, nb_streams, duration, start_time, bit_rate, info_key, info_text"
+                               " FROM probe WHERE dev=? AND ino=? AND options=?", &pc->probe_select)
+        || 0 != probe_prepare(pc, "INSERT OR REPLACE INTO probe(dev, ino, options, size, mtime, nb_streams,"
+                                  " duration, start_time, bit_rate, info_key, info_text, created)"
+                                  " VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", &pc->probe_insert)
+        || 0 != probe_prepare(pc, "DELETE FROM probe_stream WHERE dev=? AND ino=? AND options=?", &pc->stream_delete)) {
+        probe_cache_close(pc);
+        return NULL;
+    }
+
+    snprintf(sql, sizeof(sql), "SELECT idx, %s rotation, extradata, keyframes FROM probe_stream"
+        " WHERE dev=? AND ino=? AND options=? ORDER BY idx", cols);
+    if (0 != probe_prepare(pc, sql, &pc->stream_select)) {
+        probe_cache_close(pc);
+        return NULL;
+    }
+
+    snprintf(sql, sizeof(sql), "INSERT INTO probe_stream(dev, ino, options, idx, %s rotation, extradata, keyframes)"
+        " VALUES(?, ?, ?, ?, %s ?, ?, ?)", cols, params);
+    if (0 != probe_prepare(pc, sql, &pc->stream_insert)) {
+        probe_cache_close(pc);
+        return NULL;
+    }
+
+    snprintf(sql, sizeof(sql), "SELECT p.size, p.mtime, p.duration, MAX(s.width * s.height) FROM probe p"
+        " LEFT JOIN probe_stream s ON s.dev=p.dev AND s.ino=p.ino AND s.options=p.options AND s.codec_type=%d"
+        " WHERE p.dev=? AND p.ino=? AND p.options=? GROUP BY p.dev", AVMEDIA_TYPE_VIDEO);
+    if (0 != probe_prepare(pc, sql, &pc->peek_select)) {
+        probe_cache_close(pc);
+        return NULL;
+    }
+
+    return pc;
+}
+
+void probe_cache_close(ProbeCache *pc)
+{
+    if (NULL == pc)
+        return;
+
+    sqlite3_finalize(pc->probe_select);
+    sqlite3_finalize(pc->probe_insert);
+    sqlite3_finalize(pc->stream_select);
+    sqlite3_finalize(pc->stream_delete);
+    sqlite3_finalize(pc->stream_insert);
+    sqlite3_finalize(pc->peek_select);
+    sqlite3_close(pc->db);
+    free(pc);
+}
+
+static void bind_key(sqlite3_stmt *stmt, const CacheKey *key)
+{
+    sqlite3_bind_int64(stmt, 1, key->dev);
+    sqlite3_bind_int64(stmt, 2, key->ino);
+    sqlite3_bind_text(stmt, 3, key->options, -1, SQLITE_STATIC);
+}
+
+static void free_streams(ProbeStream *ps, int nb)
+{
+    int i;
+    for (i = 0; ps && i < nb; i++) {
+        free(ps[i].extradata);
+        free(ps[i].keyframes);
+    }
+    free(ps);
+}
+
+/*
+read stream rows; return number of rows or -1
+*/
+static int read_streams(ProbeCache *pc, const CacheKey *key, ProbeStream *ps, int nb)
+{
+    int n = 0, rc, i;
+
+    bind_key(pc->stream_select, key);
+    while (SQLITE_ROW == (rc = sqlite3_step(pc->stream_select))) {
+        sqlite3_stmt *s = pc->stream_select;
+        if (n >= nb || sqlite3_column_int(s, 0) != n) {
+            n = -1;
+            break;
+        }
+        for (i = 0; i < SC_NB; i++)
+            ps[n].v[i] = sqlite3_column_int64(s, 1 + i);
+        ps[n].rotation = sqlite3_column_double(s, SC_NB + 1);
+
+        int size = sqlite3_column_bytes(s, SC_NB + 2);
+        if (size > 0) {
+            ps[n].extradata = malloc(size);
+            if (NULL == ps[n].extradata) {
+                n = -1;
+                break;
+            }
+            memcpy(ps[n].extradata, sqlite3_column_blob(s, SC_NB + 2), size);
+            ps[n].extradata_size = size;
+        }
+
+        size = sqlite3_column_bytes(s, SC_NB + 3);
+        if (size >= KEYFRAME_SIZE) {
+            ps[n].keyframes = malloc(size);
+            if (NULL == ps[n].keyframes) {
+                n = -1;
+                break;
+            }
+            memcpy(ps[n].keyframes, sqlite3_column_blob(s, SC_NB + 3), size);
+            ps[n].nb_keyframes = size / KEYFRAME_SIZE;
+        }
+        n++;
+    }
+    if (n >= 0 && SQLITE_DONE != rc && SQLITE_ROW != rc) {
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: %s\n", sqlite3_errmsg(pc->db));
+        n = -1;
+    }
+    sqlite3_reset(pc->stream_select);
+    return n;
+}
+
+int probe_cache_restore(ProbeCache *pc, const CacheKey *key, AVFormatContext *ic, ProbeInfo *info)
+{
+    sqlite3_stmt *s = pc->probe_select;
+    ProbeStream *ps = NULL;
+    int64_t duration = 0, start_time = 0, bit_rate = 0;
+    int ret = 0, nb = 0, i;
+
+    memset(info, 0, sizeof(*info));
+
+    bind_key(s, key);
+    switch (sqlite3_step(s)) {
+    case SQLITE_ROW:
+        nb = sqlite3_column_int(s, 2);
+        if (sqlite3_column_int64(s, 0) != key->size || sqlite3_column_int64(s, 1) != key->mtime
+            || nb != (int)ic->nb_streams) {
+            nb = 0;
+            break;
+        }
+        duration = sqlite3_column_int64(s, 3);
+        start_time = sqlite3_column_int64(s, 4);
+        bit_rate = sqlite3_column_int64(s, 5);
+        info->info_key = (uint64_t)sqlite3_column_int64(s, 6);
+        if (SQLITE_NULL != sqlite3_column_type(s, 7))
+            info->info_text = strdup((const char*)sqlite3_column_text(s, 7));
+        ret = 1;
+        break;
+    case SQLITE_DONE:
+        break;
+    default:
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: %s\n", sqlite3_errmsg(pc->db));
+        ret = -1;
+    }
+    sqlite3_reset(s);
+    if (1 != ret || 0 == nb)
+        goto end;
+
+    // everything is read and checked before ic is changed
+    ret = -1;
+    ps = calloc(nb, sizeof(ProbeStream));
+    info->rotation = calloc(nb, sizeof(double));
+    if (NULL == ps || NULL == info->rotation || read_streams(pc, key, ps, nb) != nb)
+        goto end;
+
+    ret = 0;
+    for (i = 0; i < nb; i++) {
+        AVStream *st = ic->streams[i];
+        if (st->time_base.num != ps[i].v[SC_TB_NUM] || st->time_base.den != ps[i].v[SC_TB_DEN]
+            || (AVMEDIA_TYPE_UNKNOWN != st->codecpar->codec_type && st->codecpar->codec_type != ps[i].v[SC_CODEC_TYPE])) {
+            av_log(NULL, AV_LOG_VERBOSE, "  probe cache: stream %d doesn't match\n", i);
+            goto end;
+        }
+    }
+
+    for (i = 0; i < nb; i++) {
+        if (0 != stream_restore(ic->streams[i], &ps[i])) {
+            ret = -1;
+            goto end;
+        }
+        info->rotation[i] = ps[i].rotation;
+    }
+    ic->duration = duration;
+    ic->start_time = start_time;
+    ic->bit_rate = bit_rate;
+    info->nb_streams = nb;
+    ret = 1;
+
+  end:
+    free_streams(ps, nb);
+    if (1 != ret)
+        probe_info_free(info);
+    return ret;
+}
+
+int probe_cache_peek(ProbeCache *pc, const CacheKey *key, int64_t *duration, int64_t *pixels)
+{
+    sqlite3_stmt *s = pc->peek_select;
+    int ret = 0;
+
+    bind_key(s, key);
+    switch (sqlite3_step(s)) {
+    case SQLITE_ROW:
+        if (sqlite3_column_int64(s, 0) != key->size || sqlite3_column_int64(s, 1) != key->mtime)
+            break;
+        *duration = sqlite3_column_int64(s, 2);
+        *pixels = sqlite3_column_int64(s, 3); // 0 if NULL: no video stream
+        ret = 1;
+        break;
+    case SQLITE_DONE:
+        break;
+    default:
+        av_log(NULL, AV_LOG_ERROR, "  probe cache: %s\n", sqlite3_errmsg(pc->db));
+        ret = -1;
+    }
+    sqlite3_reset(s);
+    return ret;
+}
+
+int probe_cache_store(ProbeCache *pc, const CacheKey *key, AVFormatContext *ic, const ProbeInfo *info)
+{
+    sqlite3_stmt *s;
+    uint8_t *keyframes = NULL;
+    unsigned int i;
+    int j;
+
+    if (SQLITE_OK != sqlite3_exec(pc->db, "BEGIN IMMEDIATE", NULL, NULL, NULL))
+        goto error;
+
+    s = pc->probe_insert;
+    bind_key(s, key);
+    sqlite3_bind_int64(s, 4, key->size);
+    sqlite3_bind_int64(s, 5, key->mtime);
+    sqlite3_bind_int(s, 6, ic->nb_streams);
+    sqlite3_bind_int64(s, 7, ic->duration);
+    sqlite3_bind_int64(s, 8, ic->start_time);
+    sqlite3_bind_int64(s, 9, ic->bit_rate);
+    sqlite3_bind_int64(s, 10, (sqlite3_int64)info->info_key);
+    if (info->info_text)
+        sqlite3_bind_text(s, 11, info->info_text, -1, SQLITE_STATIC);
+    else
+        sqlite3_bind_null(s, 11);
+    sqlite3_bind_int64(s, 12, (sqlite3_int64)time(NULL));
+    j = sqlite3_step(s);
+    sqlite3_reset(s);
+    sqlite3_clear_bindings(s);
+    if (SQLITE_DONE != j)
+        goto error;
+
+    s = pc->stream_delete;
+    bind_key(s, key);
+    j = sqlite3_step(s);
+    sqlite3_reset(s);
+    if (SQLITE_DONE != j)
+        goto error;
+
+    s = pc->stream_insert;
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        int64_t v[SC_NB];
+        int nb_keyframes = 0;
+
+        stream_save(st, v);
+        bind_key(s, key);
+        sqlite3_bind_int(s, 4, i);
+        for (j = 0; j < SC_NB; j++)
+            sqlite3_bind_int64(s, 5 + j, v[j]);
+        sqlite3_bind_double(s, SC_NB + 5, (info->rotation && (int)i < info->nb_streams) ? info->rotation[i] : 0);
+        if (st->codecpar->extradata_size > 0)
+            sqlite3_bind_blob(s, SC_NB + 6, st->codecpar->extradata, st->codecpar->extradata_size, SQLITE_STATIC);
+        else
+            sqlite3_bind_null(s, SC_NB + 6);
+
+        // keyframes of video streams only; audio index is large and not used for seeking
+        if (AVMEDIA_TYPE_VIDEO == st->codecpar->codec_type && index_count(st) > 0) {
+            int n = index_count(st);
+            free(keyframes);
+            keyframes = malloc((size_t)n * KEYFRAME_SIZE);
+            if (NULL == keyframes)
+                goto error;
+            for (j = 0; j < n; j++) {
+                const AVIndexEntry *e = index_entry(st, j);
+                if (NULL == e || !(e->flags & AVINDEX_KEYFRAME))
+                    continue;
+                uint8_t *p = keyframes + nb_keyframes++ * KEYFRAME_SIZE;
+                put_le(p, e->pos, 8);
+                put_le(p + 8, e->timestamp, 8);
+                put_le(p + 16, e->size, 4);
+                put_le(p + 20, e->min_distance, 4);
+                put_le(p + 24, e->flags, 4);
+            }
+        }
+        if (nb_keyframes > 0)
+            sqlite3_bind_blob(s, SC_NB + 7, keyframes, nb_keyframes * KEYFRAME_SIZE, SQLITE_STATIC);
+        else
+            sqlite3_bind_null(s, SC_NB + 7);
+
+        j = sqlite3_step(s);
+        sqlite3_reset(s);
+        sqlite3_clear_bindings(s);
+        if (SQLITE_DONE != j)
+            goto error;
+    }
+
+    if (SQLITE_OK != sqlite3_exec(pc->db, "COMMIT", NULL, NULL, NULL))
+        goto error;
+    free(keyframes);
+    return 0;
+
+  error:
+    av_log(NULL, AV_LOG_ERROR, "  probe cache: storing failed: %s\n", sqlite3_errmsg(pc->db));
+    sqlite3_exec(pc->db, "ROLLBACK", NULL, NULL, NULL);
+    free(keyframes);
+    return -1;
+}
+
+void probe_info_free(ProbeInfo *info)
+{
+    free(info->rotation);
+    free(info->info_text);
+    memset(info, 0, sizeof(*info));
+}
+
+static void write_num(FILE *fp, const char *key, double num)
+{
+    fprintf(fp, ",\"%s\":", key);
+    json_write_num(fp, num);
+}
+
+static void write_str(FILE *fp, const char *key, const char *s)
+{
+    fprintf(fp, ",\"%s\":", key);
+    json_write_str(fp, s);
+}
+
+/* AV_NOPTS_VALUE is null */
+static void write_time(FILE *fp, const char *key, int64_t t, AVRational time_base)
+{
+    if (AV_NOPTS_VALUE == t)
+        fprintf(fp, ",\"%s\":null", key);
+    else
+        write_num(fp, key, t * av_q2d(time_base));
+}
+
+static void write_ratio(FILE *fp, const char *key, AVRational r)
+{
+    if (r.num > 0 && r.den > 0)
+        fprintf(fp, ",\"%s\":\"%d:%d\"", key, r.num, r.den);
+}
+
+static void write_video(FILE *fp, AVFormatContext *ic, AVStream *st, double rotation)
+{
+    const AVCodecParameters *par = st->codecpar;
+    AVRational sar = av_guess_sample_aspect_ratio(ic, st, NULL);
+    AVRational frame_rate = av_guess_frame_rate(ic, st, NULL);
+    AVRational dar;
+
+    fprintf(fp, ",\"width\":%d,\"height\":%d", par->width, par->height);
+    write_ratio(fp, "sar", sar);
+    if (sar.num > 0 && sar.den > 0 && par->height > 0) {
+        av_reduce(&dar.num, &dar.den, (int64_t)par->width * sar.num, (int64_t)par->height * sar.den, 1024 * 1024);
+        write_ratio(fp, "dar", dar);
+    }
+    if (frame_rate.num > 0 && frame_rate.den > 0)
+        write_num(fp, "frame_rate", av_q2d(frame_rate));
+    write_num(fp, "rotation", rotation);
+    write_str(fp, "pix_fmt", av_get_pix_fmt_name(par->format));
+    write_str(fp, "color_range", av_color_range_name(par->color_range));
+    write_str(fp, "color_primaries", av_color_primaries_name(par->color_primaries));
+    write_str(fp, "color_trc", av_color_transfer_name(par->color_trc));
+    write_str(fp, "color_space", av_color_space_name(par->color_space));
+    fprintf(fp, ",\"hdr\":%s", AVCOL_TRC_SMPTE2084 == par->color_trc || AVCOL_TRC_ARIB_STD_B67 == par->color_trc ? "true" : "false");
+}
+
+void probe_write_json(FILE *fp, const char *file, AVFormatContext *ic, const double *rotation)
+{
+    AVDictionaryEntry *lang;
+    int64_t size = ic->pb ? avio_size(ic->pb) : -1;
+    unsigned int i;
+
+    fputs("{\"file\":", fp);
+    json_write_str(fp, file);
+    write_str(fp, "format", ic->iformat->name);
+    write_str(fp, "format_long", ic->iformat->long_name);
+    write_time(fp, "duration", ic->duration, AV_TIME_BASE_Q);
+    write_time(fp, "start_time", ic->start_time, AV_TIME_BASE_Q);
+    fprintf(fp, ",\"bit_rate\":%"PRId64, ic->bit_rate);
+    if (size >= 0)
+        fprintf(fp, ",\"size\":%"PRId64, size);
+    else
+        fputs(",\"size\":null", fp);
+
+    fputs(",\"streams\":[", fp);
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        const AVCodecParameters *par = st->codecpar;
+
+        fprintf(fp, "%s{\"index\":%u", i > 0 ? "," : "", i);
+        write_str(fp, "type", av_get_media_type_string(par->codec_type));
+        write_str(fp, "codec", avcodec_get_name(par->codec_id));
+        write_str(fp, "profile", avcodec_profile_name(par->codec_id, par->profile));
+        fprintf(fp, ",\"bit_rate\":%"PRId64, par->bit_rate);
+        write_time(fp, "duration", st->duration, st->time_base);
+        lang = av_dict_get(st->metadata, "language", NULL, 0);
+        write_str(fp, "language", lang ? lang->value : NULL);
+
+        if (AVMEDIA_TYPE_VIDEO == par->codec_type) {
+            write_video(fp, ic, st, rotation ? rotation[i] : 0);
+        } else if (AVMEDIA_TYPE_AUDIO == par->codec_type) {
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(59, 24, 100)
+            fprintf(fp, ",\"sample_rate\":%d,\"channels\":%d", par->sample_rate, par->channels);
+#else
+            fprintf(fp, ",\"sample_rate\":%d,\"channels\":%d", par->sample_rate, par->ch_layout.nb_channels);
+#endif
+        }
+        fputc('}', fp);
+    }
+    fputs("]}\n", fp);
+    fflush(fp);
+}
@@ -0,0 +1,85 @@
+/*  mtn - movie thumbnailer
+    Probe cache: stream info and keyframe index of movies
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_PROBE_H
+#define MTN_PROBE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "libavformat/avformat.h"
+#include "mtn_cache.h"
+
+/**
+ * ProbeCache - facts found by avformat_find_stream_info() (SQLite database)
+ *
+ * Stored per movie (CacheKey; options = hash of demuxer options): duration,
+ * start time and bitrate of the file; codec parameters, time base, frame
+ * rates, durations, rotation and keyframe index of each stream; and the
+ * formatted info text. An entry is used only while size and modification
+ * time of the movie are unchanged.
+ */
+typedef struct ProbeCache ProbeCache;
+
+typedef struct ProbeInfo {
+    int nb_streams;
+    double *rotation;               /* degrees of each stream */
+    char *info_text;                /* text of get_stream_info() or NULL */
+    uint64_t info_key;              /* hash of everything info_text depends on */
+} ProbeInfo;
+
+/**
+ * Open or create probe cache
+ * Returns NULL on error
+ */
+ProbeCache *probe_cache_open(const char *path);
+
+/**
+ * Close probe cache; NULL is ignored
+ */
+void probe_cache_close(ProbeCache *pc);
+
+/**
+ * Restore cached stream info into ic opened by avformat_open_input(),
+ * instead of calling avformat_find_stream_info()
+ * Keyframes are added only to streams without index.
+ * Returns 1 if restored (info is filled), 0 if not cached, changed or the
+ * streams don't match, -1 on error
+ */
+int probe_cache_restore(ProbeCache *pc, const CacheKey *key, AVFormatContext *ic, ProbeInfo *info);
+
+/**
+ * Duration (AV_TIME_BASE units) and largest video resolution (width *
+ * height; 0 if none) of a cached movie without opening it
+ * Returns 1 if found, 0 if not cached or changed, -1 on error
+ */
+int probe_cache_peek(ProbeCache *pc, const CacheKey *key, int64_t *duration, int64_t *pixels);
+
+/**
+ * Store stream info and current keyframe index of ic
+ * Returns 0 on success, -1 on error
+ */
+int probe_cache_store(ProbeCache *pc, const CacheKey *key, AVFormatContext *ic, const ProbeInfo *info);
+
+/**
+ * Free data of info
+ */
+void probe_info_free(ProbeInfo *info);
+
+/**
+ * Write what avformat_find_stream_info() found in ic as one JSON line for
+ * --probe: container, duration, bitrate and size, and per stream codec,
+ * profile, bitrate, language, and resolution, SAR, DAR, frame rate,
+ * rotation (degrees of each stream) and colour properties of video streams
+ */
+void probe_write_json(FILE *fp, const char *file, AVFormatContext *ic, const double *rotation);
+
+#endif /* MTN_PROBE_H */
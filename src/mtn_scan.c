@@ -0,0 +1,277 @@
+/*  mtn - movie thumbnailer
+    Directory scanner reading subdirectories ahead in threads
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_scan.h"
+#include "libavutil/log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+enum {
+    SCAN_QUEUED,
+    SCAN_RUNNING,
+    SCAN_DONE
+};
+
+struct Scanner {
+    ScanReadDir read_dir;
+    void *opaque;
+    int max_depth;
+    pthread_mutex_t lock;
+    pthread_cond_t work;            /* queue not empty or stop */
+    pthread_cond_t done;            /* a directory was read */
+    ScanDir *head, *tail;
+    int stop;
+    int nb_threads;
+    pthread_t *tids;
+};
+
+static ScanDir *scan_dir_new(const char *path, int depth)
+{
+    ScanDir *sd = calloc(1, sizeof(ScanDir));
+    if (NULL == sd)
+        return NULL;
+    sd->path = strdup(path);
+    if (NULL == sd->path) {
+        free(sd);
+        return NULL;
+    }
+    sd->depth = depth;
+    sd->ret = -1;
+    return sd;
+}
+
+int scan_dir_add(ScanDir *sd, const char *path, int is_dir)
+{
+    if (sd->cnt == sd->size) {
+        size_t size = sd->size ? sd->size * 2 : 50;
+        ScanEntry *new = realloc(sd->entries, size * sizeof(ScanEntry));
+        if (NULL == new) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: realloc failed: %s\n", sd->path, strerror(errno));
+            return -1;
+        }
+        sd->entries = new;
+        sd->size = size;
+    }
+
+    ScanEntry *e = &sd->entries[sd->cnt];
+    e->path = strdup(path);
+    if (NULL == e->path) {
+        av_log(NULL, AV_LOG_ERROR, "\n%s: malloc failed: %s\n", sd->path, strerror(errno));
+        return -1;
+    }
+    e->is_dir = is_dir;
+    e->sub = NULL;
+    sd->cnt++;
+    return 0;
+}
+
+static int entry_sort(const void *a, const void *b)
+{
+    return strcoll(((const ScanEntry *)a)->path, ((const ScanEntry *)b)->path);
+}
+
+/* with lock */
+static void queue_unlink(Scanner *s, ScanDir *sd)
+{
+    if (sd->prev)
+        sd->prev->next = sd->next;
+    else
+        s->head = sd->next;
+    if (sd->next)
+        sd->next->prev = sd->prev;
+    else
+        s->tail = sd->prev;
+    sd->prev = sd->next = NULL;
+}
+
+/* with lock; first subdirectory is read first, as it's processed first */
+static void queue_subdirs(Scanner *s, ScanDir *sd)
+{
+    size_t i;
+    for (i = sd->cnt; i > 0; i--) {
+        ScanDir *sub = sd->entries[i - 1].sub;
+        if (NULL == sub)
+            continue;
+        sub->prev = NULL;
+        sub->next = s->head;
+        if (s->head)
+            s->head->prev = sub;
+        else
+            s->tail = sub;
+        s->head = sub;
+    }
+    if (s->head)
+        pthread_cond_broadcast(&s->work);
+}
+
+/* without lock; sd is RUNNING and owned by the caller */
+static void scan_run(Scanner *s, ScanDir *sd)
+{
+    size_t i;
+
+    sd->ret = s->read_dir(s->opaque, sd);
+    if (0 != sd->ret)
+        return;
+
+    qsort(sd->entries, sd->cnt, sizeof(ScanEntry), entry_sort);
+
+    if (s->max_depth >= 0 && sd->depth + 1 > s->max_depth)
+        return;
+    for (i = 0; i < sd->cnt; i++) {
+        if (sd->entries[i].is_dir)
+            sd->entries[i].sub = scan_dir_new(sd->entries[i].path, sd->depth + 1); // NULL = read later
+    }
+}
+
+/* with lock */
+static void scan_finish(Scanner *s, ScanDir *sd)
+{
+    sd->state = SCAN_DONE;
+    queue_subdirs(s, sd);
+    pthread_cond_broadcast(&s->done);
+}
+
+static void *scan_worker(void *arg)
+{
+    Scanner *s = arg;
+
+    pthread_mutex_lock(&s->lock);
+    while (1) {
+        while (!s->stop && NULL == s->head)
+            pthread_cond_wait(&s->work, &s->lock);
+        if (s->stop)
+            break;
+
+        ScanDir *sd = s->head;
+        queue_unlink(s, sd);
+        sd->state = SCAN_RUNNING;
+        pthread_mutex_unlock(&s->lock);
+
+        scan_run(s, sd);
+
+        pthread_mutex_lock(&s->lock);
+        scan_finish(s, sd);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+Scanner *scanner_new(ScanReadDir read_dir, void *opaque, int max_depth, int threads)
+{
+    Scanner *s = calloc(1, sizeof(Scanner));
+    if (NULL == s)
+        return NULL;
+
+    s->read_dir = read_dir;
+    s->opaque = opaque;
+    s->max_depth = max_depth;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->done, NULL);
+
+    if (threads > 0) {
+        s->tids = malloc(threads * sizeof(pthread_t));
+        while (s->tids && s->nb_threads < threads) {
+            if (0 != pthread_create(&s->tids[s->nb_threads], NULL, scan_worker, s))
+                break;
+            s->nb_threads++;
+        }
+    }
+    return s;
+}
+
+void scanner_free(Scanner *s)
+{
+    int i;
+
+    if (NULL == s)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    for (i = 0; i < s->nb_threads; i++)
+        pthread_join(s->tids[i], NULL);
+    free(s->tids);
+
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->done);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+ScanDir *scanner_open(Scanner *s, const char *path, int depth)
+{
+    ScanDir *sd = scan_dir_new(path, depth);
+    if (NULL == sd)
+        return NULL;
+
+    pthread_mutex_lock(&s->lock);
+    sd->next = s->head;
+    if (s->head)
+        s->head->prev = sd;
+    else
+        s->tail = sd;
+    s->head = sd;
+    pthread_cond_signal(&s->work);
+    pthread_mutex_unlock(&s->lock);
+    return sd;
+}
+
+int scanner_wait(Scanner *s, ScanDir *sd)
+{
+    pthread_mutex_lock(&s->lock);
+    if (SCAN_QUEUED == sd->state) {
+        // not started yet; don't wait for the threads
+        queue_unlink(s, sd);
+        sd->state = SCAN_RUNNING;
+        pthread_mutex_unlock(&s->lock);
+
+        scan_run(s, sd);
+
+        pthread_mutex_lock(&s->lock);
+        scan_finish(s, sd);
+    }
+    while (SCAN_DONE != sd->state)
+        pthread_cond_wait(&s->done, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    return sd->ret;
+}
+
+void scanner_close(Scanner *s, ScanDir *sd)
+{
+    size_t i;
+
+    if (NULL == sd)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    if (SCAN_QUEUED == sd->state) {
+        queue_unlink(s, sd);
+        sd->state = SCAN_DONE;
+    }
+    while (SCAN_DONE != sd->state)
+        pthread_cond_wait(&s->done, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+
+    for (i = 0; i < sd->cnt; i++) {
+        scanner_close(s, sd->entries[i].sub);
+        free(sd->entries[i].path);
+    }
+    free(sd->entries);
+    free(sd->path);
+    free(sd);
+}
@@ -0,0 +1,93 @@
+/*  mtn - movie thumbnailer
+    Directory scanner reading subdirectories ahead in threads
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_SCAN_H
+#define MTN_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * Scanner - reads a directory tree in the order it is processed
+ *
+ * When a directory has been read, its subdirectories are queued and read by
+ * the scanner threads while the caller processes the entries, so the listing
+ * is usually ready when the caller gets there. Entries of each directory are
+ * sorted by strcoll(); the order doesn't depend on the threads. A directory
+ * the caller waits for and no thread has started is read by the caller.
+ */
+typedef struct Scanner Scanner;
+typedef struct ScanDir ScanDir;
+
+typedef struct ScanEntry {
+    char *path;
+    int is_dir;
+    ScanDir *sub;                   /* listing of directory or NULL if too deep;
+                                       set to NULL when taken by the caller */
+} ScanEntry;
+
+struct ScanDir {
+    char *path;
+    int depth;
+    ScanEntry *entries;             /* sorted; valid after scanner_wait() */
+    size_t cnt;
+
+    /* private */
+    size_t size;
+    int state;
+    int ret;
+    ScanDir *prev, *next;           /* queue */
+};
+
+/**
+ * Reads entries of sd->path with scan_dir_add(); called from any thread
+ * with the opaque of scanner_new()
+ * Returns 0 on success, -1 on error
+ */
+typedef int (*ScanReadDir)(void *opaque, ScanDir *sd);
+
+/**
+ * Start threads reading directories; with 0 threads directories are read
+ * when waited for. Subdirectories deeper than max_depth (< 0 = unlimited)
+ * are not read.
+ * Returns NULL on error
+ */
+Scanner *scanner_new(ScanReadDir read_dir, void *opaque, int max_depth, int threads);
+
+/**
+ * Stop the threads; all listings must be closed
+ */
+void scanner_free(Scanner *s);
+
+/**
+ * Queue directory path of given depth
+ * Returns NULL on error
+ */
+ScanDir *scanner_open(Scanner *s, const char *path, int depth);
+
+/**
+ * Wait until sd is read
+ * Returns 0 on success, -1 if reading failed
+ */
+int scanner_wait(Scanner *s, ScanDir *sd);
+
+/**
+ * Free sd and listings of its subdirectories which weren't taken
+ */
+void scanner_close(Scanner *s, ScanDir *sd);
+
+/**
+ * Add entry to sd; used by ScanReadDir
+ * Returns 0 on success, -1 on error
+ */
+int scan_dir_add(ScanDir *sd, const char *path, int is_dir);
+
+#endif /* MTN_SCAN_H */
@@ -0,0 +1,625 @@
+/*  mtn - movie thumbnailer
+    Resident mode: jobs from a Unix socket run by a pool of workers
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef WIN32
+
+#define _GNU_SOURCE                 // ppoll()
+#include "mtn_serve.h"
+#include "mtn_json.h"
+#include "libavutil/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+/* max. length of a request line */
+#define SERVE_MAX_LINE (1 << 20)
+#define SERVE_BACKLOG 64
+/* seconds a client may block the replies left when the daemon stops */
+#define SERVE_FLUSH_TIMEOUT 5
+
+typedef struct Client {
+    int fd;
+    unsigned serial;                /* fds are reused; jobs refer to this */
+    char *buf;
+    size_t len, size;
+    char *out;                      /* replies not sent yet, from out_pos */
+    size_t out_pos, out_len, out_size;
+} Client;
+
+typedef struct Job {
+    struct Job *next;
+    unsigned client;
+    char *id;                       /* JSON text */
+    char *input;
+    char **argv;
+    int argc;
+    int data;
+} Job;
+
+typedef struct Worker {
+    pid_t pid;
+    int fd;                         /* result from the worker */
+    unsigned client;
+    char *id;
+    char *buf;
+    size_t len, size;
+    int cancelled;                  /* killed by a cancel or the client leaving */
+} Worker;
+
+typedef struct Server {
+    int fd;
+    ServeRun run;
+    void *opaque;
+    int max_workers;
+    Client *clients;
+    int nb_clients;
+    unsigned next_serial;
+    Job *head, *tail;
+    int nb_queued;
+    Worker *workers;
+    int nb_workers;
+    unsigned long done;
+    sigset_t poll_mask;             /* signal mask while waiting in ppoll(); of the workers too */
+} Server;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig)
+{
+    (void)sig;
+    serve_stop = 1;
+}
+
+static int append(char **buf, size_t *len, size_t *size, const char *data, size_t n)
+{
+    if (*len + n + 1 > *size) {
+        size_t new_size = *size ? *size : 4096;
+        while (new_size < *len + n + 1)
+            new_size *= 2;
+        char *new = realloc(*buf, new_size);
+        if (NULL == new)
+            return -1;
+        *buf = new;
+        *size = new_size;
+    }
+    memcpy(*buf + *len, data, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return 0;
+}
+
+/* write the queued replies until the socket is full */
+static void flush_client(Client *c)
+{
+    while (c->out_pos < c->out_len) {
+        ssize_t w = write(c->fd, c->out + c->out_pos, c->out_len - c->out_pos);
+        if (w < 0) {
+            if (EINTR == errno)
+                continue;
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+                c->out_pos = c->out_len; // client is gone; noticed when reading
+            break;
+        }
+        c->out_pos += w;
+    }
+    if (c->out_pos == c->out_len)
+        c->out_pos = c->out_len = 0;
+}
+
+static Client *find_client(Server *s, unsigned serial)
+{
+    int i;
+    for (i = 0; i < s->nb_clients; i++) {
+        if (s->clients[i].serial == serial)
+            return &s->clients[i];
+    }
+    return NULL;
+}
+
+/* queued, so a client that doesn't read never blocks the daemon */
+static void reply(Server *s, unsigned serial, const char *text)
+{
+    Client *c = find_client(s, serial);
+    if (NULL == c)
+        return;
+    if (c->out_pos > 0) {
+        c->out_len -= c->out_pos;
+        memmove(c->out, c->out + c->out_pos, c->out_len);
+        c->out_pos = 0;
+    }
+    if (0 != append(&c->out, &c->out_len, &c->out_size, text, strlen(text)))
+        av_log(NULL, AV_LOG_ERROR, "serve: out of memory; reply dropped\n");
+    flush_client(c);
+}
+
+static void reply_error(Server *s, unsigned serial, const char *id, const char *error)
+{
+    char buf[512];
+    snprintf(buf, sizeof(buf), "{\"id\":%s,\"error\":\"%s\"}\n", id ? id : "null", error);
+    reply(s, serial, buf);
+}
+
+static void job_free(Job *j)
+{
+    int i;
+    if (NULL == j)
+        return;
+    free(j->id);
+    free(j->input);
+    for (i = 0; i < j->argc; i++)
+        free(j->argv[i]);
+    free(j->argv);
+    free(j);
+}
+
+/*
+stop the jobs of client with JSON id, or all its jobs if id is NULL; queued
+jobs are dropped, running ones killed. Returns the number of jobs
+*/
+static int cancel_jobs(Server *s, unsigned client, const char *id)
+{
+    Job **pj = &s->head, *prev = NULL;
+    int i, n = 0;
+
+    while (*pj) {
+        Job *j = *pj;
+        if (j->client != client || (id && 0 != strcmp(j->id, id))) {
+            prev = j;
+            pj = &j->next;
+            continue;
+        }
+        *pj = j->next;
+        if (s->tail == j)
+            s->tail = prev;
+        s->nb_queued--;
+        reply_error(s, client, j->id, "cancelled");
+        job_free(j);
+        n++;
+    }
+    for (i = 0; i < s->nb_workers; i++) {
+        Worker *w = &s->workers[i];
+        if (w->client != client || w->cancelled || (id && 0 != strcmp(w->id, id)))
+            continue;
+        kill(w->pid, SIGTERM); // replied to in finish_worker()
+        w->cancelled = 1;
+        n++;
+    }
+    return n;
+}
+
+/* JSON text of "id" to be returned as is */
+static char *id_of(const JsonObject *req)
+{
+    const JsonMember *m = json_get(req, "id");
+    char *id = NULL;
+    size_t size;
+
+    if (NULL == m || (JSON_STRING != m->type && JSON_NUMBER != m->type))
+        return strdup("null");
+    if (JSON_NUMBER == m->type)
+        return strdup(m->str);
+
+    FILE *fp = open_memstream(&id, &size);
+    if (NULL == fp)
+        return NULL;
+    json_write_str(fp, m->str);
+    fclose(fp);
+    return id;
+}
+
+static void handle_request(Server *s, Client *c, const char *line)
+{
+    JsonObject req;
+    const JsonMember *m;
+    Job *j = NULL;
+    char *id = NULL;
+    int i;
+
+    if (0 != json_parse_object(line, &req)) {
+        reply_error(s, c->serial, NULL, "invalid request");
+        return;
+    }
+    id = id_of(&req);
+
+    m = json_get(&req, "cmd");
+    if (NULL != m && JSON_STRING == m->type && 0 == strcmp(m->str, "cancel")) {
+        // the job answers with the error "cancelled"
+        if (NULL == id || NULL == json_get(&req, "id") || 0 == cancel_jobs(s, c->serial, id))
+            reply_error(s, c->serial, id, "no such job");
+        goto end;
+    }
+    if (NULL != m) {
+        char buf[512];
+        if (JSON_STRING != m->type || 0 != strcmp(m->str, "status")) {
+            reply_error(s, c->serial, id, "unknown cmd");
+            goto end;
+        }
+        snprintf(buf, sizeof(buf), "{\"id\":%s,\"workers\":%d,\"running\":%d,\"queued\":%d,\"done\":%lu,\"clients\":%d}\n",
+            id ? id : "null", s->max_workers, s->nb_workers, s->nb_queued, s->done, s->nb_clients);
+        reply(s, c->serial, buf);
+        goto end;
+    }
+
+    m = json_get(&req, "input");
+    if (NULL == m || JSON_STRING != m->type || '\0' == m->str[0]) {
+        reply_error(s, c->serial, id, "missing input");
+        goto end;
+    }
+
+    j = calloc(1, sizeof(Job));
+    if (NULL == j)
+        goto oom;
+    j->client = c->serial;
+    j->id = id;
+    id = NULL;
+    j->input = strdup(m->str);
+    m = json_get(&req, "args");
+    int nb_args = (m && JSON_ARRAY == m->type) ? m->nb_items : 0;
+    j->argv = calloc(nb_args + 2, sizeof(char *));
+    if (NULL == j->input || NULL == j->argv)
+        goto oom;
+    j->argv[j->argc++] = strdup("mtn");
+    for (i = 0; i < nb_args; i++)
+        j->argv[j->argc++] = strdup(m->items[i]);
+    for (i = 0; i < j->argc; i++) {
+        if (NULL == j->argv[i])
+            goto oom;
+    }
+    m = json_get(&req, "data");
+    j->data = (m && JSON_BOOL == m->type && m->num);
+
+    if (s->tail)
+        s->tail->next = j;
+    else
+        s->head = j;
+    s->tail = j;
+    s->nb_queued++;
+    goto end;
+
+  oom:
+    reply_error(s, c->serial, j ? j->id : id, "out of memory");
+    job_free(j);
+  end:
+    free(id);
+    json_object_free(&req);
+}
+
+/* worker process; never returns */
+static void run_worker(Server *s, Job *j, int fd)
+{
+    int i;
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &s->poll_mask, NULL);
+    close(s->fd);
+    for (i = 0; i < s->nb_clients; i++)
+        close(s->clients[i].fd);
+    for (i = 0; i < s->nb_workers; i++)
+        close(s->workers[i].fd);
+
+    FILE *out = fdopen(fd, "w");
+    if (NULL == out)
+        _exit(1);
+
+    ServeJob job = { j->input, j->argc, j->argv, j->data };
+    fprintf(out, "{\"id\":%s,\"input\":", j->id);
+    json_write_str(out, j->input);
+    fputc(',', out);
+    s->run(s->opaque, &job, out);
+    fputs("}\n", out);
+    fclose(out);
+    fflush(NULL); // _exit() doesn't flush stdio, e.g. --json-events or --probe output
+    _exit(0);
+}
+
+static void start_jobs(Server *s)
+{
+    while (s->head && s->nb_workers < s->max_workers) {
+        Job *j = s->head;
+        s->head = j->next;
+        if (NULL == s->head)
+            s->tail = NULL;
+        s->nb_queued--;
+
+        if (NULL == find_client(s, j->client)) { // nobody waits for the result
+            job_free(j);
+            continue;
+        }
+
+        int fds[2];
+        if (0 != pipe(fds)) {
+            reply_error(s, j->client, j->id, "cannot start worker");
+            job_free(j);
+            continue;
+        }
+        fflush(NULL);
+        pid_t pid = fork();
+        if (0 == pid)
+            run_worker(s, j, fds[1]);
+        close(fds[1]);
+        if (pid < 0) {
+            av_log(NULL, AV_LOG_ERROR, "serve: fork failed: %s\n", strerror(errno));
+            close(fds[0]);
+            reply_error(s, j->client, j->id, "cannot start worker");
+            job_free(j);
+            continue;
+        }
+
+        Worker *w = &s->workers[s->nb_workers++];
+        memset(w, 0, sizeof(*w));
+        w->pid = pid;
+        w->fd = fds[0];
+        w->client = j->client;
+        w->id = j->id;
+        j->id = NULL;
+        job_free(j);
+    }
+}
+
+static void finish_worker(Server *s, int i)
+{
+    Worker *w = &s->workers[i];
+    int status = 0;
+
+    close(w->fd);
+    while (waitpid(w->pid, &status, 0) < 0 && EINTR == errno)
+        ;
+    if (w->cancelled) {
+        reply_error(s, w->client, w->id, "cancelled");
+    } else if (w->len > 0 && '\n' == w->buf[w->len - 1]) {
+        reply(s, w->client, w->buf);
+    } else {
+        char error[64];
+        if (WIFSIGNALED(status))
+            snprintf(error, sizeof(error), "worker killed by signal %d", WTERMSIG(status));
+        else
+            snprintf(error, sizeof(error), "worker failed");
+        reply_error(s, w->client, w->id, error);
+    }
+    s->done++;
+
+    free(w->id);
+    free(w->buf);
+    s->workers[i] = s->workers[--s->nb_workers];
+}
+
+/* the client's queued jobs are dropped and its running ones killed */
+static void close_client(Server *s, int i)
+{
+    cancel_jobs(s, s->clients[i].serial, NULL);
+    close(s->clients[i].fd);
+    free(s->clients[i].buf);
+    free(s->clients[i].out);
+    s->clients[i] = s->clients[--s->nb_clients];
+}
+
+/* returns 0 if the client is still connected */
+static int read_client(Server *s, Client *c)
+{
+    char buf[65536];
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+    if (n < 0)
+        return (EINTR == errno || EAGAIN == errno) ? 0 : -1;
+    if (0 == n || 0 != append(&c->buf, &c->len, &c->size, buf, n))
+        return -1;
+
+    char *line = c->buf, *nl;
+    while (NULL != (nl = memchr(line, '\n', c->len - (line - c->buf)))) {
+        *nl = '\0';
+        if (nl > line && '\r' == nl[-1])
+            nl[-1] = '\0';
+        if ('\0' != line[0])
+            handle_request(s, c, line);
+        line = nl + 1;
+    }
+    c->len -= line - c->buf;
+    memmove(c->buf, line, c->len);
+    if (c->len > SERVE_MAX_LINE) {
+        reply_error(s, c->serial, NULL, "request too long");
+        return -1;
+    }
+    return 0;
+}
+
+static int listen_on(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd, r;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        av_log(NULL, AV_LOG_ERROR, "serve: socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "serve: socket failed: %s\n", strerror(errno));
+        return -1;
+    }
+    r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (0 != r && EADDRINUSE == errno) {
+        // a socket left by a daemon which didn't exit cleanly
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        int alive = (probe >= 0 && 0 == connect(probe, (struct sockaddr *)&addr, sizeof(addr)));
+        if (probe >= 0)
+            close(probe);
+        if (alive) {
+            av_log(NULL, AV_LOG_ERROR, "serve: %s is used by another process\n", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+        r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+    if (0 != r || 0 != listen(fd, SERVE_BACKLOG)) {
+        av_log(NULL, AV_LOG_ERROR, "serve: listening on %s failed: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#ifdef __APPLE__
+/* no ppoll(); a signal arriving just before poll() waits for the next event */
+static int ppoll(struct pollfd *pfd, nfds_t n, const struct timespec *ts, const sigset_t *mask)
+{
+    sigset_t old;
+    int r;
+
+    (void)ts;
+    sigprocmask(SIG_SETMASK, mask, &old);
+    r = poll(pfd, n, -1);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return r;
+}
+#endif
+
+int serve_run(const char *path, int workers, ServeRun run, void *opaque)
+{
+    Server s;
+    struct pollfd *pfd = NULL;
+    sigset_t block;
+    int ret = -1, i;
+
+    memset(&s, 0, sizeof(s));
+    s.run = run;
+    s.opaque = opaque;
+    s.max_workers = workers > 0 ? workers : 1;
+    s.workers = calloc(s.max_workers, sizeof(Worker));
+    if (NULL == s.workers)
+        return -1;
+
+    s.fd = listen_on(path);
+    if (s.fd < 0) {
+        free(s.workers);
+        return -1;
+    }
+
+    // the signals are only delivered inside ppoll(), so one arriving while the
+    // loop works still ends the next wait at once instead of being lost
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block, &s.poll_mask);
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, serve_signal);
+    signal(SIGTERM, serve_signal);
+    av_log(NULL, AV_LOG_INFO, "serve: listening on %s with %d workers\n", path, s.max_workers);
+
+    while (!serve_stop || s.nb_workers > 0) {
+        if (!serve_stop)
+            start_jobs(&s);
+
+        int n = 0;
+        struct pollfd *new = realloc(pfd, (1 + s.nb_clients + s.nb_workers) * sizeof(struct pollfd));
+        if (NULL == new)
+            goto end;
+        pfd = new;
+        pfd[n++] = (struct pollfd){ serve_stop ? -1 : s.fd, POLLIN, 0 };
+        for (i = 0; i < s.nb_clients; i++) {
+            Client *c = &s.clients[i];
+            pfd[n++] = (struct pollfd){ c->fd, POLLIN | (c->out_pos < c->out_len ? POLLOUT : 0), 0 };
+        }
+        for (i = 0; i < s.nb_workers; i++)
+            pfd[n++] = (struct pollfd){ s.workers[i].fd, POLLIN, 0 };
+
+        if (ppoll(pfd, n, NULL, &s.poll_mask) < 0) {
+            if (EINTR == errno)
+                continue;
+            av_log(NULL, AV_LOG_ERROR, "serve: ppoll failed: %s\n", strerror(errno));
+            goto end;
+        }
+
+        // workers first; their slots are reused by the clients' jobs
+        for (i = s.nb_workers - 1; i >= 0; i--) {
+            if (0 == pfd[1 + s.nb_clients + i].revents)
+                continue;
+            Worker *w = &s.workers[i];
+            char buf[65536];
+            ssize_t r = read(w->fd, buf, sizeof(buf));
+            if (r > 0 && 0 == append(&w->buf, &w->len, &w->size, buf, r))
+                continue;
+            if (r < 0 && EINTR == errno)
+                continue;
+            finish_worker(&s, i);
+        }
+        for (i = s.nb_clients - 1; i >= 0; i--) {
+            short revents = pfd[1 + i].revents;
+            if (revents & POLLOUT)
+                flush_client(&s.clients[i]);
+            if ((revents & ~POLLOUT) && 0 != read_client(&s, &s.clients[i]))
+                close_client(&s, i);
+        }
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(s.fd, NULL, NULL);
+            Client *nc = realloc(s.clients, (s.nb_clients + 1) * sizeof(Client));
+            if (fd >= 0 && NULL != nc && 0 == fcntl(fd, F_SETFL, O_NONBLOCK)) {
+                s.clients = nc;
+                memset(&s.clients[s.nb_clients], 0, sizeof(Client));
+                s.clients[s.nb_clients].fd = fd;
+                s.clients[s.nb_clients].serial = ++s.next_serial;
+                s.nb_clients++;
+            } else {
+                if (NULL != nc)
+                    s.clients = nc;
+                if (fd >= 0)
+                    close(fd);
+            }
+        }
+    }
+    ret = 0;
+    av_log(NULL, AV_LOG_INFO, "serve: stopped after %lu jobs\n", s.done);
+
+  end:
+    while (s.head) {
+        Job *j = s.head;
+        s.head = j->next;
+        reply_error(&s, j->client, j->id, "server stopped");
+        job_free(j);
+    }
+    while (s.nb_workers > 0)
+        finish_worker(&s, s.nb_workers - 1);
+    // the replies left are sent unless the client stops reading
+    for (i = 0; i < s.nb_clients; i++) {
+        Client *c = &s.clients[i];
+        struct timeval tv = { SERVE_FLUSH_TIMEOUT, 0 };
+        if (c->out_pos == c->out_len)
+            continue;
+        fcntl(c->fd, F_SETFL, 0);
+        setsockopt(c->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        flush_client(c);
+    }
+    while (s.nb_clients > 0)
+        close_client(&s, s.nb_clients - 1);
+    free(s.clients);
+    free(s.workers);
+    free(pfd);
+    close(s.fd);
+    unlink(path);
+    sigprocmask(SIG_SETMASK, &s.poll_mask, NULL);
+    return ret;
+}
+
+#endif /* WIN32 */
@@ -0,0 +1,57 @@
+/*  mtn - movie thumbnailer
+    Resident mode: jobs from a Unix socket run by a pool of workers
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_SERVE_H
+#define MTN_SERVE_H
+
+#include <stdio.h>
+
+/**
+ * Protocol - one JSON object per line in both directions
+ *
+ * job:     {"id": 1, "input": "/movies/a.mkv", "args": ["-c", "4"], "data": false}
+ * result:  {"id": 1, "input": "/movies/a.mkv", "exit_code": 0, "outputs": ["/movies/a_s.jpg"]}
+ * status:  {"id": 2, "cmd": "status"}
+ *          {"id": 2, "workers": 4, "running": 1, "queued": 0, "done": 1, "clients": 1}
+ * cancel:  {"id": 1, "cmd": "cancel"}
+ * errors:  {"id": 3, "error": "..."}
+ *
+ * "id" is optional and returned as is; results of one connection may come
+ * in any order. cancel stops the queued or running jobs of the connection
+ * with that id; they are answered with the error "cancelled" (or the cancel
+ * with "no such job"). The jobs of a closed connection are stopped too.
+ * Each job runs in a worker process forked from the daemon, so the job's
+ * options don't change the daemon's ones. Replies to a connection that
+ * doesn't read are queued; they don't hold up the others.
+ */
+
+typedef struct ServeJob {
+    const char *input;
+    int argc;                       /* options of the job; argv[0] is the program name */
+    char **argv;
+    int data;                       /* return contents of the outputs */
+} ServeJob;
+
+/**
+ * Runs a job in the worker process with the opaque of serve_run(); writes
+ * members of the result object (after "id" and "input", without braces) to out
+ */
+typedef void (*ServeRun)(void *opaque, const ServeJob *job, FILE *out);
+
+/**
+ * Listen on Unix socket path and run jobs in at most workers processes at
+ * once until SIGINT or SIGTERM; running jobs are finished first
+ * Returns 0 on success, -1 on error
+ */
+int serve_run(const char *path, int workers, ServeRun run, void *opaque);
+
+#endif /* MTN_SERVE_H */
@@ -0,0 +1,375 @@
+/*  mtn - movie thumbnailer
+    Streaming row band writer for very tall contact sheets
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#include "mtn_stream.h"
+#include "mtn_png.h"
+#include "libavutil/log.h"
+#include <limits.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <png.h>
+
+/* jpeg error manager; libjpeg's default one calls exit() */
+typedef struct JpegEnc {
+    struct jpeg_error_mgr jerr;     /* must be first */
+    jmp_buf jmpbuf;
+    struct jpeg_compress_struct cinfo;
+} JpegEnc;
+
+/* libpng filter mask of PngEncFilter */
+static const int png_filter_mask[] = {
+    PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS
+};
+
+typedef struct PngEnc {
+    png_structp png;
+    png_infop info;
+} PngEnc;
+
+static void jpeg_enc_error_exit(j_common_ptr cinfo)
+{
+    JpegEnc *je = (JpegEnc*)cinfo->err;
+    char msg[JMSG_LENGTH_MAX];
+
+    (*cinfo->err->format_message)(cinfo, msg);
+    av_log(NULL, AV_LOG_ERROR, "  jpeg encoder: %s\n", msg);
+    longjmp(je->jmpbuf, 1);
+}
+
+static void png_enc_error(png_structp png, png_const_charp msg)
+{
+    av_log(NULL, AV_LOG_ERROR, "  png encoder: %s\n", msg);
+    png_longjmp(png, 1);
+}
+
+static void png_enc_warning(png_structp __attribute__((unused)) png, png_const_charp msg)
+{
+    av_log(NULL, AV_LOG_VERBOSE, "  png encoder: %s\n", msg);
+}
+
+/*
+return pointer to the last occurrence of needle or NULL
+*/
+static const char *find_last(const char *haystack, const char *needle)
+{
+    const char *found = NULL, *p = haystack;
+
+    if (NULL == needle || '\0' == *needle)
+        return NULL;
+
+    while ((p = strstr(p, needle)) != NULL)
+        found = p++;
+
+    return found;
+}
+
+void stream_writer_page_name(const StreamWriter *sw, int page, char *buf, size_t buf_size)
+{
+    if (sw->nb_pages <= 1) {
+        snprintf(buf, buf_size, "%s", sw->out_filename);
+        return;
+    }
+
+    // insert page number before suffix: movie_s.jpg => movie_p001_s.jpg
+    const char *pos = find_last(sw->out_filename, sw->suffix);
+    if (NULL == pos || pos == sw->out_filename)
+        pos = sw->out_filename + strlen(sw->out_filename);
+
+    snprintf(buf, buf_size, "%.*s_p%03d%s", (int)(pos - sw->out_filename), sw->out_filename, page + 1, pos);
+}
+
+int stream_writer_init(StreamWriter *sw, StreamFormat format, int quality, int width,
+                       const int *band_height, int nb_bands, int max_page_height,
+                       const char *out_filename, const char *suffix, stream_open_fn open_page, void *opaque)
+{
+    int i;
+
+    memset(sw, 0, sizeof(*sw));
+    sw->format = format;
+    sw->quality = quality;
+    sw->width = width;
+    sw->transparent = -1;
+    sw->png_level = -1;
+    sw->png_filter = PNGENC_FILTER_DEFAULT;
+    sw->open_page = open_page;
+    sw->opaque = opaque;
+    sw->page = -1;
+
+    if (max_page_height <= 0)
+        max_page_height = (STREAM_FORMAT_JPEG == format) ? STREAM_JPEG_MAX_SIZE : INT_MAX;
+    if (STREAM_FORMAT_JPEG == format && max_page_height > STREAM_JPEG_MAX_SIZE)
+        max_page_height = STREAM_JPEG_MAX_SIZE;
+
+    if (width <= 0 || (STREAM_FORMAT_JPEG == format && width > STREAM_JPEG_MAX_SIZE)) {
+        av_log(NULL, AV_LOG_ERROR, "  width %d can't be streamed\n", width);
+        return -1;
+    }
+
+    sw->page_height = malloc(nb_bands * sizeof(*sw->page_height));
+    sw->out_filename = strdup(out_filename);
+    sw->suffix = strdup(suffix);
+    sw->scanline = malloc(width * 3);
+    if (NULL == sw->page_height || NULL == sw->out_filename || NULL == sw->suffix || NULL == sw->scanline) {
+        av_log(NULL, AV_LOG_ERROR, "  stream_writer_init: malloc failed\n");
+        return -1;
+    }
+
+    // bands are never split; start a new page when the next band doesn't fit
+    for (i = 0; i < nb_bands; i++) {
+        if (band_height[i] > max_page_height) {
+            av_log(NULL, AV_LOG_ERROR, "  band height %d is higher than max. page height %d\n", band_height[i], max_page_height);
+            return -1;
+        }
+        if (band_height[i] <= 0)
+            continue;
+
+        if (0 == sw->nb_pages || sw->page_height[sw->nb_pages-1] > max_page_height - band_height[i])
+            sw->page_height[sw->nb_pages++] = 0;
+
+        sw->page_height[sw->nb_pages-1] += band_height[i];
+    }
+
+    if (0 == sw->nb_pages) {
+        av_log(NULL, AV_LOG_ERROR, "  nothing to stream\n");
+        return -1;
+    }
+
+    return sw->nb_pages;
+}
+
+static int jpeg_page_begin(StreamWriter *sw, int height)
+{
+    JpegEnc *je = calloc(1, sizeof(JpegEnc));
+    if (NULL == je)
+        return -1;
+    sw->enc = je;
+
+    je->cinfo.err = jpeg_std_error(&je->jerr);
+    je->jerr.error_exit = jpeg_enc_error_exit;
+    if (setjmp(je->jmpbuf))
+        return -1;
+
+    jpeg_create_compress(&je->cinfo);
+    jpeg_stdio_dest(&je->cinfo, sw->fp);
+
+    je->cinfo.image_width = sw->width;
+    je->cinfo.image_height = height;
+    je->cinfo.input_components = 3;
+    je->cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&je->cinfo);
+    jpeg_set_quality(&je->cinfo, sw->quality, TRUE);
+
+    // same as libgd: no chroma subsampling for high quality
+    if (sw->quality >= 90) {
+        je->cinfo.comp_info[0].h_samp_factor = 1;
+        je->cinfo.comp_info[0].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress(&je->cinfo, TRUE);
+    return 0;
+}
+
+static int png_page_begin(StreamWriter *sw, int height)
+{
+    PngEnc *pe = calloc(1, sizeof(PngEnc));
+    if (NULL == pe)
+        return -1;
+    sw->enc = pe;
+
+    pe->png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, png_enc_error, png_enc_warning);
+    if (NULL == pe->png)
+        return -1;
+    pe->info = png_create_info_struct(pe->png);
+    if (NULL == pe->info)
+        return -1;
+    if (setjmp(png_jmpbuf(pe->png)))
+        return -1;
+
+    png_init_io(pe->png, sw->fp);
+    png_set_IHDR(pe->png, pe->info, sw->width, height, 8, PNG_COLOR_TYPE_RGB,
+        PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+    if (sw->png_level >= 0)
+        png_set_compression_level(pe->png, sw->png_level);
+    if (sw->png_filter >= PNGENC_FILTER_NONE && sw->png_filter <= PNGENC_FILTER_ADAPTIVE)
+        png_set_filter(pe->png, PNG_FILTER_TYPE_BASE, png_filter_mask[sw->png_filter]);
+
+    if (sw->transparent >= 0) {
+        png_color_16 trans;
+        memset(&trans, 0, sizeof(trans));
+        trans.red   = gdTrueColorGetRed(sw->transparent);
+        trans.green = gdTrueColorGetGreen(sw->transparent);
+        trans.blue  = gdTrueColorGetBlue(sw->transparent);
+        png_set_tRNS(pe->png, pe->info, NULL, 0, &trans);
+    }
+
+    png_write_info(pe->png, pe->info);
+    return 0;
+}
+
+/*
+finish (ok=1) or abort (ok=0) encoding of the current page
+*/
+static int page_end(StreamWriter *sw, int ok)
+{
+    int ret = ok ? 0 : -1;
+
+    if (STREAM_FORMAT_JPEG == sw->format) {
+        JpegEnc *je = sw->enc;
+        if (je) {
+            if (setjmp(je->jmpbuf)) {
+                ret = -1;
+            } else if (ok) {
+                jpeg_finish_compress(&je->cinfo);
+            }
+            jpeg_destroy_compress(&je->cinfo);
+            free(je);
+        }
+    } else {
+        PngEnc *pe = sw->enc;
+        if (pe) {
+            if (pe->png && setjmp(png_jmpbuf(pe->png))) {
+                ret = -1;
+            } else if (ok && pe->png) {
+                png_write_end(pe->png, NULL);
+            }
+            png_destroy_write_struct(&pe->png, &pe->info);
+            free(pe);
+        }
+    }
+    sw->enc = NULL;
+
+    if (sw->fp) {
+        if (0 != fclose(sw->fp)) {
+            av_log(NULL, AV_LOG_ERROR, "  closing output image '%s' failed\n", sw->page_filename);
+            ret = -1;
+        }
+        sw->fp = NULL;
+    }
+
+    if (0 == ret && ok)
+        av_log(NULL, AV_LOG_VERBOSE, "  page %d/%d saved: %s\n", sw->page + 1, sw->nb_pages, sw->page_filename);
+
+    return ret;
+}
+
+static int page_begin(StreamWriter *sw)
+{
+    char name[FILENAME_MAX*4];
+
+    sw->page++;
+    sw->page_y = 0;
+    stream_writer_page_name(sw, sw->page, name, sizeof(name));
+
+    free(sw->page_filename);
+    sw->page_filename = strdup(name);
+
+    sw->fp = sw->open_page(sw->opaque, name);
+    if (NULL == sw->fp)
+        return -1;
+
+    if (STREAM_FORMAT_JPEG == sw->format)
+        return jpeg_page_begin(sw, sw->page_height[sw->page]);
+    else
+        return png_page_begin(sw, sw->page_height[sw->page]);
+}
+
+static int write_scanline(StreamWriter *sw)
+{
+    if (STREAM_FORMAT_JPEG == sw->format) {
+        JpegEnc *je = sw->enc;
+        JSAMPROW row = sw->scanline;
+        if (setjmp(je->jmpbuf))
+            return -1;
+        jpeg_write_scanlines(&je->cinfo, &row, 1);
+    } else {
+        PngEnc *pe = sw->enc;
+        if (setjmp(png_jmpbuf(pe->png)))
+            return -1;
+        png_write_row(pe->png, sw->scanline);
+    }
+    return 0;
+}
+
+int stream_writer_write(StreamWriter *sw, gdImagePtr band, int height)
+{
+    int x, y;
+
+    if (NULL == band || gdImageSX(band) < sw->width || gdImageSY(band) < height || !gdImageTrueColor(band))
+        return -1;
+
+    for (y = 0; y < height; y++) {
+        if (sw->page < 0 || sw->page_y >= sw->page_height[sw->page]) {
+            if (sw->page >= 0 && 0 != page_end(sw, 1))
+                return -1;
+            if (sw->page + 1 >= sw->nb_pages) {
+                av_log(NULL, AV_LOG_ERROR, "  stream_writer_write: more rows than planned\n");
+                return -1;
+            }
+            if (0 != page_begin(sw)) {
+                page_end(sw, 0);
+                return -1;
+            }
+        }
+
+        const int *src = band->tpixels[y];
+        uint8_t *dst = sw->scanline;
+        for (x = 0; x < sw->width; x++) {
+            *dst++ = gdTrueColorGetRed(src[x]);
+            *dst++ = gdTrueColorGetGreen(src[x]);
+            *dst++ = gdTrueColorGetBlue(src[x]);
+        }
+
+        if (0 != write_scanline(sw)) {
+            page_end(sw, 0);
+            return -1;
+        }
+        sw->page_y++;
+    }
+    return 0;
+}
+
+int stream_writer_close(StreamWriter *sw)
+{
+    int ret = 0;
+
+    if (sw->fp || sw->enc) {
+        int complete = (sw->page == sw->nb_pages - 1 && sw->page_y == sw->page_height[sw->page]);
+        if (!complete)
+            av_log(NULL, AV_LOG_ERROR, "  output image '%s' is incomplete\n", sw->page_filename);
+        ret = page_end(sw, complete);
+    } else if (sw->nb_pages <= 0 || sw->page != sw->nb_pages - 1) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+void stream_writer_free(StreamWriter *sw)
+{
+    if (sw->fp || sw->enc)
+        page_end(sw, 0);
+
+    free(sw->page_height);
+    free(sw->out_filename);
+    free(sw->suffix);
+    free(sw->page_filename);
+    free(sw->scanline);
+    sw->page_height = NULL;
+    sw->out_filename = sw->suffix = sw->page_filename = NULL;
+    sw->scanline = NULL;
+    sw->nb_pages = 0;
+    sw->page = -1;
+}
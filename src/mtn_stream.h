@@ -0,0 +1,96 @@
+/*  mtn - movie thumbnailer
+    Streaming row band writer for very tall contact sheets
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_STREAM_H
+#define MTN_STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "gd.h"
+
+/* jpeg seems to have max size of 65500 pixels */
+#define STREAM_JPEG_MAX_SIZE 65500
+
+typedef enum StreamFormat {
+    STREAM_FORMAT_JPEG,
+    STREAM_FORMAT_PNG
+} StreamFormat;
+
+/**
+ * Opens a page file for writing; returns NULL on error
+ */
+typedef FILE* (*stream_open_fn)(void *opaque, const char *filename);
+
+/**
+ * StreamWriter - writes an image band by band to one or more pages
+ *
+ * The whole layout (height of every band) must be known in advance, because
+ * both jpeg and png store the image height in the header. Bands are never
+ * split between pages; a new page is started whenever the next band would
+ * exceed the maximum page height.
+ */
+typedef struct StreamWriter {
+    StreamFormat format;
+    int quality;                    /* jpeg quality */
+    int width;
+    int transparent;                /* gd truecolor of transparent color; -1 = off (png only) */
+    int png_level;                  /* zlib level; -1 = default */
+    int png_filter;                 /* PngEncFilter; -1 = default */
+    stream_open_fn open_page;
+    void *opaque;                   /* passed to open_page */
+
+    char *out_filename;             /* name of the single page output */
+    char *suffix;                   /* page number is inserted before this suffix */
+    char *page_filename;            /* name of the current page */
+
+    int nb_pages;
+    int *page_height;               /* planned height of each page */
+    int page;                       /* current page; -1 = none opened yet */
+    int page_y;                     /* scanlines written to the current page */
+
+    FILE *fp;
+    uint8_t *scanline;              /* one RGB24 scanline */
+    void *enc;                      /* jpeg or png encoder state */
+} StreamWriter;
+
+/**
+ * Initialize writer and split bands into pages
+ * Returns number of pages on success, -1 on error
+ */
+int stream_writer_init(StreamWriter *sw, StreamFormat format, int quality, int width,
+                       const int *band_height, int nb_bands, int max_page_height,
+                       const char *out_filename, const char *suffix, stream_open_fn open_page, void *opaque);
+
+/**
+ * Write first `height` rows of a truecolor band; opens/closes pages as needed
+ * Returns 0 on success, -1 on error
+ */
+int stream_writer_write(StreamWriter *sw, gdImagePtr band, int height);
+
+/**
+ * Finish the last page
+ * Returns 0 if every page was completely written, -1 otherwise
+ */
+int stream_writer_close(StreamWriter *sw);
+
+/**
+ * Free resources; aborts the current page if it is still open
+ * Safe to call on a zeroed or already freed writer
+ */
+void stream_writer_free(StreamWriter *sw);
+
+/**
+ * Name of page (0 based) as it is or will be saved
+ */
+void stream_writer_page_name(const StreamWriter *sw, int page, char *buf, size_t buf_size);
+
+#endif /* MTN_STREAM_H */
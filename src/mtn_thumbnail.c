@@ -11,19 +11,57 @@
 */
 
 #include "mtn_thumbnail.h"
+#include "mtn_log.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/opt.h"
 #include "libavutil/display.h"
+#include "libavutil/avstring.h"
+#include "libavutil/time.h"
+#include "libavfilter/buffersrc.h"
+#include "libavfilter/buffersink.h"
 #include "libswscale/swscale.h"
+#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-void thumbnail_context_init(ThumbnailContext *ctx)
+#define MAX_PACKETS_WITHOUT_PICTURE 1000
+#define MAX_DECODE_ERRORS 10 // of a file; shots are skipped until then
+#define IO_BUFFER_SIZE 65536 // of the AVIOContext reading a MtnReader
+
+#ifndef MIN
+#define MIN(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a)<(b)?(b):(a))
+#endif
+
+#ifdef WIN32
+    #define NEWLINE "\r\n"
+#else
+    #define NEWLINE "\n"
+#endif
+
+void thumbnail_context_init(ThumbnailContext *ctx, const MtnContext *mc)
 {
     if (!ctx) return;
     
     memset(ctx, 0, sizeof(ThumbnailContext));
+    ctx->mc = mc;
+    ctx->video_index = -1;
+    ctx->filter_color_primaries_match = 1;
+    ctx->seek_mode = 1;
+    if (mc->_timeout > 0) // the budget covers opening the movie too
+        ctx->deadline = av_gettime_relative() + (int64_t)mc->_timeout * 1000000;
+}
+
+/* count err in the errors of the file; returns err */
+static int fail(ThumbnailContext *ctx, int err)
+{
+    if (MTN_SUCCESS == ctx->error)
+        ctx->error = err;
+    ctx->nb_errors++;
+    return err;
 }
 
 void thumbnail_context_cleanup(ThumbnailContext *ctx)
@@ -40,18 +78,19 @@ void thumbnail_context_cleanup(ThumbnailContext *ctx)
     
     /* Free codec context */
     if (ctx->codec_ctx) {
-        if (ctx->codec_ctx_opened) {
-            avcodec_free_context(&ctx->codec_ctx);
-        } else {
-            avcodec_free_context(&ctx->codec_ctx);
-        }
+        avcodec_free_context(&ctx->codec_ctx);
         ctx->codec_ctx = NULL;
     }
     
     /* Free format context */
-    if (ctx->format_ctx && ctx->format_ctx_opened) {
+    if (ctx->format_ctx && ctx->format_ctx_opened)
         avformat_close_input(&ctx->format_ctx);
-        ctx->format_ctx = NULL;
+    else if (ctx->format_ctx)
+        avformat_free_context(ctx->format_ctx);
+    ctx->format_ctx = NULL;
+    if (ctx->avio) {
+        av_freep(&ctx->avio->buffer);
+        avio_context_free(&ctx->avio);
     }
     
     /* Free frames */
@@ -75,65 +114,110 @@ void thumbnail_context_cleanup(ThumbnailContext *ctx)
         sws_freeContext(ctx->sws_ctx);
         ctx->sws_ctx = NULL;
     }
-    
-    /* Free GD images */
-    if (ctx->out_image) {
-        gdImageDestroy(ctx->out_image);
-        ctx->out_image = NULL;
-    }
-    if (ctx->shadow_image) {
-        gdImageDestroy(ctx->shadow_image);
-        ctx->shadow_image = NULL;
-    }
-    
-    /* Close info file */
-    if (ctx->info_fp) {
-        fclose(ctx->info_fp);
-        ctx->info_fp = NULL;
-    }
 }
 
-int thumbnail_open_file(ThumbnailContext *ctx, const char *filename, int select_stream)
+int thumbnail_cancelled(const ThumbnailContext *ctx)
+{
+    return NULL != ctx->mc->cancel && 0 != *ctx->mc->cancel;
+}
+
+int thumbnail_timed_out(const ThumbnailContext *ctx)
+{
+    return 0 != ctx->deadline && av_gettime_relative() >= ctx->deadline;
+}
+
+int thumbnail_interrupted(const ThumbnailContext *ctx)
+{
+    return thumbnail_cancelled(ctx) || thumbnail_timed_out(ctx);
+}
+
+/* error of a failed FFmpeg call: why it was interrupted, else err */
+static int interrupt_error(const ThumbnailContext *ctx, int err)
+{
+    if (thumbnail_cancelled(ctx))
+        return MTN_ERROR_CANCELLED;
+    if (thumbnail_timed_out(ctx))
+        return MTN_ERROR_TIMEOUT;
+    return err;
+}
+
+/* AVIOInterruptCB: blocking reads give up too */
+static int interrupt_cb(void *opaque)
 {
+    return thumbnail_interrupted(opaque);
+}
+
+int thumbnail_open_file(ThumbnailContext *ctx, const char *filename)
+{
+    AVDictionary *options = NULL;
     int ret;
     
-    if (!ctx || !filename) return -1;
-    
-    /* Open video file */
-    ret = avformat_open_input(&ctx->format_ctx, filename, NULL, NULL);
+    if (!ctx || !filename) return MTN_ERROR_INVALID_ARG;
+
+    ctx->format_ctx = avformat_alloc_context();
+    if (NULL == ctx->format_ctx)
+        return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
+    ctx->format_ctx->interrupt_callback.callback = interrupt_cb;
+    ctx->format_ctx->interrupt_callback.opaque = ctx;
+
+    // movie in memory etc.: avformat_open_input() reads through our AVIOContext
+    if (NULL != ctx->mc->reader) {
+        const MtnReader *reader = ctx->mc->reader;
+        uint8_t *buffer = av_malloc(IO_BUFFER_SIZE);
+        if (NULL != buffer)
+            ctx->avio = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, reader->opaque, reader->read, NULL, reader->seek);
+        if (NULL == ctx->avio) {
+            av_free(buffer);
+            return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
+        }
+        ctx->format_ctx->pb = ctx->avio;
+    }
+
+    // avformat_open_input() takes the options it used out of the dictionary;
+    // a copy keeps them for the next movie & other threads
+    av_dict_copy(&options, ctx->mc->_options, 0);
+    ret = avformat_open_input(&ctx->format_ctx, filename, NULL, &options);
+    av_dict_free(&options);
     if (ret != 0) {
-        av_log(NULL, AV_LOG_ERROR, "avformat_open_input failed: %d\n", ret);
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "\n%s: avformat_open_input %s failed: %d\n", ctx->mc->argv0, filename, ret);
+        return fail(ctx, interrupt_error(ctx, MTN_ERROR_FILE_NOT_FOUND));
     }
     ctx->format_ctx_opened = 1;
+    ctx->filename = filename;
     
-    /* Generate PTS */
+    // generate pts?? -- from ffplay, not documented
+    // it should make av_read_frame() generate pts for unknown value
     ctx->format_ctx->flags |= AVFMT_FLAG_GENPTS;
     
-    /* Retrieve stream information */
-    ret = avformat_find_stream_info(ctx->format_ctx, NULL);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "avformat_find_stream_info failed: %d\n", ret);
-        return -1;
-    }
-    
-    /* Find video stream */
-    ctx->video_index = select_stream >= 0 ? select_stream : 0;
+    return 0;
+}
+
+int thumbnail_find_stream(ThumbnailContext *ctx, int info_restored)
+{
+    int ret;
     
-    /* TODO: Implement proper stream selection */
+    if (!ctx || !ctx->format_ctx) return MTN_ERROR_INVALID_ARG;
     
-    if (ctx->video_index < 0 || (unsigned int)ctx->video_index >= ctx->format_ctx->nb_streams) {
-        av_log(NULL, AV_LOG_ERROR, "Invalid video stream index: %d\n", ctx->video_index);
-        return -1;
+    if (!info_restored) {
+        ret = avformat_find_stream_info(ctx->format_ctx, NULL);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "\n%s: avformat_find_stream_info %s failed: %d\n",
+                ctx->mc->argv0, ctx->filename, ret);
+            return fail(ctx, interrupt_error(ctx, MTN_ERROR_STREAM_NOT_FOUND));
+        }
     }
     
-    AVStream *stream = ctx->format_ctx->streams[ctx->video_index];
-    if (stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
-        av_log(NULL, AV_LOG_ERROR, "Stream %d is not a video stream\n", ctx->video_index);
-        return -1;
+    ctx->video_index = find_default_videostream_index(ctx->format_ctx, ctx->mc->S_select_video_stream);
+    if (ctx->video_index == -1) {
+        if (!ctx->mc->S_select_video_stream)
+            av_log(NULL, AV_LOG_ERROR, "  couldn't find a video stream\n");
+        else
+            av_log(NULL, AV_LOG_ERROR, "  couldn't find selected video stream (-S %d)\n", ctx->mc->S_select_video_stream);
+        return fail(ctx, MTN_ERROR_STREAM_NOT_FOUND);
     }
     
-    ctx->time_base = av_q2d(stream->time_base);
+    ctx->stream = ctx->format_ctx->streams[ctx->video_index];
+    ctx->time_base = av_q2d(ctx->stream->time_base);
     
     return 0;
 }
@@ -143,74 +227,69 @@ int thumbnail_init_decoder(ThumbnailContext *ctx)
     const AVCodec *codec;
     int ret;
     
-    if (!ctx || !ctx->format_ctx) return -1;
+    if (!ctx || !ctx->stream) return MTN_ERROR_INVALID_ARG;
     
-    AVStream *stream = ctx->format_ctx->streams[ctx->video_index];
+    ctx->codec_ctx = get_codecContext_from_codecParams(ctx->stream->codecpar);
+    if (!ctx->codec_ctx)
+        return fail(ctx, MTN_ERROR_CODEC_OPEN_FAILED);
     
-    /* Get codec context from codec parameters */
-    ctx->codec_ctx = avcodec_alloc_context3(NULL);
-    if (!ctx->codec_ctx) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate codec context\n");
-        return -1;
-    }
+    ctx->rotation = get_stream_rotation(ctx->stream);
     
-    ret = avcodec_parameters_to_context(ctx->codec_ctx, stream->codecpar);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to copy codec parameters: %d\n", ret);
-        avcodec_free_context(&ctx->codec_ctx);
-        return -1;
-    }
-    
-    /* Find decoder */
+    // Find the decoder for the video stream
     codec = avcodec_find_decoder(ctx->codec_ctx->codec_id);
     if (!codec) {
-        av_log(NULL, AV_LOG_ERROR, "Decoder not found for codec id: %d\n", ctx->codec_ctx->codec_id);
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "  couldn't find a decoder for codec_id: %d\n", ctx->codec_ctx->codec_id);
+        return fail(ctx, MTN_ERROR_CODEC_NOT_FOUND);
+    }
+    
+    // discard frames; is this OK?? // FIXME
+    if (ctx->mc->s_step >= 0) {
+        // nonkey & bidir cause program crash with some files, e.g. tokyo 275 .
+        // codec bugs???
+        //ctx->codec_ctx->skip_frame = AVDISCARD_NONKEY; // slower with nike 15-11-07
+        //ctx->codec_ctx->skip_frame = AVDISCARD_BIDIR; // this seems to speed things up
+        ctx->codec_ctx->skip_frame = AVDISCARD_NONREF; // internal err msg but not crash
     }
     
-    /* Open codec */
     ret = avcodec_open2(ctx->codec_ctx, codec, NULL);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to open codec: %d\n", ret);
-        avcodec_free_context(&ctx->codec_ctx);
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "  couldn't open codec %s id %d: %d\n", codec->name, codec->id, ret);
+        return fail(ctx, MTN_ERROR_CODEC_OPEN_FAILED);
     }
     ctx->codec_ctx_opened = 1;
     
-    /* Get rotation if any */
-    ctx->rotation = 0;
-    AVDictionaryEntry *rotate_tag = av_dict_get(stream->metadata, "rotate", NULL, 0);
-    if (rotate_tag) {
-        char *tail;
-        ctx->rotation = strtol(rotate_tag->value, &tail, 10);
-        if (*tail == '\0') {
-            av_log(NULL, AV_LOG_INFO, "Rotation: %d degrees\n", ctx->rotation);
-        }
+    ctx->frame = av_frame_alloc();
+    if (!ctx->frame) {
+        av_log(NULL, AV_LOG_ERROR, "  couldn't allocate a video frame\n");
+        return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
     }
     
     return 0;
 }
 
-int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_str)
+int thumbnail_init_filters(ThumbnailContext *ctx)
 {
     int ret;
     char args[512];
     AVFilterInOut *inputs, *outputs;
     
-    if (!ctx || !ctx->codec_ctx || !filter_str) return 0; /* No filters */
+    if (!ctx || !ctx->codec_ctx) return MTN_ERROR_INVALID_ARG;
+    if (!ctx->mc->_filters) return 0; /* No filters */
+    
+    // initialize filters (FFmpeg/doc/examples/filtering_video.c)
+    av_log(NULL, AV_LOG_VERBOSE, "Initializing filtergraph\n");
     
     const AVFilter *buffersrc = avfilter_get_by_name("buffer");
     const AVFilter *buffersink = avfilter_get_by_name("buffersink");
     
     ctx->filter_graph = avfilter_graph_alloc();
-    if (!ctx->filter_graph) return -1;
+    if (!ctx->filter_graph) return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
     
     /* Create buffer source */
     snprintf(args, sizeof(args),
             "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
             ctx->codec_ctx->width, ctx->codec_ctx->height, ctx->codec_ctx->pix_fmt,
-            ctx->format_ctx->streams[ctx->video_index]->time_base.num,
-            ctx->format_ctx->streams[ctx->video_index]->time_base.den,
+            ctx->stream->time_base.num, ctx->stream->time_base.den,
             ctx->codec_ctx->sample_aspect_ratio.num,
             ctx->codec_ctx->sample_aspect_ratio.den);
     
@@ -218,7 +297,7 @@ int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_str)
                                        args, NULL, ctx->filter_graph);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Cannot create buffer source\n");
-        return -1;
+        return fail(ctx, MTN_ERROR_FILTER_INIT_FAILED);
     }
     
     /* Create buffer sink */
@@ -226,7 +305,7 @@ int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_str)
                                        NULL, NULL, ctx->filter_graph);
     if (ret < 0) {
         av_log(NULL, AV_LOG_ERROR, "Cannot create buffer sink\n");
-        return -1;
+        return fail(ctx, MTN_ERROR_FILTER_INIT_FAILED);
     }
     
     /* Set up filter graph */
@@ -236,7 +315,7 @@ int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_str)
     if (!outputs || !inputs) {
         avfilter_inout_free(&outputs);
         avfilter_inout_free(&inputs);
-        return -1;
+        return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
     }
     
     outputs->name = av_strdup("in");
@@ -249,76 +328,157 @@ int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_str)
     inputs->pad_idx = 0;
     inputs->next = NULL;
     
-    ret = avfilter_graph_parse_ptr(ctx->filter_graph, filter_str, &inputs, &outputs, NULL);
-    if (ret < 0) {
-        avfilter_inout_free(&inputs);
-        avfilter_inout_free(&outputs);
-        return -1;
-    }
-    
-    ret = avfilter_graph_config(ctx->filter_graph, NULL);
-    if (ret < 0) {
-        avfilter_inout_free(&inputs);
-        avfilter_inout_free(&outputs);
-        return -1;
-    }
+    ret = avfilter_graph_parse_ptr(ctx->filter_graph, ctx->mc->_filters, &inputs, &outputs, NULL);
+    if (ret >= 0)
+        ret = avfilter_graph_config(ctx->filter_graph, NULL);
     
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
+    if (ret < 0)
+        return fail(ctx, MTN_ERROR_FILTER_INIT_FAILED);
     
     ctx->filter_graph_initialized = 1;
     
+    if (ctx->mc->_filter_color_primaries)
+        ctx->filter_color_primaries_match = av_match_list(av_color_primaries_name(ctx->codec_ctx->color_primaries),
+            ctx->mc->_filter_color_primaries, ',');
+    
     return 0;
 }
 
-int thumbnail_alloc_frames(ThumbnailContext *ctx, int width, int height, enum AVPixelFormat pix_fmt)
+int thumbnail_init_timing(ThumbnailContext *ctx)
 {
+    const MtnContext *mc;
+    AVCodecContext *pCodecCtx;
+    int64_t first_pts = -1; // pts of first frame
     int ret;
     
-    if (!ctx) return -1;
+    if (!ctx || !ctx->codec_ctx || !ctx->frame) return MTN_ERROR_INVALID_ARG;
+    mc = ctx->mc;
+    pCodecCtx = ctx->codec_ctx;
     
-    /* Allocate frame */
-    ctx->frame = av_frame_alloc();
-    if (!ctx->frame) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate video frame\n");
-        return -1;
+    // keep a copy of sample_aspect_ratio because it might be changed after
+    // decoding a frame, e.g. Dragonball Z 001 (720x480 H264 AAC).mkv
+    AVRational sample_aspect_ratio = av_guess_sample_aspect_ratio(ctx->format_ctx, ctx->stream, NULL);
+    
+    ctx->duration = guess_duration(ctx->format_ctx, ctx->video_index, pCodecCtx); // can be incorrect (e.g. .vob files)
+    if (ctx->duration <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "  duration is unknown: %.2f\n", ctx->duration);
+        return fail(ctx, MTN_ERROR_GENERIC);
     }
     
-    /* Allocate RGB frame */
-    ctx->frame_rgb = av_frame_alloc();
-    if (!ctx->frame_rgb) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate RGB frame\n");
-        return -1;
+    ctx->start_time = (double) ctx->format_ctx->start_time / AV_TIME_BASE; // in seconds
+    // VTS_01_2.VOB & beyond from DVD seem to be like this
+    //if (start_time > duration) {
+        //av_log(NULL, AV_LOG_VERBOSE, "  start_time: %.2f is more than duration: %.2f\n", start_time, duration);
+        //return -1;
+    //}
+    // if start_time is negative, we ignore it; FIXME: is this ok?
+    if (ctx->start_time < 0) {
+        ctx->start_time = 0;
     }
+    ctx->start_time_tb = ctx->start_time * ctx->stream->time_base.den / ctx->stream->time_base.num; // in time_base unit
     
-    /* Allocate RGB buffer */
-    int bufsize = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 1);
-    if (bufsize < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to calculate buffer size\n");
-        return -1;
+    // decode the first frame without seeking.
+    // without doing this, avcodec_decode_video wont be able to decode any picture
+    // with some files, eg. http://download.pocketmovies.net/movies/3d/twittwit_320x184.mpg
+    // bug reported by: swmaherl, jake_o from sourceforge
+    // and pCodecCtx->width and pCodecCtx->height might not be correct without this
+    // for .flv files. bug reported by: dragonbook
+    ret = video_decode_next_frame(ctx->format_ctx, pCodecCtx, ctx->frame, ctx->video_index, &first_pts);
+    if (0 == ret) { // end of file
+        av_log(NULL, AV_LOG_ERROR, "  end of file before the first frame\n");
+        return fail(ctx, MTN_ERROR_DECODE_FAILED);
+    } else if (ret < 0) { // error
+        av_log(NULL, AV_LOG_ERROR, "  read_and_decode first failed!\n");
+        return fail(ctx, ret);
+    }
+    
+    // set sample_aspect_ratio
+    // assuming sample_y = display_y
+    if (mc->a_ratio.num != 0) { // use cmd line arg if specified
+        sample_aspect_ratio.num = (double) pCodecCtx->height * av_q2d(mc->a_ratio) / pCodecCtx->width * 10000;
+        sample_aspect_ratio.den = 10000;
+        av_log(NULL, AV_LOG_INFO, "  *** using sample_aspect_ratio: %d/%d because of -a %.4f option\n", sample_aspect_ratio.num, sample_aspect_ratio.den, av_q2d(mc->a_ratio));
+    } else {
+        if (sample_aspect_ratio.num != 0 && pCodecCtx->sample_aspect_ratio.num != 0
+            && av_q2d(sample_aspect_ratio) != av_q2d(pCodecCtx->sample_aspect_ratio)) {
+            av_log(NULL, AV_LOG_INFO, "  *** conflicting sample_aspect_ratio: %.2f vs %.2f: using %.2f\n",
+                av_q2d(sample_aspect_ratio), av_q2d(pCodecCtx->sample_aspect_ratio), av_q2d(sample_aspect_ratio));
+            av_log(NULL, AV_LOG_INFO, "      to use sample_aspect_ratio %.2f use: -a %.4f option\n",
+                av_q2d(pCodecCtx->sample_aspect_ratio), av_q2d(pCodecCtx->sample_aspect_ratio) * pCodecCtx->width / pCodecCtx->height);
+            // we'll continue with existing value. is this ok? FIXME
+            // this is the same as mpc's and vlc's.
+        }
+        if (sample_aspect_ratio.num == 0) { // not defined
+            sample_aspect_ratio = pCodecCtx->sample_aspect_ratio;
+        }
     }
+    ctx->sample_aspect_ratio = sample_aspect_ratio;
     
-    ctx->rgb_buffer = av_malloc(bufsize);
+    return 0;
+}
+
+void thumbnail_get_info(const ThumbnailContext *ctx, MtnInfo *info)
+{
+    const AVFormatContext *fc = ctx->format_ctx;
+    const AVCodecParameters *par = ctx->stream->codecpar;
+    unsigned i;
+
+    memset(info, 0, sizeof(*info));
+    info->duration = ctx->duration;
+    info->width = par->width;
+    info->height = par->height;
+    info->rotation = ctx->rotation;
+    if (ctx->stream->avg_frame_rate.den > 0)
+        info->frame_rate = av_q2d(ctx->stream->avg_frame_rate);
+    info->bit_rate = fc->bit_rate;
+    info->size = fc->pb ? avio_size(fc->pb) : -1;
+    av_strlcpy(info->video_codec, avcodec_get_name(par->codec_id), sizeof(info->video_codec));
+    for (i = 0; i < fc->nb_streams; i++) {
+        if (AVMEDIA_TYPE_AUDIO == fc->streams[i]->codecpar->codec_type) {
+            av_strlcpy(info->audio_codec, avcodec_get_name(fc->streams[i]->codecpar->codec_id), sizeof(info->audio_codec));
+            break;
+        }
+    }
+}
+
+int thumbnail_alloc_frames(ThumbnailContext *ctx, int width, int height)
+{
+    int ret;
+    
+    if (!ctx || !ctx->codec_ctx) return MTN_ERROR_INVALID_ARG;
+    
+    ctx->shot_width_in = width;
+    ctx->shot_height_in = height;
+    
+    /* prepare for resize & conversion to AV_PIX_FMT_RGB24 */
+    ctx->frame_rgb = av_frame_alloc();
+    if (!ctx->frame_rgb) {
+        av_log(NULL, AV_LOG_ERROR, "  couldn't allocate a video frame\n");
+        return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
+    }
+    
+    int bufsize = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, LINESIZE_ALIGN);
+    ctx->rgb_buffer = bufsize > 0 ? av_malloc(bufsize) : NULL;
     if (!ctx->rgb_buffer) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate RGB buffer\n");
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "  av_malloc %d bytes failed\n", bufsize);
+        return fail(ctx, MTN_ERROR_OUT_OF_MEMORY);
     }
     
-    /* Fill RGB frame with buffer */
+    // Returns: the size in bytes required for src, a negative error code in case of failure
     ret = av_image_fill_arrays(ctx->frame_rgb->data, ctx->frame_rgb->linesize,
-                               ctx->rgb_buffer, AV_PIX_FMT_RGB24, width, height, 1);
+                               ctx->rgb_buffer, AV_PIX_FMT_RGB24, width, height, LINESIZE_ALIGN);
     if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to fill RGB frame arrays: %d\n", ret);
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "  av_image_fill_arrays failed (%d)\n", ret);
+        return fail(ctx, MTN_ERROR_BUFFER_TOO_SMALL);
     }
     
-    /* Create SwsContext for conversion */
-    ctx->sws_ctx = sws_getContext(width, height, pix_fmt,
-                                   width, height, AV_PIX_FMT_RGB24,
-                                   SWS_BILINEAR, NULL, NULL, NULL);
+    ctx->sws_ctx = sws_getContext(ctx->codec_ctx->width, ctx->codec_ctx->height, ctx->codec_ctx->pix_fmt,
+                                  width, height, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
     if (!ctx->sws_ctx) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to create SwsContext\n");
-        return -1;
+        av_log(NULL, AV_LOG_ERROR, "  sws_getContext failed\n");
+        return fail(ctx, MTN_ERROR_GENERIC);
     }
     
     return 0;
@@ -339,58 +499,1097 @@ void thumbnail_calc_dimensions(ThumbnailContext *ctx, int *width, int *height,
     if (*rows <= 0) *rows = 0; /* Auto-calculate */
 }
 
-int thumbnail_decode_and_assemble(ThumbnailContext *ctx, int columns, int rows, int step)
+/* push ctx->frame through the filtergraph; ctx->frame is replaced by the filtered frame */
+static int filter_frame(ThumbnailContext *ctx)
 {
-    /* Suppress unused parameter warnings - placeholder for future implementation */
-    (void)columns;
-    (void)rows;
-    (void)step;
-    
-    /* Placeholder - actual implementation requires more context from original code */
-    /* This would contain the main decoding loop from make_thumbnail() */
-    
-    if (!ctx || !ctx->codec_ctx) return -1;
-    
-    /* TODO: Implement decoding loop */
-    
+    MTN_LOG(AV_LOG_VERBOSE, "Aplying filtergraph to the frame\n");
+
+    AVFrame *filt_frame = av_frame_alloc();
+    if (NULL == filt_frame)
+        return -1;
+
+    /* push the decoded frame into the filtergraph */
+    if (av_buffersrc_add_frame_flags(ctx->buffersrc_ctx, ctx->frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error while feeding the filtergraph\n");
+        av_frame_free(&filt_frame);
+        return 0;
+    }
+
+    /* pull filtered frames from the filtergraph */
+    int got = 0;
+    while (1) {
+        int ret = av_buffersink_get_frame(ctx->buffersink_ctx, filt_frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            break;
+        if (ret >= 0)
+            got = 1;
+        else
+            av_log(NULL, AV_LOG_ERROR, "Error while reading the filtergraph\n");
+    }
+    if (got) {
+        av_frame_free(&ctx->frame);
+        ctx->frame = filt_frame;
+    }
+
+    struct SwsContext *pFilteredSwsCtx = sws_getContext(ctx->codec_ctx->width, ctx->codec_ctx->height, ctx->frame->format,
+        ctx->shot_width_in, ctx->shot_height_in, AV_PIX_FMT_RGB24, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!got)
+        av_frame_free(&filt_frame);
+    if (!pFilteredSwsCtx) {
+        av_log(NULL, AV_LOG_ERROR, "  Filtered sws_getContext failed\n");
+        return -1;
+    }
+
+    sws_freeContext(ctx->sws_ctx);
+    ctx->sws_ctx = pFilteredSwsCtx;
     return 0;
 }
 
-int thumbnail_save_image(ThumbnailContext *ctx, const char *filename, int quality)
+/*
+how far blank & edge evasion may go from sched[i]: up to the next target of
+the main output, or of its profile outputs if it's only theirs, so targets
+of profiles interleaved with the main grid don't change the main sheet
+*/
+static int64_t evade_window(const ShotTarget *sched, int nb_sched, int i, int64_t step_t)
 {
-    FILE *fp;
-    
-    if (!ctx || !ctx->out_image || !filename) return -1;
-    
-    fp = fopen(filename, "wb");
-    if (!fp) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to open output file: %s\n", filename);
-        return -1;
+    unsigned int outputs = (sched[i].outputs & 1) ? 1 : sched[i].outputs;
+    int j;
+
+    for (j = i + 1; j < nb_sched; j++) {
+        if (sched[j].outputs & outputs)
+            return sched[j].pts - sched[i].pts;
     }
-    
-    /* Save based on extension */
-    const char *ext = strrchr(filename, '.');
-    if (ext && strcasecmp(ext, ".png") == 0) {
-        gdImagePng(ctx->out_image, fp);
+    return (outputs & 1) ? step_t : sched[i].step;
+}
+
+int thumbnail_decode_and_assemble(ThumbnailContext *ctx, const ShotTarget *sched, int nb_sched,
+                                  const ThumbnailSink *sink)
+{
+    if (!ctx || !ctx->codec_ctx || !ctx->frame_rgb || !sched || nb_sched <= 0 || !sink) return MTN_ERROR_INVALID_ARG;
+
+    const MtnContext *mc = ctx->mc;
+    AVFormatContext *pFormatCtx = ctx->format_ctx;
+    AVCodecContext *pCodecCtx = ctx->codec_ctx;
+    AVStream *pStream = ctx->stream;
+    int video_index = ctx->video_index;
+    double start_time = ctx->start_time;
+    double time_base = ctx->time_base;
+    int64_t step_t = ctx->step_t;
+    int ret;
+
+    int64_t evade_step = MIN(10/time_base, step_t / 14); // max 10 s to evade blank screen
+    if (evade_step*time_base <= 1) {
+        evade_step = 0;
+        av_log(NULL, AV_LOG_INFO, "  step is less than 14 s; blank & blur evasion is turned off.\n");
+    }
+
+    ctx->eof = 0;
+    if (1 == mc->z_seek) {
+        ctx->seek_mode = 1;
+    }
+    if (1 == mc->Z_nonseek) {
+        ctx->seek_mode = 0;
+        av_log(NULL, AV_LOG_INFO, "  *** using non-seek mode -- slower but more accurate timing.\n");
+    }
+
+    int64_t seek_target, seek_evade; // in time_base unit
+    int64_t found_pts = -1;
+    int idx;
+
+    /* decode & fill in the shots */
+  restart:
+    seek_target = 0, seek_evade = 0; // in time_base unit
+    if (0 == ctx->seek_mode && mc->B_begin > 10) {
+        av_log(NULL, AV_LOG_INFO, "  -B %.2f with non-seek mode will take some time.\n", mc->B_begin);
+    }
+
+    int evade_try = 0; // blank screen evasion index
+    double avg_evade_try = 0; // average
+    int direction = 0; // seek direction (seek flags)
+    int sched_i = 0; // index of the current shot target
+    seek_target = sched[sched_i].pts;
+    int64_t prevshot_pts = -1; // pts of previous good shot
+    int64_t prevfound_pts = -1; // pts of previous decoding
+    ThumbnailShot shot;
+    memset(&shot, 0, sizeof(shot));
+
+    for (idx = 0; sched_i < nb_sched; idx++) {
+        if (thumbnail_interrupted(ctx))
+            goto eof;                   // cancelled: error; timed out: keep the shots so far
+
+        int64_t eff_target = seek_target + seek_evade; // effective target
+        eff_target = MAX(eff_target, ctx->start_time_tb); // make sure eff_target > start_time
+        TIME_STR time_tmp; // formatted only for messages that are printed
+
+        /* for some formats, previous seek might over shoot pass this seek_target; is this a bug in libavcodec? */
+        if (prevshot_pts > eff_target && 0 == evade_try) {
+            format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
+            // restart in seek mode of skipping shots (FIXME)
+            if (ctx->seek_mode == 1 && 0 == mc->z_seek && 0 == sink->restart(sink->opaque)) {
+              av_log(NULL, AV_LOG_INFO, "  *** previous seek overshot target %s; switching to non-seek mode\n", time_tmp);
+              av_seek_frame(pFormatCtx, video_index, 0, 0);
+              avcodec_flush_buffers(pCodecCtx);
+              ctx->seek_mode = 0;
+              goto restart;
+            }
+            av_log(NULL, AV_LOG_INFO, "  skipping shot at %s because of previous seek or evasions\n", time_tmp);
+            idx--;
+            goto skip_shot;
+        }
+
+        // make sure eff_target > previous found
+        eff_target = MAX(eff_target, prevfound_pts+1);
+
+        if (MTN_LOG_ENABLED(AV_LOG_VERBOSE)) {
+            format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
+            av_log(NULL, AV_LOG_VERBOSE, "\n***eff_target tb: %"PRId64", eff_target s:%.2f (%s), prevshot_pts: %"PRId64"\n",
+                eff_target, calc_time(eff_target, pStream->time_base, start_time), time_tmp, prevshot_pts);
+        }
+
+        /* jump to next shot */
+        if (1 == ctx->seek_mode) { // seek mode
+            ret = really_seek(pFormatCtx, video_index, eff_target, direction, ctx->duration);
+            if (ret < 0) {
+                if (!thumbnail_interrupted(ctx))
+                    av_log(NULL, AV_LOG_ERROR, "  seeking to %.2f s failed\n", calc_time(eff_target, pStream->time_base, start_time));
+                goto eof;
+            }
+            avcodec_flush_buffers(pCodecCtx);
+
+            ret = video_decode_next_frame(pFormatCtx, pCodecCtx, ctx->frame, video_index, &found_pts);
+            if (0 == ret || (ret < 0 && thumbnail_interrupted(ctx))) { // end of file or interrupted read
+                goto eof;               // write into image everything we have so far
+            } else if (ret < 0) { // error; the next seek might get past it
+                av_log(NULL, AV_LOG_ERROR, "  read&decode failed: %s\n", mtn_error_string(ret));
+                fail(ctx, ret);
+                if (ctx->nb_errors >= MAX_DECODE_ERRORS)
+                    goto eof;
+                format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
+                av_log(NULL, AV_LOG_INFO, "  skipping shot at %s because of the error\n", time_tmp);
+                idx--;
+                goto skip_shot;
+            }
+        } else { // non-seek mode -- we keep decoding until we get to the next shot
+            found_pts = 0;
+            while (found_pts < eff_target) {
+                if (thumbnail_interrupted(ctx)) // decoding a long movie takes long
+                    goto eof;
+                ret = video_decode_next_frame(pFormatCtx, pCodecCtx, ctx->frame, video_index, &found_pts);
+                if (0 == ret || (ret < 0 && thumbnail_interrupted(ctx))) { // end of file or interrupted read
+                    goto eof;
+                } else if (ret < 0) { // error; decoding goes on with the next packets
+                    av_log(NULL, AV_LOG_ERROR, "  read&decode failed: %s\n", mtn_error_string(ret));
+                    fail(ctx, ret);
+                    if (ctx->nb_errors >= MAX_DECODE_ERRORS)
+                        goto eof;
+                    found_pts = 0;
+                }
+            }
+        }
+
+        int64_t found_diff = found_pts - eff_target;
+        // if found frame is too far off from target, we'll disable seeking and start over
+        if (idx < 5 && 1 == ctx->seek_mode && 0 == mc->z_seek
+            // usually movies have key frames every 10 s
+            && (step_t < (15/time_base) || found_diff > 15/time_base)
+            && (found_diff <= -step_t || found_diff >= step_t)) {
+
+            // compute the approx. time it take for the non-seek mode, if too long print a msg instead
+            double shot_dtime;
+            if (ctx->scaled_src_width > 576*4/3.0) { // HD
+                shot_dtime = step_t*time_base * 30 / 30.0;
+            } else if (ctx->scaled_src_width > 288*4/3.0) { // ~DVD
+                shot_dtime = step_t*time_base * 30 / 80.0;
+            } else { // small
+                shot_dtime = step_t*time_base * 30 / 500.0;
+            }
+            if (shot_dtime > 2 || shot_dtime * ctx->column * ctx->row > 120) {
+                av_log(NULL, AV_LOG_INFO, "  *** seeking off target %.2f s, increase time step or use non-seek mode.\n", found_diff*time_base);
+            } else if (0 == sink->restart(sink->opaque)) {
+                // disable seeking and start over
+                av_seek_frame(pFormatCtx, video_index, 0, 0);
+                avcodec_flush_buffers(pCodecCtx);
+                ctx->seek_mode = 0;
+                av_log(NULL, AV_LOG_INFO, "  *** switching to non-seek mode because seeking was off target by %.2f s.\n", found_diff*time_base);
+                av_log(NULL, AV_LOG_INFO, "  non-seek mode is slower. increase time step or use -z if you don't want this.\n");
+                goto restart;
+            }
+        }
+
+        MTN_LOG(AV_LOG_VERBOSE, "shot %d: found_: %"PRId64" (%.2fs), eff_: %"PRId64" (%.2fs)\n",
+            idx, found_pts, calc_time(found_pts, pStream->time_base, start_time),
+            eff_target, calc_time(eff_target, pStream->time_base, start_time));
+
+        // got same picture as previous shot, we'll skip it
+        if (prevshot_pts == found_pts && 0 == evade_try) {
+            format_time(calc_time(eff_target, pStream->time_base, start_time), time_tmp, ':');
+            av_log(NULL, AV_LOG_INFO, "  skipping shot at %s because got previous shot\n", time_tmp);
+            idx--;
+            goto skip_shot;
+        }
+
+        if (mc->_filters && ctx->filter_color_primaries_match) {
+            if (0 != filter_frame(ctx)) {
+                ret = MTN_ERROR_FILTER_INIT_FAILED;
+                goto error;
+            }
+        }
+
+        /* convert to AV_PIX_FMT_RGB24 & resize */
+        int height_of_the_output_slice = sws_scale(ctx->sws_ctx, (const uint8_t* const*)ctx->frame->data, ctx->frame->linesize, 0, pCodecCtx->height,
+            ctx->frame_rgb->data, ctx->frame_rgb->linesize);
+        if (height_of_the_output_slice <= 0) {
+            av_log(NULL, AV_LOG_ERROR, "  sws_scale() failed\n");
+            ret = MTN_ERROR_GENERIC;
+            goto error;
+        }
+
+        /* if blank screen, try again */
+        /* Note: evade logic works best with reasonable step values (>1s) */
+        shot.blank = blank_frame(ctx->frame_rgb, ctx->shot_width_out, ctx->shot_height_out);
+        /* Edge detection array - initialized to 1 (edge found) for all parts */
+        for (int i = 0; i < EDGE_PARTS; i++) shot.edge[i] = 1.0f;
+
+        if (evade_step > 0 && shot.blank <= mc->b_blank && mc->D_edge > 0) {
+            shot.edge_ip = rotate_gdImage(
+                detect_edge(ctx->frame_rgb, ctx->shot_width_in, ctx->shot_height_in, mc->D_edge, mc->v_verbose, shot.edge, EDGE_FOUND),
+                ctx->rotation);
+        }
+        if (evade_step > 0 && (shot.blank > mc->b_blank || !is_edge(shot.edge, EDGE_FOUND, mc->V))) {
+            idx--;
+            evade_try++;
+            // we'll always search forward to support non-seek mode, which cant go backward
+            // keep trying until getting close to next step
+            int64_t sched_step = evade_window(sched, nb_sched, sched_i, step_t);
+            seek_evade = evade_step * evade_try;
+            if (seek_evade < (sched_step - evade_step)) {
+                MTN_LOG(AV_LOG_VERBOSE, "  * blank or no edge * try #%d: seeking forward seek_evade: %"PRId64" (%.2f s)\n",
+                    evade_try, seek_evade, seek_evade * av_q2d(pStream->time_base));
+                goto continue_cleanup;
+            }
+
+            // not found -- skip shot
+            format_time(calc_time(seek_target, pStream->time_base, start_time), time_tmp, ':');
+            av_log(NULL, AV_LOG_INFO, "  * blank %.2f or no edge * skipping shot at %s after %d tries\n", shot.blank, time_tmp, evade_try);
+            goto skip_shot;
+        }
+
+        avg_evade_try = (avg_evade_try * idx + evade_try ) / (idx+1); // DEBUG
+
+        /* shot is needed only by profile outputs */
+        shot.outputs = sched[sched_i].outputs;
+        if (0 == (shot.outputs & 1))
+            idx--;
+        shot.idx = (shot.outputs & 1) ? idx : -1;
+        shot.frame = ctx->frame;
+        shot.frame_rgb = ctx->frame_rgb;
+        shot.pts = found_pts;
+        shot.time = calc_time(found_pts, pStream->time_base, start_time);
+        if (0 != sink->shot(sink->opaque, &shot)) {
+            ret = MTN_ERROR_GENERIC;
+            goto error;
+        }
+
+      skip_shot:
+        /* step */
+        if (++sched_i < nb_sched)
+            seek_target = sched[sched_i].pts;
+
+        seek_evade = 0;
+        direction = 0;
+        evade_try = 0;
+        prevshot_pts = found_pts;
+        MTN_LOG(AV_LOG_VERBOSE, "found_pts bottom: %"PRId64"\n", found_pts);
+
+      continue_cleanup: // cleaning up before continuing the loop
+        prevfound_pts = found_pts;
+        if (NULL != shot.edge_ip) {
+            gdImageDestroy(shot.edge_ip);
+            shot.edge_ip = NULL;
+        }
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "  *** avg_evade_try: %.2f\n", avg_evade_try); // DEBUG
+    return idx;
+
+  eof:
+    if (thumbnail_cancelled(ctx)) {
+        ret = MTN_ERROR_CANCELLED;
+        goto error;
+    }
+    if (thumbnail_timed_out(ctx)) {
+        av_log(NULL, AV_LOG_ERROR, "  --timeout of %d s is over; keeping the shots so far\n", mc->_timeout);
+        ctx->timed_out = 1;
+        fail(ctx, MTN_ERROR_TIMEOUT);
+    }
+    ctx->eof = 1;
+    if (NULL != shot.edge_ip)
+        gdImageDestroy(shot.edge_ip);
+    return idx;
+
+  error:
+    if (NULL != shot.edge_ip)
+        gdImageDestroy(shot.edge_ip);
+    return fail(ctx, ret);
+}
+
+void format_time(double duration, TIME_STR str, char sep)
+{
+    if (duration < 0) {
+        sprintf(str, "N/A");
     } else {
-        gdImageJpeg(ctx->out_image, fp, quality);
+        int hours, mins, secs;
+        secs = duration;
+        mins = secs / 60;
+        secs %= 60;
+        hours = mins / 60;
+        mins %= 60;
+
+        snprintf(str, sizeof(TIME_STR), "%02d%c%02d%c%02d", hours, sep, mins, sep, secs);
+    }
+}
+
+int is_key_frame(AVFrame *pFrame)
+{
+    return
+#if LIBAVUTIL_VERSION_INT < AV_VERSION_INT(58, 7, 100)
+    pFrame->key_frame;
+#else
+    !!(pFrame->flags & AV_FRAME_FLAG_KEY);
+#endif
+}
+
+/*
+pFrame must be a AV_PIX_FMT_RGB24 frame
+*/
+void FrameRGB_2_gdImage(AVFrame *pFrame, gdImagePtr ip, int width, int height)
+{
+    uint8_t *src = pFrame->data[0];
+    int x, y;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width * 3; x += 3) {
+            gdImageSetPixel(ip, x / 3, y, gdImageColorResolve(ip, src[x], src[x + 1], src[x + 2]));
+        }
+        src += width * 3;
+    }
+}
+
+/*
+perform convolution on pFrame and store result in ip
+pFrame must be a AV_PIX_FMT_RGB24 frame
+ip must be of the same size as pFrame
+begin = upper left, end = lower right
+filter should be a 2-dimensional but since we cant pass it without knowning the size, we'll use 1 dimension
+modified from:
+http://cvs.php.net/viewvc.cgi/php-src/ext/gd/libgd/gd.c?revision=1.111&view=markup
+*/
+void FrameRGB_convolution(AVFrame *pFrame, int width, int height,
+    float *filter, int filter_size, float filter_div, float offset,
+    gdImagePtr ip, int xbegin, int ybegin, int xend, int yend)
+{
+
+    int x, y, i, j;
+    float new_r, new_g, new_b;
+    uint8_t *src = pFrame->data[0];
+
+    for (y=ybegin; y<=yend; y++) {
+        for(x=xbegin; x<=xend; x++) {
+            new_r = new_g = new_b = 0;
+            //float grey = 0;
+
+            for (j=0; j<filter_size; j++) {
+                int yv = MIN(MAX(y - filter_size/2 + j, 0), height - 1);
+                for (i=0; i<filter_size; i++) {
+                    int xv = MIN(MAX(x - filter_size/2 + i, 0), width - 1);
+                    int pos = yv*width*3 + xv*3;
+                    new_r += src[pos]   * filter[j * filter_size + i];
+                    new_g += src[pos+1] * filter[j * filter_size + i];
+                    new_b += src[pos+2] * filter[j * filter_size + i];
+                    //grey += (src[pos] + src[pos+1] + src[pos+2])/3 * filter[j * filter_size + i];
+                }
+            }
+
+            new_r = (new_r/filter_div)+offset;
+            new_g = (new_g/filter_div)+offset;
+            new_b = (new_b/filter_div)+offset;
+            //grey = (grey/filter_div)+offset;
+
+            new_r = (new_r > 255.0f)? 255.0f : ((new_r < 0.0f)? 0.0f:new_r);
+            new_g = (new_g > 255.0f)? 255.0f : ((new_g < 0.0f)? 0.0f:new_g);
+            new_b = (new_b > 255.0f)? 255.0f : ((new_b < 0.0f)? 0.0f:new_b);
+            //grey = (grey > 255.0f)? 255.0f : ((grey < 0.0f)? 0.0f:grey);
+
+            gdImageSetPixel(ip, x, y, gdImageColorResolve(ip, (int)new_r, (int)new_g, (int)new_b));
+            //gdImageSetPixel(ip, x, y, gdTrueColor((int)new_r, (int)new_g, (int)new_b));
+            //gdImageSetPixel(ip, x, y, gdTrueColor((int)grey, (int)grey, (int)grey));
+        }
+    }
+}
+
+/* begin = upper left, end = lower right
+*/
+float cmp_edge(gdImagePtr ip, int xbegin, int ybegin, int xend, int yend)
+{
+#define CMP_EDGE 208
+    int count = 0;
+    int i, j;
+    for (j = ybegin; j <= yend; j++) {
+        for (i = xbegin; i <= xend; i++) {
+            int pixel = gdImageGetPixel(ip, i, j);
+            if (gdImageRed(ip, pixel) >= CMP_EDGE
+                && gdImageGreen(ip, pixel) >= CMP_EDGE
+                && gdImageBlue(ip, pixel) >= CMP_EDGE) {
+                count++;
+            }
+        }
+    }
+    return (float)count / (yend - ybegin + 1) / (xend - xbegin + 1);
+}
+
+int is_edge(const float *edge, float edge_found, int debug)
+{
+    if (debug) { // DEBUG
+        return 1;
+    }
+    int count = 0;
+    int i;
+    for (i = 0; i < EDGE_PARTS; i++) {
+        if (edge[i] >= edge_found) {
+            count++;
+        }
+    }
+    if (count >= 2) {
+        return count;
     }
-    
-    fclose(fp);
     return 0;
 }
 
-int thumbnail_save_info(ThumbnailContext *ctx, const char *filename)
+/*
+pFrame must be an AV_PIX_FMT_RGB24 frame
+http://student.kuleuven.be/~m0216922/CG/
+http://www.pages.drexel.edu/~weg22/edge.html
+http://student.kuleuven.be/~m0216922/CG/filtering.html
+http://cvs.php.net/viewvc.cgi/php-src/ext/gd/libgd/gd.c?revision=1.111&view=markup
+*/
+gdImagePtr detect_edge(AVFrame *pFrame, int width, int height, int strength, int verbose,
+                       float *edge, float edge_found)
 {
-    if (!ctx || !filename) return -1;
-    
-    ctx->info_fp = fopen(filename, "w");
-    if (!ctx->info_fp) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to create info file: %s\n", filename);
-        return -1;
+    float filter[] = {
+                       0, -strength/4.0f,              0,
+        -strength/4.0f,        strength, -strength/4.0f,
+                       0, -strength/4.0f,              0
+    };
+#define FILTER_SIZE 3 // 3x3
+#define FILTER_DIV 1
+#define OFFSET 128
+
+    gdImagePtr ip = gdImageCreateTrueColor(width, height);
+    if (NULL == ip) {
+        av_log(NULL, AV_LOG_ERROR, "  gdImageCreateTrueColor failed%s", NEWLINE);
+        return NULL;
     }
-    
-    /* TODO: Write stream info to file */
-    
+    if (verbose > 0) {
+        FrameRGB_2_gdImage(pFrame, ip, width, height);
+    }
+
+    int i;
+    for (i = 0; i < EDGE_PARTS; i++) {
+        edge[i] = 1;
+    }
+
+    // check 6 parts to speed this up & to improve correctness
+    int y_size = height/10;
+    int ya = y_size*2;
+    int yb = y_size*4;
+    int yc = y_size*6;
+    int x_crop = width/8;
+
+    // only find edge if neccessary
+    int parts[EDGE_PARTS][4] = {
+        //xbegin, ybegin, xend, yend
+        {x_crop, ya, width/2, ya+y_size},
+        {width/2+1, ya+y_size, width-x_crop, ya+2*y_size},
+        {x_crop, yb, width/2, yb+y_size},
+        {width/2+1, yb+y_size, width-x_crop, yb+2*y_size},
+        {x_crop, yc, width/2, yc+y_size},
+        {width/2+1, yc+y_size, width-x_crop, yc+2*y_size},
+    };
+    int count = 0;
+    for (i = 0; i < EDGE_PARTS && count < 2; i++) {
+        FrameRGB_convolution(pFrame, width, height, filter, FILTER_SIZE, FILTER_DIV, OFFSET,
+            ip, parts[i][0], parts[i][1], parts[i][2], parts[i][3]);
+        edge[i] = cmp_edge(ip, parts[i][0], parts[i][1], parts[i][2], parts[i][3]);
+        if (edge[i] >= edge_found) {
+            count++;
+        }
+    }
+    return ip;
+}
+
+/* av_pkt_dump_log()?? */
+void dump_packet(AVPacket *p, AVStream * ps)
+{
+    /* from av_read_frame()
+    pkt->pts, pkt->dts and pkt->duration are always set to correct values in
+    AVStream.timebase units (and guessed if the format cannot provided them).
+    pkt->pts can be AV_NOPTS_VALUE if the video format has B frames, so it is
+    better to rely on pkt->dts if you do not decompress the payload.
+    */
+    av_log(NULL, AV_LOG_VERBOSE, "***dump_packet: pos:%"PRId64"%s", p->pos, NEWLINE);
+    av_log(NULL, AV_LOG_VERBOSE, "pts tb: %"PRId64", dts tb: %"PRId64", duration tb: %"PRId64"%s",
+        p->pts, p->dts, p->duration, NEWLINE);
+    av_log(NULL, AV_LOG_VERBOSE, "pts s: %.2f, dts s: %.2f, duration s: %.2f%s",
+        p->pts * av_q2d(ps->time_base), p->dts * av_q2d(ps->time_base),
+        p->duration * av_q2d(ps->time_base), NEWLINE); // pts can be AV_NOPTS_VALUE
+}
+
+void dump_codec_context(AVCodecContext * p)
+{
+    if(p->codec == 0)
+        av_log(NULL, AV_LOG_VERBOSE, "***dump_codec_context: codec = ?0?\n");
+    else
+        av_log(NULL, AV_LOG_VERBOSE, "***dump_codec_context: name: %s, time_base: %d / %d, color_primaries = %s, colorspace = %s\n",
+            p->codec->name,
+            p->time_base.num, p->time_base.den,
+            av_color_primaries_name(p->color_primaries),
+            av_color_space_name(p->colorspace)
+            );
+    #if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(60, 2, 0)
+    av_log(NULL, AV_LOG_VERBOSE, "frame_number: %d, width: %d, height: %d, sample_aspect_ratio %d/%d%s\n",
+        p->frame_number, p->width, p->height, p->sample_aspect_ratio.num, p->sample_aspect_ratio.den,
+        (0 == p->sample_aspect_ratio.num) ? "" : "**a**");
+    #else
+    av_log(NULL, AV_LOG_VERBOSE, "frame_number: %"PRId64", width: %d, height: %d, sample_aspect_ratio %d/%d%s\n",
+        p->frame_num, p->width, p->height, p->sample_aspect_ratio.num, p->sample_aspect_ratio.den,
+        (0 == p->sample_aspect_ratio.num) ? "" : "**a**");
+    #endif
+}
+
+/*
+void dump_index_entries(AVStream * p)
+{
+    int i;
+    double diff = 0;
+    for (i=0; i < p->nb_index_entries; i++) {
+        AVIndexEntry *e = p->index_entries + i;
+        double prev_ts = 0, cur_ts = 0;
+        cur_ts = e->timestamp * av_q2d(p->time_base);
+        //assert(cur_ts > 0);
+        diff += cur_ts - prev_ts;
+        if (i < 20) { // show only first 20
+            av_log(NULL, AV_LOG_VERBOSE, "    i: %2d, pos: %8"PRId64", timestamp tb: %6"PRId64", timestamp s: %6.2f, flags: %d, size: %6d, min_distance: %3d\n",
+                i, e->pos, e->timestamp, e->timestamp * av_q2d(p->time_base), e->flags, e->size, e->min_distance);
+        }
+        prev_ts = cur_ts;
+    }
+    av_log(NULL, AV_LOG_VERBOSE, "  *** nb_index_entries: %d, avg. timestamp s diff: %.2f\n", p->nb_index_entries, diff / p->nb_index_entries);
+}
+*/
+
+//based on dump.c: static void dump_sidedata(void *ctx, AVStream *st, const char *indent)
+double get_stream_rotation(AVStream *st)
+{
+    double rotation = 0.0;
+
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(60, 15, 100)
+    int _nb_side_data = st->nb_side_data;
+    const AVPacketSideData *const _src_sd = st->side_data;
+#else
+    int _nb_side_data = st->codecpar->nb_coded_side_data;
+    const AVPacketSideData *const _src_sd = st->codecpar->coded_side_data;
+#endif
+
+    if (_nb_side_data)
+    {
+        int i;
+        for(i=0; i < _nb_side_data ; i++ )
+        {
+            AVPacketSideData sd = _src_sd[i];
+
+            if(sd.type == AV_PKT_DATA_DISPLAYMATRIX) {
+                rotation = av_display_rotation_get((int32_t *)sd.data);
+                break;
+            }
+        }
+    }
+
+    return rotation;
+}
+
+void dump_stream(AVStream * p)
+{
+    av_log(NULL, AV_LOG_VERBOSE, "***dump_stream, time_base: %d / %d\n",
+        p->time_base.num, p->time_base.den);
+    av_log(NULL, AV_LOG_VERBOSE, "start_time tb: %"PRId64", duration tb: %"PRId64", nb_frames: %"PRId64"\n",
+        p->start_time, p->duration, p->nb_frames);
+    // get funny results here. use format_context's.
+    av_log(NULL, AV_LOG_VERBOSE, "start_time s: %.2f, duration s: %.2f\n",
+        p->start_time * av_q2d(p->time_base),
+        p->duration * av_q2d(p->time_base)); // duration can be AV_NOPTS_VALUE
+    // field pts in AVStream is for encoding
+}
+
+AVCodecContext* get_codecContext_from_codecParams(AVCodecParameters* pCodecPar)
+{
+    AVCodecContext *pCodecContext;
+
+    pCodecContext = avcodec_alloc_context3(NULL);
+    if(!pCodecContext)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Couldn't alocate codec context %s", NEWLINE);
+        return NULL;
+    }
+
+    if(avcodec_parameters_to_context(pCodecContext, pCodecPar) <0 )
+    {
+        avcodec_free_context(&pCodecContext);
+        return NULL;
+    }
+
+    return pCodecContext;
+}
+
+/*
+*/
+double uint8_cmp(uint8_t *pa, uint8_t *pb, uint8_t *pc, int n)
+{
+    int i, same = 0;
+    for (i=0; i<n; i++) {
+        int diffab = pa[i] - pb[i];
+        int diffac = pa[i] - pc[i];
+        int diffbc = pb[i] - pb[i];
+
+        if ((diffab > -20) && (diffab < 20) &&
+            (diffac > -20) && (diffac < 20) &&
+            (diffbc > -20) && (diffbc < 20)) {
+            same++;
+        }
+    }
+    return (double)same / n;
+}
+
+/*
+return sameness of the frame; 1 means the frame is the same in all directions, i.e. blank
+pFrame must be an AV_PIX_FMT_RGB24 frame
+*/
+double blank_frame(AVFrame *pFrame, int width, int height)
+{
+    uint8_t *src = pFrame->data[0];
+    int hor_size = height/11 * width * 3;
+    uint8_t *pa = src+hor_size*2;
+    uint8_t *pb = src+hor_size*5;
+    uint8_t *pc = src+hor_size*8;
+    double same = .4*uint8_cmp(pa, pb, pc, hor_size);
+    int ver_size = hor_size/3;
+    same += .6/3*uint8_cmp(pa, pa + ver_size, pa + ver_size*2, ver_size);
+    same += .6/3*uint8_cmp(pb, pb + ver_size, pb + ver_size*2, ver_size);
+    same += .6/3*uint8_cmp(pc, pc + ver_size, pc + ver_size*2, ver_size);
+    return same;
+}
+
+/*
+decode pkt into pFrame
+return 0 if a frame is decoded, AVERROR(EAGAIN) if more packets are needed,
+otherwise MtnError
+*/
+int get_frame_from_packet(AVCodecContext *pCodecCtx,
+                      AVPacket       *pkt,
+                      AVFrame        *pFrame)
+{
+    int fret;
+
+    /// send packet for decoding
+    fret = avcodec_send_packet(pCodecCtx, pkt);
+
+    // ignore invalid packets and continue
+    if(fret == AVERROR_INVALIDDATA ||
+       fret == -1 /* Operation not permitted */
+    )
+        return AVERROR(EAGAIN);
+
+    if (fret < 0) {
+        char error_buffer[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(fret, error_buffer, sizeof(error_buffer));
+        av_log(NULL, AV_LOG_ERROR,  "Error sending a packet for decoding - %s\n", error_buffer);
+        return MTN_ERROR_DECODE_FAILED;
+    }
+
+    fret = avcodec_receive_frame(pCodecCtx, pFrame);
+
+    if (fret == AVERROR(EAGAIN))
+        return fret;
+
+    if(fret == AVERROR_EOF)
+    {
+        av_log(NULL, AV_LOG_ERROR, "No more frames: recieved AVERROR_EOF\n");
+        return MTN_ERROR_DECODE_FAILED;
+    }
+    if (fret == AVERROR(EINVAL))
+    {
+        av_log(NULL, AV_LOG_ERROR, "Codec not opened: recieved AVERROR(EINVAL)\n");
+        return MTN_ERROR_CODEC_OPEN_FAILED;
+    }
+    if (fret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Error during decoding packet\n");
+        return MTN_ERROR_DECODE_FAILED;
+    }
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 34, 100)
+    MTN_LOG(AV_LOG_VERBOSE, "Got picture from frame pts=%"PRId64"\n", pFrame->pts);
+#else
+    MTN_LOG(AV_LOG_VERBOSE, "Got picture, Frame pkt_pts=%"PRId64"\n", pFrame->pkt_pts);
+#endif
     return 0;
 }
+
+/**
+ * @brief read packet and decode it into a frame
+ * @param pFormatCtx - input
+ * @param pCodecCtx - input
+ * @param pFrame - decoded video frame
+ * @param video_index - input
+ * @param pPts - on succes it is set to packet's pts
+ * @return >0 if can read packet(s) & decode a frame
+ *          0 if end of file
+ *         <0 MtnError
+ */
+int
+video_decode_next_frame(AVFormatContext *pFormatCtx,
+       AVCodecContext  *pCodecCtx,
+       AVFrame         *pFrame,     /* OUTPUT */
+       int              video_index,
+       int64_t         *pPts        /* OUTPUT */
+       )
+{
+    assert(pFrame);
+    assert(pPts);
+
+    AVPacket*   pkt;
+    AVStream*   pStream = pFormatCtx->streams[video_index];
+    int         fret;       //function return code
+    int         got_picture=0;
+    uint64_t    pkt_without_pic=0;
+    int         decoded_frame = 0;
+
+    int64_t     pkt_pts = AV_NOPTS_VALUE;
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+    {
+        av_log(NULL, AV_LOG_ERROR ,"Could not allocate packet\n");
+        return MTN_ERROR_OUT_OF_MEMORY;
+    }
+
+    while(got_picture == 0)
+    {
+        /// read packet
+        do
+        {
+            av_packet_unref(pkt);
+            fret = av_read_frame(pFormatCtx, pkt);
+            if(fret != 0)
+            {
+                av_log(NULL, AV_LOG_VERBOSE, "av_read_frame returned %d - considering as the end of file\n", fret);
+                av_log(NULL, AV_LOG_ERROR, "Error reading from video file\n");
+                av_packet_free(&pkt);
+                return 0;
+            }
+        } while(pkt->stream_index != video_index);
+
+        pkt_without_pic++;
+
+        if (MTN_LOG_ENABLED(AV_LOG_VERBOSE)) {
+            dump_packet(pkt, pStream);
+            av_log(NULL, AV_LOG_VERBOSE, "*saving pkt_pts: %"PRId64"\n", pkt->pts);
+        }
+        pkt_pts = pkt->pts;
+
+        /// try to decode packet
+        fret = get_frame_from_packet(pCodecCtx, pkt, pFrame);
+
+        // need more video packet(s)
+        if(fret == AVERROR(EAGAIN))
+        {
+            if(pkt_without_pic%50 == 0)
+                av_log(NULL, AV_LOG_INFO, "  no picture in %"PRId64" packets\n", pkt_without_pic);
+
+            if (pkt_without_pic >= MAX_PACKETS_WITHOUT_PICTURE) {
+                av_log(NULL, AV_LOG_ERROR, "  * av_read_frame couldn't decode picture in %d packets\n", MAX_PACKETS_WITHOUT_PICTURE);
+                av_packet_unref(pkt);
+                av_packet_free(&pkt);
+                return MTN_ERROR_DECODE_FAILED;
+            }
+            continue;
+        }
+
+        /// decoded frame
+        if(fret == 0)
+        {
+            got_picture=1;
+            pkt_without_pic=0;
+            decoded_frame++;
+
+            MTN_LOG(AV_LOG_VERBOSE, "*get_videoframe got frame: key_frame: %d, pict_type: %c\n",
+                           is_key_frame(pFrame), av_get_picture_type_char(pFrame->pict_type));
+
+            if (0 == decoded_frame%200) {
+                av_log(NULL, AV_LOG_INFO, "  picture not decoded in %d frames\n", decoded_frame);
+            }
+        }
+        // error decoding packet
+        else
+        {
+            av_packet_unref(pkt);
+            av_packet_free(&pkt);
+            return fret;
+        }
+    }  // end of while
+
+    av_packet_unref(pkt);
+    av_packet_free(&pkt);
+
+    if (MTN_LOG_ENABLED(AV_LOG_VERBOSE)) {
+        av_log(NULL, AV_LOG_VERBOSE, "*****got picture, repeat_pict: %d%s, key_frame: %d, pict_type: %c\n",
+            pFrame->repeat_pict,(pFrame->repeat_pict > 0) ? "**r**" : "", is_key_frame(pFrame), av_get_picture_type_char(pFrame->pict_type));
+        dump_stream(pStream);
+        dump_codec_context(pCodecCtx);
+    }
+
+    *pPts = pkt_pts;
+    return 1;
+}
+
+
+/* calculate timestamp to display to users
+*/
+double calc_time(int64_t timestamp, AVRational time_base, double start_time)
+{
+    // for files with start_time > 0, we need to subtract the start_time
+    // from timestamp. this should match the time display by MPC & VLC.
+    // however, for .vob files of dvds, after subtracting start_time
+    // each file will start with timestamp 0 instead of continuing from the previous file.
+
+    return av_rescale(timestamp, time_base.num, time_base.den) - start_time;
+}
+
+/*
+return the duration. guess when unknown.
+must be called after codec has been opened
+*/
+double guess_duration(AVFormatContext *pFormatCtx, int index, AVCodecContext *pCodecCtx)
+{
+    double duration = (double) pFormatCtx->duration / AV_TIME_BASE; // can be incorrect for .vob files
+    if (duration > 0) {
+        return duration;
+    }
+
+    AVStream *pStream = pFormatCtx->streams[index];
+    double guess;
+
+    // if stream bitrate is known we'll interpolate from file size.
+    // pFormatCtx->start_time would be incorrect for .vob file with multiple titles.
+    // pStream->start_time doesn't work either. so we'll need to disable timestamping.
+    assert(NULL != pStream && NULL != pCodecCtx);
+
+    int64_t file_size = avio_size(pFormatCtx->pb);
+
+//    if (pStream->codec->bit_rate > 0 && file_size > 0) {
+//        guess = 0.9 * file_size / (pStream->codec->bit_rate / 8);
+    if (pCodecCtx->bit_rate > 0 && file_size > 0) {
+        guess = 0.9 * file_size / (pCodecCtx->bit_rate / 8);
+        if (guess > 0) {
+            av_log(NULL, AV_LOG_ERROR, "  ** duration is unknown: %.2f; guessing: %.2f s from bit_rate\n", duration, guess);
+            return guess;
+        }
+    }
+
+    return -1;
+
+    // the following doesn't work.
+    /*
+    // we'll guess the duration by seeking to near the end of the file and
+    // decode a frame. the timestamp of that frame is the guess.
+    // things get more complicated for dvd's .vob files. each .vob file
+    // can contain more than 1 title. and each title will have its own pts.
+    // for example, 90% of a .vob might be for title 1 and the last 10%
+    // might be for title 2; seeking to near the end will end up getting
+    // title 2's pts. this problem cannot be solved if we just look at the
+    // .vob files. need to process other info outside .vob files too.
+    // as a result, the following will probably never work.
+    // .vob files weirdness will make our assumption to seek by byte incorrect too.
+    if (pFormatCtx->file_size <= 0) {
+        return -1;
+    }
+    int64_t byte_pos = 0.9 * pFormatCtx->file_size;
+    int ret = av_seek_frame(pFormatCtx, index, byte_pos, AVSEEK_FLAG_BYTE);
+    if (ret < 0) { // failed
+        return -1;
+    }
+    avcodec_flush_buffers(pCodecCtx);
+    int64_t pts;
+    ret = read_and_decode(pFormatCtx, index, pCodecCtx, pFrame, &pts, 0); // FIXME: key or not?
+    if (ret <= 0) { // end of file or error
+        av_log(NULL, AV_LOG_VERBOSE, "  read_and_decode during guessing duration failed\n");
+        return -1;
+    }
+    double start_time = (double) pFormatCtx->start_time / AV_TIME_BASE; // FIXME: can be unknown?
+    guess = calc_time(pts, pStream->time_base, start_time);
+    if (guess <= 0) {
+        return -1;
+    }
+    av_log(NULL, AV_LOG_ERROR, "  ** duration is unknown: %.2f; guessing: %.2f s.\n", duration, guess);
+
+    // seek back to 0 & flush buffer; FIXME: is 0 correct?
+    av_seek_frame(pFormatCtx, index, 0, AVSEEK_FLAG_BYTE); // ignore errors
+    avcodec_flush_buffers(pCodecCtx);
+
+    return guess;
+    */
+}
+
+/*
+try hard to seek
+assume flags can be either 0 or AVSEEK_FLAG_BACKWARD
+*/
+int really_seek(AVFormatContext *pFormatCtx, int index, int64_t timestamp, int flags, double duration)
+{
+    assert(flags == 0 || flags == AVSEEK_FLAG_BACKWARD);
+    int ret;
+
+    /* first try av_seek_frame */
+    ret = av_seek_frame(pFormatCtx, index, timestamp, flags);
+    if (ret >= 0) { // success
+        return ret;
+    }
+
+    /* then we try seeking to any (non key) frame AVSEEK_FLAG_ANY */
+    ret = av_seek_frame(pFormatCtx, index, timestamp, flags | AVSEEK_FLAG_ANY);
+    if (ret >= 0) { // success
+        av_log(NULL, AV_LOG_INFO, "AVSEEK_FLAG_ANY: timestamp: %"PRId64"\n", timestamp); // DEBUG
+        return ret;
+    }
+
+    /* and then we try seeking by byte (AVSEEK_FLAG_BYTE) */
+    // here we assume that the whole file has duration seconds.
+    // so we'll interpolate accordingly.
+    AVStream *pStream = pFormatCtx->streams[index];
+    double start_time = (double) pFormatCtx->start_time / AV_TIME_BASE; // in seconds
+    // if start_time is negative, we ignore it; FIXME: is this ok?
+    if (start_time < 0) {
+        start_time = 0;
+    }
+
+    // normally when seeking by timestamp we add start_time to timestamp
+    // before seeking, but seeking by byte we need to subtract the added start_time
+    timestamp -= start_time / av_q2d(pStream->time_base);
+    int64_t file_size = avio_size(pFormatCtx->pb);
+    if (file_size <= 0) {
+        return -1;
+    }
+    if (duration > 0) {
+        int64_t duration_tb = duration / av_q2d(pStream->time_base); // in time_base unit
+        int64_t byte_pos = av_rescale(timestamp, file_size, duration_tb);
+        av_log(NULL, AV_LOG_INFO, "AVSEEK_FLAG_BYTE: byte_pos: %"PRId64", timestamp: %"PRId64", file_size: %"PRId64", duration_tb: %"PRId64"\n", byte_pos, timestamp, file_size, duration_tb);
+        return av_seek_frame(pFormatCtx, index, byte_pos, AVSEEK_FLAG_BYTE);
+    }
+
+    return -1;
+}
+
+/*
+ * find first usable video stream (not cover art)
+ * based on av_find_default_stream_index()
+ * returns
+ *      >0: video index
+ *      -1: can't find any usable video
+ */
+int
+find_default_videostream_index(AVFormatContext *s, int user_selected_video_stream)
+{
+    int default_stream_idx = -1;
+    int cover_image;
+    int n_video_stream = 0;
+    unsigned int i;
+    AVStream *st;
+
+    for (i = 0; i < s->nb_streams; i++)
+    {
+        st = s->streams[i];
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            cover_image = (st->disposition & AV_DISPOSITION_ATTACHED_PIC);
+
+            if(user_selected_video_stream)
+            {
+                if (++n_video_stream == user_selected_video_stream)
+                {
+                    default_stream_idx = i;
+                    av_log(NULL, AV_LOG_INFO, "Selecting video stream (-S): %d%s", user_selected_video_stream, NEWLINE);
+
+                    if(cover_image)
+                        av_log(NULL, AV_LOG_INFO, "  Warning: Selected video stream is \"cover art\"%s", NEWLINE);
+                    break;
+                }
+            }
+            else
+            {
+                if (!cover_image) {
+                    default_stream_idx = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    return default_stream_idx;
+}
+
+void rotate_geometry(int *w, int *h, int angle)
+{
+    if(abs(angle) == 90)
+    {
+        int tmp = *w;
+        *w = *h;
+        *h = tmp;
+    }
+}
+
+gdImagePtr rotate_gdImage(gdImagePtr ip, int angle)
+{
+    if(angle == 0)
+        return ip;
+
+    int win = gdImageSX(ip);
+    int hin = gdImageSY(ip);
+    int wout = win;
+    int hout = hin;
+
+    if(abs(angle) == 90) {
+        wout = hin;
+        hout = win;
+    }
+
+    gdImagePtr ipr = gdImageCreateTrueColor(wout, hout);
+
+    int i,j;
+
+    for(i=0; i<win; i++)
+        for(j=0; j<hin; j++)
+            switch(angle)
+            {
+                case -180:
+                case +180:
+                    gdImageSetPixel(ipr, wout-i, hout-j, gdImageGetPixel(ip, i, j));
+                    break;
+                case   90:
+                    gdImageSetPixel(ipr, j,      hout-i, gdImageGetPixel(ip, i, j));
+                    break;
+                case  -90:
+                    gdImageSetPixel(ipr, wout-j, i,      gdImageGetPixel(ip, i, j));
+                    break;
+                default:
+                    gdImageDestroy(ipr);
+                    return ip;
+            }
+
+    gdImageDestroy(ip);
+    return ipr;
+}
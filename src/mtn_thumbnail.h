@@ -17,13 +17,69 @@
 #include "libavcodec/avcodec.h"
 #include "libavfilter/avfilter.h"
 #include "gd.h"
+#include "mtn_context.h"
+#include "mtn_error.h"
+
+#define LINESIZE_ALIGN 1
+#define EDGE_PARTS 6 // # of parts used in edge detection
+#define EDGE_FOUND 0.001f // edge is considered found
+
+typedef char TIME_STR[20];
+
+/**
+ * ShotTarget - pts at which a shot is decoded for one or more outputs
+ */
+typedef struct SHOT_TARGET
+{
+    int64_t pts;            // in time_base units
+    int64_t step;           // step of the output this target was created for
+    unsigned int outputs;   // bit 0 = main output; bit i = i-th profile output
+} ShotTarget;
+
+/**
+ * ThumbnailShot - a decoded shot that passed blank & edge evasion
+ */
+typedef struct ThumbnailShot {
+    AVFrame *frame;                 /* decoded (and filtered) frame */
+    AVFrame *frame_rgb;             /* AV_PIX_FMT_RGB24, shot_width_in x shot_height_in */
+    int64_t pts;                    /* in time_base units */
+    double time;                    /* seconds shown to users */
+    int idx;                        /* index in the main output; -1 if not in it */
+    unsigned int outputs;           /* of the shot target */
+    double blank;
+    float edge[EDGE_PARTS];
+    gdImagePtr edge_ip;             /* rotated edge image or NULL; set to NULL to keep it */
+} ThumbnailShot;
+
+/**
+ * ThumbnailSink - receives the shots of thumbnail_decode_and_assemble()
+ */
+typedef struct ThumbnailSink {
+    /**
+     * Decoding starts over in non-seek mode; shots received so far are to be
+     * replaced. Returns 0 if they can be, -1 if not (e.g. already written)
+     */
+    int (*restart)(void *opaque);
+    /**
+     * Add shot to the outputs
+     * Returns 0 on success, -1 on error
+     */
+    int (*shot)(void *opaque, ThumbnailShot *shot);
+    void *opaque;
+} ThumbnailSink;
 
 /**
  * ThumbnailContext - manages resources for thumbnail generation
+ *
+ * Every call works only on ctx and the options in ctx->mc, so movies can be
+ * processed at once by different threads, each with its own context.
  */
 typedef struct ThumbnailContext {
+    const MtnContext *mc;           /* options; not owned */
+
     /* FFmpeg resources */
     AVFormatContext *format_ctx;
+    AVIOContext *avio;              /* reading ctx->mc->reader; NULL = file */
     AVCodecContext *codec_ctx;
     AVFrame *frame;
     AVFrame *frame_rgb;
@@ -35,16 +91,36 @@ typedef struct ThumbnailContext {
     AVFilterContext *buffersrc_ctx;
     AVFilterGraph *filter_graph;
     
-    /* Output resources */
-    gdImagePtr out_image;
-    gdImagePtr shadow_image;
-    FILE *info_fp;
-    
     /* State */
+    const char *filename;           /* of thumbnail_open_file(); not owned */
+    AVStream *stream;
     int video_index;
     int rotation;
     double time_base;
     int timestamp_enabled;
+    int filter_color_primaries_match;
+    AVRational sample_aspect_ratio;
+    double duration;                /* seconds */
+    double start_time;              /* seconds; >= 0 */
+    int64_t start_time_tb;          /* in time_base units */
+
+    /* Layout; set by the caller before thumbnail_decode_and_assemble() */
+    int shot_width_in, shot_height_in;
+    int shot_width_out, shot_height_out;
+    int column, row;
+    int64_t step_t;                 /* in time_base units */
+    int scaled_src_width;
+
+    /* Results of thumbnail_decode_and_assemble() */
+    int seek_mode;                  /* 1 = seek; 0 = non-seek */
+    int eof;                        /* stopped before the last shot target */
+    int timed_out;                  /* stopped by --timeout */
+
+    int64_t deadline;               /* av_gettime_relative() of --timeout; 0 = none */
+
+    /* Errors of the file; decoding goes on after a few of them */
+    int nb_errors;
+    MtnError error;                 /* first one; MTN_SUCCESS = none */
     
     /* Cleanup flags */
     int format_ctx_opened;
@@ -53,9 +129,9 @@ typedef struct ThumbnailContext {
 } ThumbnailContext;
 
 /**
- * Initialize thumbnail context with NULL/default values
+ * Initialize thumbnail context with NULL/default values; mc must outlive it
  */
-void thumbnail_context_init(ThumbnailContext *ctx);
+void thumbnail_context_init(ThumbnailContext *ctx, const MtnContext *mc);
 
 /**
  * Free all resources in thumbnail context
@@ -63,28 +139,63 @@ void thumbnail_context_init(ThumbnailContext *ctx);
 void thumbnail_context_cleanup(ThumbnailContext *ctx);
 
 /**
- * Open video file and find video stream
- * Returns 0 on success, -1 on error
+ * 1 if libmtn cancelled the job
+ */
+int thumbnail_cancelled(const ThumbnailContext *ctx);
+
+/**
+ * 1 if the --timeout of the movie is over
+ */
+int thumbnail_timed_out(const ThumbnailContext *ctx);
+
+/**
+ * 1 if the movie should stop: cancelled or timed out
+ */
+int thumbnail_interrupted(const ThumbnailContext *ctx);
+
+/**
+ * Open video file with the --options of ctx->mc; if ctx->mc->reader is set,
+ * the movie is read through it and filename is only its name
+ * Returns 0 on success, MtnError on error
+ */
+int thumbnail_open_file(ThumbnailContext *ctx, const char *filename);
+
+/**
+ * Read stream information unless info_restored (e.g. from the probe cache)
+ * and select the video stream (-S)
+ * Returns 0 on success, MtnError on error
  */
-int thumbnail_open_file(ThumbnailContext *ctx, const char *filename, int select_stream);
+int thumbnail_find_stream(ThumbnailContext *ctx, int info_restored);
 
 /**
- * Initialize video decoder
- * Returns 0 on success, -1 on error
+ * Initialize video decoder & the decoded frame
+ * Returns 0 on success, MtnError on error
  */
 int thumbnail_init_decoder(ThumbnailContext *ctx);
 
 /**
- * Initialize video filters if specified
- * Returns 0 on success, -1 on error
+ * Initialize video filters (--filters) if specified
+ * Returns 0 on success, MtnError on error
+ */
+int thumbnail_init_filters(ThumbnailContext *ctx);
+
+/**
+ * Find duration & start time, decode the first frame and settle the
+ * sample aspect ratio (-a)
+ * Returns 0 on success, MtnError on error
+ */
+int thumbnail_init_timing(ThumbnailContext *ctx);
+
+/**
+ * Fill info of the opened movie; after thumbnail_init_timing()
  */
-int thumbnail_init_filters(ThumbnailContext *ctx, const char *filter_graph_str);
+void thumbnail_get_info(const ThumbnailContext *ctx, MtnInfo *info);
 
 /**
- * Allocate and prepare frame buffers
- * Returns 0 on success, -1 on error
+ * Allocate the RGB frame & scaler for shots of width x height
+ * Returns 0 on success, MtnError on error
  */
-int thumbnail_alloc_frames(ThumbnailContext *ctx, int width, int height, enum AVPixelFormat pix_fmt);
+int thumbnail_alloc_frames(ThumbnailContext *ctx, int width, int height);
 
 /**
  * Calculate thumbnail dimensions and layout
@@ -92,21 +203,73 @@ int thumbnail_alloc_frames(ThumbnailContext *ctx, int width, int height, enum AV
 void thumbnail_calc_dimensions(ThumbnailContext *ctx, int *width, int *height, int *columns, int *rows);
 
 /**
- * Main decoding and thumbnail assembly loop
- * Returns 0 on success, -1 on error
+ * Seek to & decode the shots of sched, evading blank and blurry frames,
+ * and pass them to sink. ctx->eof is set if it stopped early; a shot which
+ * can't be decoded is skipped until there are too many errors
+ * Returns the number of shots in the main output, MtnError on error
+ */
+int thumbnail_decode_and_assemble(ThumbnailContext *ctx, const ShotTarget *sched, int nb_sched,
+                                  const ThumbnailSink *sink);
+
+/* decoding helpers */
+
+/**
+ * Read packets & decode them into pFrame; *pPts is set to the packet's pts
+ * Returns >0 if a frame is decoded, 0 at end of file, MtnError on error
+ */
+int video_decode_next_frame(AVFormatContext *pFormatCtx, AVCodecContext *pCodecCtx,
+                            AVFrame *pFrame, int video_index, int64_t *pPts);
+
+/**
+ * Seek trying key frames, any frame & bytes in turn
+ * flags can be 0 or AVSEEK_FLAG_BACKWARD
  */
-int thumbnail_decode_and_assemble(ThumbnailContext *ctx, int columns, int rows, int step);
+int really_seek(AVFormatContext *pFormatCtx, int index, int64_t timestamp, int flags, double duration);
 
 /**
- * Save thumbnail to file
- * Returns 0 on success, -1 on error
+ * Duration in seconds; guessed from bit rate when unknown; -1 if it can't be
  */
-int thumbnail_save_image(ThumbnailContext *ctx, const char *filename, int quality);
+double guess_duration(AVFormatContext *pFormatCtx, int index, AVCodecContext *pCodecCtx);
 
 /**
- * Save info text to file
- * Returns 0 on success, -1 on error
+ * First usable video stream (not cover art) or the user_selected_video_stream-th
+ * video stream; -1 if there is none
  */
-int thumbnail_save_info(ThumbnailContext *ctx, const char *filename);
+int find_default_videostream_index(AVFormatContext *s, int user_selected_video_stream);
+
+AVCodecContext *get_codecContext_from_codecParams(AVCodecParameters *pCodecPar);
+double get_stream_rotation(AVStream *st);
+int is_key_frame(AVFrame *pFrame);
+double calc_time(int64_t timestamp, AVRational time_base, double start_time);
+void format_time(double duration, TIME_STR str, char sep);
+
+/* image helpers; pFrame must be an AV_PIX_FMT_RGB24 frame */
+
+void FrameRGB_2_gdImage(AVFrame *pFrame, gdImagePtr ip, int width, int height);
+gdImagePtr rotate_gdImage(gdImagePtr ip, int angle);
+void rotate_geometry(int *w, int *h, int angle);
+
+/**
+ * Sameness of the frame; 1 means the frame is the same in all directions, i.e. blank
+ */
+double blank_frame(AVFrame *pFrame, int width, int height);
+
+/**
+ * Edges of 6 parts of the frame found with filter of strength (-D) into edge
+ * Returns the edge image (the frame itself too if verbose), NULL on error
+ */
+gdImagePtr detect_edge(AVFrame *pFrame, int width, int height, int strength, int verbose,
+                       float *edge, float edge_found);
+
+/**
+ * Returns >0 if enough parts have edges or debug is on
+ */
+int is_edge(const float *edge, float edge_found, int debug);
+
+/* debugging dumps at AV_LOG_VERBOSE; callers check MTN_LOG_ENABLED(AV_LOG_VERBOSE) first */
+
+void dump_packet(AVPacket *p, AVStream *ps);
+void dump_codec_context(AVCodecContext *p);
+void dump_stream(AVStream *p);
 
 #endif /* MTN_THUMBNAIL_H */
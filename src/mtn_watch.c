@@ -0,0 +1,423 @@
+/*  mtn - movie thumbnailer
+    Watch mode: process movies as they are written into a directory
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifdef __linux__
+
+#define _GNU_SOURCE                 // ppoll()
+#include "mtn_watch.h"
+#include "libavutil/log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define WATCH_DIR_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct WatchDir {
+    int wd;
+    int depth;
+    char *path;
+} WatchDir;
+
+/* file waiting until it isn't written anymore */
+typedef struct Pending {
+    struct Pending *next;
+    char *path;
+    int64_t due;                    /* ms */
+    int64_t size, mtime;
+} Pending;
+
+typedef struct Running {
+    pid_t pid;
+    char *path;
+} Running;
+
+typedef struct Watcher {
+    const WatchOptions *opt;
+    int fd;
+    WatchDir *dirs;
+    int nb_dirs;
+    Pending *pending;               /* unordered */
+    Pending *ready, *ready_tail;    /* FIFO */
+    Running *running;
+    int nb_running;
+    unsigned long done;
+    sigset_t poll_mask;             /* signal mask while waiting in ppoll(); of the workers too */
+} Watcher;
+
+static volatile sig_atomic_t watch_stop = 0;
+
+static void watch_signal(int sig)
+{
+    (void)sig;
+    watch_stop = 1;
+}
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static char *join_path(const char *dir, const char *name)
+{
+    char *p = malloc(strlen(dir) + strlen(name) + 2);
+    if (p)
+        sprintf(p, "%s/%s", dir, name);
+    return p;
+}
+
+static WatchDir *find_dir(Watcher *w, int wd)
+{
+    int i;
+    for (i = 0; i < w->nb_dirs; i++) {
+        if (w->dirs[i].wd == wd)
+            return &w->dirs[i];
+    }
+    return NULL;
+}
+
+static void remove_dir(Watcher *w, int wd)
+{
+    WatchDir *d = find_dir(w, wd);
+    if (NULL == d)
+        return;
+    free(d->path);
+    *d = w->dirs[--w->nb_dirs];
+}
+
+/* queue path or postpone it if already waiting */
+static void add_pending(Watcher *w, const char *path)
+{
+    Pending *p;
+    struct stat st;
+
+    if (0 != stat(path, &st) || !S_ISREG(st.st_mode))
+        return;
+
+    for (p = w->pending; p; p = p->next) {
+        if (0 == strcmp(p->path, path))
+            break;
+    }
+    if (NULL == p) {
+        p = calloc(1, sizeof(Pending));
+        if (NULL == p || NULL == (p->path = strdup(path))) {
+            free(p);
+            return;
+        }
+        p->next = w->pending;
+        w->pending = p;
+        av_log(NULL, AV_LOG_VERBOSE, "watch: %s queued\n", path);
+    }
+    p->due = now_ms() + w->opt->delay;
+    p->size = st.st_size;
+    p->mtime = st.st_mtime;
+}
+
+static void postpone(Watcher *w, const char *path)
+{
+    Pending *p;
+    for (p = w->pending; p; p = p->next) {
+        if (0 == strcmp(p->path, path)) {
+            p->due = now_ms() + w->opt->delay;
+            return;
+        }
+    }
+}
+
+static void add_dir(Watcher *w, const char *path, int depth, int queue_files);
+
+/* files and subdirectories of a directory found after it was created */
+static void scan_dir(Watcher *w, const char *path, int depth, int queue_files)
+{
+    DIR *dp = opendir(path);
+    struct dirent *d;
+
+    if (NULL == dp)
+        return;
+    while (NULL != (d = readdir(dp))) {
+        if (0 == strcmp(d->d_name, ".") || 0 == strcmp(d->d_name, ".."))
+            continue;
+        char *child = join_path(path, d->d_name);
+        if (NULL == child)
+            break;
+        struct stat st;
+        if (0 == stat(child, &st)) {
+            if (S_ISDIR(st.st_mode))
+                add_dir(w, child, depth + 1, queue_files);
+            else if (queue_files && w->opt->accept(w->opt->opaque, child))
+                add_pending(w, child);
+        }
+        free(child);
+    }
+    closedir(dp);
+}
+
+static void add_dir(Watcher *w, const char *path, int depth, int queue_files)
+{
+    if (w->opt->max_depth >= 0 && depth > w->opt->max_depth)
+        return;
+
+    int wd = inotify_add_watch(w->fd, path, WATCH_DIR_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "watch: watching %s failed: %s\n", path, strerror(errno));
+        return;
+    }
+    if (NULL == find_dir(w, wd)) {
+        WatchDir *new = realloc(w->dirs, (w->nb_dirs + 1) * sizeof(WatchDir));
+        char *p = strdup(path);
+        if (NULL == new || NULL == p) {
+            if (new)
+                w->dirs = new;
+            free(p);
+            inotify_rm_watch(w->fd, wd);
+            return;
+        }
+        w->dirs = new;
+        w->dirs[w->nb_dirs++] = (WatchDir){ wd, depth, p };
+        av_log(NULL, AV_LOG_VERBOSE, "watch: watching %s\n", path);
+    }
+    scan_dir(w, path, depth, queue_files);
+}
+
+static void handle_event(Watcher *w, const struct inotify_event *e)
+{
+    if (e->mask & IN_Q_OVERFLOW) {
+        av_log(NULL, AV_LOG_WARNING, "watch: too many events, some files may be missed\n");
+        return;
+    }
+    if (e->mask & IN_IGNORED) { // directory removed
+        remove_dir(w, e->wd);
+        return;
+    }
+
+    WatchDir *d = find_dir(w, e->wd);
+    if (NULL == d || 0 == e->len)
+        return;
+    char *path = join_path(d->path, e->name);
+    if (NULL == path)
+        return;
+
+    if (e->mask & IN_ISDIR) {
+        if (e->mask & (IN_CREATE | IN_MOVED_TO)) // files moved in with it are queued
+            add_dir(w, path, d->depth + 1, 1);
+    } else if (e->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        if (w->opt->accept(w->opt->opaque, path))
+            add_pending(w, path);
+    } else if (e->mask & IN_MODIFY) {
+        postpone(w, path);
+    }
+    free(path);
+}
+
+/* move files not changed since their last event to ready; return ms to the next due */
+static int check_pending(Watcher *w)
+{
+    int64_t now = now_ms(), next = -1;
+    Pending **pp = &w->pending;
+
+    while (*pp) {
+        Pending *p = *pp;
+        struct stat st;
+
+        if (p->due > now) {
+            if (next < 0 || p->due - now < next)
+                next = p->due - now;
+            pp = &p->next;
+            continue;
+        }
+        *pp = p->next;
+
+        if (0 != stat(p->path, &st)) { // removed meanwhile
+            free(p->path);
+            free(p);
+            continue;
+        }
+        if (st.st_size != p->size || st.st_mtime != p->mtime) { // still written
+            p->size = st.st_size;
+            p->mtime = st.st_mtime;
+            p->due = now + w->opt->delay;
+            p->next = *pp;
+            *pp = p;
+            continue;
+        }
+
+        p->next = NULL;
+        if (w->ready_tail)
+            w->ready_tail->next = p;
+        else
+            w->ready = p;
+        w->ready_tail = p;
+    }
+    return (int)next;
+}
+
+static void start_workers(Watcher *w)
+{
+    while (w->ready && w->nb_running < w->opt->workers) {
+        Pending *p = w->ready;
+        w->ready = p->next;
+        if (NULL == w->ready)
+            w->ready_tail = NULL;
+
+        fflush(NULL);
+        pid_t pid = fork();
+        if (0 == pid) {
+            signal(SIGINT, SIG_DFL);
+            signal(SIGTERM, SIG_DFL);
+            signal(SIGCHLD, SIG_DFL);
+            sigprocmask(SIG_SETMASK, &w->poll_mask, NULL);
+            close(w->fd);
+            int ret = w->opt->run(w->opt->opaque, p->path);
+            fflush(NULL);
+            _exit(ret);
+        }
+        if (pid < 0) {
+            av_log(NULL, AV_LOG_ERROR, "watch: fork failed: %s\n", strerror(errno));
+            free(p->path);
+        } else {
+            av_log(NULL, AV_LOG_INFO, "watch: processing %s\n", p->path);
+            w->running[w->nb_running++] = (Running){ pid, p->path };
+        }
+        free(p);
+    }
+}
+
+static void reap_workers(Watcher *w, int block)
+{
+    int status, i;
+    pid_t pid;
+
+    while (w->nb_running > 0 && (pid = waitpid(-1, &status, block ? 0 : WNOHANG)) > 0) {
+        for (i = 0; i < w->nb_running; i++) {
+            if (w->running[i].pid != pid)
+                continue;
+            if (WIFEXITED(status))
+                av_log(NULL, AV_LOG_INFO, "watch: %s: exit code %d\n", w->running[i].path, WEXITSTATUS(status));
+            else
+                av_log(NULL, AV_LOG_ERROR, "watch: %s: killed by signal %d\n", w->running[i].path, WTERMSIG(status));
+            free(w->running[i].path);
+            w->running[i] = w->running[--w->nb_running];
+            w->done++;
+            break;
+        }
+        block = 0;
+    }
+}
+
+static void free_list(Pending *p)
+{
+    while (p) {
+        Pending *next = p->next;
+        free(p->path);
+        free(p);
+        p = next;
+    }
+}
+
+static void on_child(int sig)
+{
+    (void)sig; // only interrupts ppoll()
+}
+
+int watch_run(const WatchOptions *opt)
+{
+    Watcher w;
+    sigset_t block;
+    char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    w.opt = opt;
+    w.running = calloc(opt->workers > 0 ? opt->workers : 1, sizeof(Running));
+    w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (NULL == w.running || w.fd < 0) {
+        av_log(NULL, AV_LOG_ERROR, "watch: inotify failed: %s\n", strerror(errno));
+        free(w.running);
+        return -1;
+    }
+
+    // the signals are only delivered inside ppoll(), so one arriving while the
+    // loop works still ends the next wait at once instead of being lost
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &w.poll_mask);
+    signal(SIGINT, watch_signal);
+    signal(SIGTERM, watch_signal);
+    signal(SIGCHLD, on_child);
+
+    add_dir(&w, opt->dir, 0, 0);
+    if (0 == w.nb_dirs) {
+        sigprocmask(SIG_SETMASK, &w.poll_mask, NULL);
+        close(w.fd);
+        free(w.running);
+        return -1;
+    }
+    av_log(NULL, AV_LOG_INFO, "watch: watching %s (%d directories) with %d workers\n", opt->dir, w.nb_dirs, opt->workers);
+
+    while (!watch_stop) {
+        reap_workers(&w, 0);
+        int timeout = check_pending(&w);
+        start_workers(&w);
+
+        struct pollfd pfd = { w.fd, POLLIN, 0 };
+        struct timespec ts = { timeout / 1000, (timeout % 1000) * 1000000L };
+        if (ppoll(&pfd, 1, timeout < 0 ? NULL : &ts, &w.poll_mask) < 0) {
+            if (EINTR == errno)
+                continue;
+            av_log(NULL, AV_LOG_ERROR, "watch: ppoll failed: %s\n", strerror(errno));
+            break;
+        }
+
+        ssize_t n;
+        while ((n = read(w.fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + n; ) {
+                const struct inotify_event *e = (const struct inotify_event *)p;
+                handle_event(&w, e);
+                p += sizeof(struct inotify_event) + e->len;
+            }
+        }
+        if (0 == w.nb_dirs) {
+            av_log(NULL, AV_LOG_ERROR, "watch: %s is gone\n", opt->dir);
+            break;
+        }
+    }
+
+    // files being processed are finished
+    while (w.nb_running > 0)
+        reap_workers(&w, 1);
+    av_log(NULL, AV_LOG_INFO, "watch: stopped after %lu files\n", w.done);
+    sigprocmask(SIG_SETMASK, &w.poll_mask, NULL);
+
+    free_list(w.pending);
+    free_list(w.ready);
+    for (i = 0; i < w.nb_dirs; i++)
+        free(w.dirs[i].path);
+    free(w.dirs);
+    free(w.running);
+    close(w.fd);
+    return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,45 @@
+/*  mtn - movie thumbnailer
+    Watch mode: process movies as they are written into a directory
+
+    Copyright (C) 2007-2017 tuit <tuitfun@yahoo.co.th>
+    Copyright (C) 2017-2024 wahibre <wahibre@gmx.com>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+*/
+
+#ifndef MTN_WATCH_H
+#define MTN_WATCH_H
+
+/* returns 1 if path should be processed */
+typedef int (*WatchAccept)(void *opaque, char *path);
+
+/* processes path in a worker process; returns exit code */
+typedef int (*WatchRun)(void *opaque, char *path);
+
+typedef struct WatchOptions {
+    const char *dir;
+    int max_depth;                  /* of subdirectories; < 0 = unlimited */
+    int delay;                      /* ms without writes before a file is processed */
+    int workers;                    /* max. files processed at once */
+    WatchAccept accept;
+    WatchRun run;
+    void *opaque;                   /* passed to accept and run */
+} WatchOptions;
+
+/**
+ * Watch dir and its subdirectories (inotify) until SIGINT or SIGTERM
+ *
+ * A file is queued when it is closed after writing or moved in, and is
+ * processed after it hasn't changed for delay ms, so files which are
+ * written in several sessions or still copied are not processed early.
+ * Files in directories moved in are queued too. Files which are there
+ * already are not processed. Each file runs in its own worker process.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int watch_run(const WatchOptions *opt);
+
+#endif /* MTN_WATCH_H */
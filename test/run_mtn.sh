@@ -40,12 +40,48 @@ function colouredecho {
     echo -e '\e[0;32m'$1'\e[0m'
 }
 
+# returns the exit code of mtn
 function run_mtn {
+    local ret=0
     pushd $O_DIR > /dev/null
     CMD="$MTN $MIN_SWITCHES $*"
     echo $CMD $VIDEO
-    $CMD "$VIDEO" &>>out.log
+    $CMD "$VIDEO" &>>out.log || ret=$?
     popd > /dev/null
+    return $ret
+}
+
+# check_jsonl FILE KEY [VALUE...]
+# every line of FILE must be a JSON object with KEY, and each VALUE must be
+# the KEY of some line; fails the run otherwise. Skipped without python3
+function check_jsonl {
+    command -v python3 > /dev/null || return 0
+    if ! python3 - "$@" <<'PYEOF' &>>out.log; then
+import json, sys
+path, key, wanted = sys.argv[1], sys.argv[2], set(sys.argv[3:])
+lines = [json.loads(l) for l in open(path)]
+if not lines:
+    sys.exit("%s: empty" % path)
+for n, obj in enumerate(lines, 1):
+    if key not in obj:
+        sys.exit("%s:%d: no \"%s\"" % (path, n, key))
+    wanted.discard(obj[key])
+if wanted:
+    sys.exit("%s: missing %s %s" % (path, key, ", ".join(sorted(wanted))))
+PYEOF
+        echo "invalid JSON in $O_DIR/$1, see $O_DIR/out.log"
+        exit 1
+    fi
+}
+
+# a single movie: VIDEO itself, or the first movie found in it
+function one_movie {
+    if [ -d "$VIDEO" ]; then
+        find "$VIDEO" -path "*/$SCREENS_DIR" -prune -o -type f \( -iname '*.avi' -o -iname '*.mkv' \
+            -o -iname '*.mp4' -o -iname '*.mov' -o -iname '*.webm' -o -iname '*.mpg' -o -iname '*.wmv' \) -print | sort | head -n 1
+    else
+        echo "$VIDEO"
+    fi
 }
 
 function tcdir {
@@ -86,6 +122,154 @@ colouredecho  "===> Transparent png image"
 tcdir transparent_png_noinfo
 run_mtn -o .png --transparent -i -g 10 -k 00FFBB
 
+colouredecho  "===> Streamed output split into pages"
+tcdir stream_pages
+run_mtn -r 12 -c 2 -g 5 --stream=1000
+run_mtn -r 12 -c 2 -L 2 --stream=1000 -o _s.png
+
+colouredecho  "===> Several outputs from one decoding"
+tcdir profiles
+run_mtn -w 1024 --profile="o:_small.jpg|w:400|c:4|r:4|j:80" --profile="o:_preview.png|c:2|r:1" --vtt
+
+colouredecho  "===> Png compression options"
+tcdir png_compression
+run_mtn -o _fast.png --png-level=1 --png-filter=none
+run_mtn -o _small.png --png-level=9 --png-threads=4 --transparent
+
+colouredecho  "===> Output size limit"
+tcdir target_size
+run_mtn -w 2048 -N .txt --target-size=200
+run_mtn -w 2048 -o _s.webp --target-size=100
+
+colouredecho  "===> Incremental run"
+tcdir cache
+run_mtn --cache=results.db
+run_mtn --cache=results.db
+run_mtn --cache=results.db -c 4
+
+colouredecho  "===> Probe cache"
+tcdir probe_cache
+run_mtn --probe-cache=probe.db
+run_mtn --probe-cache=probe.db -c 4
+
+colouredecho  "===> Batch by size"
+tcdir batch
+run_mtn --order=largest --jobs=2
+run_mtn --order=smallest
+
+colouredecho  "===> Shards"
+tcdir shard
+run_mtn --shard=1/2
+run_mtn --shard=2/2
+
+colouredecho  "===> Journal and resume"
+tcdir journal
+run_mtn --journal=journal.txt
+run_mtn --resume=journal.txt --max-retries=1
+
+colouredecho  "===> Duplicates"
+tcdir dedupe
+MOVIE="$(one_movie)"
+if [ -n "$MOVIE" ]; then
+    pushd $O_DIR > /dev/null
+    cp "$MOVIE" copy_1.${MOVIE##*.}
+    cp "$MOVIE" copy_2.${MOVIE##*.}
+    ln -f copy_1.${MOVIE##*.} link_1.${MOVIE##*.}
+    echo $MTN $MIN_SWITCHES --dedupe=content .
+    $MTN $MIN_SWITCHES --dedupe=content . &>>out.log
+    popd > /dev/null
+else
+    echo "no movie in $VIDEO, skipped"
+fi
+
+colouredecho  "===> File list from stdin"
+tcdir files_from
+pushd $O_DIR > /dev/null
+printf '%s\0' "$VIDEO" > list
+CMD="$MTN $MIN_SWITCHES --files-from=-"
+echo $CMD "< list"
+$CMD < list &>>out.log
+popd > /dev/null
+
+colouredecho  "===> JSON events"
+tcdir json_events
+pushd $O_DIR > /dev/null
+echo $MTN $MIN_SWITCHES --json-events "$VIDEO" "> events.jsonl"
+$MTN $MIN_SWITCHES --json-events "$VIDEO" > events.jsonl 2>>out.log
+check_jsonl events.jsonl event start probe output done
+popd > /dev/null
+
+colouredecho  "===> Probe only"
+tcdir probe
+pushd $O_DIR > /dev/null
+echo $MTN --probe --probesize=1000000 --probe-cache=probe.db "$VIDEO" "> probe.jsonl"
+$MTN --probe --probesize=1000000 --probe-cache=probe.db "$VIDEO" > probe.jsonl 2>>out.log
+$MTN --probe --probesize=1000000 --probe-cache=probe.db "$VIDEO" >> probe.jsonl 2>>out.log
+check_jsonl probe.jsonl streams
+popd > /dev/null
+
+colouredecho  "===> Time budget"
+tcdir timeout
+run_mtn --timeout=60
+# the budget runs out: only the shots so far, exit code 1
+run_mtn -Z --timeout=1 || [ $? -eq 1 ]
+
+colouredecho  "===> JSON log"
+tcdir log_json
+pushd $O_DIR > /dev/null
+echo $MTN $MIN_SWITCHES -v --log-format=json "$VIDEO" "2> log.jsonl"
+$MTN $MIN_SWITCHES -v --log-format=json "$VIDEO" 2> log.jsonl >>out.log
+check_jsonl log.jsonl msg
+popd > /dev/null
+
+colouredecho  "===> Daemon mode"
+tcdir serve
+if command -v python3 > /dev/null; then
+    pushd $O_DIR > /dev/null
+    echo $MTN $MIN_SWITCHES --serve=mtn.sock
+    $MTN $MIN_SWITCHES --serve=mtn.sock --serve-workers=2 &>>out.log &
+    sleep 1
+    python3 - "$VIDEO" <<'PYEOF' >> out.log
+import json, socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect("mtn.sock")
+s.sendall((json.dumps({"id": 1, "input": sys.argv[1], "args": ["-c", "2"]}) + "\n").encode())
+s.sendall((json.dumps({"id": 2, "cmd": "status"}) + "\n").encode())
+s.sendall((json.dumps({"id": 9, "cmd": "cancel"}) + "\n").encode())
+buf = b""
+while buf.count(b"\n") < 3:
+    buf += s.recv(65536)
+print(buf.decode())
+PYEOF
+    kill %1
+    wait
+    popd > /dev/null
+fi
+
+if [ "$(uname -s)" = Linux ]; then
+    colouredecho  "===> Watch mode"
+    tcdir watch
+    MOVIE="$(one_movie)"
+    if [ -n "$MOVIE" ]; then
+        pushd $O_DIR > /dev/null
+        mkdir -p incoming
+        echo $MTN $MIN_SWITCHES --watch=incoming
+        $MTN $MIN_SWITCHES --watch=incoming --watch-delay=500 --watch-workers=2 &>>out.log &
+        sleep 1
+        cp "$MOVIE" incoming/
+        sleep 5
+        kill %1
+        wait
+        popd > /dev/null
+    else
+        echo "no movie in $VIDEO, skipped"
+    fi
+fi
+
+colouredecho  "===> All outputs in one archive"
+tcdir archive
+run_mtn -I -N .txt --vtt --archive=outputs.db
+
 colouredecho  "===> Fixed grid"
 tcdir grid_3_3_with_cover
 run_mtn -r3 -c3 --cover $VID_COVER